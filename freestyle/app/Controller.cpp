@@ -145,6 +145,9 @@ Controller::Controller()
 
     _cuspTrimThreshold = 0;
     _graftThreshold = 0;
+    _Grid = &_FastGrid;
+    _gridBuildTime = 0;
+    _benchmarkOccluders = false;
     _VisibilityAlgo = ViewMapBuilder::ray_casting;
 
     //_VisibilityAlgo = ViewMapBuilder::ray_casting_fast;
@@ -272,6 +275,18 @@ void Controller::SetMainWindow(AppMainWindow *iMainWindow)
 }
 
 int Controller::Load3DSFile(const char *iFileName, double wiggleFactor)
+{
+    PLYFileLoader sceneLoader(iFileName);
+    return LoadScene(sceneLoader, iFileName, wiggleFactor);
+}
+
+int Controller::LoadMesh(const PLYMeshData& iMesh, const char *iModelName, double wiggleFactor)
+{
+    PLYFileLoader sceneLoader(iMesh);
+    return LoadScene(sceneLoader, iModelName, wiggleFactor);
+}
+
+int Controller::LoadScene(PLYFileLoader& sceneLoader, const char *iFileName, double wiggleFactor)
 {
 
     if (_pView)
@@ -289,8 +304,6 @@ int Controller::Load3DSFile(const char *iFileName, double wiggleFactor)
     _pMainWindow->DisplayMessage("Reading File");
     _pMainWindow->DisplayMessage("Cleaning Mesh");
 
-    PLYFileLoader sceneLoader(iFileName);
-
     //_RootNode->AddChild(BuildSceneTest());
 
     _Chrono.start();
@@ -387,27 +400,13 @@ int Controller::Load3DSFile(const char *iFileName, double wiggleFactor)
     _pMainWindow->DisplayMessage("Building Grid");
     _Chrono.start();
 
-    _Grid.clear();
-    Vec3r size;
-    for(unsigned int i=0; i<3; i++)
-    {
-        size[i] = fabs(_RootNode->bbox().getMax()[i] - _RootNode->bbox().getMin()[i]);
-        size[i] += size[i]/10.0; // let make the grid 1/10 bigger to avoid numerical errors while computing triangles/cells intersections
-        if(size[i]==0){
-            cout << "Warning: the bbox size is 0 in dimension "<<i<<endl;
-        }
-    }
-    _Grid.configure(Vec3r(_RootNode->bbox().getMin() - size / 20.0), size,
-                    _SceneNumFaces);
-
-    // Fill in the grid:
-    WFillGrid fillGridRenderer(&_Grid, _winged_edge);
-    fillGridRenderer.fillGrid();
+    BuildGrid(_Grid);
 
-    printf("Grid building    : %lf\n", _Chrono.stop());
+    _gridBuildTime = _Chrono.stop();
+    printf("Grid building    : %lf\n", _gridBuildTime);
 
     // DEBUG
-    _Grid.displayDebug();
+    _Grid->displayDebug();
 
     _ProgressBar->setProgress(3);
 
@@ -434,6 +433,27 @@ int Controller::Load3DSFile(const char *iFileName, double wiggleFactor)
 
 
 
+// configures the grid on the scene bounding box and fills it with the faces of the winged edge
+void Controller::BuildGrid(Grid * grid)
+{
+    grid->clear();
+    Vec3r size;
+    for(unsigned int i=0; i<3; i++)
+    {
+        size[i] = fabs(_RootNode->bbox().getMax()[i] - _RootNode->bbox().getMin()[i]);
+        size[i] += size[i]/10.0; // let make the grid 1/10 bigger to avoid numerical errors while computing triangles/cells intersections
+        if(size[i]==0){
+            cout << "Warning: the bbox size is 0 in dimension "<<i<<endl;
+        }
+    }
+    grid->configure(Vec3r(_RootNode->bbox().getMin() - size / 20.0), size,
+                    _SceneNumFaces);
+
+    // Fill in the grid:
+    WFillGrid fillGridRenderer(grid, _winged_edge);
+    fillGridRenderer.fillGrid();
+}
+
 void Controller::CloseFile()
 {
     WShape::SetCurrentId(0);
@@ -533,7 +553,7 @@ void Controller::CloseFile()
     _Canvas->Erase();
 
     // clears the grid
-    _Grid.clear();
+    _Grid->clear();
     _SceneNumFaces = 0;
     _minEdgeSize = DBL_MAX;
     //  _pView2D->DetachScene();
@@ -928,7 +948,7 @@ void Controller::ComputeViewMap()
     vmBuilder.SetTransform(mv, proj, viewport, focalLength, aspect, fovy_radian);
     vmBuilder.SetFrustum(znear, zfar);
 
-    vmBuilder.SetGrid(&_Grid);
+    vmBuilder.SetGrid(_Grid);
 
     vmBuilder.SetUseConsistency(_useConsistency);
 
@@ -948,6 +968,9 @@ void Controller::ComputeViewMap()
     _ViewMap = vmBuilder.BuildViewMap(*_winged_edge, _VisibilityAlgo, _EPSILON);
     _ViewMap->setScene3dBBox(_RootNode->bbox());
 
+    if (_benchmarkOccluders)
+        BenchmarkOccluders(vp);
+
     assert(_ViewMap->ViewEdges().size() > 0);
 
     //Tesselate the 3D edges:
@@ -1142,6 +1165,136 @@ void Controller::ComputeViewMap()
     resetModified(true);
 }
 
+// Times the FastGrid and the BVH on the rays of the ray casting visibility: from the center
+// of each FEdge to the viewpoint (castRay) and away from it (first intersection, as for the
+// occludee). The structure not in use is built for the occasion and cleared afterwards.
+void Controller::BenchmarkOccluders(const Vec3r& viewpoint)
+{
+    Grid * grids[2] = { &_FastGrid, &_BVHGrid };
+    const char * names[2] = { "FastGrid", "BVH" };
+    double buildTime[2], castTime[2], firstTime[2], occludeeTime[2];
+    unsigned long candidates[2], hits[2], firstHits[2], occludeeHits[2];
+    vector<unsigned> rayHits[2];
+    vector<void*> firstFaces[2], occludeeFaces[2];  // faces (occluder userdata) hit first behind each fedge, or NULL
+
+    vector<FEdge*>& fedges = _ViewMap->FEdges();
+
+    for (int g = 0; g < 2; g++)
+    {
+        Grid * grid = grids[g];
+        if (grid == _Grid)
+            buildTime[g] = _gridBuildTime;
+        else
+        {
+            _Chrono.start();
+            BuildGrid(grid);
+            buildTime[g] = _Chrono.stop();
+        }
+
+        GridRay ray;
+        unsigned timestamp = 1;
+        OccludersSet occluders;
+        candidates[g] = hits[g] = firstHits[g] = occludeeHits[g] = 0;
+
+        _Chrono.start();
+        for (vector<FEdge*>::iterator fe = fedges.begin(); fe != fedges.end(); ++fe)
+        {
+            Vec3r center = (*fe)->center3d();
+            Vec3r u(viewpoint - center);
+            real raylength = u.norm();
+            u.normalize();
+
+            occluders.clear();
+            grid->castRay(center, viewpoint, occluders, timestamp++, &ray);
+            candidates[g] += occluders.size();
+
+            // the occluders actually crossed, which both structures must agree on
+            unsigned n = 0;
+            for (OccludersSet::iterator p = occluders.begin(); p != occluders.end(); ++p)
+            {
+                real t, t_u, t_v;
+                if ((*p)->rayIntersect(center, u, t, t_u, t_v) && t > 0 && t < raylength)
+                    n++;
+            }
+            hits[g] += n;
+            rayHits[g].push_back(n);
+        }
+        castTime[g] = _Chrono.stop();
+
+        _Chrono.start();
+        for (vector<FEdge*>::iterator fe = fedges.begin(); fe != fedges.end(); ++fe)
+        {
+            Vec3r center = (*fe)->center3d();
+            Vec3r u(center - viewpoint);
+            u.normalize();
+
+            double t, t_u, t_v;
+            Polygon3r * first = grid->castRayToFindFirstIntersection(center, u, t, t_u, t_v, timestamp++, &ray);
+            if (first != NULL)
+                firstHits[g]++;
+            firstFaces[g].push_back(first != NULL ? first->userdata : NULL);
+        }
+        firstTime[g] = _Chrono.stop();
+
+        // as ComputeRayCastingVisibility then FindOccludee: a ray to the viewpoint, then the
+        // closest occluder behind the fedge among the candidates of a ray with the next timestamp
+        _Chrono.start();
+        for (vector<FEdge*>::iterator fe = fedges.begin(); fe != fedges.end(); ++fe)
+        {
+            Vec3r center = (*fe)->center3d();
+            Vec3r u(center - viewpoint);
+            u.normalize();
+
+            occluders.clear();
+            grid->castRay(center, viewpoint, occluders, timestamp, &ray);
+            occluders.clear();
+            grid->castInfiniteRay(center, u, occluders, timestamp + 1, &ray);
+            timestamp += 2;
+
+            Polygon3r * closest = NULL;
+            real mint = FLT_MAX;
+            for (OccludersSet::iterator p = occluders.begin(); p != occluders.end(); ++p)
+            {
+                real t, t_u, t_v;
+                if ((*p)->rayIntersect(center, u, t, t_u, t_v) && t > 0 && t < mint)
+                {
+                    closest = *p;
+                    mint = t;
+                }
+            }
+            if (closest != NULL)
+                occludeeHits[g]++;
+            occludeeFaces[g].push_back(closest != NULL ? closest->userdata : NULL);
+        }
+        occludeeTime[g] = _Chrono.stop();
+
+        if (grid != _Grid)
+            grid->clear();
+    }
+
+    unsigned mismatches = 0, firstMismatches = 0, occludeeMismatches = 0;
+    for (unsigned i = 0; i < fedges.size(); i++)
+    {
+        if (rayHits[0][i] != rayHits[1][i])
+            mismatches++;
+        if (firstFaces[0][i] != firstFaces[1][i])
+            firstMismatches++;
+        if (occludeeFaces[0][i] != occludeeFaces[1][i])
+            occludeeMismatches++;
+    }
+
+    unsigned numRays = max((unsigned)fedges.size(), 1u);
+    printf("Occluder benchmark, %u rays:\n", (unsigned)fedges.size());
+    for (int g = 0; g < 2; g++)
+        printf("  %-8s build %.3fs, castRay %.2fus (%.1f candidates, %.2f hits per ray), first intersection %.2fus (%lu found), "
+               "occludee %.2fus (%lu found)\n",
+               names[g], buildTime[g], 1e6 * castTime[g] / numRays, double(candidates[g]) / numRays,
+               double(hits[g]) / numRays, 1e6 * firstTime[g] / numRays, firstHits[g],
+               1e6 * occludeeTime[g] / numRays, occludeeHits[g]);
+    printf("  rays with a different number of hits: %u, a different first intersection: %u, a different occludee: %u\n",
+           mismatches, firstMismatches, occludeeMismatches);
+}
+
 void Controller::ComputeSteerableViewMap(){
     if((!_Canvas) || (!_ViewMap))
         return;
@@ -35,6 +35,7 @@
 # include "../rendering/GLUtils.h"
 # include "../geometry/FastGrid.h"
 # include "../geometry/HashGrid.h"
+# include "../geometry/BVHGrid.h"
 # include "../view_map/ViewMapBuilder.h"
 # include "../system/TimeUtils.h"
 # include "../system/Precision.h"
@@ -45,6 +46,8 @@ class AppProgressBar;
 class AppGLWidget;
 class AppMainWindow;
 class NodeGroup;
+class PLYFileLoader;
+struct PLYMeshData;
 class WShape;
 class SShape;
 class ViewMap;
@@ -66,6 +69,7 @@ public:
   void SetView(AppGLWidget *iView);
   void SetMainWindow(AppMainWindow *iMainWindow); 
   int  Load3DSFile(const char *iFileName, double jiggleFactor = 0);
+  int  LoadMesh(const PLYMeshData& iMesh, const char *iModelName, double jiggleFactor = 0);
   void CloseFile();
   void LoadViewMapFile(const char *iFileName, bool only_camera = false);
   void SaveViewMapFile(const char *iFileName);
@@ -106,7 +110,7 @@ public:
   NodeGroup* debugNode() {return _DebugNode;}
   AppGLWidget * view() {return _pView;}
   NodeGroup* debugScene() {return _DebugNode;}
-  Grid& grid() {return _Grid;}
+  Grid& grid() {return *_Grid;}
   
   void toggleVisibilityAlgo();
   void setVisibilityAlgo(ViewMapBuilder::visibility_algo alg, bool useConsistency);
@@ -114,6 +118,11 @@ public:
   void SetCuspTrimThreshold(real threshold) { _cuspTrimThreshold = threshold; }
     void SetGraftThreshold(real threshold) { _graftThreshold = threshold; }
 
+  // occluders of the ray casting in a BVH instead of the FastGrid (to be set before loading)
+  void SetUseOccluderBVH(bool b) { _Grid = b ? (Grid*)&_BVHGrid : (Grid*)&_FastGrid; }
+  // after the view map, times both occluder structures on the rays of the visibility
+  void SetBenchmarkOccluders(bool b) { _benchmarkOccluders = b; }
+
   void setQuantitativeInvisibility(bool iBool); // if true, we compute quantitativeInvisibility
   bool getQuantitativeInvisibility() const;
 
@@ -167,6 +176,9 @@ public:
   //  GLuint getName(WFace*f) { return (_faceNames2.find(f) != _faceNames2.end() ? _faceNames2[f] : (GLuint)-1);}
 
 private:
+  // builds the winged edge structure and grid from a loaded scene
+  int  LoadScene(PLYFileLoader& iLoader, const char *iModelName, double jiggleFactor);
+
 
   // Main Window:
   AppMainWindow *_pMainWindow;
@@ -221,8 +233,16 @@ private:
   // edges tesselation nature
   int _edgeTesselationNature;
 
-  FastGrid _Grid;
+  // occluders of the ray casting: _Grid is one of the two
+  FastGrid _FastGrid;
+  BVHGrid _BVHGrid;
   //HashGrid _Grid;
+  Grid * _Grid;
+  double _gridBuildTime;
+  bool _benchmarkOccluders;
+
+  void BuildGrid(Grid * grid);
+  void BenchmarkOccluders(const Vec3r& viewpoint);
   
   unsigned int _SceneNumFaces;
   real _minEdgeSize;
@@ -21,11 +21,13 @@
 
 #include <Python.h>
 #include <QApplication>
+#include <QMutex>
 #include "../rendering/GLUtils.h"
 #include "Controller.h"
 #include "AppMainWindow.h"
 #include "AppConfig.h"
 #include "AppGLWidget.h"
+#include "../scene_graph/PLYFileLoader.h"
 #include "Run.h"
 
 // Global
@@ -55,6 +57,7 @@ struct RIFDebugPoint
 };
 
 vector<RIFDebugPoint> RIFdebugPoints;
+static QMutex RIFdebugPointsMutex; // the RIF adds points from its tessellation threads
 
 void setupCamera(float top, float bottom, float left, float right,
                  float pixelaspect, float aspectratio,
@@ -273,6 +276,36 @@ void clearStylesFS()
     styleNames.clear();
 }
 
+// occluder structure of the next runs
+static bool useOccluderBVH = false;
+static bool benchmarkOccluders = false;
+
+// useBVH: ray cast against a BVH instead of the FastGrid; benchmark: time both after the view map
+void setOccludersFS(bool useBVH, bool benchmark)
+{
+    useOccluderBVH = useBVH;
+    benchmarkOccluders = benchmark;
+}
+
+// mesh handed over by the RIF for the next run, used instead of loading the mesh file
+static PLYMeshData * pendingMesh = NULL;
+
+// the arrays are allocated with new[] by the caller and owned by Freestyle afterwards
+void setMeshFS(unsigned numVertices, double * vertices, double * normals, float * vertexUserData,
+               unsigned numFaces, unsigned * faceVertices, int * faceUserData, bool meshSilhouettes)
+{
+    delete pendingMesh;
+    pendingMesh = new PLYMeshData;
+    pendingMesh->numVertices = numVertices;
+    pendingMesh->numFaces = numFaces;
+    pendingMesh->vertices = vertices;
+    pendingMesh->normals = normals;
+    pendingMesh->vertexUserData = vertexUserData;
+    pendingMesh->faceVertices = faceVertices;
+    pendingMesh->faceUserData = faceUserData;
+    pendingMesh->meshSilhouettes = meshSilhouettes;
+}
+
 QApplication *app = NULL;
 AppMainWindow *mainWindow = NULL;
 
@@ -353,6 +386,9 @@ void run(const char * meshFilename, const char * snapshotFilename, const char *
     printf("after init: ");
     g_pController->printRowCount();
 
+    g_pController->SetUseOccluderBVH(useOccluderBVH);
+    g_pController->SetBenchmarkOccluders(benchmarkOccluders);
+
 
     //  windowWidth = outputWidth;
     //  windowHeight = outputHeight;
@@ -392,7 +428,14 @@ void run(const char * meshFilename, const char * snapshotFilename, const char *
 
     printf("Wiggle Factor = %f\n", wiggleFactor);
 
-    g_pController->Load3DSFile(meshFilename,wiggleFactor);
+    if (pendingMesh != NULL)
+    {
+        g_pController->LoadMesh(*pendingMesh,meshFilename,wiggleFactor);
+        delete pendingMesh;
+        pendingMesh = NULL;
+    }
+    else
+        g_pController->Load3DSFile(meshFilename,wiggleFactor);
 
     setupCamera( top,  bottom,  left,  right, pixelaspect,  aspectratio, near,  far, focalLength, worldTransform);
 
@@ -532,6 +575,7 @@ void addRIFDebugPoint(int type, double x, double y, double z, char * debugString
     //  t.rootFindingFailed = rootFindingFailed;
     //  t.degenerate = degenerate;
 
+    QMutexLocker lock(&RIFdebugPointsMutex);
     RIFdebugPoints.push_back(t);
 }
 
@@ -63,6 +63,7 @@ public:
 
 void addStyleFS(const char * styleFilename);
 void clearStylesFS();
+void setOccludersFS(bool useBVH, bool benchmark);
 
 void run(const char * meshFilename, const char * snapshotFilename, const char * outputEPSPolyline, const char * outputEPSThick,
          Matrix4x4 worldTransform,
@@ -0,0 +1,470 @@
+
+//
+//  Copyright (C) : Please refer to the COPYRIGHT file distributed
+//   with this source distribution.
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BVHGrid.h"
+
+#include <algorithm>
+
+// build parameters
+static const unsigned BVH_NUM_BINS = 16;     // candidate split planes per axis
+static const unsigned BVH_MIN_LEAF = 2;      // no SAH evaluation below this size
+static const unsigned BVH_MAX_LEAF = 16;     // larger leaves are always split
+static const unsigned BVH_MAX_DEPTH = 60;    // bounds the traversal stack
+static const real BVH_TRAVERSAL_COST = 1.0;  // relative to one primitive test
+
+// the primitive boxes are padded by this fraction of the scene size, so that
+// flat triangles and rays grazing a box are not missed because of rounding
+static const real BVH_BOX_PADDING = 1e-7;
+
+static const unsigned BVH_STACK_SIZE = 2 * BVH_MAX_DEPTH + 4;
+
+static inline real boxArea(const real * bmin, const real * bmax)
+{
+  real dx = bmax[0] - bmin[0], dy = bmax[1] - bmin[1], dz = bmax[2] - bmin[2];
+  return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+static inline void emptyBox(real * bmin, real * bmax)
+{
+  for (unsigned i = 0; i < 3; i++) {
+    bmin[i] = DBL_MAX;
+    bmax[i] = -DBL_MAX;
+  }
+}
+
+static inline void growBox(real * bmin, real * bmax, const real * omin, const real * omax)
+{
+  for (unsigned i = 0; i < 3; i++) {
+    if (omin[i] < bmin[i]) bmin[i] = omin[i];
+    if (omax[i] > bmax[i]) bmax[i] = omax[i];
+  }
+}
+
+static inline bool boxesOverlap(const real * amin, const real * amax, const real * bmin, const real * bmax)
+{
+  return amin[0] <= bmax[0] && amax[0] >= bmin[0] &&
+    amin[1] <= bmax[1] && amax[1] >= bmin[1] &&
+    amin[2] <= bmax[2] && amax[2] >= bmin[2];
+}
+
+// the ray orig + t dir, dir normalized, for t in [0, tEnd]
+struct BVHRay {
+  real orig[3], dir[3], invDir[3];
+  real tEnd;
+
+  BVHRay(const Vec3r& o, const Vec3r& d, real end) : tEnd(end) {
+    for (unsigned i = 0; i < 3; i++) {
+      orig[i] = o[i];
+      dir[i] = d[i];
+      invDir[i] = d[i] != 0 ? 1.0 / d[i] : 0;
+    }
+  }
+
+  // slab test; tEntry is where the ray enters the box (0 if it starts inside)
+  inline bool hits(const real * bmin, const real * bmax, real tMax, real& tEntry) const {
+    real t0 = 0, t1 = tMax;
+    for (unsigned i = 0; i < 3; i++) {
+      if (dir[i] == 0) {
+	if (orig[i] < bmin[i] || orig[i] > bmax[i])
+	  return false;
+	continue;
+      }
+      real ta = (bmin[i] - orig[i]) * invDir[i];
+      real tb = (bmax[i] - orig[i]) * invDir[i];
+      if (ta > tb)
+	std::swap(ta, tb);
+      if (ta > t0) t0 = ta;
+      if (tb < t1) t1 = tb;
+      if (t0 > t1)
+	return false;
+    }
+    tEntry = t0;
+    return true;
+  }
+};
+
+void BVHGrid::clear() {
+  _nodes.clear();
+  _prims.clear();
+  _primBoxes.clear();
+  Grid::clear();
+}
+
+void BVHGrid::insertOccluder(Polygon3r* occluder) {
+  if (occluder->getVertices().size() == 0)
+    return;
+  addOccluder(occluder);
+}
+
+void BVHGrid::build() {
+  _nodes.clear();
+  _prims.clear();
+  _primBoxes.clear();
+
+  unsigned n = _occluders.size();
+  if (n == 0)
+    return;
+
+  real padding = BVH_BOX_PADDING * max(_size[0], max(_size[1], _size[2]));
+
+  vector<BuildPrimitive> prims(n);
+  for (unsigned i = 0; i < n; i++) {
+    Vec3r bmin, bmax;
+    _occluders[i]->getBBox(bmin, bmax);
+    BuildPrimitive& p = prims[i];
+    for (unsigned k = 0; k < 3; k++) {
+      p.bmin[k] = bmin[k] - padding;
+      p.bmax[k] = bmax[k] + padding;
+      p.centroid[k] = 0.5 * (bmin[k] + bmax[k]);
+    }
+    p.index = i;
+  }
+
+  _nodes.reserve(2 * n / BVH_MIN_LEAF + 1);
+  buildNode(prims, 0, n, 0);
+
+  _prims.resize(n);
+  _primBoxes.resize(6 * n);
+  for (unsigned i = 0; i < n; i++) {
+    _prims[i] = _occluders[prims[i].index];
+    for (unsigned k = 0; k < 3; k++) {
+      _primBoxes[6 * i + k] = prims[i].bmin[k];
+      _primBoxes[6 * i + 3 + k] = prims[i].bmax[k];
+    }
+  }
+}
+
+// Binned SAH: the centroids of the range are sorted into BVH_NUM_BINS bins along each axis,
+// and the range is split at the bin boundary of least cost.
+unsigned BVHGrid::buildNode(vector<BuildPrimitive>& prims, unsigned first, unsigned count, unsigned depth) {
+  unsigned nodeIndex = _nodes.size();
+  _nodes.push_back(Node());
+
+  real bmin[3], bmax[3], cmin[3], cmax[3];
+  emptyBox(bmin, bmax);
+  emptyBox(cmin, cmax);
+  for (unsigned i = first; i < first + count; i++) {
+    growBox(bmin, bmax, prims[i].bmin, prims[i].bmax);
+    growBox(cmin, cmax, prims[i].centroid, prims[i].centroid);
+  }
+  for (unsigned k = 0; k < 3; k++) {
+    _nodes[nodeIndex].bmin[k] = bmin[k];
+    _nodes[nodeIndex].bmax[k] = bmax[k];
+  }
+
+  if (count <= BVH_MIN_LEAF || depth >= BVH_MAX_DEPTH) {
+    _nodes[nodeIndex].offset = first;
+    _nodes[nodeIndex].count = count;
+    return nodeIndex;
+  }
+
+  // find the best split
+  real bestCost = DBL_MAX;
+  unsigned bestAxis = 0, bestSplit = 0;
+  real parentArea = boxArea(bmin, bmax);
+
+  for (unsigned axis = 0; axis < 3; axis++) {
+    real extent = cmax[axis] - cmin[axis];
+    if (extent <= 0)
+      continue;
+    real scale = BVH_NUM_BINS / extent;
+
+    unsigned binCount[BVH_NUM_BINS];
+    real binMin[BVH_NUM_BINS][3], binMax[BVH_NUM_BINS][3];
+    for (unsigned b = 0; b < BVH_NUM_BINS; b++) {
+      binCount[b] = 0;
+      emptyBox(binMin[b], binMax[b]);
+    }
+    for (unsigned i = first; i < first + count; i++) {
+      unsigned b = min(BVH_NUM_BINS - 1, (unsigned)((prims[i].centroid[axis] - cmin[axis]) * scale));
+      binCount[b]++;
+      growBox(binMin[b], binMax[b], prims[i].bmin, prims[i].bmax);
+    }
+
+    // area * count of everything right of each split, swept from the right
+    real rightCost[BVH_NUM_BINS];
+    real rmin[3], rmax[3];
+    emptyBox(rmin, rmax);
+    unsigned rcount = 0;
+    for (unsigned b = BVH_NUM_BINS - 1; b > 0; b--) {
+      rcount += binCount[b];
+      growBox(rmin, rmax, binMin[b], binMax[b]);
+      rightCost[b] = rcount > 0 ? rcount * boxArea(rmin, rmax) : 0;
+    }
+
+    real lmin[3], lmax[3];
+    emptyBox(lmin, lmax);
+    unsigned lcount = 0;
+    for (unsigned split = 1; split < BVH_NUM_BINS; split++) {
+      lcount += binCount[split - 1];
+      growBox(lmin, lmax, binMin[split - 1], binMax[split - 1]);
+      if (lcount == 0 || lcount == count)
+	continue;
+      real cost = BVH_TRAVERSAL_COST + (lcount * boxArea(lmin, lmax) + rightCost[split]) / parentArea;
+      if (cost < bestCost) {
+	bestCost = cost;
+	bestAxis = axis;
+	bestSplit = split;
+      }
+    }
+  }
+
+  // make a leaf when splitting does not pay (the leaf cost is one test per primitive)
+  if (bestSplit != 0 && bestCost >= count && count <= BVH_MAX_LEAF) {
+    _nodes[nodeIndex].offset = first;
+    _nodes[nodeIndex].count = count;
+    return nodeIndex;
+  }
+
+  unsigned mid;
+  if (bestSplit != 0) {
+    real scale = BVH_NUM_BINS / (cmax[bestAxis] - cmin[bestAxis]);
+    BuildPrimitive * begin = &prims[0] + first;
+    BuildPrimitive * split = begin;
+    for (BuildPrimitive * p = begin; p != begin + count; p++) {
+      unsigned b = min(BVH_NUM_BINS - 1, (unsigned)((p->centroid[bestAxis] - cmin[bestAxis]) * scale));
+      if (b < bestSplit)
+	std::swap(*p, *split++);
+    }
+    mid = split - &prims[0];
+  }
+  else {
+    // all the centroids coincide: split the range in two halves
+    if (count <= BVH_MAX_LEAF) {
+      _nodes[nodeIndex].offset = first;
+      _nodes[nodeIndex].count = count;
+      return nodeIndex;
+    }
+    mid = first + count / 2;
+  }
+
+  buildNode(prims, first, mid - first, depth + 1);
+  unsigned right = buildNode(prims, mid, first + count - mid, depth + 1);
+  _nodes[nodeIndex].offset = right;
+  _nodes[nodeIndex].count = 0;
+  return nodeIndex;
+}
+
+void BVHGrid::collectOccluders(const Vec3r& orig, const Vec3r& dir, real tEnd, OccludersSet& occluders, GridRay& gridRay) const {
+  if (_nodes.empty())
+    return;
+
+  BVHRay ray(orig, dir, tEnd);
+  vector<pair<real,unsigned> > hits;
+
+  unsigned stack[BVH_STACK_SIZE];
+  unsigned stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0) {
+    const Node& node = _nodes[stack[--stackSize]];
+    real t;
+    if (!ray.hits(node.bmin, node.bmax, ray.tEnd, t))
+      continue;
+
+    if (node.count > 0) {
+      for (unsigned i = node.offset; i < node.offset + node.count; i++)
+	if (ray.hits(&_primBoxes[6 * i], &_primBoxes[6 * i + 3], ray.tEnd, t))
+	  hits.push_back(pair<real,unsigned>(t, i));
+    }
+    else {
+      stack[stackSize++] = node.offset;
+      stack[stackSize++] = &node - &_nodes[0] + 1;
+    }
+  }
+
+  // nearest boxes first, as the grid returns the occluders cell by cell along the ray
+  std::sort(hits.begin(), hits.end());
+  for (vector<pair<real,unsigned> >::const_iterator h = hits.begin(); h != hits.end(); ++h)
+    if (gridRay.visit(_prims[h->second]))
+      occluders.push_back(_prims[h->second]);
+}
+
+void BVHGrid::castRay(const Vec3r& orig,
+		      const Vec3r& end,
+		      OccludersSet& occluders,
+		      unsigned timestamp,
+		      GridRay * ray) {
+  GridRay& r = ray ? *ray : _ray;
+  r.timestamp = timestamp;
+  Vec3r dir(end - orig);
+  real length = dir.norm();
+  if (length == 0)
+    return;
+  collectOccluders(orig, dir / length, length, occluders, r);
+}
+
+void BVHGrid::castInfiniteRay(const Vec3r& orig,
+			      const Vec3r& dir,
+			      OccludersSet& occluders,
+			      unsigned timestamp,
+			      GridRay * ray) {
+  GridRay& r = ray ? *ray : _ray;
+  r.timestamp = timestamp;
+  real length = dir.norm();
+  if (length == 0)
+    return;
+  collectOccluders(orig, dir / length, FLT_MAX, occluders, r);
+}
+
+Polygon3r* BVHGrid::castRayToFindFirstIntersection(const Vec3r& orig,
+						   const Vec3r& dir,
+						   double& t,
+						   double& u,
+						   double& v,
+						   unsigned timestamp,
+						   GridRay * ray) {
+  GridRay& r = ray ? *ray : _ray;
+  r.timestamp = timestamp;
+  real length = dir.norm();
+  if (_nodes.empty() || length == 0)
+    return 0;
+
+  // the boxes are traversed along the normalized direction; the triangle tests use dir
+  // itself, as the grid does, so t is in units of dir
+  BVHRay bray(orig, dir / length, FLT_MAX);
+  Vec3r o(orig), d(dir);
+  Polygon3r * occluder = 0;
+  real closest = FLT_MAX;
+
+  unsigned stack[BVH_STACK_SIZE];
+  unsigned stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0) {
+    const Node& node = _nodes[stack[--stackSize]];
+    real tEntry;
+    if (!bray.hits(node.bmin, node.bmax, closest, tEntry))
+      continue;
+
+    if (node.count > 0) {
+      for (unsigned i = node.offset; i < node.offset + node.count; i++) {
+	if (!bray.hits(&_primBoxes[6 * i], &_primBoxes[6 * i + 3], closest, tEntry))
+	  continue;
+	Polygon3r * occ = _prims[i];
+	if (!r.visit(occ))
+	  continue;
+	real tmp_t, tmp_u, tmp_v;
+	if (occ->rayIntersect(o, d, tmp_t, tmp_u, tmp_v) && tmp_t >= 0 &&
+	    fabs(d * occ->getNormal()) > 0.0001 && tmp_t * length < closest) {
+	  closest = tmp_t * length;
+	  occluder = occ;
+	  t = tmp_t;
+	  u = tmp_u;
+	  v = tmp_v;
+	}
+      }
+    }
+    else {
+      // visit the nearer child first, so that the closest hit prunes the other one
+      unsigned left = &node - &_nodes[0] + 1, right = node.offset;
+      real tl, tr;
+      bool hitLeft = bray.hits(_nodes[left].bmin, _nodes[left].bmax, closest, tl);
+      bool hitRight = bray.hits(_nodes[right].bmin, _nodes[right].bmax, closest, tr);
+      if (hitLeft && hitRight) {
+	if (tl <= tr) {
+	  stack[stackSize++] = right;
+	  stack[stackSize++] = left;
+	}
+	else {
+	  stack[stackSize++] = left;
+	  stack[stackSize++] = right;
+	}
+      }
+      else if (hitLeft)
+	stack[stackSize++] = left;
+      else if (hitRight)
+	stack[stackSize++] = right;
+    }
+  }
+
+  return occluder;
+}
+
+void BVHGrid::collectOverlaps(const real * bmin, const real * bmax, vector<unsigned>& prims) const {
+  if (_nodes.empty())
+    return;
+
+  unsigned stack[BVH_STACK_SIZE];
+  unsigned stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0) {
+    const Node& node = _nodes[stack[--stackSize]];
+    if (!boxesOverlap(bmin, bmax, node.bmin, node.bmax))
+      continue;
+
+    if (node.count > 0) {
+      for (unsigned i = node.offset; i < node.offset + node.count; i++)
+	if (boxesOverlap(bmin, bmax, &_primBoxes[6 * i], &_primBoxes[6 * i + 3]))
+	  prims.push_back(i);
+    }
+    else {
+      stack[stackSize++] = node.offset;
+      stack[stackSize++] = &node - &_nodes[0] + 1;
+    }
+  }
+}
+
+void BVHGrid::triangleIntersections(Vec3r p0,Vec3r p1,Vec3r p2, set<Polygon3r*> & possibleIntersections) {
+  real bmin[3], bmax[3];
+  for (unsigned k = 0; k < 3; k++) {
+    bmin[k] = min(p0[k], min(p1[k], p2[k]));
+    bmax[k] = max(p0[k], max(p1[k], p2[k]));
+  }
+
+  vector<unsigned> prims;
+  collectOverlaps(bmin, bmax, prims);
+  for (vector<unsigned>::const_iterator i = prims.begin(); i != prims.end(); ++i)
+    possibleIntersections.insert(_prims[*i]);
+}
+
+void BVHGrid::overlappingPairs(vector<pair<Polygon3r*,Polygon3r*> >& pairs) const {
+  vector<unsigned> prims;
+  for (unsigned i = 0; i < _prims.size(); i++) {
+    prims.clear();
+    collectOverlaps(&_primBoxes[6 * i], &_primBoxes[6 * i + 3], prims);
+    std::sort(prims.begin(), prims.end());
+    for (vector<unsigned>::const_iterator j = prims.begin(); j != prims.end(); ++j)
+      if (*j > i)
+	pairs.push_back(pair<Polygon3r*,Polygon3r*>(_prims[i], _prims[*j]));
+  }
+}
+
+unsigned long BVHGrid::memoryUsage() const {
+  return _nodes.capacity() * sizeof(Node) + _prims.capacity() * sizeof(Polygon3r*) +
+    _primBoxes.capacity() * sizeof(real);
+}
+
+void BVHGrid::displayDebug() {
+  unsigned leaves = 0, maxLeaf = 0;
+  for (vector<Node>::const_iterator n = _nodes.begin(); n != _nodes.end(); ++n)
+    if (n->count > 0) {
+      leaves++;
+      maxLeaf = max(maxLeaf, n->count);
+    }
+
+  cerr << "BVH nodes    : " << _nodes.size() << " (" << leaves << " leaves, up to "
+       << maxLeaf << " occluders per leaf)" << endl;
+  cerr << "BVH memory   : " << memoryUsage() / 1024 << " KB" << endl;
+  cerr << "Origin       : " << _orig << endl;
+  cerr << "Occluders nb : " << _occluders.size() << endl;
+}
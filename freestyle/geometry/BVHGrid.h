@@ -0,0 +1,138 @@
+//
+//  Filename         : BVHGrid.h
+//  Purpose          : Bounding volume hierarchy over the occluders, used
+//                     in place of a cell grid for ray casting
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+//
+//  Copyright (C) : Please refer to the COPYRIGHT file distributed
+//   with this source distribution.
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef  BVHGRID_H
+# define BVHGRID_H
+
+# include <vector>
+# include <utility>
+# include "Grid.h"
+
+/*! Occluders organized in a bounding volume hierarchy built with
+ *  the surface area heuristic, instead of the cells of a regular grid.
+ *  Meshes refined along the contours mix many tiny triangles with huge
+ *  ones, which a uniform grid handles badly (overfull cells, or many
+ *  empty ones).
+ *  The grid origin and size (configure()) are kept since the view map
+ *  builder checks points against them, but there are no cells:
+ *  the ray casting methods are answered by the hierarchy, which is
+ *  built by build() once all the occluders are inserted.
+ *  The nodes and the primitive boxes are stored in flat arrays, in
+ *  depth-first order; the queries only read them, and keep the occluder
+ *  mailbox in the GridRay as the grid does (an occluder already examined
+ *  by a ray with the same timestamp is skipped), so threads passing their
+ *  own GridRay can cast rays at once.
+ */
+
+class LIB_GEOMETRY_EXPORT BVHGrid : public Grid
+{
+ public:
+
+  BVHGrid() : Grid() {}
+
+  virtual ~BVHGrid() {
+    clear();
+  }
+
+  /*! clears the hierarchy and deletes the occluders */
+  virtual void clear();
+
+  /*! only stores the occluder; the hierarchy is built by build() */
+  virtual void insertOccluder(Polygon3r * convex_poly);
+
+  /*! builds the hierarchy over all the inserted occluders */
+  virtual void build();
+
+  /*! there are no cells */
+  virtual void fillCell(const Vec3u& coord, Cell& cell) {}
+  virtual Cell* getCell(const Vec3u& coord) { return NULL; }
+
+  /*! Returns the occluders whose bounding box is crossed by the segment
+   *  (orig, end), sorted by the distance at which the segment enters the box.
+   */
+  virtual void castRay(const Vec3r& orig,
+		       const Vec3r& end,
+		       OccludersSet& occluders,
+		       unsigned timestamp,
+		       GridRay * ray = NULL);
+
+  /*! Same as castRay, for the ray starting at orig in the direction dir */
+  virtual void castInfiniteRay(const Vec3r& orig,
+			       const Vec3r& dir,
+			       OccludersSet& occluders,
+			       unsigned timestamp,
+			       GridRay * ray = NULL);
+
+  /*! Returns the closest occluder intersected by the ray (t, u, v as in
+   *  Polygon3r::rayIntersect, for the direction dir) or null.
+   */
+  virtual Polygon3r * castRayToFindFirstIntersection(const Vec3r& orig,
+						     const Vec3r& dir,
+						     double& t,
+						     double& u,
+						     double& v,
+						     unsigned timestamp,
+						     GridRay * ray = NULL);
+
+  /*! returns the occluders whose bounding box overlaps the triangle bounding box */
+  virtual void triangleIntersections(Vec3r p1,Vec3r p2,Vec3r p3, set<Polygon3r*> & possibleIntersections);
+
+  /*! Candidate pairs for the mesh self-intersections: all the pairs of
+   *  occluders whose bounding boxes overlap, each pair once.
+   */
+  void overlappingPairs(vector<pair<Polygon3r*,Polygon3r*> >& pairs) const;
+
+  virtual void displayDebug();
+
+  unsigned numNodes() const { return _nodes.size(); }
+  unsigned long memoryUsage() const;  // bytes used by the hierarchy (not by the occluders themselves)
+
+ private:
+
+  struct Node {
+    real bmin[3], bmax[3];
+    unsigned offset;  // first primitive for a leaf, right child for an inner node (the left child follows the node)
+    unsigned count;   // number of primitives of a leaf, 0 for an inner node
+  };
+
+  struct BuildPrimitive {
+    real bmin[3], bmax[3], centroid[3];
+    unsigned index;   // in _occluders
+  };
+
+  unsigned buildNode(vector<BuildPrimitive>& prims, unsigned first, unsigned count, unsigned depth);
+
+  void collectOccluders(const Vec3r& orig, const Vec3r& dir, real tEnd, OccludersSet& occluders, GridRay& gridRay) const;
+  void collectOverlaps(const real * bmin, const real * bmax, vector<unsigned>& prims) const;
+
+  vector<Node>		_nodes;
+  vector<Polygon3r*>	_prims;      // occluders in leaf order
+  vector<real>		_primBoxes;  // min and max of the bounding box of each primitive, in leaf order
+};
+
+#endif // BVHGRID_H
@@ -63,7 +63,7 @@ void firstIntersectionGridVisitor::examineOccluder(Polygon3r *occ){
                     t_ = tmp_t;
                 }
             }else{
-                occ->userdata2 = 0;
+                ray_.unvisit(occ);
             }
         }
     }
@@ -87,6 +87,9 @@ void Grid::clear() {
     }
     _occluders.clear();
   }
+  _triangles.clear();
+  _filledCells.clear();
+  _cellOccluders.clear();
 
   _size = Vec3r(0, 0, 0);
   _cell_size = Vec3r(0, 0, 0);
@@ -199,8 +202,9 @@ void Grid::insertOccluder(Polygon3r* occluder) {
 	    if (!cell) {
 	      cell = new Cell(boxmin);
 	      fillCell(coord, *cell);
+	      _filledCells.push_back(cell);
 	    }
-	    cell->addOccluder(occluder);
+	    cell->addOccluder(occluder->getId());
 	  }
 	}
   }
@@ -217,13 +221,35 @@ void Grid::insertOccluder(Polygon3r* occluder) {
 	    getCellOrigin(coord, orig);
 	    cell = new Cell(orig);
 	    fillCell(coord, *cell);
+	    _filledCells.push_back(cell);
 	  }
-	  cell->addOccluder(occluder);
+	  cell->addOccluder(occluder->getId());
 	}
   }
 }
 
-bool Grid::nextRayCell(Vec3u& current_cell, Vec3u& next_cell) {
+void Grid::build() {
+  unsigned total = 0;
+  for (vector<Cell*>::iterator it = _filledCells.begin(); it != _filledCells.end(); ++it)
+    total += (*it)->numOccluders();
+
+  // the cells may already point into the previous array
+  vector<unsigned> packed;
+  packed.reserve(total);
+  for (vector<Cell*>::iterator it = _filledCells.begin(); it != _filledCells.end(); ++it)
+    packed.insert(packed.end(), (*it)->occluders(), (*it)->occluders() + (*it)->numOccluders());
+  _cellOccluders.swap(packed);
+
+  // the array is not resized anymore, the cells can point into it
+  unsigned first = 0;
+  for (vector<Cell*>::iterator it = _filledCells.begin(); it != _filledCells.end(); ++it) {
+    unsigned count = (*it)->numOccluders();
+    (*it)->setOccluders(count > 0 ? &_cellOccluders[first] : NULL);
+    first += count;
+  }
+}
+
+bool Grid::nextRayCell(Vec3u& current_cell, Vec3u& next_cell, GridRay& ray) {
   next_cell = current_cell;
   real t_min, t;
   unsigned i;
@@ -238,12 +264,12 @@ bool Grid::nextRayCell(Vec3u& current_cell, Vec3u& next_cell) {
   // to the intersections with the plans:
   // x = _cell_size[0], y = _cell_size[1], z = _cell_size[2]
   for (i = 0; i < 3; i++) {
-    if (_ray_dir[i] == 0)
+    if (ray.ray_dir[i] == 0)
       continue;
-    if (_ray_dir[i] > 0)
-      t = (_cell_size[i] - _pt[i]) / _ray_dir[i];
+    if (ray.ray_dir[i] > 0)
+      t = (_cell_size[i] - ray.pt[i]) / ray.ray_dir[i];
     else
-      t = -_pt[i] / _ray_dir[i];
+      t = -ray.pt[i] / ray.ray_dir[i];
     if (t < t_min) {
       t_min = t;
       coord = i;
@@ -253,31 +279,31 @@ bool Grid::nextRayCell(Vec3u& current_cell, Vec3u& next_cell) {
   // We use the parametric line equation and
   // the found t (tamx) to compute the
   // B coordinates:
-  Vec3r pt_tmp(_pt);
-  _pt = pt_tmp + t_min * _ray_dir;
+  Vec3r pt_tmp(ray.pt);
+  ray.pt = pt_tmp + t_min * ray.ray_dir;
     
   // We express B coordinates in the next cell
   // coordinates system. We just have to
   // set the coordinate coord of B to 0
   // of _CellSize[coord] depending on the sign
   // of _u[coord]
-  if (_ray_dir[coord] > 0) {
+  if (ray.ray_dir[coord] > 0) {
     next_cell[coord]++;
-    _pt[coord] -= _cell_size[coord];
+    ray.pt[coord] -= _cell_size[coord];
     // if we are out of the grid, we must stop
     if (next_cell[coord] >= _cells_nb[coord])
       return false;
   }
   else {
     int tmp = next_cell[coord] - 1;
-    _pt[coord] = _cell_size[coord];
+    ray.pt[coord] = _cell_size[coord];
     if (tmp < 0)
       return false;
     next_cell[coord]--;
   }
 
-  _t += t_min;
-  if (_t >= _t_end)
+  ray.t += t_min;
+  if (ray.t >= ray.t_end)
     return false;
 
   return true;
@@ -286,25 +312,29 @@ bool Grid::nextRayCell(Vec3u& current_cell, Vec3u& next_cell) {
 void Grid::castRay(const Vec3r& orig,
 		   const Vec3r& end,
 		   OccludersSet& occluders,
-		   unsigned timestamp) {
+		   unsigned timestamp,
+		   GridRay * ray) {
   //  printf("inGrid = %s, orig = %f %f %f\n", inGrid(orig) ? "TRUE" : "FALSE", orig[0], orig[1], orig[2]);
   
 
-  initRay(orig, end, timestamp);
+  GridRay& r = ray ? *ray : _ray;
+  initRay(orig, end, timestamp, r);
   allOccludersGridVisitor visitor(occluders);
-  castRayInternal(visitor);
+  castRayInternal(visitor, r);
 }
 
 void Grid::castInfiniteRay(const Vec3r& orig,
 			   const Vec3r& dir,
 			   OccludersSet& occluders,
-			   unsigned timestamp) {
+			   unsigned timestamp,
+			   GridRay * ray) {
+  GridRay& r = ray ? *ray : _ray;
   Vec3r end = Vec3r(orig + FLT_MAX * dir / dir.norm());
-  bool inter = initInfiniteRay(orig, dir, timestamp);
+  bool inter = initInfiniteRay(orig, dir, timestamp, r);
   if(!inter)
       return;
   allOccludersGridVisitor visitor(occluders);
-  castRayInternal(visitor);
+  castRayInternal(visitor, r);
 }
   
 Polygon3r* Grid::castRayToFindFirstIntersection(const Vec3r& orig,
@@ -312,15 +342,17 @@ Polygon3r* Grid::castRayToFindFirstIntersection(const Vec3r& orig,
                    double& t,
                    double& u,
                    double& v,
-                   unsigned timestamp){
+                   unsigned timestamp,
+                   GridRay * ray){
+    GridRay& r = ray ? *ray : _ray;
     Polygon3r *occluder = 0;
     Vec3r end = Vec3r(orig + FLT_MAX * dir / dir.norm());
-    bool inter = initInfiniteRay(orig, dir, timestamp);
+    bool inter = initInfiniteRay(orig, dir, timestamp, r);
     if(!inter){
         return 0;
     }
-    firstIntersectionGridVisitor visitor(orig,dir,_cell_size);
-    castRayInternal(visitor);
+    firstIntersectionGridVisitor visitor(orig,dir,_cell_size,r);
+    castRayInternal(visitor, r);
     occluder = visitor.occluder();
     t = visitor.t_;
     u = visitor.u_;
@@ -330,17 +362,18 @@ Polygon3r* Grid::castRayToFindFirstIntersection(const Vec3r& orig,
 
 void Grid::initRay (const Vec3r &orig,
 		    const Vec3r& end,
-		    unsigned timestamp) {
-  _ray_dir = end - orig;
-  _t_end = _ray_dir.norm();
-  _t = 0;
-  _ray_dir.normalize();
-  _timestamp = timestamp;
+		    unsigned timestamp,
+		    GridRay& ray) {
+  ray.ray_dir = end - orig;
+  ray.t_end = ray.ray_dir.norm();
+  ray.t = 0;
+  ray.ray_dir.normalize();
+  ray.timestamp = timestamp;
 
   for(unsigned i = 0; i < 3; i++) {
-    _current_cell[i] = (unsigned)floor((orig[i] - _orig[i]) / _cell_size[i]);
-    unsigned u = _current_cell[i];
-    _pt[i] = orig[i] - _orig[i] - _current_cell[i] * _cell_size[i];
+    ray.current_cell[i] = (unsigned)floor((orig[i] - _orig[i]) / _cell_size[i]);
+    unsigned u = ray.current_cell[i];
+    ray.pt[i] = orig[i] - _orig[i] - ray.current_cell[i] * _cell_size[i];
   }
   //_ray_occluders.clear();
 
@@ -348,12 +381,13 @@ void Grid::initRay (const Vec3r &orig,
 
 bool Grid::initInfiniteRay (const Vec3r &orig,
 		    const Vec3r& dir,
-		    unsigned timestamp) {
-  _ray_dir = dir;
-  _t_end = FLT_MAX;
-  _t = 0;
-  _ray_dir.normalize();
-  _timestamp = timestamp;
+		    unsigned timestamp,
+		    GridRay& ray) {
+  ray.ray_dir = dir;
+  ray.t_end = FLT_MAX;
+  ray.t = 0;
+  ray.ray_dir.normalize();
+  ray.timestamp = timestamp;
 
   // check whether the origin is in or out the box:
   Vec3r boxMin(_orig);
@@ -361,22 +395,22 @@ bool Grid::initInfiniteRay (const Vec3r &orig,
   BBox<Vec3r> box(boxMin, boxMax);
   if(box.inside(orig)){
       for(unsigned i = 0; i < 3; i++) {
-          _current_cell[i] = (unsigned)floor((orig[i] - _orig[i]) / _cell_size[i]);
-          unsigned u = _current_cell[i];
-          _pt[i] = orig[i] - _orig[i] - _current_cell[i] * _cell_size[i];
+          ray.current_cell[i] = (unsigned)floor((orig[i] - _orig[i]) / _cell_size[i]);
+          unsigned u = ray.current_cell[i];
+          ray.pt[i] = orig[i] - _orig[i] - ray.current_cell[i] * _cell_size[i];
       }
   }else{
       // is the ray intersecting the box?
       real tmin(-1.0), tmax(-1.0);
-      if(GeomUtils::intersectRayBBox(orig, _ray_dir, boxMin, boxMax, 0, _t_end, tmin, tmax)){
+      if(GeomUtils::intersectRayBBox(orig, ray.ray_dir, boxMin, boxMax, 0, ray.t_end, tmin, tmax)){
         assert(tmin != -1.0);
-        Vec3r newOrig = orig + tmin*_ray_dir;
+        Vec3r newOrig = orig + tmin*ray.ray_dir;
         for(unsigned i = 0; i < 3; i++) {
-            _current_cell[i] = (unsigned)floor((newOrig[i] - _orig[i]) / _cell_size[i]);
-            if(_current_cell[i] == _cells_nb[i])
-                _current_cell[i] = _cells_nb[i] - 1;
-            unsigned u = _current_cell[i];
-            _pt[i] = newOrig[i] - _orig[i] - _current_cell[i] * _cell_size[i];
+            ray.current_cell[i] = (unsigned)floor((newOrig[i] - _orig[i]) / _cell_size[i]);
+            if(ray.current_cell[i] == _cells_nb[i])
+                ray.current_cell[i] = _cells_nb[i] - 1;
+            unsigned u = ray.current_cell[i];
+            ray.pt[i] = newOrig[i] - _orig[i] - ray.current_cell[i] * _cell_size[i];
         }
 
       }else{
@@ -439,7 +473,7 @@ void Grid::triangleIntersections(Vec3r p0,Vec3r p1,Vec3r p2, set<Polygon3r*> & p
 	  Cell * cell = getCell(coord);
 
 	  if (cell != NULL && GeomUtils::overlapTriangleBox(boxcenter, boxhalfsize, triverts))
-	    for(OccludersSet::iterator it = cell->getOccluders().begin(); it != cell->getOccluders().end(); ++it)
-	      possibleIntersections.insert(*it);
+	    for(unsigned i = 0; i < cell->numOccluders(); i++)
+	      possibleIntersections.insert(_occluders[cell->occluders()[i]]);
 	}
 }
@@ -38,6 +38,7 @@
 # include "GeomUtils.h"
 # include "Geom.h"
 # include "Polygon.h"
+# include "OccluderTriangles.h"
 
 using namespace std;
 using namespace Geometry;
@@ -45,38 +46,109 @@ using namespace Geometry;
 typedef vector<Polygon3r*>	OccludersSet;
 
 
+//
+// State of one ray cast through the grid
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/*! The cell walk of the ray being cast, and the occluder mailbox: the
+ *  timestamp at which each occluder (by id) was last examined, so that an
+ *  occluder lying in several cells is only examined once per ray.
+ *  The grid owns one for the usual single-threaded calls; threads casting
+ *  rays concurrently in the same grid pass their own.
+ */
+class LIB_GEOMETRY_EXPORT GridRay
+{
+public:
+  GridRay() : t_end(0), t(0), timestamp(0) {}
+
+  /*! true if the occluder has not been examined yet by the current ray */
+  inline bool visit(unsigned id) {
+    if (id >= mailbox.size())
+      mailbox.resize(max(id + 1, 2 * (unsigned)mailbox.size()), 0);
+    if (mailbox[id] == timestamp)
+      return false;
+    mailbox[id] = timestamp;
+    return true;
+  }
+
+  inline bool visit(Polygon3r * occ) {
+    return visit(occ->getId());
+  }
+
+  /*! lets the current ray examine the occluder again */
+  inline void unvisit(Polygon3r * occ) {
+    if (occ->getId() < mailbox.size())
+      mailbox[occ->getId()] = 0;
+  }
+
+  Vec3r		ray_dir;      // direction vector for the ray
+  Vec3u		current_cell; // The current cell being processed (designated by its 3 coordinates)
+  Vec3r		pt;           // Points corresponding to the incoming and outgoing intersections
+                              // of one cell with the ray
+  real		t_end;        // To know when we are at the end of the ray
+  real		t;
+  unsigned	timestamp;
+
+  vector<unsigned> mailbox;   // occluder id -> timestamp of the last ray that examined it
+};
+
+
 //
 // Class to define cells used by the regular grid
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+/*! The occluders of a cell are given by their ids (Grid::getOccluder),
+ *  in increasing order since the occluders are inserted in id order.
+ *  Once the grid is built, the ids of all the cells are packed in one
+ *  array of the grid and each cell only keeps its range in this array.
+ */
 class LIB_GEOMETRY_EXPORT Cell
 {
  public:
   
   Cell(Vec3r& orig) {
     _orig = orig;
+    _first = NULL;
+    _count = 0;
   }
 
   virtual ~Cell() {}
 
-  inline void addOccluder(Polygon3r* o) {
-    if (o)
-      _occluders.push_back(o);
+  inline void addOccluder(unsigned id) {
+    if (_ids.empty() && _count > 0)  // packed: take the ids back
+      _ids.assign(_first, _first + _count);
+    _ids.push_back(id);
+    _first = &_ids[0];
+    _count = _ids.size();
   }
 
   inline const Vec3r& getOrigin() {
     return _orig;
   }
 
-  inline OccludersSet& getOccluders() {
-    return _occluders;
+  /*! ids of the occluders of the cell */
+  inline const unsigned * occluders() const {
+    return _first;
+  }
+
+  inline unsigned numOccluders() const {
+    return _count;
+  }
+
+  /*! makes the cell use ids, a copy of its own, and frees its own */
+  inline void setOccluders(const unsigned * ids) {
+    _first = ids;
+    vector<unsigned>().swap(_ids);
   }
   
  private:
 
-  Vec3r		_orig;
-  OccludersSet	_occluders;
+  Vec3r			_orig;
+  vector<unsigned>	_ids;    // until the cell is packed
+  const unsigned *	_first;
+  unsigned		_count;
 };
 
 
@@ -108,9 +180,9 @@ private:
  */
 class firstIntersectionGridVisitor : public GridVisitor {
 public:
-      firstIntersectionGridVisitor(const Vec3r& ray_org, const Vec3r& ray_dir, const Vec3r& cell_size) : 
+      firstIntersectionGridVisitor(const Vec3r& ray_org, const Vec3r& ray_dir, const Vec3r& cell_size, GridRay& ray) : 
       GridVisitor(), ray_org_(ray_org), cell_size_(cell_size),ray_dir_(ray_dir),occluder_(0),
-            u_(0),v_(0),t_(DBL_MAX),current_cell_(0){}
+            u_(0),v_(0),t_(DBL_MAX),current_cell_(0),ray_(ray){}
       virtual ~firstIntersectionGridVisitor() {}
 
     virtual void discoverCell(Cell *cell) {current_cell_=cell;}
@@ -126,6 +198,7 @@ private:
     Vec3r ray_org_, ray_dir_;
     Vec3r cell_size_;
     Cell * current_cell_;
+    GridRay& ray_;
 };
 
 //
@@ -250,43 +323,71 @@ public:
    *    convex_poly
    *      The list of 3D points constituing a convex polygon
    */
-  void insertOccluder(Polygon3r * convex_poly);
+  virtual void insertOccluder(Polygon3r * convex_poly);
+
+  /*! Called once all the occluders have been inserted,
+   *  before any ray is cast: packs the occluder ids of the
+   *  cells in one array (builds BVHGrid's hierarchy).
+   */
+  virtual void build();
 
-  /*! Adds an occluder to the list of occluders */
+  /*! Adds an occluder to the list of occluders and to the
+   *  triangle buffer. Its id becomes its index in the list.
+   */
   void addOccluder(Polygon3r* occluder) {
+    occluder->setId(_occluders.size());
     _occluders.push_back(occluder);
+    _triangles.add(occluder);
+  }
+
+  inline Polygon3r * getOccluder(unsigned id) const {
+    return _occluders[id];
+  }
+
+  inline unsigned numOccluders() const {
+    return _occluders.size();
+  }
+
+  /*! the occluders (by id) as arrays of triangles, for the ray tests */
+  inline const OccluderTriangles& triangles() const {
+    return _triangles;
   }
 
   /*! Casts a ray between a starting point and an ending point
    *  Returns the list of occluders contained
    *  in the cells intersected by this ray
    *  Starts with a call to InitRay.
+   *  The ray state is the grid's own unless ray is given
+   *  (one per thread when casting rays concurrently).
    */
-  void castRay(const Vec3r& orig,
+  virtual void castRay(const Vec3r& orig,
 	       const Vec3r& end,
 	       OccludersSet& occluders,
-	       unsigned timestamp);
+	       unsigned timestamp,
+	       GridRay * ray = NULL);
 
   /*! Casts an infinite ray (still finishing at the end of the grid) from a starting point and in a given direction.
    *  Returns the list of occluders contained
    *  in the cells intersected by this ray
    *  Starts with a call to InitRay.
    */
-  void castInfiniteRay(const Vec3r& orig,
+  virtual void castInfiniteRay(const Vec3r& orig,
 		       const Vec3r& dir,
 		       OccludersSet& occluders,
-		       unsigned timestamp);
+		       unsigned timestamp,
+		       GridRay * ray = NULL);
 
   /*! Casts an infinite ray (still finishing at the end of the grid) from a starting point and in a given direction.
   *  Returns the first intersection (occluder,t,u,v) or null.
   *  Starts with a call to InitRay.
   */
-  Polygon3r * castRayToFindFirstIntersection(const Vec3r& orig,
+  virtual Polygon3r * castRayToFindFirstIntersection(const Vec3r& orig,
       const Vec3r& dir,
       double& t,
       double& u,
       double& v,
-      unsigned timestamp);
+      unsigned timestamp,
+      GridRay * ray = NULL);
 
 
   /*! Init all structures and values for computing
@@ -294,7 +395,8 @@ public:
    */
   void initRay (const Vec3r &orig,
 		const Vec3r& end,
-		unsigned timestamp);
+		unsigned timestamp,
+		GridRay& ray);
 
   /*! Init all structures and values for computing
    *  the cells intersected by this infinite ray.
@@ -303,7 +405,8 @@ public:
    */
   bool initInfiniteRay (const Vec3r &orig,
 		const Vec3r& dir,
-		unsigned timestamp);
+		unsigned timestamp,
+		GridRay& ray);
 
  
   /*! Accessors */
@@ -320,11 +423,13 @@ public:
     return _cells_nb;
   }
 
-  void displayDebug() {
+  virtual void displayDebug() {
     cerr << "Cells nb     : " << _cells_nb << endl;
     cerr << "Cell size    : " << _cell_size << endl;
     cerr << "Origin       : " << _orig << endl;
     cerr << "Occluders nb : " << _occluders.size() << endl;
+    cerr << "Cells        : " << _filledCells.size() << " (" << _cellOccluders.size() << " occluder ids)" << endl;
+    cerr << "Triangles    : " << _triangles.memoryUsage() / 1024 << " KB" << endl;
   }
 
   /*
@@ -364,55 +469,48 @@ public:
 
   // return all occluders in all cells that intersect the triangle (p1,p2,p3)
   // these occluders do not necessarily intersect (p1,p2,p3), but all possible intersections are included in this set
-  void triangleIntersections(Vec3r p1,Vec3r p2,Vec3r p3, set<Polygon3r*> & possibleIntersections);
+  virtual void triangleIntersections(Vec3r p1,Vec3r p2,Vec3r p3, set<Polygon3r*> & possibleIntersections);
   
  protected:
 
   /*! Core of castRay and castInfiniteRay, find occluders
    *  along the given ray
    */
-  inline void castRayInternal(GridVisitor& visitor) {
+  inline void castRayInternal(GridVisitor& visitor, GridRay& ray) {
     Cell* current_cell = NULL;
     do {
-      current_cell = getCell(_current_cell);
+      current_cell = getCell(ray.current_cell);
       if (current_cell){
           visitor.discoverCell(current_cell);
-          OccludersSet& occluders = current_cell->getOccluders(); // FIXME: I had forgotten the ref &
-          for (OccludersSet::iterator it = occluders.begin();
-              it != occluders.end();
-              it++) {
-                  if ((unsigned long)(*it)->userdata2 != _timestamp) {
-                      (*it)->userdata2 = (void*)_timestamp;
-                      visitor.examineOccluder(*it);
-                  }
-              }
+          const unsigned * ids = current_cell->occluders();
+          for (unsigned i = 0, n = current_cell->numOccluders(); i < n; i++) {
+              if (ray.visit(ids[i]))
+                  visitor.examineOccluder(_occluders[ids[i]]);
+          }
           visitor.finishCell(current_cell);
       }
-    } while ((!visitor.stop()) && (nextRayCell(_current_cell, _current_cell)));
+    } while ((!visitor.stop()) && (nextRayCell(ray.current_cell, ray.current_cell, ray)));
   }
 
  
   /*! returns the  cell next to the cell
    *  passed as argument.
    */
-  bool nextRayCell(Vec3u& current_cell, Vec3u& next_cell);
-
-  unsigned long	_timestamp;
+  bool nextRayCell(Vec3u& current_cell, Vec3u& next_cell, GridRay& ray);
 
   Vec3u		_cells_nb;  // number of cells for x,y,z axis
   Vec3r		_cell_size; // cell x,y,z dimensions
   Vec3r		_size;      // grid x,y,x dimensions
   Vec3r		_orig;      // grid origin
 
-  Vec3r		_ray_dir;      // direction vector for the ray
-  Vec3u		_current_cell; // The current cell being processed (designated by its 3 coordinates)
-  Vec3r		_pt;           // Points corresponding to the incoming and outgoing intersections
-                               // of one cell with the ray
-  real		_t_end;        // To know when we are at the end of the ray
-  real		_t;
+  GridRay	_ray;       // state of the rays cast without their own GridRay
 
   //OccludersSet _ray_occluders; // Set storing the occluders contained in the cells traversed by a ray
   OccludersSet _occluders;     // List of all occluders inserted in the grid
+  OccluderTriangles _triangles; // Their first triangles, by id
+
+  vector<Cell*>    _filledCells;   // cells created by insertOccluder
+  vector<unsigned> _cellOccluders; // occluder ids of all the cells, after build()
 };
 
 #endif // GRID_H
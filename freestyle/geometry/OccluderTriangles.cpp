@@ -0,0 +1,201 @@
+
+//
+//  Copyright (C) : Please refer to the COPYRIGHT file distributed
+//   with this source distribution.
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OccluderTriangles.h"
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+void OccluderTriangles::clear() {
+  for (unsigned i = 0; i < 3; i++) {
+    _v0[i].clear();
+    _e1[i].clear();
+    _e2[i].clear();
+  }
+}
+
+void OccluderTriangles::reserve(unsigned n) {
+  for (unsigned i = 0; i < 3; i++) {
+    _v0[i].reserve(n);
+    _e1[i].reserve(n);
+    _e2[i].reserve(n);
+  }
+}
+
+void OccluderTriangles::add(const Polygon3r * occluder) {
+  unsigned id = occluder->getId();
+  if (id >= size()) {
+    for (unsigned i = 0; i < 3; i++) {
+      _v0[i].resize(id + 1, 0);
+      _e1[i].resize(id + 1, 0);
+      _e2[i].resize(id + 1, 0);
+    }
+  }
+
+  // polygons with less than 3 vertices keep null edges, which are never hit
+  const vector<Vec3r>& vertices = occluder->getVertices();
+  if (vertices.size() < 3)
+    return;
+
+  Vec3r e1(vertices[1] - vertices[0]);
+  Vec3r e2(vertices[2] - vertices[0]);
+  for (unsigned i = 0; i < 3; i++) {
+    _v0[i][id] = vertices[0][i];
+    _e1[i][id] = e1[i];
+    _e2[i][id] = e2[i];
+  }
+}
+
+#ifdef __SSE2__
+
+// SSE2 is part of x86-64, so this is what the usual builds run, whatever
+// the compiler flags: two triangles per register (real is double).
+void OccluderTriangles::intersect(const Vec3r& orig, const Vec3r& dir,
+				  const unsigned * ids, unsigned n,
+				  real * t, unsigned char * hit,
+				  real epsilon) const {
+  const __m128d ox = _mm_set1_pd(orig[0]), oy = _mm_set1_pd(orig[1]), oz = _mm_set1_pd(orig[2]);
+  const __m128d dx = _mm_set1_pd(dir[0]), dy = _mm_set1_pd(dir[1]), dz = _mm_set1_pd(dir[2]);
+  const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+  const __m128d eps = _mm_set1_pd(epsilon), minusEps = _mm_set1_pd(-epsilon);
+
+  for (unsigned first = 0; first < n; first += 2) {
+    // the second lane repeats the last triangle when n is odd, its result is dropped
+    unsigned a = ids[first], b = ids[first + 1 < n ? first + 1 : first];
+
+    __m128d v0x = _mm_set_pd(_v0[0][b], _v0[0][a]), v0y = _mm_set_pd(_v0[1][b], _v0[1][a]), v0z = _mm_set_pd(_v0[2][b], _v0[2][a]);
+    __m128d e1x = _mm_set_pd(_e1[0][b], _e1[0][a]), e1y = _mm_set_pd(_e1[1][b], _e1[1][a]), e1z = _mm_set_pd(_e1[2][b], _e1[2][a]);
+    __m128d e2x = _mm_set_pd(_e2[0][b], _e2[0][a]), e2y = _mm_set_pd(_e2[1][b], _e2[1][a]), e2z = _mm_set_pd(_e2[2][b], _e2[2][a]);
+
+    // Moller-Trumbore, operation for operation as in the portable version below
+    __m128d px = _mm_sub_pd(_mm_mul_pd(dy, e2z), _mm_mul_pd(dz, e2y));
+    __m128d py = _mm_sub_pd(_mm_mul_pd(dz, e2x), _mm_mul_pd(dx, e2z));
+    __m128d pz = _mm_sub_pd(_mm_mul_pd(dx, e2y), _mm_mul_pd(dy, e2x));
+    __m128d det = _mm_add_pd(_mm_add_pd(_mm_mul_pd(e1x, px), _mm_mul_pd(e1y, py)), _mm_mul_pd(e1z, pz));
+
+    __m128d tx = _mm_sub_pd(ox, v0x), ty = _mm_sub_pd(oy, v0y), tz = _mm_sub_pd(oz, v0z);
+    __m128d qx = _mm_sub_pd(_mm_mul_pd(ty, e1z), _mm_mul_pd(tz, e1y));
+    __m128d qy = _mm_sub_pd(_mm_mul_pd(tz, e1x), _mm_mul_pd(tx, e1z));
+    __m128d qz = _mm_sub_pd(_mm_mul_pd(tx, e1y), _mm_mul_pd(ty, e1x));
+
+    __m128d u = _mm_add_pd(_mm_add_pd(_mm_mul_pd(tx, px), _mm_mul_pd(ty, py)), _mm_mul_pd(tz, pz));
+    __m128d v = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, qx), _mm_mul_pd(dy, qy)), _mm_mul_pd(dz, qz));
+    __m128d inv_det = _mm_div_pd(one, det);
+    __m128d tt = _mm_mul_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(e2x, qx), _mm_mul_pd(e2y, qy)), _mm_mul_pd(e2z, qz)), inv_det);
+    __m128d uv = _mm_add_pd(u, v);
+
+    __m128d front = _mm_and_pd(_mm_and_pd(_mm_cmpgt_pd(det, eps), _mm_cmpge_pd(u, zero)),
+			       _mm_and_pd(_mm_and_pd(_mm_cmple_pd(u, det), _mm_cmpge_pd(v, zero)), _mm_cmple_pd(uv, det)));
+    __m128d back = _mm_and_pd(_mm_and_pd(_mm_cmplt_pd(det, minusEps), _mm_cmple_pd(u, zero)),
+			      _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(u, det), _mm_cmple_pd(v, zero)), _mm_cmpge_pd(uv, det)));
+    int mask = _mm_movemask_pd(_mm_and_pd(_mm_or_pd(front, back), _mm_cmpge_pd(tt, zero)));
+
+    real pt[2];
+    _mm_storeu_pd(pt, tt);
+    t[first] = pt[0];
+    hit[first] = mask & 1;
+    if (first + 1 < n) {
+      t[first + 1] = pt[1];
+      hit[first + 1] = (mask >> 1) & 1;
+    }
+  }
+}
+
+#else
+
+void OccluderTriangles::intersect(const Vec3r& orig, const Vec3r& dir,
+				  const unsigned * ids, unsigned n,
+				  real * t, unsigned char * hit,
+				  real epsilon) const {
+  const real ox = orig[0], oy = orig[1], oz = orig[2];
+  const real dx = dir[0], dy = dir[1], dz = dir[2];
+
+  // packet of triangles gathered from the arrays; the last packet is
+  // padded with the last triangle, whose extra results are dropped
+  real v0x[PACKET_SIZE], v0y[PACKET_SIZE], v0z[PACKET_SIZE];
+  real e1x[PACKET_SIZE], e1y[PACKET_SIZE], e1z[PACKET_SIZE];
+  real e2x[PACKET_SIZE], e2y[PACKET_SIZE], e2z[PACKET_SIZE];
+  real pt[PACKET_SIZE];
+  long phit[PACKET_SIZE];  // as wide as real, so that the masks vectorize
+
+  for (unsigned first = 0; first < n; first += PACKET_SIZE) {
+    for (unsigned j = 0; j < PACKET_SIZE; j++) {
+      unsigned id = ids[first + j < n ? first + j : n - 1];
+      v0x[j] = _v0[0][id]; v0y[j] = _v0[1][id]; v0z[j] = _v0[2][id];
+      e1x[j] = _e1[0][id]; e1y[j] = _e1[1][id]; e1z[j] = _e1[2][id];
+      e2x[j] = _e2[0][id]; e2y[j] = _e2[1][id]; e2z[j] = _e2[2][id];
+    }
+
+    // Moller-Trumbore, as in GeomUtils::intersectRayTriangle, with the
+    // bound tests of both signs of the determinant turned into masks
+    for (unsigned j = 0; j < PACKET_SIZE; j++) {
+      real px = dy * e2z[j] - dz * e2y[j];
+      real py = dz * e2x[j] - dx * e2z[j];
+      real pz = dx * e2y[j] - dy * e2x[j];
+      real det = e1x[j] * px + e1y[j] * py + e1z[j] * pz;
+
+      real tx = ox - v0x[j], ty = oy - v0y[j], tz = oz - v0z[j];
+      real qx = ty * e1z[j] - tz * e1y[j];
+      real qy = tz * e1x[j] - tx * e1z[j];
+      real qz = tx * e1y[j] - ty * e1x[j];
+
+      real u = tx * px + ty * py + tz * pz;
+      real v = dx * qx + dy * qy + dz * qz;
+      real inv_det = 1.0 / det;
+      real tt = (e2x[j] * qx + e2y[j] * qy + e2z[j] * qz) * inv_det;
+
+      long front = (det > epsilon) & (u >= 0.0) & (u <= det) & (v >= 0.0) & (u + v <= det);
+      long back = (det < -epsilon) & (u <= 0.0) & (u >= det) & (v <= 0.0) & (u + v >= det);
+
+      pt[j] = tt;
+      phit[j] = (front | back) & (long)(tt >= 0.0);
+    }
+
+    unsigned count = (n - first < PACKET_SIZE ? n - first : PACKET_SIZE);
+    for (unsigned j = 0; j < count; j++) {
+      t[first + j] = pt[j];
+      hit[first + j] = phit[j];
+    }
+  }
+}
+
+#endif // __SSE2__
+
+void OccluderTriangles::intersect(const Vec3r& orig, const Vec3r& dir,
+				  const vector<Polygon3r*>& occluders,
+				  OccluderHits& hits,
+				  real epsilon) const {
+  unsigned n = occluders.size();
+  hits.ids.resize(n);
+  hits.t.resize(n);
+  hits.hit.resize(n);
+  if (n == 0)
+    return;
+
+  for (unsigned k = 0; k < n; k++)
+    hits.ids[k] = occluders[k]->getId();
+  intersect(orig, dir, &hits.ids[0], n, &hits.t[0], &hits.hit[0], epsilon);
+}
+
+unsigned long OccluderTriangles::memoryUsage() const {
+  return 9 * sizeof(real) * (unsigned long)_v0[0].capacity();
+}
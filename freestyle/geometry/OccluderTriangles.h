@@ -0,0 +1,101 @@
+//
+//  Filename         : OccluderTriangles.h
+//  Purpose          : Occluder triangles stored as a structure of arrays,
+//                     for testing a ray against many occluders at once
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+//
+//  Copyright (C) : Please refer to the COPYRIGHT file distributed
+//   with this source distribution.
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef  OCCLUDERTRIANGLES_H
+# define OCCLUDERTRIANGLES_H
+
+# include <vector>
+# include "../system/FreestyleConfig.h"
+# include "Geom.h"
+# include "Polygon.h"
+
+using namespace std;
+using namespace Geometry;
+
+/*! Ray/occluder tests of one ray against a list of occluders:
+ *  hit[k] and t[k] are the result of occluders[k]->rayIntersect.
+ *  Kept by the caller between rays to avoid reallocations.
+ */
+struct OccluderHits
+{
+  vector<unsigned>	ids;
+  vector<real>		t;
+  vector<unsigned char>	hit;
+};
+
+/*! The first triangle of each occluder of a grid (the one tested by
+ *  Polygon3r::rayIntersect), in a structure of arrays indexed by the
+ *  occluder id: the first vertex and the two edges from it. The normal
+ *  and the plane are only needed for the hits, so they are read from
+ *  the Polygon3r and not duplicated here.
+ *  The intersection tests run two triangles at a time with SSE2 when the
+ *  target has it (always on x86-64); elsewhere they run on packets of
+ *  PACKET_SIZE triangles with no branch in the arithmetic, which the
+ *  compiler may vectorize. Either way the results are the same as the
+ *  ones of GeomUtils::intersectRayTriangle.
+ */
+class LIB_GEOMETRY_EXPORT OccluderTriangles
+{
+ public:
+
+  static const unsigned PACKET_SIZE = 4;
+
+  OccluderTriangles() {}
+
+  void clear();
+  void reserve(unsigned n);
+
+  /*! stores the occluder at index occluder->getId() */
+  void add(const Polygon3r * occluder);
+
+  unsigned size() const { return _v0[0].size(); }
+
+  /*! Tests the ray (orig, dir) against the n occluders ids[0..n-1]:
+   *  hit[k] tells whether the ray hits occluder ids[k], at orig + t[k]*dir.
+   */
+  void intersect(const Vec3r& orig, const Vec3r& dir,
+		 const unsigned * ids, unsigned n,
+		 real * t, unsigned char * hit,
+		 real epsilon = M_EPSILON) const;
+
+  /*! Same as above for a list of occluders (by their ids) */
+  void intersect(const Vec3r& orig, const Vec3r& dir,
+		 const vector<Polygon3r*>& occluders,
+		 OccluderHits& hits,
+		 real epsilon = M_EPSILON) const;
+
+  unsigned long memoryUsage() const;  // bytes
+
+ private:
+
+  vector<real>	_v0[3];
+  vector<real>	_e1[3];  // v1 - v0
+  vector<real>	_e2[3];  // v2 - v0
+};
+
+#endif // OCCLUDERTRIANGLES_H
@@ -30,9 +30,10 @@
 #ifndef  SWEEPLINE_H
 # define SWEEPLINE_H
 
-# include <list>
 # include <vector>
+# include <deque>
 # include <set>
+# include <algorithm>
 
 /*! Class to define the intersection berween two segments*/
 template<class Edge>
@@ -86,15 +87,19 @@ public:
 
 
 
+template<class T, class Point> class SweepLine;
+
 template<class T, class Point>
 class Segment
 {
 public:
     Segment()
     {
+        _sweepSeq = NOT_ACTIVE;
     }
     Segment(T& s, const Point& iA, const Point& iB)
     {
+        _sweepSeq = NOT_ACTIVE;
         _edge = s;
         if(iA < iB)
         {
@@ -117,6 +122,7 @@ public:
         B = iBrother.B;
         _Intersections = iBrother._Intersections;
         _order = iBrother._order;
+        _sweepSeq = NOT_ACTIVE;
     }
 
     Segment(const Segment<T,Point>& iBrother)
@@ -126,6 +132,7 @@ public:
         B = iBrother.B;
         _Intersections = iBrother._Intersections;
         _order = iBrother._order;
+        _sweepSeq = NOT_ACTIVE;
     }
 
     ~Segment() {
@@ -170,11 +177,15 @@ public:
     inline T& edge() {return _edge;}
 
 private:
+    friend class SweepLine<T,Point>;
+    static const unsigned NOT_ACTIVE = ~0U;
+
     T _edge;
     Point A;
     Point B;
     std::vector<Intersection<Segment<T,Point> >*> _Intersections; // list of intersections parameters
     bool _order; // true if A and B are in the same order than _edge.A and _edge.B. false otherwise.
+    unsigned _sweepSeq; // rank of insertion in the active set of the sweep line, NOT_ACTIVE outside of it
 };
 
 /*! defines a binary function that can be overload 
@@ -196,32 +207,273 @@ struct binary_rule
 };
 
 
+/*! Balanced (AVL) tree of intervals [lo, hi], ordered by (lo, seq) and
+ *  augmented with the largest hi of each subtree, to find all the items
+ *  whose interval overlaps a given one in O(log n + number found).
+ *  seq must be unique. The nodes are pooled in an array.
+ */
+template<class Item>
+class SweepIntervalTree
+{
+public:
+
+    SweepIntervalTree() : _root(NIL), _free(NIL), _size(0) {}
+
+    void insert(Item *item, real lo, real hi, unsigned seq)
+    {
+        int node = newNode(item, lo, hi, seq);
+        _root = insert(_root, node);
+        _size++;
+    }
+
+    /*! removes the interval (lo, seq); returns false if there is none */
+    bool erase(real lo, unsigned seq)
+    {
+        bool found = false;
+        _root = erase(_root, lo, seq, found);
+        if (found)
+            _size--;
+        return found;
+    }
+
+    /*! appends the items whose interval overlaps [lo, hi], in (lo, seq) order */
+    void query(real lo, real hi, vector<Item*>& items) const
+    {
+        query(_root, lo, hi, items);
+    }
+
+    unsigned size() const {return _size;}
+
+    void clear()
+    {
+        _nodes.clear();
+        _root = _free = NIL;
+        _size = 0;
+    }
+
+private:
+
+    static const int NIL = -1;
+
+    struct Node
+    {
+        Item *item;
+        real lo, hi;
+        real maxHi;      // largest hi of the subtree
+        unsigned seq;
+        int left, right; // NIL if none; left is the next free node for a free node
+        int height;
+    };
+
+    inline static bool less(real lo1, unsigned seq1, real lo2, unsigned seq2)
+    {
+        return lo1 < lo2 || (lo1 == lo2 && seq1 < seq2);
+    }
+
+    inline int height(int n) const {return n == NIL ? 0 : _nodes[n].height;}
+
+    int newNode(Item *item, real lo, real hi, unsigned seq)
+    {
+        int n;
+        if (_free != NIL)
+        {
+            n = _free;
+            _free = _nodes[n].left;
+        }
+        else
+        {
+            n = _nodes.size();
+            _nodes.push_back(Node());
+        }
+        Node & node = _nodes[n];
+        node.item = item;
+        node.lo = lo;
+        node.hi = node.maxHi = hi;
+        node.seq = seq;
+        node.left = node.right = NIL;
+        node.height = 1;
+        return n;
+    }
+
+    void freeNode(int n)
+    {
+        _nodes[n].left = _free;
+        _free = n;
+    }
+
+    void update(int n)
+    {
+        Node & node = _nodes[n];
+        node.height = 1 + max(height(node.left), height(node.right));
+        node.maxHi = node.hi;
+        if (node.left != NIL && _nodes[node.left].maxHi > node.maxHi)
+            node.maxHi = _nodes[node.left].maxHi;
+        if (node.right != NIL && _nodes[node.right].maxHi > node.maxHi)
+            node.maxHi = _nodes[node.right].maxHi;
+    }
+
+    int rotateRight(int n)
+    {
+        int l = _nodes[n].left;
+        _nodes[n].left = _nodes[l].right;
+        _nodes[l].right = n;
+        update(n);
+        update(l);
+        return l;
+    }
+
+    int rotateLeft(int n)
+    {
+        int r = _nodes[n].right;
+        _nodes[n].right = _nodes[r].left;
+        _nodes[r].left = n;
+        update(n);
+        update(r);
+        return r;
+    }
+
+    // restores the balance of n, whose subtrees are balanced; returns the new subtree root
+    int balance(int n)
+    {
+        update(n);
+        int l = _nodes[n].left, r = _nodes[n].right;
+        int b = height(l) - height(r);
+        if (b > 1)
+        {
+            if (height(_nodes[l].left) < height(_nodes[l].right))
+                _nodes[n].left = rotateLeft(l);
+            return rotateRight(n);
+        }
+        if (b < -1)
+        {
+            if (height(_nodes[r].right) < height(_nodes[r].left))
+                _nodes[n].right = rotateRight(r);
+            return rotateLeft(n);
+        }
+        return n;
+    }
+
+    int insert(int n, int node)
+    {
+        if (n == NIL)
+            return node;
+        if (less(_nodes[node].lo, _nodes[node].seq, _nodes[n].lo, _nodes[n].seq))
+        {
+            int l = insert(_nodes[n].left, node);
+            _nodes[n].left = l;
+        }
+        else
+        {
+            int r = insert(_nodes[n].right, node);
+            _nodes[n].right = r;
+        }
+        return balance(n);
+    }
+
+    // removes the smallest node of the subtree n, returned in minNode
+    int eraseMin(int n, int & minNode)
+    {
+        if (_nodes[n].left == NIL)
+        {
+            minNode = n;
+            return _nodes[n].right;
+        }
+        int l = eraseMin(_nodes[n].left, minNode);
+        _nodes[n].left = l;
+        return balance(n);
+    }
+
+    int erase(int n, real lo, unsigned seq, bool & found)
+    {
+        if (n == NIL)
+            return NIL;
+
+        if (less(lo, seq, _nodes[n].lo, _nodes[n].seq))
+        {
+            int l = erase(_nodes[n].left, lo, seq, found);
+            _nodes[n].left = l;
+        }
+        else if (less(_nodes[n].lo, _nodes[n].seq, lo, seq))
+        {
+            int r = erase(_nodes[n].right, lo, seq, found);
+            _nodes[n].right = r;
+        }
+        else
+        {
+            found = true;
+            int l = _nodes[n].left, r = _nodes[n].right;
+            freeNode(n);
+            if (r == NIL)
+                return l;
+            int m;
+            r = eraseMin(r, m);
+            _nodes[m].left = l;
+            _nodes[m].right = r;
+            return balance(m);
+        }
+        return balance(n);
+    }
+
+    void query(int n, real lo, real hi, vector<Item*>& items) const
+    {
+        if (n == NIL || _nodes[n].maxHi < lo)
+            return;
+        const Node & node = _nodes[n];
+        query(node.left, lo, hi, items);
+        if (node.lo > hi)
+            return;  // and so do all the intervals of the right subtree
+        if (node.hi >= lo)
+            items.push_back(node.item);
+        query(node.right, lo, hi, items);
+    }
+
+    vector<Node> _nodes;
+    int _root;
+    int _free;      // list of the free nodes
+    unsigned _size;
+};
+
+
+/*! Intersections between 2D segments, found by sweeping a line over the
+ *  segment endpoints (in lexicographic order, see process()).
+ *  The active segments (those crossed by the sweep line) are kept in an
+ *  interval tree on their y extent: a new segment is only tested against
+ *  the active segments whose y extent overlaps its own, which are the only
+ *  ones it can intersect. The candidates are tested in the order in which
+ *  they entered the active set, so the intersections are found in the same
+ *  order as by testing all the active segments.
+ *  The segments and intersections created by newSegment() and
+ *  newIntersection() are pooled and freed with the sweep line.
+ */
 template<class T,class Point>
 class SweepLine 
 {
 public:
 
-    SweepLine() {}
+    SweepLine() : _seq(0) {}
     ~SweepLine()
     {
-        for(typename vector<Intersection<Segment<T,Point> >*>::iterator i=_Intersections.begin(),iend=_Intersections.end();
-            i!=iend;
-            i++)
-        {
-            delete (*i);
-        }
+        // the intersections and segments are freed with their pools
         _Intersections.clear();
-        /*
-    for(typename vector<Segment<T,Point>* >::iterator ie=_IntersectedEdges.begin(),ieend=_IntersectedEdges.end();
-    ie!=ieend;
-    ie++)
+        _IntersectedEdges.clear();
+        _active.clear();
+    }
+
+    /*! Creates a segment owned by the sweep line */
+    inline Segment<T,Point>* newSegment(T& s, const Point& iA, const Point& iB)
     {
-      delete (*ie);
+        _segmentPool.push_back(Segment<T,Point>(s, iA, iB));
+        return &_segmentPool.back();
     }
-    */
-        _IntersectedEdges.clear();
 
-        _set.clear();
+    /*! Creates an intersection owned by the sweep line
+     *  (not added to intersections())
+     */
+    template<class EdgeClass>
+    inline Intersection<Segment<T,Point> >* newIntersection(EdgeClass* eA, real ta, EdgeClass* eB, real tb)
+    {
+        _intersectionPool.push_back(Intersection<Segment<T,Point> >(eA, ta, eB, tb));
+        return &_intersectionPool.back();
     }
 
     // it is assumed that the points have been sorted according to X coordinate
@@ -287,7 +539,18 @@ public:
             v0[0] = ((*S)[1])[0];
             v0[1] = ((*S)[1])[1];
         }
-        for(typename std::list<Segment<T,Point>* >::iterator s=_set.begin(), send=_set.end();
+
+        // active segments whose y extent overlaps the one of S, slightly
+        // enlarged so that rounding in the intersection test cannot make
+        // it find an intersection that the boxes exclude
+        real lo, hi;
+        yExtent(S, lo, hi);
+        real pad = 1e-9 * (1.0 + max(fabs(lo), fabs(hi)));
+        _candidates.clear();
+        _active.query(lo - pad, hi + pad, _candidates);
+        sort(_candidates.begin(), _candidates.end(), activatedBefore);
+
+        for(typename vector<Segment<T,Point>* >::iterator s=_candidates.begin(), send=_candidates.end();
             s!=send;
             s++)
         {
@@ -323,7 +586,7 @@ public:
                 // fails if both segments are degenerate
 
                 // create the intersection
-                Intersection<Segment<T,Point> > * inter = new Intersection<Segment<T,Point> >(S,t,currentS,u);
+                Intersection<Segment<T,Point> > * inter = newIntersection(S,t,currentS,u);
                 // add it to the intersections list
                 _Intersections.push_back(inter);
                 // add this intersection to the first edge intersections list
@@ -332,15 +595,25 @@ public:
                 currentS->AddIntersection(inter);
             }
         }
-        // add the added segment to the list of active segments
-        _set.push_back(S);
+
+        // add the added segment to the set of active segments
+        if (S->_sweepSeq != Segment<T,Point>::NOT_ACTIVE)
+            _active.erase(lo, S->_sweepSeq);
+        S->_sweepSeq = _seq++;
+        _active.insert(S, lo, hi, S->_sweepSeq);
     }
 
     inline void remove(Segment<T,Point>* s)
     {
         if(s->intersections().size() > 0)
             _IntersectedEdges.insert(s);
-        _set.remove(s);
+        if (s->_sweepSeq == Segment<T,Point>::NOT_ACTIVE)
+            return;
+
+        real lo, hi;
+        yExtent(s, lo, hi);
+        _active.erase(lo, s->_sweepSeq);
+        s->_sweepSeq = Segment<T,Point>::NOT_ACTIVE;
     }
 
     set<Segment<T,Point>* >& intersectedEdges() {return _IntersectedEdges;}
@@ -348,9 +621,26 @@ public:
 
 
 private:
-    std::list<Segment<T,Point>* > _set; // set of active edges for a given position of the sweep line
+
+    inline static void yExtent(Segment<T,Point>* s, real & lo, real & hi)
+    {
+        lo = min(((*s)[0])[1], ((*s)[1])[1]);
+        hi = max(((*s)[0])[1], ((*s)[1])[1]);
+    }
+
+    inline static bool activatedBefore(const Segment<T,Point>* s1, const Segment<T,Point>* s2)
+    {
+        return s1->_sweepSeq < s2->_sweepSeq;
+    }
+
+    SweepIntervalTree<Segment<T,Point> > _active; // active edges for a given position of the sweep line, by y extent
+    unsigned _seq; // insertion rank of the next active edge
+    vector<Segment<T,Point>* > _candidates; // active edges tested against the edge being added
     std::set<Segment<T,Point>* > _IntersectedEdges; // the list of intersected edges
     std::vector<Intersection<Segment<T,Point> >*> _Intersections; // the list of all intersections.
+
+    std::deque<Segment<T,Point> > _segmentPool;
+    std::deque<Intersection<Segment<T,Point> > > _intersectionPool;
 };
 
 #endif // SWEEPLINE_H
@@ -4,12 +4,34 @@
 #include "IndexedFaceSet.h"
 #include "PLYFileLoader.h"
 #include <locale.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+# include <stdio.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
 
 PLYFileLoader::PLYFileLoader(const char *iFileName)
 {
     _FileName = new char[strlen(iFileName)+1];
     strcpy(_FileName, iFileName);
 
+    _Mesh = NULL;
+    _Scene = NULL;
+    _numFacesRead = 0;
+    _minEdgeSize = DBL_MAX;
+}
+
+PLYFileLoader::PLYFileLoader(const PLYMeshData& iMesh)
+{
+    _FileName = NULL;
+    _Mesh = &iMesh;
     _Scene = NULL;
     _numFacesRead = 0;
     _minEdgeSize = DBL_MAX;
@@ -36,12 +58,182 @@ void PLYFileLoader::SetFileName(const char *iFileName)
   strcpy(_FileName, iFileName);
   }*/
 
+// ---------- PLY parsing helpers ----------
+//
+// The tessellator writes either ascii or binary_little_endian files with the same elements:
+// "vertex" (x y z nx ny nz, optionally red green blue ndotv) and "face" (a vertex_index list and a
+// uchar vbf flag). Properties are looked up by name, so either layout can be read.
+
+enum PLYType { PLY_NONE, PLY_CHAR, PLY_UCHAR, PLY_SHORT, PLY_USHORT, PLY_INT, PLY_UINT, PLY_FLOAT, PLY_DOUBLE };
+
+struct PLYProperty
+{
+    std::string name;
+    PLYType type;
+    PLYType countType;  // PLY_NONE unless this is a list property
+};
+
+static PLYType PLYTypeFromName(const char *name)
+{
+    static const struct { const char *name; PLYType type; } types[] = {
+        { "char", PLY_CHAR }, { "int8", PLY_CHAR }, { "uchar", PLY_UCHAR }, { "uint8", PLY_UCHAR },
+        { "short", PLY_SHORT }, { "int16", PLY_SHORT }, { "ushort", PLY_USHORT }, { "uint16", PLY_USHORT },
+        { "int", PLY_INT }, { "int32", PLY_INT }, { "uint", PLY_UINT }, { "uint32", PLY_UINT },
+        { "float", PLY_FLOAT }, { "float32", PLY_FLOAT }, { "double", PLY_DOUBLE }, { "float64", PLY_DOUBLE } };
+
+    for(unsigned i=0; i<sizeof(types)/sizeof(types[0]); i++)
+        if (strcmp(name, types[i].name) == 0)
+            return types[i].type;
+
+    printf("ERROR: UNKNOWN PLY PROPERTY TYPE %s\n", name);
+    exit(1);
+}
+
+static unsigned PLYTypeSize(PLYType type)
+{
+    switch(type)
+    {
+    case PLY_CHAR: case PLY_UCHAR: return 1;
+    case PLY_SHORT: case PLY_USHORT: return 2;
+    case PLY_INT: case PLY_UINT: case PLY_FLOAT: return 4;
+    case PLY_DOUBLE: return 8;
+    default: return 0;
+    }
+}
+
+// sequential reader over the body of a PLY file (after end_header)
+class PLYBodyReader
+{
+public:
+    // ascii bodies must be null-terminated
+    PLYBodyReader(const char *begin, const char *end, bool binary)
+        : _p(begin), _end(end), _binary(binary)
+    {
+        const int one = 1;
+        _swap = (*(const char*)&one != 1);  // file is little-endian
+    }
+
+    real Read(PLYType type)
+    {
+        if (!_binary)
+        {
+            char *next;
+            real value = strtod(_p, &next);
+            if (next == _p)
+                UnexpectedEOF();
+            _p = next;
+            return value;
+        }
+
+        unsigned size = PLYTypeSize(type);
+        if (_p + size > _end)
+            UnexpectedEOF();
+
+        char bytes[8];
+        for(unsigned b=0; b<size; b++)
+            bytes[b] = _swap ? _p[size-1-b] : _p[b];
+        _p += size;
+
+        switch(type)
+        {
+        case PLY_CHAR:   return *(const signed char*)bytes;
+        case PLY_UCHAR:  return *(const unsigned char*)bytes;
+        case PLY_SHORT:  { short v; memcpy(&v, bytes, 2); return v; }
+        case PLY_USHORT: { unsigned short v; memcpy(&v, bytes, 2); return v; }
+        case PLY_INT:    { int v; memcpy(&v, bytes, 4); return v; }
+        case PLY_UINT:   { unsigned v; memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT:  { float v; memcpy(&v, bytes, 4); return v; }
+        case PLY_DOUBLE: { double v; memcpy(&v, bytes, 8); return v; }
+        default: return 0;
+        }
+    }
+
+private:
+    static void UnexpectedEOF()
+    {
+        printf("UNEXPECTED EOF IN PLY\n");
+        exit(1);
+    }
+
+    const char *_p;
+    const char *_end;
+    bool _binary;
+    bool _swap;
+};
+
+// read-only view of a whole file: memory-mapped where available
+class PLYFileContents
+{
+public:
+    explicit PLYFileContents(const char *fileName) : _data(NULL), _size(0), _mapped(false)
+    {
+#ifndef WIN32
+        int fd = open(fileName, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                _data = (const char*)data;
+                _size = st.st_size;
+                _mapped = true;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+        if (_mapped)
+            return;
+#endif
+        FILE *fp = fopen(fileName, "rb");
+        if (fp == NULL)
+            return;
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if (size > 0)
+        {
+            char *buffer = new char[size];
+            _size = fread(buffer, 1, size, fp);
+            _data = buffer;
+        }
+        fclose(fp);
+    }
+
+    ~PLYFileContents()
+    {
+#ifndef WIN32
+        if (_mapped)
+        {
+            munmap((void*)_data, _size);
+            return;
+        }
+#endif
+        delete [] _data;
+    }
+
+    const char *data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    const char *_data;
+    size_t _size;
+    bool _mapped;
+};
+
 NodeGroup* PLYFileLoader::Load()
 {
+    if (_Mesh != NULL)
+    {
+        printf("Loading in-memory mesh\n");
+        printf("Num Vertices = %d, Num Faces = %d\n", _Mesh->numVertices, _Mesh->numFaces);
+        return BuildScene(*_Mesh);
+    }
+
     printf("Loading PLY file %s\n", _FileName);
 
-    FILE * fp = fopen(_FileName, "rt");
-    if (fp == NULL)
+    PLYFileContents file(_FileName);
+    if (file.data() == NULL)
     {
         printf("ERROR: CANNOT OPEN INPUT FILE %s\n", _FileName);
         exit(1);
@@ -49,42 +241,210 @@ NodeGroup* PLYFileLoader::Load()
 
     // ---------- Read the headers ---------
 
-    char buffer[200];
+    const char *p = file.data(), *end = file.data() + file.size();
 
     unsigned numVertices = 0, numFaces = 0;
-    fscanf(fp, "ply\nformat ascii 1.0\n");
+    bool binary = false, meshSilhouettes = false, hasSilhouetteComment = false;
+    std::vector<PLYProperty> vertexProperties, faceProperties;
+    std::vector<PLYProperty> *currentProperties = NULL;
+    bool headerEnded = false;
+
+    while (p < end && !headerEnded)
+    {
+        const char *eol = (const char*)memchr(p, '\n', end - p);
+        if (eol == NULL)
+            break;
+        std::string line(p, eol);
+        p = eol + 1;
+
+        char word[3][64];
+        unsigned count;
+        if (line == "ply")
+            continue;
+        else if (sscanf(line.c_str(), "format %63s", word[0]) == 1)
+        {
+            binary = (strcmp(word[0], "binary_little_endian") == 0);
+            if (!binary && strcmp(word[0], "ascii") != 0)
+            {
+                printf("ERROR: UNSUPPORTED PLY FORMAT %s\n", word[0]);
+                exit(1);
+            }
+        }
+        else if (line == "comment mesh silhouettes" || line == "comment smooth silhouettes")
+        {
+            meshSilhouettes = (line == "comment mesh silhouettes");
+            hasSilhouetteComment = true;
+        }
+        else if (sscanf(line.c_str(), "element %63s %u", word[0], &count) == 2)
+        {
+            if (strcmp(word[0], "vertex") == 0)
+            {
+                numVertices = count;
+                currentProperties = &vertexProperties;
+            }
+            else if (strcmp(word[0], "face") == 0)
+            {
+                numFaces = count;
+                currentProperties = &faceProperties;
+            }
+            else
+            {
+                printf("ERROR: UNEXPECTED PLY ELEMENT %s\n", word[0]);
+                exit(1);
+            }
+        }
+        else if (sscanf(line.c_str(), "property list %63s %63s %63s", word[0], word[1], word[2]) == 3 && currentProperties != NULL)
+        {
+            PLYProperty property = { word[2], PLYTypeFromName(word[1]), PLYTypeFromName(word[0]) };
+            currentProperties->push_back(property);
+        }
+        else if (sscanf(line.c_str(), "property %63s %63s", word[0], word[1]) == 2 && currentProperties != NULL)
+        {
+            PLYProperty property = { word[1], PLYTypeFromName(word[0]), PLY_NONE };
+            currentProperties->push_back(property);
+        }
+        else if (line == "end_header")
+            headerEnded = true;
+    }
+
+    if (!hasSilhouetteComment)
+    {
+        printf("missing comment indicating smooth vs. mesh silhouettes.\n");
+        exit(1);
+    }
 
-    fgets(buffer, 200, fp);
-    bool meshSilhouettes = (strcmp(buffer, "comment mesh silhouettes\n") == 0);
-    if (!meshSilhouettes && (strcmp(buffer, "comment smooth silhouettes\n") != 0))
+    if (!headerEnded || numVertices <= 0 || numFaces <= 0)
     {
-        printf("missing comment indicating smooth vs. mesh silhouettes. line: %s\n", buffer);
+        printf("ERROR:  READING PLY (nv = %d, nf = %d)\n", numVertices, numFaces);
         exit(1);
     }
 
-    fscanf(fp,"element vertex %d\n", &numVertices);
-    fscanf(fp, "property float x\nproperty float y\nproperty float z\n");
+    // vertex properties used by Freestyle, -1 if absent
+    enum { X, Y, Z, NX, NY, NZ, NDOTV, NUM_VERTEX_SLOTS };
+    const char *slotNames[NUM_VERTEX_SLOTS] = { "x", "y", "z", "nx", "ny", "nz", "ndotv" };
+    int slots[NUM_VERTEX_SLOTS];
+    for(int j=0;j<NUM_VERTEX_SLOTS;j++)
+    {
+        slots[j] = -1;
+        for(unsigned k=0;k<vertexProperties.size();k++)
+            if (vertexProperties[k].name == slotNames[j])
+                slots[j] = k;
+    }
+    for(int j=X;j<=NZ;j++)
+        if (slots[j] < 0 || vertexProperties[slots[j]].countType != PLY_NONE)
+        {
+            printf("ERROR: MISSING PLY VERTEX PROPERTY %s\n", slotNames[j]);
+            exit(1);
+        }
+
+    // ascii values are parsed with strtod, which needs a terminated string
+    std::string asciiBody;
+    if (!binary)
+    {
+        asciiBody.assign(p, end);
+        p = asciiBody.c_str();
+        end = p + asciiBody.size();
+        setlocale(LC_NUMERIC,"C");
+    }
+    PLYBodyReader reader(p, end, binary);
+
+    // ------ Read the vertices and faces into the mesh arrays ------
 
-    fscanf(fp, "property float nx\n");
-    fscanf(fp, "property float ny\n");
-    fscanf(fp, "property float nz\n");
+    printf("Num Vertices = %d, Num Faces = %d\n", numVertices, numFaces);
 
-    fscanf(fp, "property float red\n");
-    fscanf(fp, "property float green\n");
-    fscanf(fp, "property float blue\n");
-    fscanf(fp, "property float ndotv\n");
+    PLYMeshData mesh;
+    mesh.numVertices = numVertices;
+    mesh.numFaces = numFaces;
+    mesh.vertices = new real[3*numVertices];
+    mesh.normals = new real[3*numVertices];
+    mesh.vertexUserData = new float[numVertices];
+    mesh.faceVertices = new unsigned[3*numFaces];
+    mesh.faceUserData = new int[numFaces];
+    mesh.meshSilhouettes = meshSilhouettes;
 
-    fscanf(fp,"element face %d\n", &numFaces);
+    std::vector<real> values(vertexProperties.size());
 
-    if (numVertices <= 0 || numFaces <= 0)
+    for(unsigned i=0;i<numVertices;i++)
     {
-        printf("ERROR:  READING PLY (nv = %d, nf = %d)\n", numVertices, numFaces);
-        exit(1);
+        for(unsigned k=0;k<vertexProperties.size();k++)
+        {
+            if (vertexProperties[k].countType != PLY_NONE)
+            {
+                // skip lists
+                unsigned n = (unsigned)reader.Read(vertexProperties[k].countType);
+                for(unsigned l=0;l<n;l++)
+                    reader.Read(vertexProperties[k].type);
+                continue;
+            }
+            values[k] = reader.Read(vertexProperties[k].type);
+        }
+
+        for(int j=0;j<3;j++)
+        {
+            mesh.vertices[3*i+j] = values[slots[X+j]];
+            mesh.normals[3*i+j] = values[slots[NX+j]];
+        }
+
+        mesh.vertexUserData[i] = slots[NDOTV] >= 0 ? values[slots[NDOTV]] : 0;
     }
 
-    fscanf(fp, "property list uchar int vertex_index\n");
-    fscanf(fp, "property uchar int\n");  // vbf
-    fscanf(fp, "end_header\n");
+    for(unsigned i=0;i<numFaces;i++)
+    {
+        int N = 0, v[3] = { 0, 0, 0 }, vfint = 0;
+        bool hasIndices = false, hasVbf = false;
+
+        for(unsigned k=0;k<faceProperties.size();k++)
+        {
+            const PLYProperty & property = faceProperties[k];
+            if (property.countType == PLY_NONE)
+            {
+                // the facing flag is the face's scalar property (historically named "int")
+                int value = (int)reader.Read(property.type);
+                if (!hasVbf)
+                    vfint = value;
+                hasVbf = true;
+                continue;
+            }
+
+            int n = (int)reader.Read(property.countType);
+            for(int l=0;l<n;l++)
+            {
+                int index = (int)reader.Read(property.type);
+                if (property.name == "vertex_index" && l < 3)
+                    v[l] = index;
+            }
+            if (property.name == "vertex_index")
+            {
+                N = n;
+                hasIndices = true;
+            }
+        }
+
+        if (!hasIndices || N != 3)
+        {
+            printf("UNEXPECTED NON-TRIANGULAR FACE IN PLY %d: %d vertices)\n", i, N);
+            exit(1);
+        }
+
+        for(int j=0;j<3;j++)
+        {
+            if (v[j] < 0 || (unsigned)v[j] >= numVertices)
+            {
+                printf("ERROR: INVALID VERTEX INDEX IN PLY FACE %d: %d\n", i, v[j]);
+                exit(1);
+            }
+            mesh.faceVertices[3*i+j] = v[j];
+        }
+
+        mesh.faceUserData[i] = vfint;  // vbf goes here
+    }
+
+    return BuildScene(mesh);
+}
+
+NodeGroup* PLYFileLoader::BuildScene(const PLYMeshData & mesh)
+{
+    unsigned numVertices = mesh.numVertices, numFaces = mesh.numFaces;
 
     // ------ Initialize data structures ------
 
@@ -93,53 +453,28 @@ NodeGroup* PLYFileLoader::Load()
     NodeShape * shape = new NodeShape;
     _Scene->AddChild(shape);
 
-    // allocate elements for the indexed face set
-    real * vertices = new real[3*numVertices];
+    // elements for the indexed face set; the mesh arrays are used in place
+    real * vertices = mesh.vertices;
     unsigned * nvertPerFace = new unsigned[numFaces];
     IndexedFaceSet::TRIANGLES_STYLE * faceStyles = new IndexedFaceSet::TRIANGLES_STYLE[numFaces];
-    unsigned * faces = new unsigned[3*numFaces];
+    unsigned * faces = mesh.faceVertices;
     _numFacesRead = numFaces;
 
     unsigned numNormals = numVertices;
-    real * normals = new real[numNormals * 3];
+    real * normals = mesh.normals;
     unsigned * nindices = new unsigned[numFaces * 3];
 
-    int * faceUserData = new int[numFaces];
-    float * vertexUserData = new float[numVertices];
+    int * faceUserData = mesh.faceUserData;
+    float * vertexUserData = mesh.vertexUserData;
 
     real minBBox[3] = { 0,0,0};
     real maxBBox[3] = { 0,0,0};
     //  real minBBox[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
     //  real maxBBox[3] = { DBL_MIN, DBL_MIN, DBL_MIN };
 
-    printf("Num Vertices = %d, Num Faces = %d\n", numVertices, numFaces);
-
-    // ------- Read the vertices and faces -----
+    // ------- Process the vertices and faces -----
     for(unsigned i=0;i<numVertices;i++)
     {
-        if (feof(fp) != 0)
-        {
-            printf("UNEXPECTED EOF IN PLY\n");
-            exit(1);
-        }
-
-        // note: should be using strtod
-
-        char buffer[200];
-        fgets(buffer, 200, fp);
-
-        real x,y,z, ndotv;
-        char * nextptr;
-
-        setlocale(LC_NUMERIC,"C");
-        x = strtod(buffer, &nextptr);
-        y = strtod(nextptr, &nextptr);
-        z = strtod(nextptr, &nextptr);
-
-        vertices[3*i] = x;
-        vertices[3*i+1] = y;
-        vertices[3*i+2] = z;
-
         for(int j=0;j<3;j++)
         {
             if (vertices[3*i+j] < minBBox[j] || i == 0)
@@ -149,64 +484,27 @@ NodeGroup* PLYFileLoader::Load()
         }
 
         // per-vertex normals
-        real nx, ny, nz;
-
-        nx = strtod(nextptr, &nextptr);
-        ny = strtod(nextptr, &nextptr);
-        nz = strtod(nextptr, &nextptr);
-
-        Vec3r normal(nx,ny,nz);
+        Vec3r normal(normals[3*i], normals[3*i+1], normals[3*i+2]);
         normal.normalize();
         for(int j=0;j<3;j++)
             normals[3*i+j]=normal[j];
 
-        // per-vertex color
-        real red, green, blue;
-
-        red = strtod(nextptr, &nextptr);
-        green = strtod(nextptr, &nextptr);
-        blue = strtod(nextptr, &nextptr);
-
-        ndotv = strtod(nextptr, &nextptr);
-        vertexUserData[i] = ndotv;
-
         //if (i < 3 || i+4 > numVertices )
-        //printf("Vertex %d: %f %f %f (%g %g %g)\n", i, vertices[3*i], vertices[3*i+1], vertices[3*i+2],x,y,z);
+        //printf("Vertex %d: %f %f %f\n", i, vertices[3*i], vertices[3*i+1], vertices[3*i+2]);
     }
 
 
     for(unsigned i=0;i<numFaces;i++)
     {
-        if (feof(fp) != 0)
-        {
-            printf("UNEXPECTED EOF IN PLY\n");
-            exit(1);
-        }
+        unsigned v[3] = { faces[3*i], faces[3*i+1], faces[3*i+2] };
 
-        //      char buffer[200];
-        //      fgets(buffer, 200, fp);
-
-        int N, v[3], vfint;
-        int r = fscanf(fp, "%d %d %d %d %d\n", &N, &v[0], &v[1], &v[2], &vfint);
         faces[3*i] = 3*v[0];  // why multiply by 3?  no idea (there's a mysterious division by 3 is in WingedEdgeBuilder::buildTriangles)
         faces[3*i+1] = 3*v[1];
         faces[3*i+2] = 3*v[2];
-        //      fscanf(fp, "%d %d %d %d\n", &N, &faces[3*i], &faces[3*i+1], &faces[3*i+2]);
-
-        //      if (i <5  || i +3 > numFaces -1)
-        //      	printf("Face %d: %d verts: %d %d %d (r = %d)\n", i, N, v[0], v[1], v[2], r);
-
-        if (N != 3)
-        {
-            printf("UNEXPECTED NON-TRIANGULAR FACE IN PLY %d: %d vertices)\n", i, N);
-            exit(1);
-        }
 
-        nvertPerFace[i] = N;
+        nvertPerFace[i] = 3;
         faceStyles[i] = IndexedFaceSet::TRIANGLES;
 
-        faceUserData[i] = vfint;  // vbf goes here
-
         Vec3r vert[3];
         for(int j=0;j<3;j++)
             for(int k=0;k<3;k++)
@@ -239,7 +537,7 @@ NodeGroup* PLYFileLoader::Load()
 
     IndexedFaceSet * rep = new IndexedFaceSet(vertices, 3*numVertices, normals, 3*numNormals, NULL, 0, 0, 0,
                                               numFaces, nvertPerFace, faceStyles, faces, 3*numFaces, nindices, 3*numFaces, NULL, 0, NULL, 0,
-                                              faceUserData, vertexUserData, 0, meshSilhouettes); // set to zero means it will be deallocated elsewhere
+                                              faceUserData, vertexUserData, 0, mesh.meshSilhouettes); // set to zero means it will be deallocated elsewhere
 
     rep->SetId(Id(0,0));
 
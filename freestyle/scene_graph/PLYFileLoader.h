@@ -4,6 +4,23 @@
 # include "NodeGroup.h"
 
 
+/*! Triangle mesh with the contents of a tessellator PLY file:
+ *  3 coordinates per vertex and per vertex normal, the ndotv vertex
+ *  user data, 3 vertex indices and the vbf facing flag per face.
+ *  The arrays are allocated with new[] and the scene built from them
+ *  takes ownership.
+ */
+struct PLYMeshData
+{
+  unsigned numVertices;
+  unsigned numFaces;
+  real *vertices;
+  real *normals;
+  float *vertexUserData;
+  unsigned *faceVertices;
+  int *faceUserData;
+  bool meshSilhouettes;
+};
 
 class LIB_SCENE_GRAPH_EXPORT PLYFileLoader
 {
@@ -12,6 +29,10 @@ public:
   //  PLYFileLoader();
 
   explicit PLYFileLoader(const char *iFileName);
+
+  /*! Builds a PLYFileLoader for a mesh already in memory (e.g. handed
+   *  over by the RIF); Load() then skips the file entirely */
+  explicit PLYFileLoader(const PLYMeshData& iMesh);
   virtual ~PLYFileLoader();
 
   /*! Sets the name of the 3dsMax file to load */
@@ -30,7 +51,11 @@ public:
   inline real minEdgeSize() {return _minEdgeSize;}
 
 protected:
+  /*! Builds the scene from the mesh arrays, taking ownership of them */
+  NodeGroup * BuildScene(const PLYMeshData& iMesh);
+
   char *_FileName;
+  const PLYMeshData *_Mesh;
   NodeGroup* _Scene;
   unsigned _numFacesRead;
   real _minEdgeSize;
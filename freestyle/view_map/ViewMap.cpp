@@ -117,8 +117,11 @@ ViewMap::~ViewMap()
 
 ViewShape * ViewMap::viewShape(unsigned id) 
 {
-    int index = _shapeIdToIndex[id];
-    return _VShapes[ index ];
+    // find() rather than [], so that concurrent lookups (ray casting threads) do not modify the map
+    id_to_index_map::const_iterator index = _shapeIdToIndex.find(id);
+    if (index == _shapeIdToIndex.end())
+        return _VShapes[0];
+    return _VShapes[ index->second ];
 }
 void  ViewMap::AddViewShape(ViewShape *iVShape) {
     _shapeIdToIndex[iVShape->getId().getFirst()] = _VShapes.size();
@@ -2381,6 +2384,15 @@ void ViewMap::checkPointers(const char * stepName,bool forceCheck)
 
 
 DebugPoint * ViewMap::addDebugPoint(DebugPoint::PointType ptType, Vec3r point3D, bool knownInvis, SVertex *sv)
+{
+    DebugPoint *dp = newDebugPoint(ptType, point3D, knownInvis, sv);
+
+    _debugPoints.push_back(dp);
+
+    return dp;
+}
+
+DebugPoint * ViewMap::newDebugPoint(DebugPoint::PointType ptType, Vec3r point3D, bool knownInvis, SVertex *sv)
 {
     DebugPoint *dp = new DebugPoint();
 
@@ -2392,11 +2404,14 @@ DebugPoint * ViewMap::addDebugPoint(DebugPoint::PointType ptType, Vec3r point3D,
     dp->RIFpoint = false;
     dp->debugString = NULL;
 
-    _debugPoints.push_back(dp);
-
     return dp;
 }
 
+void ViewMap::addDebugPoints(const vector<DebugPoint*> & points)
+{
+    _debugPoints.insert(_debugPoints.end(), points.begin(), points.end());
+}
+
 
 DebugPoint * ViewMap::addDebugPoint(DebugPoint::PointType ptType, Vec3r point3D, Vec3r pairPoint3D, bool knownInvis, SVertex *sv, bool pairKnownInvis, SVertex * pairSV)
 {
@@ -240,6 +240,10 @@ public:
 		     bool knownInvis=false, SVertex * sv=NULL, bool pairKnownInvis=false, SVertex * pairSV=NULL);
   void addRIFDebugPoint(DebugPoint::PointType ptType, Vec3r point3D, char * debugString, real radialCurvature);
 
+  // debug points made without touching the view map (e.g., by ray casting threads), added later in one go
+  static DebugPoint* newDebugPoint(DebugPoint::PointType ptType, Vec3r point3D, bool knownInvis=false, SVertex * sv=NULL);
+  void addDebugPoints(const vector<DebugPoint*> & points);
+
   void addCuspFace(WFace * f, Vec3r color) { _poCuspFaces.push_back(pair<WFace*,Vec3r>(f,color)); }
 
   FacePOData * facePOData(WFace * f) { assert(_facePOData.find(f) != _facePOData.end()); return _facePOData[f]; }
@@ -20,8 +20,11 @@
 
 
 #include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
 #include "ViewMapBuilder.h"
 #include "../geometry/FastGrid.h"  // included as a workaround
+#include "../geometry/BVHGrid.h"
 #include "../scene_graph/NodeGroup.h"
 #include "../scene_graph/NodeShape.h"
 #include "../scene_graph/VertexRep.h"
@@ -992,430 +995,646 @@ bool alreadyVisited(const WFace *f1, const WFace*f2, const set<pair<const WFace*
 
 
 
-void ViewMapBuilder::computeSelfIntersections(WingedEdge & we)
+// Face pairs of the self-intersections, collected in the grid cells (phase 1)
+// and tested (phase 2) by several threads; only the chain tracing is serial
+struct SelfIntersectionTask
 {
-    printf("Computing self intersections:\n");
-    fflush(stdout);
+    Grid * grid;
 
-    badIntersection = false;
+    // phase 1
+    const vector<Vec3u> * cells;                            // non-empty cells, in order
+    const vector<Vec3u> * cellMin, * cellMax;               // cells of the bbox of each occluder
+    vector<vector<pair<unsigned,unsigned> > > * cellPairs;  // pairs owned by each cell
 
-    FastGrid * fg = dynamic_cast<FastGrid*>(_Grid);
+    // phase 2
+    const vector<pair<unsigned,unsigned> > * pairs;
+    vector<unsigned char> * intersecting;
 
+    bool collect;                // phase 1, else phase 2
+    unsigned numItems;           // cells or pairs
+    unsigned * nextItem;         // shared by the threads
+    pthread_t thread;
 
-    bool progressBarDisplay = false;
-    unsigned progressBarStep = 0;
+    SelfIntersectionTask() : grid(NULL), cells(NULL), cellMin(NULL), cellMax(NULL), cellPairs(NULL),
+        pairs(NULL), intersecting(NULL), collect(false), numItems(0), nextItem(NULL) {}
+};
 
-    if(_pProgressBar != NULL && fg->numNonempty() > gProgressBarMinSize) {
-        unsigned progressBarSteps = fg->numNonempty();
-        if (progressBarSteps > 100)
-            progressBarSteps = 100;
-        progressBarStep = fg->numNonempty() / progressBarSteps;
-        _pProgressBar->reset();
-        _pProgressBar->setLabelText("Computing Self-Intersections");
-        _pProgressBar->setTotalSteps(progressBarSteps);
-        _pProgressBar->setProgress(0);
-        progressBarDisplay = true;
-    }
+static const unsigned SELF_INTERSECTION_CHUNK = 64;
 
-    unsigned counter = progressBarStep;
+// the ids of a cell are sorted, since the occluders are inserted in id order
+static inline bool cellHasOccluder(Cell * cell, unsigned id)
+{
+    return cell != NULL && binary_search(cell->occluders(), cell->occluders() + cell->numOccluders(), id);
+}
 
+// A pair of occluders found in several cells belongs to the first of them in
+// the order of the non-empty cells (the order of Vec3u): the cell in which the
+// serial loop over the cells used to meet it first.
+static bool ownsPair(const SelfIntersectionTask * task, const Vec3u & cell, unsigned a, unsigned b)
+{
+    Vec3u lo, hi;
+    for(unsigned i=0;i<3;i++)
+    {
+        lo[i] = max((*task->cellMin)[a][i], (*task->cellMin)[b][i]);
+        hi[i] = min((*task->cellMax)[a][i], (*task->cellMax)[b][i]);
+    }
 
-    /*
-  NodeShape *seNode = new NodeShape();
-  visDebugNode->AddChild(seNode);
-  Material semat;
-  semat.SetDiffuse(1,0,1,1);
-  semat.SetEmission(0,0,0,0);
-  semat.SetAmbient(0,0,0,0);
+    // both bounding boxes overlap the cell, so it is in [lo, hi]
+    for(unsigned x=lo[0];x<=hi[0];x++)
+        for(unsigned y=lo[1];y<=hi[1];y++)
+            for(unsigned z=lo[2];z<=hi[2];z++)
+            {
+                Vec3u other(x,y,z);
+                if (!(other < cell))
+                    return true;
+                Cell * c = task->grid->getCell(other);
+                if (cellHasOccluder(c, a) && cellHasOccluder(c, b))
+                    return false;
+            }
+    return true;
+}
 
-  seNode->SetMaterial(semat);
-  */
+// the test of intersectFaces, without computing the intersection segment
+// (nor reporting degenerate intersections): true if the faces may intersect
+static bool facesMayIntersect(const WFace * face1, const WFace * face2)
+{
+    if (face1 == face2 || adjacent(face1, face2))
+        return false;
 
+    int coplanar = 0;
+    real source[3], target[3];
+    real t1[3][3], t2[3][3];
+    for(int m=0;m<3;m++)
+        for(int n=0;n<3;n++)
+        {
+            t1[m][n] = face1->GetVertex(m)->GetVertex()[n];
+            t2[m][n] = face2->GetVertex(m)->GetVertex()[n];
+        }
 
-    //  PRINTMEM
+    return tri_tri_intersection_test_3d(t1[0], t1[1], t1[2],
+                                        t2[0], t2[1], t2[2],
+                                        &coplanar, source, target) != 0;
+}
 
-    assert(we.getWShapes().size() > 0);
+static void * SelfIntersectionThread(void * arg)
+{
+    SelfIntersectionTask * task = (SelfIntersectionTask*)arg;
 
-    int id = 0;
-    for(int i=0;i<we.getWShapes().size();i++)
+    while (true)
     {
-        int sid = we.getWShapes()[i]->GetId();
-        if (sid > id)
-            id = sid + 1;
-    }
-
-    SShape * psShape = new SShape;
-    assert(psShape != NULL);
-    psShape->SetId( id );
-    psShape->SetMaterials( we.getWShapes()[0]->materials());
+        unsigned start = __sync_fetch_and_add(task->nextItem, SELF_INTERSECTION_CHUNK);
+        if (start >= task->numItems)
+            break;
+        unsigned end = min(start + SELF_INTERSECTION_CHUNK, task->numItems);
 
-    ViewShape * vshape = new ViewShape(psShape);
-    assert(vshape != NULL);
-    _ViewMap->AddViewShape(vshape);
-    psShape->SetViewShape(vshape);
+        for(unsigned k = start; k < end; k++)
+        {
+            if (task->collect)
+            {
+                const Vec3u & coord = (*task->cells)[k];
+                Cell * cell = task->grid->getCell(coord);
+                const unsigned * ids = cell->occluders();
+                vector<pair<unsigned,unsigned> > & cellPairs = (*task->cellPairs)[k];
+
+                for(unsigned i=0;i<cell->numOccluders();i++)
+                    for(unsigned j=i+1;j<cell->numOccluders();j++)
+                        if (ownsPair(task, coord, ids[i], ids[j]))
+                            cellPairs.push_back(pair<unsigned,unsigned>(ids[i], ids[j]));
+            }
+            else
+            {
+                const pair<unsigned,unsigned> & p = (*task->pairs)[k];
+                (*task->intersecting)[k] = facesMayIntersect((WFace*)task->grid->getOccluder(p.first)->userdata,
+                                                             (WFace*)task->grid->getOccluder(p.second)->userdata);
+            }
+        }
+    }
 
-    set<pair<const WFace*,const WFace*> > processed;
+    return NULL;
+}
 
-    list<TriPair> chain;
+// runs the phase of the task on up to numThreads threads, this one included
+static void RunSelfIntersectionTasks(const SelfIntersectionTask & task, unsigned numThreads)
+{
+    numThreads = max(1U, min(numThreads, (task.numItems + SELF_INTERSECTION_CHUNK - 1) / SELF_INTERSECTION_CHUNK));
 
-    //  FILE * histFile = fopen("hist.txt","wt");
+    unsigned nextItem = 0;
+    vector<SelfIntersectionTask> tasks(numThreads, task);
 
-    int n = 0, firstId = _currentId, firstFId = _currentFId;
-    // iterate over all non-empty grid cells
-    for(FastGrid::FGiterator it = fg->beginFG() ; it != fg->endFG(); ++it)
-        //  for(Grid::iterator it = _Grid->begin(); it!= _Grid->end(); ++it)
+    for(unsigned i = 0; i < numThreads; i++)
     {
-        printf("Visiting cell # %d / %d. Created so far: %d ViewEdges, %d FEdges   \r",
-               n++, fg->numNonempty()-1, _currentId-firstId, _currentFId - firstFId);
-        //      printf("sizeof: ViewEdge: %d, ViewVertex: %d, FEdgeSmooth: %d, SVertex: %d\n",
-        //	     (int)sizeof(ViewEdge), (int)sizeof(ViewVertex), (int)sizeof(FEdgeSmooth),
-        //	     (int)sizeof(SVertex));
+        tasks[i].nextItem = &nextItem;
 
-        vector<Polygon3r*> & tris = _Grid->getCell(*it)->getOccluders();
+        // the first task runs in this thread, as do the ones whose thread could not be created
+        if (i == 0 || pthread_create(&tasks[i].thread, NULL, SelfIntersectionThread, &tasks[i]) != 0)
+            tasks[i].thread = pthread_self();
+    }
 
-        //      fprintf(histFile, "%d ", tris.size());
+    SelfIntersectionThread(&tasks[0]);
 
-        for(int i=0;i<tris.size();i++)
-            for(int j=i+1;j<tris.size();j++)
-            {
-                TriPair start_tp;
+    for(unsigned i = 1; i < numThreads; i++)
+        if (pthread_equal(tasks[i].thread, pthread_self()))
+            SelfIntersectionThread(&tasks[i]);
+        else
+            pthread_join(tasks[i].thread, NULL);
+}
 
-                start_tp.face1 = (WFace*)tris[i]->userdata;
-                start_tp.face2 = (WFace*)tris[j]->userdata;
+// Traces the intersection curve through the pair of faces, if they intersect
+// and the curve has not been traced yet, and adds it to the self-intersection shape
+void ViewMapBuilder::TraceSelfIntersection(WFace * face1, WFace * face2,
+                                           set<pair<const WFace*,const WFace*> > & processed,
+                                           SShape * psShape, ViewShape * vshape)
+{
+    TriPair start_tp;
 
-                // ------- check if we've already done this pair of triangles ---------
+    start_tp.face1 = face1;
+    start_tp.face2 = face2;
 
-                if (alreadyVisited(start_tp,processed))
-                    continue;
+    // ------- check if we've already done this pair of triangles ---------
 
-                // -------------- check if the polys share any vertices ---------------
+    if (alreadyVisited(start_tp,processed))
+        return;
 
-                if (adjacent(start_tp))
-                {
-                    //		printf("Skipping adjacent: [%08X, %08X]\n", start_tp.face1, start_tp.face2);
-                    continue;
-                }
+    // -------------- check if the polys share any vertices ---------------
 
-                // ------------------------ check for intersection ------------------------
+    if (adjacent(start_tp))
+    {
+        //		printf("Skipping adjacent: [%08X, %08X]\n", start_tp.face1, start_tp.face2);
+        return;
+    }
 
-                bool result = intersectFaces(start_tp);
-                if (result == false)
-                    continue;
+    // ------------------------ check for intersection ------------------------
+
+    bool result = intersectFaces(start_tp);
+    if (result == false)
+        return;
 
-                processed.insert(pair<const WFace*,const WFace*>(start_tp.face1,start_tp.face2));
+    processed.insert(pair<const WFace*,const WFace*>(start_tp.face1,start_tp.face2));
 
-                // ------------------------ create the chain ------------------------------
+    // ------------------------ create the chain ------------------------------
 
-                bool closed = false;
+    bool closed = false;
 
-                chain.clear();
-                chain.push_back(start_tp);
+    list<TriPair> chain;
+    chain.push_back(start_tp);
 
-                // ------------------------ forward chaining pass -------------------------
+    // ------------------------ forward chaining pass -------------------------
 
-                TriPair lasttp = start_tp;
+    TriPair lasttp = start_tp;
 
-                while(true)
-                {
-                    TriPair tp = lasttp;
+    while(true)
+    {
+        TriPair tp = lasttp;
 
-                    // advance to the next pair of faces
+        // advance to the next pair of faces
 #ifdef DEBUG_INTERSECTION
-                    printf("forward\n");
+        printf("forward\n");
 #endif
-                    tp.forward();
+        tp.forward();
 
-                    // check if we've reached an object boundary
-                    if (tp.face1 == NULL || tp.face2 == NULL)
-                    {
+        // check if we've reached an object boundary
+        if (tp.face1 == NULL || tp.face2 == NULL)
+        {
 #ifdef DEBUG_INTERSECTION
-                        printf("reached object boundary\n");
+            printf("reached object boundary\n");
 #endif
-                        break;
-                    }
+            break;
+        }
 
-                    // check if we're back where we started
-                    if ( (tp.face1 == start_tp.face1 && tp.face2 == start_tp.face2) ||
-                         (tp.face1 == start_tp.face2 && tp.face2 == start_tp.face1))
-                    {
+        // check if we're back where we started
+        if ( (tp.face1 == start_tp.face1 && tp.face2 == start_tp.face2) ||
+             (tp.face1 == start_tp.face2 && tp.face2 == start_tp.face1))
+        {
 #ifdef DEBUG_INTERSECTION
-                        printf("Closed the loop\n");
+            printf("Closed the loop\n");
 #endif
-                        closed = true;
-                        break;
-                    }
+            closed = true;
+            break;
+        }
 
-                    // check if this pair has already been processed
-                    if (alreadyVisited(tp, processed))
-                    {
+        // check if this pair has already been processed
+        if (alreadyVisited(tp, processed))
+        {
 #ifdef DEBUG_INTERSECTION
-                        printf("WARNING: found already-processed pair without loop closure\n");
-                        printf("Face1: %08X [%08X, %08X, %08X]\n", tp.face1,
-                               tp.face1->GetVertex(0),tp.face1->GetVertex(1),tp.face1->GetVertex(2));
-                        printf("Face2: %08X [%08X, %08X, %08X]\n", tp.face2,
-                               tp.face2->GetVertex(0),tp.face2->GetVertex(1),tp.face2->GetVertex(2));
-
-                        real t1[3][3], t2[3][3];
-                        for(int m=0;m<3;m++)
-                            for(int n=0;n<3;n++)
-                            {
-                                t1[m][n] = tp.face1->GetVertex(m)->GetVertex()[n];
-                                t2[m][n] = tp.face2->GetVertex(m)->GetVertex()[n];
-                            }
+            printf("WARNING: found already-processed pair without loop closure\n");
+            printf("Face1: %08X [%08X, %08X, %08X]\n", tp.face1,
+                   tp.face1->GetVertex(0),tp.face1->GetVertex(1),tp.face1->GetVertex(2));
+            printf("Face2: %08X [%08X, %08X, %08X]\n", tp.face2,
+                   tp.face2->GetVertex(0),tp.face2->GetVertex(1),tp.face2->GetVertex(2));
+
+            real t1[3][3], t2[3][3];
+            for(int m=0;m<3;m++)
+                for(int n=0;n<3;n++)
+                {
+                    t1[m][n] = tp.face1->GetVertex(m)->GetVertex()[n];
+                    t2[m][n] = tp.face2->GetVertex(m)->GetVertex()[n];
+                }
 
-                        printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f]); hold on;\n",
-                               t1[0][0],t1[1][0],t1[2][0],t1[0][0],
-                                t1[0][1],t1[1][1],t1[2][1],t1[0][1],
-                                t1[0][2],t1[1][2],t1[2][2],t1[0][2]);
-                        printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f])\n",
-                               t2[0][0],t2[1][0],t2[2][0],t2[0][0],
-                                t2[0][1],t2[1][1],t2[2][1],t2[0][1],
-                                t2[0][2],t2[1][2],t2[2][2],t2[0][2]);
+            printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f]); hold on;\n",
+                   t1[0][0],t1[1][0],t1[2][0],t1[0][0],
+                    t1[0][1],t1[1][1],t1[2][1],t1[0][1],
+                    t1[0][2],t1[1][2],t1[2][2],t1[0][2]);
+            printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f])\n",
+                   t2[0][0],t2[1][0],t2[2][0],t2[0][0],
+                    t2[0][1],t2[1][1],t2[2][1],t2[0][1],
+                    t2[0][2],t2[1][2],t2[2][2],t2[0][2]);
 
 
-                        bool result = intersectFaces(tp);
-                        printf("  test: %s\n", result ? "INTERSECTION" : "NO INTERSECTION");
+            bool result = intersectFaces(tp);
+            printf("  test: %s\n", result ? "INTERSECTION" : "NO INTERSECTION");
 #endif
-                        break;
-                    }
+            break;
+        }
 
-                    processed.insert(pair<const WFace*,const WFace*>(tp.face1,tp.face2));
+        processed.insert(pair<const WFace*,const WFace*>(tp.face1,tp.face2));
 
-                    // compute the intersection between these two faces
-                    // if things are working properly, these faces must intersect
-                    // (unless they are adjacent on the surface, not sure if this case is important)
-                    result = intersectFaces(tp, &lasttp.ptB,true);
-                    if (!result)
-                    {
+        // compute the intersection between these two faces
+        // if things are working properly, these faces must intersect
+        // (unless they are adjacent on the surface, not sure if this case is important)
+        result = intersectFaces(tp, &lasttp.ptB,true);
+        if (!result)
+        {
 #ifdef DEBUG_INTERSECTION
-                        printf("WARNING: didn't find expected intersection\n");
+            printf("WARNING: didn't find expected intersection\n");
 
 
-                        real t1[3][3], t2[3][3];
-                        for(int m=0;m<3;m++)
-                            for(int n=0;n<3;n++)
-                            {
-                                t1[m][n] = tp.face1->GetVertex(m)->GetVertex()[n];
-                                t2[m][n] = tp.face2->GetVertex(m)->GetVertex()[n];
-                            }
+            real t1[3][3], t2[3][3];
+            for(int m=0;m<3;m++)
+                for(int n=0;n<3;n++)
+                {
+                    t1[m][n] = tp.face1->GetVertex(m)->GetVertex()[n];
+                    t2[m][n] = tp.face2->GetVertex(m)->GetVertex()[n];
+                }
 
-                        printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f]); hold on;\n",
-                               t1[0][0],t1[1][0],t1[2][0],t1[0][0],
-                                t1[0][1],t1[1][1],t1[2][1],t1[0][1],
-                                t1[0][2],t1[1][2],t1[2][2],t1[0][2]);
-                        printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f])\n",
-                               t2[0][0],t2[1][0],t2[2][0],t2[0][0],
-                                t2[0][1],t2[1][1],t2[2][1],t2[0][1],
-                                t2[0][2],t2[1][2],t2[2][2],t2[0][2]);
+            printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f]); hold on;\n",
+                   t1[0][0],t1[1][0],t1[2][0],t1[0][0],
+                    t1[0][1],t1[1][1],t1[2][1],t1[0][1],
+                    t1[0][2],t1[1][2],t1[2][2],t1[0][2]);
+            printf("\tplot3([%f %f %f %f],[%f %f %f %f],[%f %f %f %f])\n",
+                   t2[0][0],t2[1][0],t2[2][0],t2[0][0],
+                    t2[0][1],t2[1][1],t2[2][1],t2[0][1],
+                    t2[0][2],t2[1][2],t2[2][2],t2[0][2]);
 
-                        //		    makeDebugTriangles(tp.face1, tp.face2);
+            //		    makeDebugTriangles(tp.face1, tp.face2);
 #endif
-                        break;
-                    }
-                    //		  FATAL_ERROR("didn't find expected intersection");
+            break;
+        }
+        //		  FATAL_ERROR("didn't find expected intersection");
 
-                    chain.push_back(tp);
-                    lasttp = tp;
-                }
+        chain.push_back(tp);
+        lasttp = tp;
+    }
 
-                // ------------------------ backward chaining -----------------------------
+    // ------------------------ backward chaining -----------------------------
 
-                if (!closed)
-                {
+    if (!closed)
+    {
 #ifdef DEBUG_INTERSECTION
-                    printf("doing bidirectional chaining\n");
+        printf("doing bidirectional chaining\n");
 #endif
 
-                    lasttp = start_tp;
+        lasttp = start_tp;
 
-                    while(true)
-                    {
-                        TriPair tp = lasttp;
+        while(true)
+        {
+            TriPair tp = lasttp;
 
-                        Vec3r last_ptA = lasttp.ptA;
+            Vec3r last_ptA = lasttp.ptA;
 
-                        // advance to the next pair of faces
-                        tp.backward();
-                        if (tp.face1 == NULL || tp.face2 == NULL)   // should only happens at object boundaries
-                            break;
+            // advance to the next pair of faces
+            tp.backward();
+            if (tp.face1 == NULL || tp.face2 == NULL)   // should only happens at object boundaries
+                break;
 
-                        if (alreadyVisited(tp, processed))
-                        {
+            if (alreadyVisited(tp, processed))
+            {
 #ifdef DEBUG_INTERSECTION
-                            printf("warning: found already-processed pair without loop closure\n");
+                printf("warning: found already-processed pair without loop closure\n");
 #endif
-                            break;
-                        }
+                break;
+            }
 
-                        processed.insert(pair<const WFace*,const WFace*>(tp.face1,tp.face2));
+            processed.insert(pair<const WFace*,const WFace*>(tp.face1,tp.face2));
 
-                        // compute the intersection between these two faces
-                        result = intersectFaces(tp,&lasttp.ptA,false);
-                        if (result == false)
-                            break;
-                        //		      FATAL_ERROR("didn't find expected intersection");
+            // compute the intersection between these two faces
+            result = intersectFaces(tp,&lasttp.ptA,false);
+            if (result == false)
+                break;
+            //		      FATAL_ERROR("didn't find expected intersection");
 
-                        chain.push_front(tp);
-                        lasttp = tp;
-                    }
+            chain.push_front(tp);
+            lasttp = tp;
+        }
 
-                }
+    }
 
-                // ------- we now have a chain of face pairs, with ordered pts (A,B) -------
-                // ------- now we generate the corresponding chain of FEdges, and the ViewEdge and ViewVertices
+    // ------- we now have a chain of face pairs, with ordered pts (A,B) -------
+    // ------- now we generate the corresponding chain of FEdges, and the ViewEdge and ViewVertices
 
-                //	    printf("i = %d, j= %d\n", i,j);
+    //	    printf("i = %d, j= %d\n", i,j);
 
-                //	    PRINTMEM
+    //	    PRINTMEM
 
-                //	    _ViewMap->AddViewEdge(newVEdge);
-                ///	    vector<ViewEdge*> & ves = _ViewMap->ViewEdges();
-                //	    printf("ves.size() = %d\n", ves.size());
-                //	    ves.push_back(newVEdge);
+    //	    _ViewMap->AddViewEdge(newVEdge);
+    ///	    vector<ViewEdge*> & ves = _ViewMap->ViewEdges();
+    //	    printf("ves.size() = %d\n", ves.size());
+    //	    ves.push_back(newVEdge);
 
 
-                bool isPORegion = ((WXFace*)start_tp.face1)->sourcePOB() != NULL ||
-                        ((WXFace*)start_tp.face2)->sourcePOB() != NULL;
+    bool isPORegion = ((WXFace*)start_tp.face1)->sourcePOB() != NULL ||
+            ((WXFace*)start_tp.face2)->sourcePOB() != NULL;
 
 
-                ViewEdge * newVEdge = new ViewEdge;
-                assert(newVEdge != NULL);
+    ViewEdge * newVEdge = new ViewEdge;
+    assert(newVEdge != NULL);
 
-                newVEdge->SetNature(isPORegion ? Nature::PO_SURFACE_INTERSECTION : Nature::SURFACE_INTERSECTION);
-                newVEdge->SetId(_currentId);
-                _currentId++;
+    newVEdge->SetNature(isPORegion ? Nature::PO_SURFACE_INTERSECTION : Nature::SURFACE_INTERSECTION);
+    newVEdge->SetId(_currentId);
+    _currentId++;
 
-                _ViewMap->AddViewEdge(newVEdge);
-                vshape->AddEdge(newVEdge);
+    _ViewMap->AddViewEdge(newVEdge);
+    vshape->AddEdge(newVEdge);
 
 
 #ifdef DEBUG_INTERSECTION
-                Id id = newVEdge->getId();
-                printf("NEW VIEWEDGE, ID: %d %d\n", id.getFirst(), id.getSecond());
+    Id id = newVEdge->getId();
+    printf("NEW VIEWEDGE, ID: %d %d\n", id.getFirst(), id.getSecond());
 #endif
-                fflush(stdout);
+    fflush(stdout);
 
-                FEdgeIntersection * fe;
-                FEdgeIntersection * fefirst = NULL;
-                FEdgeIntersection * feprevious = NULL;
-                SVertex * vA = NULL;
-                SVertex * vB = NULL;
-                SVertex * vFirst = NULL;
+    FEdgeIntersection * fe;
+    FEdgeIntersection * fefirst = NULL;
+    FEdgeIntersection * feprevious = NULL;
+    SVertex * vA = NULL;
+    SVertex * vB = NULL;
+    SVertex * vFirst = NULL;
 
-                vA = new SVertex( chain.front().ptA, _currentSVertexId);
-                vA->SetSourceEdge(chain.front().getEdge(true));
-                vFirst = vA;
+    vA = new SVertex( chain.front().ptA, _currentSVertexId);
+    vA->SetSourceEdge(chain.front().getEdge(true));
+    vFirst = vA;
 
-                _currentSVertexId++;
-                SilhouetteGeomEngine::ProjectSilhouette(vA);
+    _currentSVertexId++;
+    SilhouetteGeomEngine::ProjectSilhouette(vA);
 
-                _ViewMap->AddSVertex(vA);
-                psShape->AddNewVertex(vA);
+    _ViewMap->AddSVertex(vA);
+    psShape->AddNewVertex(vA);
 
-                int k;
-                list<TriPair>::iterator it;
-                for(it = chain.begin(), k=0;it!= chain.end();++it, ++k)
-                {
-                    // check if we're at the end of a loop
-                    if (closed && (k+1 == chain.size()) && (chain.size() > 1))
-                    {
-                        vB = vFirst;
+    int k;
+    list<TriPair>::iterator it;
+    for(it = chain.begin(), k=0;it!= chain.end();++it, ++k)
+    {
+        // check if we're at the end of a loop
+        if (closed && (k+1 == chain.size()) && (chain.size() > 1))
+        {
+            vB = vFirst;
 
 #ifdef DEBUG_INTERSECTION
-                        // make sure vFirst is on these faces
-                        //		    printf("DEBUGGING LOOP CLOSURE\n");
-                        //		    ComputeBarycentricCoords((*it).face1, vB->getPoint3D());
-                        //		    ComputeBarycentricCoords((*it).face2, vB->getPoint3D());
+            // make sure vFirst is on these faces
+            //		    printf("DEBUGGING LOOP CLOSURE\n");
+            //		    ComputeBarycentricCoords((*it).face1, vB->getPoint3D());
+            //		    ComputeBarycentricCoords((*it).face2, vB->getPoint3D());
 #endif
-                    }
-                    else
-                    {
-                        vB = new SVertex( (*it).ptB, _currentSVertexId);
-                        vB->SetSourceEdge((*it).getEdge(false));
-                        _currentSVertexId++;
+        }
+        else
+        {
+            vB = new SVertex( (*it).ptB, _currentSVertexId);
+            vB->SetSourceEdge((*it).getEdge(false));
+            _currentSVertexId++;
 
-                        SilhouetteGeomEngine::ProjectSilhouette(vB);
-                        _ViewMap->AddSVertex(vB);
-                        psShape->AddNewVertex(vB);
-                    }
+            SilhouetteGeomEngine::ProjectSilhouette(vB);
+            _ViewMap->AddSVertex(vB);
+            psShape->AddNewVertex(vB);
+        }
 
-                    fe = new FEdgeIntersection(vA, vB);
-                    fe->SetViewEdge(newVEdge);
-                    fe->SetNature(isPORegion ? Nature::PO_SURFACE_INTERSECTION : Nature::SURFACE_INTERSECTION);//Nature::SURFACE_INTERSECTION);
-                    fe->SetId(_currentFId);
-                    _currentFId++;
-                    fe->SetPreviousEdge(feprevious);
-                    fe->SetFaces( (*it).face1 , (*it).face2 );
-                    assert((*it).face1 != NULL && (*it).face2 != NULL);
+        fe = new FEdgeIntersection(vA, vB);
+        fe->SetViewEdge(newVEdge);
+        fe->SetNature(isPORegion ? Nature::PO_SURFACE_INTERSECTION : Nature::SURFACE_INTERSECTION);//Nature::SURFACE_INTERSECTION);
+        fe->SetId(_currentFId);
+        _currentFId++;
+        fe->SetPreviousEdge(feprevious);
+        fe->SetFaces( (*it).face1 , (*it).face2 );
+        assert((*it).face1 != NULL && (*it).face2 != NULL);
 
-                    if (feprevious != NULL)
-                        feprevious->SetNextEdge(fe);
-                    //		(*it).face1->getIntersections().push_back(fe);
-                    //		(*it).face2->getIntersections().push_back(fe);
+        if (feprevious != NULL)
+            feprevious->SetNextEdge(fe);
+        //		(*it).face1->getIntersections().push_back(fe);
+        //		(*it).face2->getIntersections().push_back(fe);
 
-                    vA->AddFEdge(fe);
-                    vB->AddFEdge(fe);
-                    _ViewMap->AddFEdge(fe);
+        vA->AddFEdge(fe);
+        vB->AddFEdge(fe);
+        _ViewMap->AddFEdge(fe);
 
 #ifdef DEBUG_INTERSECTION
-                    printf("\t NEW FE: [%f %f %f], [%f %f %f], ID: %d %d\n", vA->getX(),vA->getY(),vA->getZ(),
-                           vB->getX(),vB->getY(),vB->getZ(), fe->getId().getFirst(), fe->getId().getSecond());
+        printf("\t NEW FE: [%f %f %f], [%f %f %f], ID: %d %d\n", vA->getX(),vA->getY(),vA->getZ(),
+               vB->getX(),vB->getY(),vB->getZ(), fe->getId().getFirst(), fe->getId().getSecond());
 
-                    //		debugFES(fe);
+        //		debugFES(fe);
 #endif
 
-                    if (fefirst == NULL)
-                        fefirst = fe;
+        if (fefirst == NULL)
+            fefirst = fe;
 
-                    // increment pointers along the chain
-                    feprevious = fe;
-                    vA = vB;
-                }
+        // increment pointers along the chain
+        feprevious = fe;
+        vA = vB;
+    }
 
-                psShape->AddChain(fefirst);
+    psShape->AddChain(fefirst);
 
-                newVEdge->SetFEdgeA(fefirst);
-                newVEdge->SetFEdgeB(fe);
+    newVEdge->SetFEdgeA(fefirst);
+    newVEdge->SetFEdgeB(fe);
 
-                if (closed)
-                {
-                    newVEdge->SetA(NULL);
-                    newVEdge->SetB(NULL);
-                    fe->SetNextEdge(fefirst);
-                    fefirst->SetPreviousEdge(fe);
-                }
-                else
-                {
-                    // create view vertecies for the endpoints.
-                    // Usually a NonTVertex, but a TVertex for one special case (end of PO cusp region connecting to silhouette)
-
-                    //		if (!isPORegion || chain.front().getPOendpoint(_ViewMap,true) == NULL)
-                    //		  {
-                    // just create a plain new vertex here
-                    NonTVertex * vva = new NonTVertex(fefirst->vertexA());
-                    newVEdge->SetA(vva);
-                    vva->AddOutgoingViewEdge(newVEdge);
-                    _ViewMap->AddViewVertex(vva);
-
-                    //		if (!isPORegion || chain.back().getPOendpoint(_ViewMap,false) == NULL)
-                    //		  {
-                    NonTVertex * vvb = new NonTVertex(fe->vertexB());
-                    newVEdge->SetB(vvb);
-                    vvb->AddIncomingViewEdge(newVEdge);
-
-                    _ViewMap->AddViewVertex(vvb);
-                }
-            }
+    if (closed)
+    {
+        newVEdge->SetA(NULL);
+        newVEdge->SetB(NULL);
+        fe->SetNextEdge(fefirst);
+        fefirst->SetPreviousEdge(fe);
+    }
+    else
+    {
+        // create view vertecies for the endpoints.
+        // Usually a NonTVertex, but a TVertex for one special case (end of PO cusp region connecting to silhouette)
+
+        //		if (!isPORegion || chain.front().getPOendpoint(_ViewMap,true) == NULL)
+        //		  {
+        // just create a plain new vertex here
+        NonTVertex * vva = new NonTVertex(fefirst->vertexA());
+        newVEdge->SetA(vva);
+        vva->AddOutgoingViewEdge(newVEdge);
+        _ViewMap->AddViewVertex(vva);
+
+        //		if (!isPORegion || chain.back().getPOendpoint(_ViewMap,false) == NULL)
+        //		  {
+        NonTVertex * vvb = new NonTVertex(fe->vertexB());
+        newVEdge->SetB(vvb);
+        vvb->AddIncomingViewEdge(newVEdge);
+
+        _ViewMap->AddViewVertex(vvb);
+    }
+}
 
-        if(progressBarDisplay) {
-            counter--;
-            if (counter <= 0) {
-                counter = progressBarStep;
-                _pProgressBar->setProgress(_pProgressBar->getProgress() + 1);
-            }
+void ViewMapBuilder::computeSelfIntersections(WingedEdge & we)
+{
+    printf("Computing self intersections:\n");
+    fflush(stdout);
+
+    badIntersection = false;
+
+    FastGrid * fg = dynamic_cast<FastGrid*>(_Grid);
+    BVHGrid * bvh = dynamic_cast<BVHGrid*>(_Grid);
+    assert(fg != NULL || bvh != NULL);
+
+    bool progressBarDisplay = false;
+
+    if(_pProgressBar != NULL && _Grid->numOccluders() > gProgressBarMinSize) {
+        _pProgressBar->reset();
+        _pProgressBar->setLabelText("Computing Self-Intersections");
+        _pProgressBar->setTotalSteps(3);
+        _pProgressBar->setProgress(0);
+        progressBarDisplay = true;
+    }
+
+    unsigned numThreads = _numThreads;
+    if (numThreads == 0)
+        numThreads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+
+    /*
+  NodeShape *seNode = new NodeShape();
+  visDebugNode->AddChild(seNode);
+  Material semat;
+  semat.SetDiffuse(1,0,1,1);
+  semat.SetEmission(0,0,0,0);
+  semat.SetAmbient(0,0,0,0);
+
+  seNode->SetMaterial(semat);
+  */
+
+
+    //  PRINTMEM
+
+    assert(we.getWShapes().size() > 0);
+
+    int id = 0;
+    for(int i=0;i<we.getWShapes().size();i++)
+    {
+        int sid = we.getWShapes()[i]->GetId();
+        if (sid > id)
+            id = sid + 1;
+    }
+
+    SShape * psShape = new SShape;
+    assert(psShape != NULL);
+    psShape->SetId( id );
+    psShape->SetMaterials( we.getWShapes()[0]->materials());
+
+    ViewShape * vshape = new ViewShape(psShape);
+    assert(vshape != NULL);
+    _ViewMap->AddViewShape(vshape);
+    psShape->SetViewShape(vshape);
+
+    // ------------- phase 1: candidate pairs of occluders (by id) -------------
+
+    vector<pair<unsigned,unsigned> > pairs;
+
+    if (bvh != NULL)
+    {
+        // with the hierarchy, the candidates are the pairs of overlapping boxes
+        vector<pair<Polygon3r*,Polygon3r*> > candidates;
+        bvh->overlappingPairs(candidates);
+        pairs.reserve(candidates.size());
+        for(unsigned k=0;k<candidates.size();k++)
+            pairs.push_back(pair<unsigned,unsigned>(candidates[k].first->getId(), candidates[k].second->getId()));
+    }
+    else
+    {
+        // the pairs of each non-empty cell, each pair only in the cell that owns it
+        vector<Vec3u> cells;
+        cells.reserve(fg->numNonempty());
+        for(FastGrid::FGiterator it = fg->beginFG() ; it != fg->endFG(); ++it)
+            cells.push_back(*it);
+
+        // cells overlapped by the bounding box of each occluder, as in Grid::insertOccluder
+        unsigned numOccluders = _Grid->numOccluders();
+        vector<Vec3u> cellMin(numOccluders), cellMax(numOccluders);
+        for(unsigned i=0;i<numOccluders;i++)
+        {
+            Vec3r bmin, bmax;
+            _Grid->getOccluder(i)->getBBox(bmin, bmax);
+            _Grid->getCellCoordinates(bmin, cellMin[i]);
+            _Grid->getCellCoordinates(bmax, cellMax[i]);
+        }
+
+        vector<vector<pair<unsigned,unsigned> > > cellPairs(cells.size());
+
+        SelfIntersectionTask task;
+        task.grid = _Grid;
+        task.cells = &cells;
+        task.cellMin = &cellMin;
+        task.cellMax = &cellMax;
+        task.cellPairs = &cellPairs;
+        task.collect = true;
+        task.numItems = cells.size();
+        RunSelfIntersectionTasks(task, numThreads);
+
+        // in cell order, as the serial loop over the cells met them
+        unsigned numPairs = 0;
+        for(unsigned c=0;c<cells.size();c++)
+            numPairs += cellPairs[c].size();
+        pairs.reserve(numPairs);
+        for(unsigned c=0;c<cells.size();c++)
+        {
+            pairs.insert(pairs.end(), cellPairs[c].begin(), cellPairs[c].end());
+            vector<pair<unsigned,unsigned> >().swap(cellPairs[c]);
         }
     }
 
+    printf("%u candidate pairs of faces\n", (unsigned)pairs.size());
+    if(progressBarDisplay)
+        _pProgressBar->setProgress(1);
+
+    // ------------- phase 2: test the pairs -------------
+
+    vector<unsigned char> intersecting(pairs.size(), 0);
+    {
+        SelfIntersectionTask task;
+        task.grid = _Grid;
+        task.pairs = &pairs;
+        task.intersecting = &intersecting;
+        task.collect = false;
+        task.numItems = pairs.size();
+        RunSelfIntersectionTasks(task, numThreads);
+    }
+
+    if(progressBarDisplay)
+        _pProgressBar->setProgress(2);
+
+    // ------------- phase 3: trace the intersection curves -------------
+
+    set<pair<const WFace*,const WFace*> > processed;
+
+    //  FILE * histFile = fopen("hist.txt","wt");
+
+    int firstId = _currentId, firstFId = _currentFId;
+    unsigned numIntersecting = 0;
+
+    for(unsigned k=0;k<pairs.size();k++)
+    {
+        if (!intersecting[k])
+            continue;
+        numIntersecting++;
+
+        TraceSelfIntersection((WFace*)_Grid->getOccluder(pairs[k].first)->userdata,
+                              (WFace*)_Grid->getOccluder(pairs[k].second)->userdata,
+                              processed, psShape, vshape);
+    }
+
+    printf("%u intersecting pairs. Created %d ViewEdges, %d FEdges\n",
+           numIntersecting, _currentId-firstId, _currentFId - firstFId);
+    if(progressBarDisplay)
+        _pProgressBar->setProgress(3);
+
     // ----- make visualization ----
 
 #ifdef DEBUG_INTERSECTION
@@ -2154,6 +2373,48 @@ void ViewMapBuilder::ComputeEdgesVisibility(ViewMap *ioViewMap, WingedEdge & we,
     printf("Done\n");
 }
 
+// One ray casting thread: view edges of a block, taken RAY_CASTING_CHUNK at a time
+struct RayCastingTask
+{
+    ViewMapBuilder * builder;
+    ViewMap * viewMap;
+    Grid * grid;
+    real epsilon;
+    ViewMapBuilder::visibility_algo algo;
+
+    ViewEdge ** edges;
+    unsigned numEdges;
+    unsigned * nextEdge;                      // shared by the threads of the block
+    vector<DebugPoint*> * edgeDebugPoints;    // one list per edge of the block
+
+    RayCastingState * state;
+    pthread_t thread;
+};
+
+static const unsigned RAY_CASTING_CHUNK = 16;
+
+void * ViewMapBuilder::RayCastingThread(void * arg)
+{
+    RayCastingTask * task = (RayCastingTask*)arg;
+
+    while (true)
+    {
+        unsigned start = __sync_fetch_and_add(task->nextEdge, RAY_CASTING_CHUNK);
+        if (start >= task->numEdges)
+            break;
+        unsigned end = min(start + RAY_CASTING_CHUNK, task->numEdges);
+
+        for(unsigned i = start; i < end; i++)
+        {
+            task->state->debugPoints = &task->edgeDebugPoints[i];
+            task->builder->ComputeViewEdgeRayCastingVisibility(task->viewMap, task->edges[i], task->grid,
+                                                               task->epsilon, task->algo, task->state);
+        }
+    }
+
+    return NULL;
+}
+
 void ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, Grid* iGrid, real epsilon,
                                                  visibility_algo iAlgo)
 {
@@ -2163,25 +2424,8 @@ void ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, Grid* iGrid
     unsigned vEdgesSize = vedges.size();
     unsigned fEdgesSize = ioViewMap->FEdges().size();
 
-    /*
-  NodeShape * rtshape1 = new NodeShape();
-  visDebugNode->AddChild(rtshape1);
-  Material rtmat1;
-  rtmat1.SetDiffuse(0,0,1,1);
-  rtmat1.SetEmission(0,0,0,0);
-  rtmat1.SetAmbient(0,0,0,0);
-
-  rtshape1->SetMaterial(rtmat1);
-
-  NodeShape * rtshape2 = new NodeShape();
-  visDebugNode->AddChild(rtshape2);
-  Material rtmat2;
-  rtmat2.SetDiffuse(1,1,0,1);
-  rtmat2.SetEmission(0,0,0,0);
-  rtmat2.SetAmbient(0,0,0,0);
-
-  rtshape2->SetMaterial(rtmat2);
-  */
+    if (vEdgesSize == 0)
+        return;
 
     if(_pProgressBar != NULL && fEdgesSize > gProgressBarMinSize) {
         unsigned progressBarSteps = min(gProgressBarMaxSteps, vEdgesSize);
@@ -2193,7 +2437,70 @@ void ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, Grid* iGrid
         progressBarDisplay = true;
     }
 
-    unsigned counter = progressBarStep;
+    // The view edges are independent: each one only writes to itself and its fedges,
+    // and each thread casts its rays with its own GridRay, so the grid is only read.
+    // Punch-out visibility adds its debug geometry to the scene graph and stays serial.
+    unsigned numThreads = _numThreads;
+    if (numThreads == 0)
+        numThreads = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    if (iAlgo == punch_out)
+        numThreads = 1;
+    numThreads = min(numThreads, (vEdgesSize + RAY_CASTING_CHUNK - 1) / RAY_CASTING_CHUNK);
+
+    vector<RayCastingState> states(numThreads);
+    vector<RayCastingTask> tasks(numThreads);
+
+    // edges are processed in blocks, one per progress bar step
+    unsigned blockSize = progressBarDisplay ? progressBarStep : vEdgesSize;
+    vector<vector<DebugPoint*> > edgeDebugPoints(blockSize);
+
+    for(unsigned blockStart = 0; blockStart < vEdgesSize; blockStart += blockSize)
+    {
+        unsigned numEdges = min(blockSize, vEdgesSize - blockStart);
+        unsigned nextEdge = 0;
+
+        for(unsigned i = 0; i < numThreads; i++)
+        {
+            RayCastingTask & task = tasks[i];
+            task.builder = this;
+            task.viewMap = ioViewMap;
+            task.grid = iGrid;
+            task.epsilon = epsilon;
+            task.algo = iAlgo;
+            task.edges = &vedges[blockStart];
+            task.numEdges = numEdges;
+            task.nextEdge = &nextEdge;
+            task.edgeDebugPoints = &edgeDebugPoints[0];
+            task.state = &states[i];
+
+            // the first task runs in this thread, as do the ones whose thread could not be created
+            if (i == 0 || pthread_create(&task.thread, NULL, RayCastingThread, &task) != 0)
+                task.thread = pthread_self();
+        }
+
+        RayCastingThread(&tasks[0]);
+
+        for(unsigned i = 1; i < numThreads; i++)
+            if (pthread_equal(tasks[i].thread, pthread_self()))
+                RayCastingThread(&tasks[i]);
+            else
+                pthread_join(tasks[i].thread, NULL);
+
+        // debug points in view edge order, as if the edges had been processed one by one
+        for(unsigned i = 0; i < numEdges; i++)
+        {
+            ioViewMap->addDebugPoints(edgeDebugPoints[i]);
+            edgeDebugPoints[i].clear();
+        }
+
+        if(progressBarDisplay)
+            _pProgressBar->setProgress(_pProgressBar->getProgress() + 1);
+    }
+}
+
+void ViewMapBuilder::ComputeViewEdgeRayCastingVisibility(ViewMap *ioViewMap, ViewEdge *ve, Grid *iGrid, real epsilon,
+                                                         visibility_algo iAlgo, RayCastingState *state)
+{
     FEdge * fe, *festart;
     int nSamples = 0;
     vector<Polygon3r*> aFaces;
@@ -2202,145 +2509,130 @@ void ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, Grid* iGrid
     unsigned qiClasses[256];
     unsigned maxIndex, maxCard;
     unsigned qiMajority;
-    static unsigned timestamp = 1;
-    for(vector<ViewEdge*>::iterator ve=vedges.begin(), veend=vedges.end();
-        ve!=veend;
-        ve++)
-    {
-        festart = (*ve)->fedgeA();
-        fe = (*ve)->fedgeA();
-        qiMajority = 1;
-        do {
-            qiMajority++;
-            fe = fe->nextEdge();
-        } while (fe && fe != festart);
-        //    qiMajority >>= 1;   // halve the number of possible votes. If N/2 votes agree, no point in getting more votes.
 
-        // freestyle used to keep track of QI, but I'm disabling/not supporting
-        // those features -Aaron
+    festart = ve->fedgeA();
+    fe = ve->fedgeA();
+    qiMajority = 1;
+    do {
+        qiMajority++;
+        fe = fe->nextEdge();
+    } while (fe && fe != festart);
+    //    qiMajority >>= 1;   // halve the number of possible votes. If N/2 votes agree, no point in getting more votes.
 
-        tmpQI = 0;
-        maxIndex = 0;
-        maxCard = 0;
-        nSamples = 0;
-        fe = (*ve)->fedgeA();
-        memset(qiClasses, 0, 256 * sizeof(*qiClasses));
+    // freestyle used to keep track of QI, but I'm disabling/not supporting
+    // those features -Aaron
 
-        int visVotes = 0;
-        int invisVotes = 0;
+    tmpQI = 0;
+    maxIndex = 0;
+    maxCard = 0;
+    nSamples = 0;
+    fe = ve->fedgeA();
+    memset(qiClasses, 0, 256 * sizeof(*qiClasses));
 
-        set<ViewShape*> occluders;
-        do
-        {
-            if((maxCard < qiMajority)) {
+    int visVotes = 0;
+    int invisVotes = 0;
 
-                if (iAlgo == punch_out)
-                    tmpQI = ComputeRayCastingVisibilityPunchOut(fe, iGrid,
-                                                                epsilon, occluders, &aFace, timestamp++);
-                else
-                    tmpQI = ComputeRayCastingVisibility(ioViewMap, fe, iGrid, epsilon,
-                                                        occluders, &aFace, timestamp++);
+    set<ViewShape*> occluders;
+    do
+    {
+        if((maxCard < qiMajority)) {
 
-                if (tmpQI != -1)
-                {
-                    if(tmpQI >= 256)
-                        cerr << "Warning: too many occluding levels" << endl;
+            if (iAlgo == punch_out)
+                tmpQI = ComputeRayCastingVisibilityPunchOut(fe, iGrid,
+                                                            epsilon, occluders, &aFace, state->timestamp, state);
+            else
+                tmpQI = ComputeRayCastingVisibility(ioViewMap, fe, iGrid, epsilon,
+                                                    occluders, &aFace, state->timestamp, state);
+            state->timestamp += 2;
 
-                    if (++qiClasses[tmpQI] > maxCard)
-                    {
-                        maxCard = qiClasses[tmpQI];
-                        maxIndex = tmpQI;
-                    }
+            if (tmpQI != -1)
+            {
+                if(tmpQI >= 256)
+                    cerr << "Warning: too many occluding levels" << endl;
 
-                    if (tmpQI == 0)
-                        visVotes ++;
-                    else
-                        invisVotes ++;
+                if (++qiClasses[tmpQI] > maxCard)
+                {
+                    maxCard = qiClasses[tmpQI];
+                    maxIndex = tmpQI;
+                }
 
-                    switch (tmpQI)
-                    {
-                    case 0:
-                        ioViewMap->addDebugPoint(DebugPoint::RAY_TRACE_VISIBLE,fe->center3d());
-                        break;
+                if (tmpQI == 0)
+                    visVotes ++;
+                else
+                    invisVotes ++;
 
-                    case 101:
-                        ioViewMap->addDebugPoint(DebugPoint::INVISIBLE_BACK_FACE, fe->center3d(), true);
-                        break;
+                switch (tmpQI)
+                {
+                case 0:
+                    state->debugPoints->push_back(ViewMap::newDebugPoint(DebugPoint::RAY_TRACE_VISIBLE,fe->center3d()));
+                    break;
 
-                    case 123:
-                        ioViewMap->addDebugPoint(DebugPoint::INVISIBLE_ONE_RING_OVERLAP, fe->center3d(), true);
-                        break;
+                case 101:
+                    state->debugPoints->push_back(ViewMap::newDebugPoint(DebugPoint::INVISIBLE_BACK_FACE, fe->center3d(), true));
+                    break;
 
-                    default:
-                    case 100:
-                        ioViewMap->addDebugPoint(DebugPoint::RAY_TRACE_INVISIBLE,fe->center3d(),true);
-                        break;
-                    }
+                case 123:
+                    state->debugPoints->push_back(ViewMap::newDebugPoint(DebugPoint::INVISIBLE_ONE_RING_OVERLAP, fe->center3d(), true));
+                    break;
+
+                default:
+                case 100:
+                    state->debugPoints->push_back(ViewMap::newDebugPoint(DebugPoint::RAY_TRACE_INVISIBLE,fe->center3d(),true));
+                    break;
                 }
-                else
-                    FindOccludee(fe, iGrid, epsilon, &aFace, timestamp++);
             }
+            else
+                FindOccludee(fe, iGrid, epsilon, &aFace, state->timestamp++, state);
+        }
 
-            if(aFace) {
-                fe->SetaFace(*aFace); aFaces.push_back(aFace);
-                fe->SetOccludeeEmpty(false);
-            } else
-                fe->SetOccludeeEmpty(true);
+        if(aFace) {
+            fe->SetaFace(*aFace); aFaces.push_back(aFace);
+            fe->SetOccludeeEmpty(false);
+        } else
+            fe->SetOccludeeEmpty(true);
 
-            ++nSamples; fe = fe->nextEdge();
-        } while((maxCard < qiMajority) && (0!=fe) && (fe!=festart));
+        ++nSamples; fe = fe->nextEdge();
+    } while((maxCard < qiMajority) && (0!=fe) && (fe!=festart));
 
-        // ViewEdge qi -- (*ve)->SetQI(maxIndex);
+    // ViewEdge qi -- ve->SetQI(maxIndex);
 
-        // I don't care about estimating QI.
-        if (visVotes > invisVotes)
-            (*ve)->SetQI(0);
-        else
-            (*ve)->SetQI(100);
+    // I don't care about estimating QI.
+    if (visVotes > invisVotes)
+        ve->SetQI(0);
+    else
+        ve->SetQI(100);
 
-        if (invisVotes > 0 && visVotes > 0)
-            (*ve)->MarkInconsistent();
+    if (invisVotes > 0 && visVotes > 0)
+        ve->MarkInconsistent();
 
-        if (invisVotes == 0 && visVotes == 0){
-            (*ve)->MarkAmbiguous();
-        }
+    if (invisVotes == 0 && visVotes == 0){
+        ve->MarkAmbiguous();
+    }
 
-        (*ve)->visVotes = visVotes;
-        (*ve)->invisVotes = invisVotes;
+    ve->visVotes = visVotes;
+    ve->invisVotes = invisVotes;
 
-        //    assert(invisVotes + visVotes > 0);
+    //    assert(invisVotes + visVotes > 0);
 
-        // occluders --
-        for(set<ViewShape*>::iterator o=occluders.begin(),    oend=occluders.end(); o!=oend; ++o)
-            (*ve)->AddOccluder((*o));
+    // occluders --
+    for(set<ViewShape*>::iterator o=occluders.begin(),    oend=occluders.end(); o!=oend; ++o)
+        ve->AddOccluder((*o));
 
-        // occludee --
-        if(!aFaces.empty())
+    // occludee --
+    if(!aFaces.empty())
+    {
+        if(aFaces.size() <= (float)nSamples/2.f)
         {
-            if(aFaces.size() <= (float)nSamples/2.f)
-            {
-                (*ve)->SetaShape(0);
-            }
-            else
-            {
-                vector<Polygon3r*>::iterator p = aFaces.begin();
-                WFace * wface = (WFace*)((*p)->userdata);
-                ViewShape *vshape = ioViewMap->viewShape(wface->GetVertex(0)->shape()->GetId());
-                ++p;
-                (*ve)->SetaShape(vshape);
-            }
+            ve->SetaShape(0);
         }
-
-        if(progressBarDisplay)
+        else
         {
-            counter--;
-            if (counter <= 0)
-            {
-                counter = progressBarStep;
-                _pProgressBar->setProgress(_pProgressBar->getProgress() + 1);
-            }
+            vector<Polygon3r*>::iterator p = aFaces.begin();
+            WFace * wface = (WFace*)((*p)->userdata);
+            ViewShape *vshape = ioViewMap->viewShape(wface->GetVertex(0)->shape()->GetId());
+            ++p;
+            ve->SetaShape(vshape);
         }
-        aFaces.clear();
     }
 }
 
@@ -2402,7 +2694,8 @@ void ViewMapBuilder::ComputeFastRayCastingVisibility(ViewMap *ioViewMap, Grid* i
             if (even_test)
             {
                 if((maxCard < qiMajority)) {
-                    tmpQI = ComputeRayCastingVisibility(ioViewMap, fe, iGrid, epsilon, occluders, &aFace, timestamp++);
+                    tmpQI = ComputeRayCastingVisibility(ioViewMap, fe, iGrid, epsilon, occluders, &aFace, timestamp);
+                    timestamp += 2;
 
                     if(tmpQI >= 256)
                         cerr << "Warning: too many occluding levels" << endl;
@@ -2502,7 +2795,8 @@ void ViewMapBuilder::ComputeVeryFastRayCastingVisibility(ViewMap *ioViewMap, Gri
         set<ViewShape*> occluders;
 
         fe = (*ve)->fedgeA();
-        qi = ComputeRayCastingVisibility(ioViewMap, fe, iGrid, epsilon, occluders, &aFace, timestamp++);
+        qi = ComputeRayCastingVisibility(ioViewMap, fe, iGrid, epsilon, occluders, &aFace, timestamp);
+        timestamp += 2;
         if(aFace)
         {
             fe->SetaFace(*aFace);
@@ -2529,7 +2823,8 @@ void ViewMapBuilder::ComputeVeryFastRayCastingVisibility(ViewMap *ioViewMap, Gri
 
 
 void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3r** oaPolygon, unsigned timestamp, 
-                                  Vec3r& u, Vec3r& A, Vec3r& origin, Vec3r& edge, vector<WVertex*>& faceVertices)
+                                  Vec3r& u, Vec3r& A, Vec3r& origin, Vec3r& edge, vector<WVertex*>& faceVertices,
+                                  RayCastingState *state)
 {
     WFace *face = 0;
 
@@ -2556,7 +2851,13 @@ void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3
         occluders.clear();
         // we cast a ray from A in the same direction but looking behind
         Vec3r v(-u[0],-u[1],-u[2]);
-        iGrid->castInfiniteRay(A, v, occluders, timestamp);
+        iGrid->castInfiniteRay(A, v, occluders, timestamp, state ? &state->ray : NULL);
+
+        // all the ray/triangle tests at once
+        OccluderHits localHits;
+        OccluderHits & hits = (state != NULL ? state->hits : localHits);
+        const OccluderTriangles & triangles = iGrid->triangles();
+        triangles.intersect(A, v, occluders, hits);
 
         bool noIntersection = true;
         real mint=FLT_MAX;
@@ -2569,11 +2870,12 @@ void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3
             // check whether the edge and the polygon plane are coincident:
             //-------------------------------------------------------------
             //first let us compute the plane equation.
+            unsigned k = p - occluders.begin();
             oface = (WFace*)(*p)->userdata;
             Vec3r v1(((*p)->getVertices())[0]);
             Vec3r normal((*p)->getNormal());
             real d = -(v1 * normal);
-            real t,t_u,t_v;
+            real t;
 
             if(0 != face)
             {
@@ -2616,8 +2918,9 @@ void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3
                 if(GeomUtils::COINCIDENT == GeomUtils::intersectRayPlane(origin, edge, normal, d, t, epsilon))
                     continue;
             }
-            if((*p)->rayIntersect(A, v, t,t_u,t_v))
+            if(hits.hit[k])
             {
+                t = hits.t[k];
                 if (fabs(v * normal) > 0.0001)
                     if ((t>0.0)) // && (t<1.0))
                     {
@@ -2637,7 +2940,8 @@ void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3
     }
 }
 
-void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3r** oaPolygon, unsigned timestamp)
+void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3r** oaPolygon, unsigned timestamp,
+                                  RayCastingState *state)
 {
     OccludersSet occluders;
 
@@ -2664,14 +2968,14 @@ void ViewMapBuilder::FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3
         face->RetrieveVertexList(faceVertices);
 
     return FindOccludee(fe,iGrid, epsilon, oaPolygon, timestamp,
-                        u, A, origin, edge, faceVertices);
+                        u, A, origin, edge, faceVertices, state);
 }
 
 
 
 
 int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, Grid* iGrid, real epsilon, set<ViewShape*>& oOccluders,
-                                                Polygon3r** oaPolygon, unsigned timestamp)
+                                                Polygon3r** oaPolygon, unsigned timestamp, RayCastingState *state)
 {
     // return -1 for "can't tell"
 
@@ -2755,7 +3059,14 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
 
                 if ((discriminant > 1 || discriminant < -1) && !nearFace->front(false))
                 {	    //	    ignoreOneOccluder = true;
-                    DebugPoint * dp = ioViewMap->addDebugPoint(DebugPoint::INVISIBLE_ONE_RING_OVERLAP, fe->center3d(), true);
+                    DebugPoint * dp;
+                    if (state != NULL)
+                    {
+                        dp = ViewMap::newDebugPoint(DebugPoint::INVISIBLE_ONE_RING_OVERLAP, fe->center3d(), true);
+                        state->debugPoints->push_back(dp);
+                    }
+                    else
+                        dp = ioViewMap->addDebugPoint(DebugPoint::INVISIBLE_ONE_RING_OVERLAP, fe->center3d(), true);
                     dp->debugString = new char[200];
                     sprintf(dp->debugString, "Discriminant: %f\n", discriminant);
                     return 123;
@@ -2826,7 +3137,7 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
         assert(face != NULL);
     }
 
-    iGrid->castRay(center, Vec3r(_viewpoint), occluders, timestamp);
+    iGrid->castRay(center, Vec3r(_viewpoint), occluders, timestamp, state ? &state->ray : NULL);
 
     vector<WVertex*> faceVertices;
     WVertex::incoming_edge_iterator ie;
@@ -2837,6 +3148,12 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
     if(face)
         face->RetrieveVertexList(faceVertices);
 
+    // all the ray/triangle tests at once
+    OccluderHits localHits;
+    OccluderHits & hits = (state != NULL ? state->hits : localHits);
+    const OccluderTriangles & triangles = iGrid->triangles();
+    triangles.intersect(center, u, occluders, hits);
+
     for(p=occluders.begin(),pend=occluders.end();
         p!=pend;
         p++)
@@ -2847,11 +3164,12 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
         // share at least one vertex with the face containing
         // this edge).
         //-----------
+        unsigned k = p - occluders.begin();
         oface = (WXFace*)(*p)->userdata;
         Vec3r v1(((*p)->getVertices())[0]);
         Vec3r normal((*p)->getNormal());
         real d = -(v1 * normal);
-        real t, t_u, t_v;
+        real t;
 
         if (oface == face || oface == face1 || oface == face2)
             continue;
@@ -2901,8 +3219,9 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
                 continue;
         }
 
-        if((*p)->rayIntersect(center, u, t, t_u, t_v))
+        if(hits.hit[k])
         {
+            t = hits.t[k];
             if (fabs(u * normal) > 0.0001)
                 if ((t>0.0) && (t<raylength))
                 {
@@ -2928,8 +3247,8 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
     }
 
     // Find occludee
-    FindOccludee(fe,iGrid, epsilon, oaPolygon, timestamp,
-                 u, center, edge, origin, faceVertices);
+    FindOccludee(fe,iGrid, epsilon, oaPolygon, timestamp + 1,
+                 u, center, edge, origin, faceVertices, state);
 
     return qi;
 }
@@ -2939,7 +3258,7 @@ int ViewMapBuilder::ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, G
 
 
 int ViewMapBuilder::ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid, real epsilon, set<ViewShape*>& oOccluders,
-                                                        Polygon3r** oaPolygon, unsigned timestamp)
+                                                        Polygon3r** oaPolygon, unsigned timestamp, RayCastingState *state)
 {
     OccludersSet occluders;
     int qi = 0;
@@ -3018,7 +3337,7 @@ int ViewMapBuilder::ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid,
 
     //  printf("_viewpoint = %f %f %f\n", _viewpoint[0], _viewpoint[1], _viewpoint[2]);
 
-    iGrid->castRay(center, Vec3r(_viewpoint), occluders, timestamp);
+    iGrid->castRay(center, Vec3r(_viewpoint), occluders, timestamp, state ? &state->ray : NULL);
 
     // the faces this intersection came from
     WXFace * face1 = (WXFace*)fe->getFace1();
@@ -3082,10 +3401,17 @@ int ViewMapBuilder::ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid,
     //    (d) for PO-intersection-curve points: on source triangles
     //    (e) on a PO-intersction-curve surface
 
+    // all the ray/triangle tests at once
+    OccluderHits localHits;
+    OccluderHits & hits = (state != NULL ? state->hits : localHits);
+    const OccluderTriangles & triangles = iGrid->triangles();
+    triangles.intersect(center, u, occluders, hits);
+
     for(p=occluders.begin(),pend=occluders.end();
         p!=pend;
         p++)
     {
+        unsigned k = p - occluders.begin();
         oface = (WXFace*)(*p)->userdata;  // possibly occluding face
 
         if (oface == NULL || oface == face1 || oface == face2)
@@ -3095,13 +3421,11 @@ int ViewMapBuilder::ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid,
         if (oface->sourcePOB() != NULL)
             continue;
 
-        Vec3r v1(((*p)->getVertices())[0]);
         Vec3r normal((*p)->getNormal());
-        real d = -(v1 * normal);
-        real t, t_u, t_v;
+        real t = hits.t[k];
         POType pt;
 
-        bool geomResult = (*p)->rayIntersect(center, u, t, t_u, t_v) &&
+        bool geomResult = hits.hit[k] &&
                 (fabs(u * normal) > 0.0001) && (t>0.0) && (t<raylength);
 
         if (!geomResult)
@@ -3144,8 +3468,8 @@ int ViewMapBuilder::ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid,
     }
 
     // Find occludee
-    FindOccludee(fe,iGrid, epsilon, oaPolygon, timestamp,
-                 u, center, edge, origin, faceVertices);
+    FindOccludee(fe,iGrid, epsilon, oaPolygon, timestamp + 1,
+                 u, center, edge, origin, faceVertices, state);
 
 
     // accurate QI computation is messed-up
@@ -3414,7 +3738,7 @@ void ViewMapBuilder::ComputeCurveIntersections(ViewMap *ioViewMap, visibility_al
 
     for(fe=ioViewMap->FEdges().begin(), fend=ioViewMap->FEdges().end(); fe!=fend; fe++)
     {
-        segment * s = new segment((*fe), (*fe)->vertexA()->point2D(), (*fe)->vertexB()->point2D());
+        segment * s = SL.newSegment((*fe), (*fe)->vertexA()->point2D(), (*fe)->vertexB()->point2D());
         (*fe)->userdata = s;
         segments.push_back(s);
     }
@@ -3460,13 +3784,15 @@ void ViewMapBuilder::ComputeCurveIntersections(ViewMap *ioViewMap, visibility_al
     // ----------------- Brute force intersection test O(n^2) ----------------------
     printf("\t brute force\n");
 
+    SweepLine<FEdge*,Vec3r> SL; // only for its segment and intersection pools
+
     vector<segment* > segments;
 
     vector<FEdge*>::iterator fe,fend;
 
     for(fe=ioViewMap->FEdges().begin(), fend=ioViewMap->FEdges().end(); fe!=fend; fe++)
     {
-        segment * s = new segment((*fe), (*fe)->vertexA()->point2D(), (*fe)->vertexB()->point2D());
+        segment * s = SL.newSegment((*fe), (*fe)->vertexA()->point2D(), (*fe)->vertexB()->point2D());
         (*fe)->userdata = s;
         segments.push_back(s);
     }
@@ -3526,7 +3852,7 @@ void ViewMapBuilder::ComputeCurveIntersections(ViewMap *ioViewMap, visibility_al
 
             if(GeomUtils::intersect2dSeg2dSegParametric(v0, v1, v2, v3, t, u) == GeomUtils::DO_INTERSECT){
                 // create the intersection
-                Intersection<segment> * inter = new Intersection<segment>(S,t,currentS,u);
+                Intersection<segment> * inter = SL.newIntersection(S,t,currentS,u);
                 // add it to the intersections list
                 intersections.push_back(inter);
                 // add this intersection to the first edge intersections list
@@ -3660,7 +3986,7 @@ void ViewMapBuilder::ComputeCurveIntersections(ViewMap *ioViewMap, visibility_al
 
         segment * segsm = NULL;
         segment * segsh = (segment*)feSharp->userdata;
-        Intersection<segment> * inter = new Intersection<segment>(segsm, t_sm, segsh, t_sh);
+        Intersection<segment> * inter = SL.newIntersection(segsm, t_sm, segsh, t_sh);
 
         intersections.push_back(inter);
         iedges.insert(segsh);
@@ -3874,9 +4200,7 @@ void ViewMapBuilder::ComputeCurveIntersections(ViewMap *ioViewMap, visibility_al
         (*fe)->userdata = NULL;
 
 
-    // delete segments
-    for(vector<segment*>::iterator s=segments.begin(); s!= segments.end(); s++)
-        delete *s;
+    // the segments and intersections are freed with the sweep line
     segments.clear();
 
     ViewMap::viewvertices_container& vvertices = ioViewMap->ViewVertices();
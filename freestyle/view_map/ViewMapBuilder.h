@@ -57,6 +57,22 @@ using namespace Geometry;
 typedef enum { VALID, INCONSISTENT, PUNCH_OUT, UNKNOWN } POType;
 
 
+/*! What a ray casting thread does not share with the others:
+ *  its ray state and occluder mailbox in the grid, the timestamps
+ *  of its rays, and the debug points of the view edge it is processing
+ *  (added to the view map afterwards, in view edge order).
+ */
+struct RayCastingState
+{
+    GridRay ray;
+    OccluderHits hits;
+    unsigned timestamp;
+    vector<DebugPoint*> * debugPoints;
+
+    RayCastingState() : timestamp(1), debugPoints(NULL) {}
+};
+
+
 class LIB_VIEW_MAP_EXPORT ViewMapBuilder
 {
 private:
@@ -79,6 +95,8 @@ private:
     real _cuspTrimThreshold;
     real _graftThreshold;
 
+    unsigned _numThreads; // ray casting threads, 0 for one per processor
+
 public:
 
     typedef enum {
@@ -104,6 +122,7 @@ public:
         _EnableQI = true;
         _useConsistency = false;
         _cuspTrimThreshold = 0;
+        _numThreads = 0;
     }
 
     inline ~ViewMapBuilder()
@@ -197,6 +216,9 @@ public:
 
     void SetCuspTrimThreshold(real threshold) { _cuspTrimThreshold = threshold; }
     void SetGraftThreshold(real threshold) { _graftThreshold = threshold; }
+    /*! Number of threads of the ray casting visibility and of the
+   *  self-intersection tests, 0 for one per processor */
+    void SetNumThreads(unsigned numThreads) { _numThreads = numThreads; }
 
     bool HideSmallBits(ViewMap * ioViewMap);
     bool HideDeadEnds(ViewMap * vm);
@@ -205,6 +227,14 @@ public:
 
 protected:
 
+    /*! Traces the self-intersection curve through a pair of candidate faces
+   *  (found in a grid cell or by the hierarchy) into psShape/vshape.
+   *  Pairs already in processed, adjacent or not intersecting are skipped.
+   */
+    void TraceSelfIntersection(WFace *face1, WFace *face2,
+                               set<pair<const WFace*,const WFace*> > &processed,
+                               SShape *psShape, ViewShape *vshape);
+
     /*! Computes the 2D scene silhouette edges visibility
    *  using a ray casting. On each edge, a ray is cast
    *  to check its quantitative invisibility. The list
@@ -221,6 +251,14 @@ protected:
     void ComputeFastRayCastingVisibility(ViewMap *ioViewMap, Grid *iGrid, real epsilon=1e-6);
     void ComputeVeryFastRayCastingVisibility(ViewMap *ioViewMap, Grid *iGrid, real epsilon=1e-6);
 
+    /*! Votes for the visibility of one view edge by casting rays from its fedges
+   *  (ComputeRayCastingVisibility runs this for several edges at a time).
+   *  Only the view edge, its fedges and the given state are modified.
+   */
+    void ComputeViewEdgeRayCastingVisibility(ViewMap *ioViewMap, ViewEdge *ve, Grid *iGrid, real epsilon,
+                                             visibility_algo iAlgo, RayCastingState *state);
+    static void * RayCastingThread(void * arg);
+
     /*! Compute the visibility for the FEdge fe.
    *  The occluders are added to fe occluders list.
    *    fe
@@ -238,19 +276,25 @@ protected:
    *      We use this ray csating operation to determine which shape
    *      lies on fe's right.
    *      The result is the shape id stored in oShapeId
+   *    timestamp
+   *      the ray to the viewpoint uses timestamp, and the ray looking for
+   *      the occludee timestamp+1, so that the occluders examined by the
+   *      first ray are not skipped by the second; callers advance by 2.
    */
     int ComputeRayCastingVisibility(ViewMap *ioViewMap, FEdge *fe, Grid* iGrid, real epsilon, set<ViewShape*>& oOccluders,
-                                    Polygon3r** oaPolygon, unsigned timestamp);
+                                    Polygon3r** oaPolygon, unsigned timestamp, RayCastingState *state = NULL);
     int ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid, real epsilon, set<ViewShape*>& oOccluders,
-                                            Polygon3r** oaPolygon, unsigned timestamp);
+                                            Polygon3r** oaPolygon, unsigned timestamp, RayCastingState *state = NULL);
 
     //  int ComputeRayCastingVisibilityPunchOut(FEdge *fe, Grid* iGrid, real epsilon, set<ViewShape*>& oOccluders,
     //					  Polygon3r** oaPolygon, unsigned timestamp);
 
     // FIXME
-    void FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3r** oaPolygon, unsigned timestamp);
     void FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3r** oaPolygon, unsigned timestamp,
-                      Vec3r& u, Vec3r& A, Vec3r& origin, Vec3r& edge, vector<WVertex*>& faceVertices);
+                      RayCastingState *state = NULL);
+    void FindOccludee(FEdge *fe, Grid* iGrid, real epsilon, Polygon3r** oaPolygon, unsigned timestamp,
+                      Vec3r& u, Vec3r& A, Vec3r& origin, Vec3r& edge, vector<WVertex*>& faceVertices,
+                      RayCastingState *state = NULL);
 
 
     // our region-based visibility algorithm
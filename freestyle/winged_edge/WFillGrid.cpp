@@ -31,6 +31,8 @@ void WFillGrid::fillGrid() {
 
   for (vector<WShape*>::const_iterator it = wshapes.begin();it != wshapes.end(); ++it)
     addShape(*it);
+
+  _grid->build();
 }
 
 void WFillGrid::addShape(WShape *shape)
@@ -46,9 +48,9 @@ void WFillGrid::addShape(WShape *shape)
       for (vector<WVertex*>::const_iterator wv = fvertices.begin(); wv != fvertices.end(); wv++)
 	vectors.push_back(Vec3r((*wv)->GetVertex()));
       
-      // occluder will be deleted by the grid
+      // occluder will be deleted by the grid, which sets its id
+      // and copies its triangle into the grid's triangle buffer
       Polygon3r *occluder = new Polygon3r(vectors, (*f)->GetNormal());
-      occluder->setId(_polygon_id++);
       occluder->userdata = (void*)(*f);
       _grid->insertOccluder(occluder);
       vectors.clear();
@@ -43,7 +43,6 @@ public:
   inline WFillGrid(Grid* grid = 0, WingedEdge* winged_edge = 0) {
     _winged_edge = winged_edge;
     _grid = grid;
-    _polygon_id = 0;
   }
 
   virtual ~WFillGrid() {}
@@ -76,7 +75,6 @@ private:
 
   Grid*		_grid;
   WingedEdge*	_winged_edge;
-  unsigned	_polygon_id;
 };
 
 #endif // WS_FILL_GRID_H
@@ -205,6 +205,14 @@ def runStrokes(s):  # s is the settings module/class
                                    '-cuspTrimThreshold',str(s.cuspTrimThreshold),
                                    '-graftThreshold',str(s.graftThreshold),
                                    '-wiggleFactor',str(s.wiggleFactor),
+                                   '-plyFormat',getattr(s,'plyFormat','binary'),
+                                   '-savePLY',str(getattr(s,'savePLY',True)),
+                                   '-parallelRefine',str(getattr(s,'parallelRefine',False)),
+                                   '-adaptiveArea',str(getattr(s,'adaptiveArea',0)),
+                                   '-profile',str(getattr(s,'profile',False)),
+                                   '-occluderBVH',str(getattr(s,'occluderBVH',False)),
+                                   '-benchmarkOccluders',str(getattr(s,'benchmarkOccluders',False)),
+                                   '-radialCurvatures',str(getattr(s,'radialCurvatures',False)),
                                    '-useOrientation',str(useOrientation),
                                    '-useConsistency',str(useConsistencyLocal),
                                    '-outputImage',snapshotFilename,
@@ -218,6 +226,12 @@ def runStrokes(s):  # s is the settings module/class
             if exclusionPattern != None:
                 rifargs = rifargs +' -exclude "'+exclusionPattern+'"'
 
+            if getattr(s,'temporalReuse',False):
+                temporalCacheFolder = outputFolder+'/'+meshBasename+'_temporal'
+                if not os.path.exists(temporalCacheFolder):
+                    os.makedirs(temporalCacheFolder)
+                rifargs = rifargs +' -temporalCache '+temporalCacheFolder
+
             rifargs = rifargs + ' -rifend'
         
             cmd = 'prman -rif %s %s %s'%(dso,rifargs,headerFilename)
@@ -231,13 +245,16 @@ def runStrokes(s):  # s is the settings module/class
         
         # ----- count the number of faces in the geometry files (to be able to tell if it's empty -----
         if s.renderStrokes:
-            f = open(geomFilename)
             numFaces = -1
-            for line in f:
-                if line[0:12] == 'element face':
-                    numFaces = int(line[13:])
-                    break
-            f.close()
+            if fileExists(geomFilename):
+                f = open(geomFilename)
+                for line in f:
+                    if line[0:12] == 'element face':
+                        numFaces = int(line[13:])
+                        break
+                f.close()
+            elif runRIF:
+                numFaces = 1  # geometry went to Freestyle in memory without a PLY file
 
         ############################ RENDER STROKES IMAGE USING FREESTYLE #########################
 
@@ -296,6 +313,7 @@ def runStrokes(s):  # s is the settings module/class
                 sys.exit(1)
 
             if numFaces > 0:
+                Freestyle.setOccludersFS(getattr(s,'occluderBVH',False), getattr(s,'benchmarkOccluders',False))
                 Freestyle.run(geomFilename,snapshotFilename, EPSFilenamePolyline, EPSFilenameThick,
                               arrayToMatrix(cameraData['worldTransform']),
                               cameraData['left'], cameraData['right'], cameraData['bottom'], cameraData['top'],
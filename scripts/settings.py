@@ -20,6 +20,16 @@ meshSmoothing = 0.75       # smoothing to apply to triangle meshes when initiali
 
 wiggleFactor = 0           # wiggling of the vertices in freestyle to avoid degenerated cases
 
+plyFormat = 'binary'       # 'ascii' writes human-readable PLY files (for debugging)
+savePLY = True             # write the PLY file even when Freestyle runs inside the RIF (it gets the mesh in memory)
+parallelRefine = False     # split independent faces concurrently; reproducible, but differs from the serial refinement
+temporalReuse = False      # start each frame's refinement from the previous frame's mesh (consecutive frames only)
+adaptiveArea = 0           # target pixel area of the initial triangles; 0 samples every face at subdivisionLevel
+profile = False            # write per-object and per-frame stage timings and counters to <mesh>_profile.json
+occluderBVH = False        # Freestyle ray casting against a BVH of the faces instead of the uniform grid
+benchmarkOccluders = False # Freestyle prints the timings of both occluder structures on the visibility rays
+radialCurvatures = False   # radial curvature (PLY and Freestyle vertex data) and isophote distance of the output vertices
+
 # when computing mesh contours and ray-tests in Freestyle, take the consistency flags into account.
 # ignored when refinement == 'None'
 useConsistency = True
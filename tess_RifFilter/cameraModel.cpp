@@ -71,6 +71,37 @@ bool CameraModel::TriangleInside(const vec3 & p0, const vec3 & p1, const vec3 &
 }
 
 
+// conservative test for a set of points whose convex hull bounds a surface (e.g., the control
+// points around a subdivision face): false only if all points are outside the same clipping plane.
+// the test is done in homogeneous camera coordinates, so points behind the camera are handled
+bool CameraModel::HullInside(const std::vector<vec3> & pts) const
+{
+    bool outside[6] = { true, true, true, true, true, true };
+
+    for(size_t i=0;i<pts.size();i++)
+    {
+        vec4 pt2 = vec4(pts[i][0],pts[i][1],pts[i][2],1) * _cameraMatrix;
+
+        outside[0] = outside[0] && _focalLength * pt2[0] < _left * pt2[2];
+        outside[1] = outside[1] && _focalLength * pt2[0] > _right * pt2[2];
+        outside[2] = outside[2] && _focalLength * pt2[1] < _bottom * pt2[2];
+        outside[3] = outside[3] && _focalLength * pt2[1] > _top * pt2[2];
+        outside[4] = outside[4] && pt2[2] < _near;
+        outside[5] = outside[5] && pt2[2] > _far;
+    }
+
+    for(int i=0;i<6;i++)
+        if (outside[i])
+            return false;
+
+    return true;
+}
+
+bool CameraModel::InFrontOfNearPlane(const vec3 & pt) const
+{
+    vec4 pt2 = vec4(pt[0],pt[1],pt[2],1) * _cameraMatrix;
+    return pt2[2] >= _near;
+}
 
 vec3 CameraModel::Project(const vec3 & pt) const
 {
@@ -94,7 +125,7 @@ real CameraModel::ImageSpaceArea(const vec3 & p0, const vec3 & p1, const vec3 &
 
     vec3 n = v2 ^ v1;
 
-    return 0.5*n*n;
+    return 0.5*length(n);
 }
 
 
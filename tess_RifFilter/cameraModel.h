@@ -1,6 +1,7 @@
 #ifndef __CAMERA_MODEL_H__
 #define __CAMERA_MODEL_H__
 
+#include <vector>
 #include "VecMat.h"
 using namespace VecMat;
 
@@ -17,6 +18,8 @@ public:
     CameraModel(const mat4 & cameraMatrix, float near, float far, float left, float right, float top, float bottom, float xres, float yres, float focalLength, vec3 cameraCenter);
     bool PointInside(const vec3 & pt) const;
     bool TriangleInside(const vec3 & p0, const vec3 & p1, const vec3 & p2) const;
+    bool HullInside(const std::vector<vec3> & pts) const;  // can the convex hull of pts intersect the frustum?
+    bool InFrontOfNearPlane(const vec3 & p) const;         // can p be projected (e.g., by ImageSpaceArea)?
     vec3 Project(const vec3 & p) const;
     vec3 CameraCenter() const { return _cameraCenter; }
     real ImageSpaceArea(const vec3 & p0, const vec3 & p1, const vec3 & p2) const;
@@ -3,6 +3,9 @@
 
 #include "paramPoint.h"
 
+#include <vector>
+#include <pthread.h>
+
 // A chart is a bijective mapping between R^2 and a local neighborhood on a base mesh.  Different kinds of charts may be defined for different kinds of neighborhoods, and need not be isometric w.r.t. each other
 
 // A vertex-centered chart defines a mapping for all faces in the one-ring of a given vertex.  Different cases depending on triangle vs. quads and extraordinary vs. regular, boundary vs. interior
@@ -22,22 +25,34 @@ private:
     HbrFace<T> * _face;
 
 public:
-    FaceMapQuad() { _origin = NULL; _face = NULL; } // for STL initalizers
+    FaceMapQuad() { _origin = NULL; _face = NULL; } // for array initializers
     FaceMapQuad(HbrVertex<T> * origin, HbrFace<T> * face);
     bool ParamToAB(const ParamPoint<T> & pt, real & a, real & b) const;
     ParamPoint<T> ABtoParam(real a, real b) const;
     bool PointInside(const ParamPoint<T> & pt) const;
+    HbrFace<T> * Face() const { return _face; }
 };
 
-// general vertex-centered chart data-structure
+// general vertex-centered chart data-structure.  A regular vertex has four faces and nine
+// vertices (itself included) in its chart, so they are stored in small flat arrays; the (A,B)
+// coordinates of the vertices are all in {-1,0,1}.
 template<class T>
 class Chart
 {
 private:
     HbrVertex<T> * _origin; // vertex at the center of the chart
 
-    std::map<HbrFace<T>*, FaceMapQuad<T> > _faces; // list of adjacent faces and their UV<->AB mappings
-    std::map<HbrVertex<T>*, std::pair<real, real> > _verts; // list of vertices in the one-ring and their (A,B) coordinates
+    enum { MAX_FACES = 4, MAX_VERTS = 9 };
+
+    int _numFaces;
+    FaceMapQuad<T> _faces[MAX_FACES];   // adjacent faces and their UV<->AB mappings, in ring order
+
+    int _numVerts;
+    HbrVertex<T> * _verts[MAX_VERTS];   // vertices in the one-ring
+    signed char _vertAB[MAX_VERTS][2];  // and their (A,B) coordinates
+
+    int FindVertex(const HbrVertex<T> * v) const;
+    const FaceMapQuad<T> * FindFace(const HbrFace<T> * f) const;
 
 public:
     Chart(HbrVertex<T> * origin);
@@ -46,6 +61,37 @@ public:
     bool PointInside(const ParamPoint<T> & pt) const;
 };
 
+// The charts of the regular vertices of one source mesh, indexed by vertex ID and built on first
+// use; FindChart returns charts from here, so they must not be deleted.  Owned by the surface's
+// evaluator (Subdiv), which SurfaceToMesh creates once the source mesh is refined.
+template<class T>
+class ChartCache : public ChartCacheBase
+{
+private:
+    std::vector<Chart<T>*> _charts;  // NULL until built
+    pthread_mutex_t _mutex;          // serializes building; lookups of built charts do not lock
+    long _numBuilt;
+
+    ChartCache(const ChartCache &);
+    ChartCache & operator=(const ChartCache &);
+
+public:
+    ChartCache(int numVertices);
+    ~ChartCache();
+
+    // chart centered at a regular vertex (valence 4, not on the boundary)
+    const Chart<T> * Get(HbrVertex<T> * origin);
+
+    void PrintStats() const;
+
+    static ChartCache<T> & Get(const HbrMesh<T> * mesh)
+    {
+        Subdiv * subdiv = Subdiv::Get(mesh);
+        assert(subdiv != NULL && subdiv->chartCache != NULL);
+        return *static_cast<ChartCache<T>*>(subdiv->chartCache);
+    }
+};
+
 
 
 #include "chartFunctions.h"
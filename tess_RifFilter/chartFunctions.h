@@ -127,61 +127,87 @@ Chart<T>::Chart(HbrVertex<T>* origin)
     assert(origin->GetValence() == 4 && !origin->OnBoundary());
 
     _origin = origin;
+    _numFaces = 0;
+    _numVerts = 0;
 
     // collect the faces in the one-ring
-    std::list<HbrHalfedge<T>*> edges;
+    std::vector<HbrHalfedge<T>*> edges;
     origin->GetSurroundingEdges(std::back_inserter(edges));
 
-    for(typename std::list<HbrHalfedge<T>*>::iterator it = edges.begin(); it != edges.end(); ++it)
+    for(typename std::vector<HbrHalfedge<T>*>::iterator it = edges.begin(); it != edges.end(); ++it)
     {
-        if ( (*it)->GetLeftFace() != NULL && _faces.find( (*it)->GetLeftFace()) == _faces.end())
-            _faces[(*it)->GetLeftFace()] = FaceMapQuad<T>(origin, (*it)->GetLeftFace() );
+        HbrFace<T> * sides[2] = { (*it)->GetLeftFace(), (*it)->GetRightFace() };
 
-        if ( (*it)->GetRightFace() != NULL && _faces.find( (*it)->GetRightFace()) == _faces.end())
-            _faces[(*it)->GetRightFace()] = FaceMapQuad<T>(origin, (*it)->GetRightFace() );
+        for(int j=0;j<2;j++)
+            if (sides[j] != NULL && FindFace(sides[j]) == NULL)
+            {
+                assert(_numFaces < MAX_FACES);
+                _faces[_numFaces++] = FaceMapQuad<T>(origin, sides[j]);
+            }
     }
 
     // Get the AB coordinates for each vertex in the one-ring
 
-    for(typename std::map<HbrFace<T>*, FaceMapQuad<T> >::const_iterator it = _faces.begin(); it != _faces.end(); ++it)
+    for(int f=0;f<_numFaces;f++)
     {
-        HbrFace<T> * face = (*it).first;
+        HbrFace<T> * face = _faces[f].Face();
         for(int i=0;i<face->GetNumVertices();i++)
         {
             HbrVertex<T> * vert = face->GetVertex(i);
-            if (_verts.find(vert) == _verts.end())
+            if (FindVertex(vert) == -1)
             {
                 real a, b;
-                bool result = (*it).second.ParamToAB(ParamPoint<T>(vert), a, b);
+                bool result = _faces[f].ParamToAB(ParamPoint<T>(vert), a, b);
                 assert(result);
-                _verts[vert] = std::pair<real,real>(a,b);
+                assert(_numVerts < MAX_VERTS);
+                _verts[_numVerts] = vert;
+                _vertAB[_numVerts][0] = (signed char)a;
+                _vertAB[_numVerts][1] = (signed char)b;
+                _numVerts ++;
             }
         }
     }
 }
 
+template<class T>
+int Chart<T>::FindVertex(const HbrVertex<T> * v) const
+{
+    for(int i=0;i<_numVerts;i++)
+        if (_verts[i] == v)
+            return i;
+    return -1;
+}
+
+template<class T>
+const FaceMapQuad<T> * Chart<T>::FindFace(const HbrFace<T> * f) const
+{
+    for(int i=0;i<_numFaces;i++)
+        if (_faces[i].Face() == f)
+            return &_faces[i];
+    return NULL;
+}
+
 template<class T>
 bool Chart<T>::ParamToAB(const ParamPoint<T> & pt, real & a, real & b) const
 {
     if (pt.SourceVertex() != NULL)
     {
-        typename std::map<HbrVertex<T>*,std::pair<real,real> >::const_iterator vit = _verts.find(pt.SourceVertex());
-        if (vit == _verts.end())
+        int i = FindVertex(pt.SourceVertex());
+        if (i == -1)
             return false;
-        a = (*vit).second.first;
-        b = (*vit).second.second;
-        assert(a>=-1 && a<=1 && b>=-1 && b<=1);
+        a = _vertAB[i][0];
+        b = _vertAB[i][1];
         return true;
     }
 
     if (pt.SourceFace() != NULL)
     {
-        typename std::map<HbrFace<T>*, FaceMapQuad<T> >::const_iterator fit = _faces.find(pt.SourceFace());
+        const FaceMapQuad<T> * map = FindFace(pt.SourceFace());
 
-        if (fit == _faces.end())
+        if (map == NULL)
             return false;
 
-        bool result = (*fit).second.ParamToAB(pt, a, b);
+        bool result = map->ParamToAB(pt, a, b);
         assert(result);
         return true;
     }
@@ -189,15 +215,15 @@ bool Chart<T>::ParamToAB(const ParamPoint<T> & pt, real & a, real & b) const
     HbrHalfedge<T> * edge = pt.SourceEdge();
     assert(edge != NULL);
 
-    if (_verts.find(edge->GetOrgVertex()) == _verts.end() || _verts.find(edge->GetDestVertex()) == _verts.end())
-        return false;
+    int i0 = FindVertex(edge->GetOrgVertex());
+    int i1 = FindVertex(edge->GetDestVertex());
 
-    std::pair<real,real> AB0 = (*_verts.find(edge->GetOrgVertex())).second;
-    std::pair<real,real> AB1 = (*_verts.find(edge->GetDestVertex())).second;
+    if (i0 == -1 || i1 == -1)
+        return false;
 
     real t = pt.EdgeT();
-    a = (1-t)*AB0.first  + t*AB1.first;
-    b = (1-t)*AB0.second + t*AB1.second;
+    a = (1-t)*_vertAB[i0][0] + t*_vertAB[i1][0];
+    b = (1-t)*_vertAB[i0][1] + t*_vertAB[i1][1];
 
     assert(a>=-1 && a<=1 && b>=-1 && b<=1);
     return true;
@@ -212,9 +238,9 @@ ParamPoint<T> Chart<T>::ABtoParam(real a, real b) const
 
     // need special treatment to check if we're on an edge?
 
-    for(typename std::map<HbrFace<T>*, FaceMapQuad<T> >::const_iterator it = _faces.begin(); it != _faces.end(); ++it)
+    for(int i=0;i<_numFaces;i++)
     {
-        ParamPoint<T> pt = (*it).second.ABtoParam(a,b);
+        ParamPoint<T> pt = _faces[i].ABtoParam(a,b);
 
         if (!pt.IsNull())
             return pt;
@@ -226,9 +252,55 @@ ParamPoint<T> Chart<T>::ABtoParam(real a, real b) const
 template<class T>
 bool Chart<T>::PointInside(const ParamPoint<T> & pt) const
 {
-    for(typename std::map<HbrFace<T>*, FaceMapQuad<T> >::iterator it = _faces.begin(); it != _faces.end(); ++it)
-        if ((*it).second.PointInside(pt))
+    for(int i=0;i<_numFaces;i++)
+        if (_faces[i].PointInside(pt))
             return true;
 
     return true;
 }
+
+template<class T>
+ChartCache<T>::ChartCache(int numVertices)
+    : _charts(numVertices, (Chart<T>*)NULL)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    _numBuilt = 0;
+}
+
+template<class T>
+ChartCache<T>::~ChartCache()
+{
+    for(size_t i=0;i<_charts.size();i++)
+        delete _charts[i];
+    pthread_mutex_destroy(&_mutex);
+}
+
+template<class T>
+const Chart<T> * ChartCache<T>::Get(HbrVertex<T> * origin)
+{
+    int id = origin->GetID();
+    assert(id >= 0 && id < (int)_charts.size());
+
+    // the slot is published with release semantics after the chart is complete
+    Chart<T> * chart = __atomic_load_n(&_charts[id], __ATOMIC_ACQUIRE);
+    if (chart != NULL)
+        return chart;
+
+    pthread_mutex_lock(&_mutex);
+    chart = _charts[id];
+    if (chart == NULL)
+    {
+        chart = new Chart<T>(origin);
+        __atomic_store_n(&_charts[id], chart, __ATOMIC_RELEASE);
+        _numBuilt ++;
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return chart;
+}
+
+template<class T>
+void ChartCache<T>::PrintStats() const
+{
+    printf("Chart cache: %ld charts built for %d vertices\n", _numBuilt, (int)_charts.size());
+}
@@ -7,10 +7,10 @@
 
 #include "refineContour.h"
 
-typedef HbrMesh<VertexDataCatmark> Mesh;
-typedef HbrVertex<VertexDataCatmark> MeshVertex;
-typedef HbrFace<VertexDataCatmark> MeshFace;
-typedef HbrHalfedge<VertexDataCatmark> MeshEdge;
+typedef TriMesh<VertexDataCatmark> Mesh;
+typedef TriVertex<VertexDataCatmark> MeshVertex;
+typedef TriFace<VertexDataCatmark> MeshFace;
+typedef TriHalfedge<VertexDataCatmark> MeshEdge;
 
 
 struct FlowLinePoint;
@@ -2,11 +2,14 @@
 #define __MESHFUNCTIONS_H__
 
 #include "paramPoint.h"
+#include "triangleMesh.h"
 
 #include <list>
+#include <vector>
+#include <algorithm>
 
 template<class T>
-HbrVertex<T> * GetOtherVertex(const HbrFace<T> * face, const HbrVertex<T> * v1, const HbrVertex<T> * v2)
+TriVertex<T> * GetOtherVertex(const TriFace<T> * face, const TriVertex<T> * v1, const TriVertex<T> * v2)
 {
     for(int i=0;i<3;i++)
         if (face->GetVertex(i) != v1 && face->GetVertex(i) != v2)
@@ -16,7 +19,7 @@ HbrVertex<T> * GetOtherVertex(const HbrFace<T> * face, const HbrVertex<T> * v1,
 }
 
 template<class T>
-int GetOtherVertexIndex(const HbrFace<T> * face, const HbrVertex<T> * v1, const HbrVertex<T> * v2)
+int GetOtherVertexIndex(const TriFace<T> * face, const TriVertex<T> * v1, const TriVertex<T> * v2)
 {
     for(int i=0;i<3;i++)
         if (face->GetVertex(i) != v1 && face->GetVertex(i) != v2)
@@ -34,19 +37,19 @@ vec3 GetNormal(const vec3 & p0, const vec3 & p1, const vec3 & p2)
 }
 
 template<class T>
-vec3 GetNormal(const HbrVertex<T> * v0, const HbrVertex<T> * v1, const HbrVertex<T> * v2)
+vec3 GetNormal(const TriVertex<T> * v0, const TriVertex<T> * v1, const TriVertex<T> * v2)
 {
     return GetNormal(v0->GetData().pos, v1->GetData().pos, v2->GetData().pos);
 }
 
 template<class T>
-vec3 GetNormal(const HbrFace<T> * face)
+vec3 GetNormal(const TriFace<T> * face)
 {
     return GetNormal(face->GetVertex(0), face->GetVertex(1), face->GetVertex(2));
 }
 
 template<class T>
-real GetArea(const HbrVertex<T> * v0, const HbrVertex<T> * v1, const HbrVertex<T> * v2)
+real GetArea(const TriVertex<T> * v0, const TriVertex<T> * v1, const TriVertex<T> * v2)
 {
     vec3 normal = GetNormal<T>(v0,v1,v2);
     return  normal*normal/2.;
@@ -60,13 +63,13 @@ real GetArea(const vec3 & p0, const vec3 & p1, const vec3 p2)
 }
 
 template<class T>
-real GetArea(HbrVertex<T> * const * v)
+real GetArea(TriVertex<T> * const * v)
 {
     return GetArea<T>(v[0],v[1],v[2]);
 }
 
 template<class T>
-real GetArea(const HbrFace<T> * face)
+real GetArea(const TriFace<T> * face)
 {
     return GetArea<T>(face->GetVertex(0), face->GetVertex(1), face->GetVertex(2));
 }
@@ -108,21 +111,21 @@ int NearestVertex(real u, real v, real & uvert, real & vvert)
 
 
 template<class T>
-HbrFace<T> * NewFace(HbrMesh<T> * outputMesh, HbrVertex<T> * v1, HbrVertex<T> * v2,HbrVertex<T> * v3)
+TriFace<T> * NewFace(TriMesh<T> * outputMesh, TriVertex<T> * v1, TriVertex<T> * v2,TriVertex<T> * v3)
 {
     int vtx[3] = { v1->GetID(), v2->GetID(), v3->GetID() };
 
-    HbrFace<T> * result =  outputMesh->NewFace(3,vtx,0);
+    TriFace<T> * result =  outputMesh->NewFace(3,vtx,0);
     assert(result != NULL);
     return result;
 }
 
 template<class T>
-HbrFace<T> * NewFace(HbrMesh<T> * outputMesh, HbrVertex<T> * v1, HbrVertex<T> * v2,HbrVertex<T> * v3,HbrVertex<T> * v4)
+TriFace<T> * NewFace(TriMesh<T> * outputMesh, TriVertex<T> * v1, TriVertex<T> * v2,TriVertex<T> * v3,TriVertex<T> * v4)
 {
     int vtx[4] = { v1->GetID(), v2->GetID(), v3->GetID(), v4->GetID() };
 
-    HbrFace<T>* result =  outputMesh->NewFace(4,vtx,0);
+    TriFace<T>* result =  outputMesh->NewFace(4,vtx,0);
     assert(result != NULL);
     return result;
 }
@@ -257,8 +260,8 @@ bool FaceHasVertex(const HbrFace<T> * face, const HbrVertex<T> * vert,int * inde
     return false;
 }
 
-template<class T>
-bool FaceHasEdge(const HbrFace<T> * face, const HbrHalfedge<T> * edge)
+template<class T, template<class> class Face, template<class> class Halfedge>
+bool FaceHasEdge(const Face<T> * face, const Halfedge<T> * edge)
 {
     if (face == NULL || edge == NULL)
         return false;
@@ -370,22 +373,22 @@ int GetEdgeIndex(HbrVertex<T> * source, HbrVertex<T> * target)
 
 
 template<class T>
-HbrFace<T> * GetOppFace(const HbrFace<T> * face, int oppVertex, int & eOpp)
+TriFace<T> * GetOppFace(const TriFace<T> * face, int oppVertex, int & eOpp)
 {
-    HbrHalfedge<T> * adjEdge = face->GetEdge( (oppVertex+1)%3);
+    TriHalfedge<T> * adjEdge = face->GetEdge( (oppVertex+1)%3);
     assert(adjEdge != NULL);  // why doesn't this crash at boundaries?
 
     // check my assumptions
     assert(adjEdge->GetOrgVertex() != face->GetVertex(oppVertex) &&
             adjEdge->GetDestVertex() != face->GetVertex(oppVertex));
 
-    HbrFace<T> * oppFace = adjEdge->GetLeftFace() == face ? adjEdge->GetRightFace() : adjEdge->GetLeftFace();
+    TriFace<T> * oppFace = adjEdge->GetLeftFace() == face ? adjEdge->GetRightFace() : adjEdge->GetLeftFace();
 
     if (oppFace != NULL)
     {
         for(int i=0;i<3;i++)
         {
-            HbrHalfedge<T> * edge = oppFace->GetEdge((i+1)%3);
+            TriHalfedge<T> * edge = oppFace->GetEdge((i+1)%3);
             if (edge->GetLeftFace() == face || edge->GetRightFace() == face)
             {
                 eOpp = i;
@@ -402,42 +405,98 @@ HbrFace<T> * GetOppFace(const HbrFace<T> * face, int oppVertex, int & eOpp)
 }
 
 template<class T>
-HbrFace<T> * GetOppFace(const HbrFace<T> * face, int oppVertex)
+TriFace<T> * GetOppFace(const TriFace<T> * face, int oppVertex)
 {
-    HbrHalfedge<T> * edge = face->GetEdge( (oppVertex+1)%3);
-    HbrFace<T> * oppFace = edge->GetLeftFace() == face ? edge->GetRightFace() : edge->GetLeftFace();
+    TriHalfedge<T> * edge = face->GetEdge( (oppVertex+1)%3);
+    TriFace<T> * oppFace = edge->GetLeftFace() == face ? edge->GetRightFace() : edge->GetLeftFace();
     return oppFace;
 }
 
 template<class T>
-void GetOneRing(HbrVertex<T> * vertex, std::set<HbrFace<T>*> & faces)
+inline void AddUnique(std::vector<T> & elements, const T & element)
+{
+    if (std::find(elements.begin(), elements.end(), element) == elements.end())
+        elements.push_back(element);
+}
+
+// The one-ring functions run on the source meshes (Hbr) as well as on the refined meshes (TriMesh);
+// MeshTypes gives the face and halfedge types that go with a vertex type.
+template<class Vertex> struct MeshTypes;
+template<class T> struct MeshTypes<HbrVertex<T> > { typedef HbrFace<T> Face; typedef HbrHalfedge<T> Halfedge; };
+template<class T> struct MeshTypes<TriVertex<T> > { typedef TriFace<T> Face; typedef TriHalfedge<T> Halfedge; };
+
+// faces around a vertex, in ring order and without duplicates.  Walks the halfedges directly, like
+// HbrVertex::GetSurroundingEdges does, without building a list; valences are small, so the
+// duplicate check is a linear scan.  Prefer this to the std::set version when just iterating.
+template<class T, template<class> class Vertex>
+void GetOneRing(Vertex<T> * vertex, std::vector<typename MeshTypes<Vertex<T> >::Face*> & faces)
 {
-    std::list<HbrHalfedge<T>*> edges;
-    vertex->GetSurroundingEdges(std::back_inserter(edges));
+    typedef typename MeshTypes<Vertex<T> >::Halfedge Halfedge;
 
-    for(typename std::list<HbrHalfedge<T>*>::iterator it = edges.begin(); it != edges.end(); ++it)
+    faces.clear();
+
+    Halfedge * start = vertex->GetIncidentEdge();
+    Halfedge * edge = start;
+
+    while (edge != NULL)
     {
-        if ( (*it)->GetLeftFace() != NULL)
-            faces.insert( (*it)->GetLeftFace() );
-        if ( (*it)->GetRightFace() != NULL)
-            faces.insert( (*it)->GetRightFace() );
+        if (edge->GetLeftFace() != NULL)
+            AddUnique(faces, edge->GetLeftFace());
+        if (edge->GetRightFace() != NULL)
+            AddUnique(faces, edge->GetRightFace());
+
+        Halfedge * next = vertex->GetNextEdge(edge);
+        if (next == start)
+            break;
+
+        if (next == NULL)
+        {
+            // last edge of an open ring
+            Halfedge * prev = edge->GetPrev();
+            if (prev->GetLeftFace() != NULL)
+                AddUnique(faces, prev->GetLeftFace());
+            if (prev->GetRightFace() != NULL)
+                AddUnique(faces, prev->GetRightFace());
+        }
+        edge = next;
     }
 }
 
+template<class T, template<class> class Vertex>
+void GetOneRing(Vertex<T> * vertex, std::set<typename MeshTypes<Vertex<T> >::Face*> & faces)
+{
+    std::vector<typename MeshTypes<Vertex<T> >::Face*> ring;
+    GetOneRing<T>(vertex, ring);
+    faces.insert(ring.begin(), ring.end());
+}
+
+// vertices sharing a face with this vertex, in ring order and without duplicates
 template<class T>
-void GetOneRingVertices(HbrVertex<T> * vertex, std::set<HbrVertex<T>*> & oneRingVertices)
+void GetOneRingVertices(TriVertex<T> * vertex, std::vector<TriVertex<T>*> & oneRingVertices)
 {
-    std::set<HbrFace<T>*> oneRing;
-    GetOneRing<T>(vertex,oneRing);
-    for(typename std::set<HbrFace<T>*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
+    std::vector<TriFace<T>*> oneRing;
+    GetOneRing<T>(vertex, oneRing);
+
+    oneRingVertices.clear();
+    for(typename std::vector<TriFace<T>*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
         for(int i=0;i<3;i++)
-            oneRingVertices.insert((*fit)->GetVertex(i));
-    oneRingVertices.erase(oneRingVertices.find(vertex));
+            if ((*fit)->GetVertex(i) != vertex)
+                AddUnique(oneRingVertices, (*fit)->GetVertex(i));
 }
 
-
+// adds the vertices sharing a face with this vertex; the vertex itself is not added, nor erased if it is
+// already in the set
 template<class T>
-int GetVertexIndex(const HbrFace<T> * face, const HbrVertex<T> * v)
+void GetOneRingVertices(TriVertex<T> * vertex, std::set<TriVertex<T>*> & oneRingVertices)
+{
+    std::vector<TriVertex<T>*> ring;
+    GetOneRingVertices<T>(vertex, ring);
+    oneRingVertices.insert(ring.begin(), ring.end());
+}
+
+
+template<class T, template<class> class Face, template<class> class Vertex>
+int GetVertexIndex(const Face<T> * face, const Vertex<T> * v)
 {
     assert(face->GetNumVertices() == 3 || face->GetNumVertices() == 4);
 
@@ -448,25 +507,24 @@ int GetVertexIndex(const HbrFace<T> * face, const HbrVertex<T> * v)
     return -1;
 }
 
+// Laplacian of v_center as if it were located at centerPos; the mesh is not modified
 template<class T>
-vec3 Laplacian(HbrVertex<T> * v_center, std::set<HbrVertex<T>*> & oneRingVertices)
+vec3 Laplacian(TriVertex<T> * v_center, const vec3 & centerPos, const std::vector<TriVertex<T>*> & oneRingVertices)
 {
     vec3 laplacian(0,0,0);
     real totalWeight = 0;
 
-    const vec3 centerPos = v_center->GetData().pos;
-
-    for(typename std::set<HbrVertex<T>*>::iterator it=oneRingVertices.begin(); it!=oneRingVertices.end();++it)
+    for(typename std::vector<TriVertex<T>*>::const_iterator it=oneRingVertices.begin(); it!=oneRingVertices.end();++it)
     {
-        HbrHalfedge<T> * edge = v_center->GetEdge( *it) != NULL ? v_center->GetEdge(*it) : (*it)->GetEdge(v_center);
+        TriHalfedge<T> * edge = v_center->GetEdge( *it) != NULL ? v_center->GetEdge(*it) : (*it)->GetEdge(v_center);
 
-        HbrFace<T> * faces[2] = { edge->GetLeftFace() , edge->GetRightFace() };
+        TriFace<T> * faces[2] = { edge->GetLeftFace() , edge->GetRightFace() };
 
         real weight = 0;
         for(int j=0;j<2;j++)
             if (faces[j] != NULL)
             {
-                HbrFace<T> * face = faces[j];
+                TriFace<T> * face = faces[j];
                 int i = GetVertexIndex<T>(face,v_center);
                 vec3 e0 = (face->GetVertex( (i+1)%3 )->GetData().pos - centerPos );
                 vec3 e1 = (face->GetVertex( (i+2)%3 )->GetData().pos - centerPos );
@@ -477,12 +535,12 @@ vec3 Laplacian(HbrVertex<T> * v_center, std::set<HbrVertex<T>*> & oneRingVertice
                 e0.normalize();
                 e1.normalize();
 
-                weight += tanl( acosl(e0*e1) /2 );
+                weight += std::tan( std::acos(e0*e1) /2 );
 
                 assert(weight == weight); // check for nan
             }
 
-        vec3 vec = (*it)->GetData().pos - v_center->GetData().pos;
+        vec3 vec = (*it)->GetData().pos - centerPos;
         if (length(vec) < 1e-10)
             continue;
 
@@ -503,22 +561,30 @@ vec3 Laplacian(HbrVertex<T> * v_center, std::set<HbrVertex<T>*> & oneRingVertice
     return laplacian;
 }
 
+template<class T>
+vec3 Laplacian(TriVertex<T> * v_center, const std::vector<TriVertex<T>*> & oneRingVertices)
+{
+    return Laplacian<T>(v_center, v_center->GetData().pos, oneRingVertices);
+}
+
 
 template<class T>
-vec3 Laplacian(HbrVertex<T> * v_center)
+vec3 Laplacian(TriVertex<T> * v_center)
 {
-    std::set<HbrVertex<T>*> oneRingVertices;
+    std::vector<TriVertex<T>*> oneRingVertices;
     GetOneRingVertices<T>(v_center, oneRingVertices);
     return Laplacian(v_center, oneRingVertices);
 }
 
 
-template <class T>
-vec3 FaceAveragedVertexNormal(HbrVertex<T> * vertex)
+template <class T, template<class> class Vertex>
+vec3 FaceAveragedVertexNormal(Vertex<T> * vertex)
 {
+    typedef typename MeshTypes<Vertex<T> >::Face Face;
+
     // what is the best weighting to use?
 
-    std::set<HbrFace<T>*> faces;
+    std::vector<Face*> faces;
 
     GetOneRing<T>(vertex, faces);
 
@@ -530,9 +596,9 @@ vec3 FaceAveragedVertexNormal(HbrVertex<T> * vertex)
 
     // weights from this paper: https://computing.llnl.gov/vis/images/pdf/max_jgt99.pdf
     // equation 3  (might be inaccurate at boundaries?)
-    for(typename std::set<HbrFace<T>*>::iterator it = faces.begin(); it != faces.end(); ++it)
+    for(typename std::vector<Face*>::iterator it = faces.begin(); it != faces.end(); ++it)
     {
-        HbrFace<T> * face = *it;
+        Face * face = *it;
         int i = GetVertexIndex<T>(face,vertex);
         vec3 v0 = vec3(face->GetVertex( (i+1)%3 )->GetData().GetPos()) - centerPos;
         vec3 v1 = vec3(face->GetVertex( (i+2)%3 )->GetData().GetPos()) - centerPos ;
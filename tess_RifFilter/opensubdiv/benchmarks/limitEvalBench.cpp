@@ -0,0 +1,151 @@
+//
+//   Copyright 2013 Pixar
+//
+//   Licensed under the Apache License, Version 2.0 (the "Apache License")
+//   with the following modification; you may not use this file except in
+//   compliance with the Apache License and the following modification to it:
+//   Section 6. Trademarks. is deleted and replaced with:
+//
+//   6. Trademarks. This License does not grant permission to use the trade
+//      names, trademarks, service marks, or product names of the Licensor
+//      and its affiliates, except as required to comply with Section 4(c) of
+//      the License and to reproduce the content of the NOTICE file.
+//
+//   You may obtain a copy of the Apache License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the Apache License with the above modification is
+//   distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+//   KIND, either express or implied. See the Apache License for the specific
+//   language governing permissions and limitations under the Apache License.
+//
+
+// Compares the per-sample B-spline limit kernel (evalBSpline) against the
+// batched kernel (evalBSplineSamples) on a synthetic set of patches, with
+// positions, first and second derivatives.
+//
+//   limitEvalBench [numPatches] [samplesPerPatch] [repeats]
+
+#include "../osd/cpuEvalLimitKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+using namespace OpenSubdiv;
+
+static double
+seconds() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+static real
+frand() {
+    return real(rand()) / real(RAND_MAX);
+}
+
+int
+main(int argc, char ** argv) {
+
+    int numPatches = argc > 1 ? atoi(argv[1]) : 10000,
+        samplesPerPatch = argc > 2 ? atoi(argv[2]) : 8,
+        repeats = argc > 3 ? atoi(argv[3]) : 10;
+
+    if (numPatches <= 0 or samplesPerPatch <= 0 or repeats <= 0) {
+        printf("usage: %s [numPatches] [samplesPerPatch] [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+
+    // 16 independent control points per patch, 3 coordinates each
+    int numVerts = numPatches*16;
+
+    std::vector<real> verts(numVerts*3);
+    for (size_t i=0; i<verts.size(); ++i)
+        verts[i] = frand();
+
+    std::vector<unsigned int> indices(numVerts);
+    for (int i=0; i<numVerts; ++i)
+        indices[i] = i;
+
+    int numSamples = numPatches*samplesPerPatch;
+
+    std::vector<real> u(numSamples), v(numSamples);
+    for (int i=0; i<numSamples; ++i) {
+        u[i] = frand();
+        v[i] = frand();
+    }
+
+    OsdVertexBufferDescriptor desc(0, 3, 3);
+
+    std::vector<real> P0(numSamples*3), Du0(numSamples*3), Dv0(numSamples*3),
+                      Duu0(numSamples*3), Dvv0(numSamples*3), Duv0(numSamples*3);
+    std::vector<real> P1(numSamples*3), Du1(numSamples*3), Dv1(numSamples*3),
+                      Duu1(numSamples*3), Dvv1(numSamples*3), Duv1(numSamples*3);
+
+    double t0 = seconds();
+
+    for (int r=0; r<repeats; ++r) {
+        for (int i=0; i<numSamples; ++i) {
+            unsigned int const * cvs = &indices[(i/samplesPerPatch)*16];
+            int o = i*3;
+            evalBSpline(u[i], v[i], cvs, desc, &verts[0], desc,
+                        &P0[o], &Du0[o], &Dv0[o], &Duu0[o], &Dvv0[o], &Duv0[o]);
+        }
+    }
+
+    double t1 = seconds();
+
+    real cvs[16*3];
+    int outIndex[OSD_EVAL_LIMIT_BATCH_SIZE];
+
+    for (int r=0; r<repeats; ++r) {
+        for (int p=0; p<numPatches; ++p) {
+
+            gatherRegularCVs(&indices[p*16], desc, &verts[0], cvs);
+
+            for (int s=0; s<samplesPerPatch; s+=OSD_EVAL_LIMIT_BATCH_SIZE) {
+
+                int first = p*samplesPerPatch + s,
+                    n = std::min(OSD_EVAL_LIMIT_BATCH_SIZE, samplesPerPatch-s);
+
+                for (int k=0; k<n; ++k)
+                    outIndex[k] = first+k;
+
+                evalBSplineSamples(n, &u[first], &v[first], cvs, 3, outIndex, desc,
+                                   &P1[0], &Du1[0], &Dv1[0], &Duu1[0], &Dvv1[0], &Duv1[0]);
+            }
+        }
+    }
+
+    double t2 = seconds();
+
+    real maxErr = 0.0f;
+    for (int i=0; i<numSamples*3; ++i) {
+        maxErr = std::max(maxErr, std::abs(P0[i]-P1[i]));
+        maxErr = std::max(maxErr, std::abs(Du0[i]-Du1[i]));
+        maxErr = std::max(maxErr, std::abs(Dv0[i]-Dv1[i]));
+        maxErr = std::max(maxErr, std::abs(Duu0[i]-Duu1[i]));
+        maxErr = std::max(maxErr, std::abs(Dvv0[i]-Dvv1[i]));
+        maxErr = std::max(maxErr, std::abs(Duv0[i]-Duv1[i]));
+    }
+
+    double evals = double(numSamples)*repeats;
+
+    printf("%d patches, %d samples per patch, %d repeats, sizeof(real) = %d\n",
+           numPatches, samplesPerPatch, repeats, (int)sizeof(real));
+    printf("evalBSpline        : %8.2f ns/sample\n", 1e9*(t1-t0)/evals);
+    printf("evalBSplineSamples : %8.2f ns/sample\n", 1e9*(t2-t1)/evals);
+    printf("speedup            : %8.2fx\n", (t1-t0)/(t2-t1));
+    printf("max difference     : %g\n", (double)maxErr);
+
+    return 0;
+}
@@ -105,6 +105,12 @@ public:
         vertexClientData[id] = data;
     }
 
+    // Ask for client data associated with the mesh
+    void* GetClientData() const { return clientData; }
+
+    // Set client data associated with the mesh. The mesh does not own it.
+    void SetClientData(void *data) { clientData = data; }
+
     // Create face from a list of vertex IDs
     HbrFace<T>* NewFace(int nvertices, const int *vtx, int uindex);
 
@@ -419,6 +425,9 @@ private:
     // deemed temporary
     bool m_transientMode;
 
+    // Client data associated with the mesh
+    void *clientData;
+
     // Vertices which are transient
     std::vector<HbrVertex<T>*> m_transientVertices;
 
@@ -486,7 +495,8 @@ HbrMesh<T>::HbrMesh(HbrSubdivision<T>* s, int _fvarcount, const int *_fvarindice
       m_numCoarseFaces(-1),
       hasVertexEdits(0),
       hasCreaseEdits(0),
-      m_transientMode(false) {
+      m_transientMode(false),
+      clientData(0) {
 }
 
 template <class T>
@@ -26,6 +26,10 @@
 #include "../osd/cpuEvalLimitKernel.h"
 #include "../far/patchTables.h"
 
+#include <cassert>
+#include <cstdlib>
+#include <string.h>
+
 namespace OpenSubdiv {
 namespace OPENSUBDIV_VERSION {
 
@@ -47,6 +51,110 @@ computeSubPatchCoords( OsdCpuEvalLimitContext * context, unsigned int patchIdx,
     bits.Rotate( u, v );
 }
 
+// Number of samples of the same bicubic patch from which EvalLimitSamples
+// evaluates them together with evalBSplineSamples.  The batched kernel only
+// beats evalBSpline with doubles, from about 3 samples per patch (see
+// benchmarks/limitEvalBench).  Long doubles do not fit in vector registers,
+// so the long double build does not batch at all.
+#define OSD_EVAL_LIMIT_MIN_BATCH 4
+
+// Vertex interpolation of one sample with the scalar kernels, written at
+// index in the outputs.  Boundary and corner patches are evaluated by
+// evalBSpline on their gathered control points, like in evalBSplineSamples,
+// so that they get the same second derivatives whichever path is taken.
+// Gregory patches have no second derivatives.
+static void
+evalLimitSampleScalar( OsdCpuEvalLimitContext * context,
+                       FarPatchMap::Handle const * handle,
+                       real u, real v,
+                       OsdVertexBufferDescriptor const & inDesc,
+                       real const * inQ,
+                       OsdVertexBufferDescriptor const & outDesc,
+                       int index,
+                       real * outQ,
+                       real * outDQU,
+                       real * outDQV,
+                       real * outDQUDQU,
+                       real * outDQVDQV,
+                       real * outDQUDQV ) {
+
+    static unsigned int const gatheredIndices[16] = { 0, 1, 2, 3, 4, 5, 6, 7,
+                                                      8, 9,10,11,12,13,14,15 };
+
+    FarPatchTables::PatchArray const & parray = context->GetPatchArrayVector()[ handle->patchArrayIdx ];
+
+    unsigned int const * cvs = &context->GetControlVertices()[ parray.GetVertIndex() + handle->vertexOffset ];
+
+    FarPatchTables::Type type = parray.GetDescriptor().GetType();
+
+    int length = inDesc.length,
+        offset = outDesc.stride * index;
+
+    real * out     = outQ ? outQ+offset : 0,
+         * outDu   = outDQU ? outDQU+offset : 0,
+         * outDv   = outDQV ? outDQV+offset : 0,
+         * outDuDu = outDQUDQU ? outDQUDQU+offset : 0,
+         * outDvDv = outDQVDQV ? outDQVDQV+offset : 0,
+         * outDuDv = outDQUDQV ? outDQUDQV+offset : 0;
+
+    switch( type ) {
+
+        case FarPatchTables::REGULAR  : evalBSpline( v, u, cvs,
+                                                     inDesc,
+                                                     inQ,
+                                                     outDesc,
+                                                     out, outDu, outDv, outDuDu, outDvDv, outDuDv );
+                                        break;
+
+        case FarPatchTables::BOUNDARY :
+        case FarPatchTables::CORNER   : {
+                                        real * patchCVs = (real*)alloca(16*length*sizeof(real));
+
+                                        if (type==FarPatchTables::BOUNDARY)
+                                            gatherBoundaryCVs( cvs, inDesc, inQ, patchCVs );
+                                        else
+                                            gatherCornerCVs( cvs, inDesc, inQ, patchCVs );
+
+                                        evalBSpline( v, u, gatheredIndices,
+                                                     OsdVertexBufferDescriptor(0, length, length),
+                                                     patchCVs,
+                                                     outDesc,
+                                                     out, outDu, outDv, outDuDu, outDvDv, outDuDv );
+                                        }
+                                        break;
+
+        case FarPatchTables::GREGORY  : evalGregory( v, u, cvs,
+                                                     &context->GetVertexValenceTable()[0],
+                                                     &context->GetQuadOffsetTable()[ parray.GetQuadOffsetIndex() + handle->vertexOffset ],
+                                                     context->GetMaxValence(),
+                                                     inDesc,
+                                                     inQ,
+                                                     outDesc,
+                                                     out, outDu, outDv );
+                                        break;
+
+        case FarPatchTables::GREGORY_BOUNDARY :
+                                        evalGregoryBoundary( v, u, cvs,
+                                                             &context->GetVertexValenceTable()[0],
+                                                             &context->GetQuadOffsetTable()[ parray.GetQuadOffsetIndex() + handle->vertexOffset ],
+                                                             context->GetMaxValence(),
+                                                             inDesc,
+                                                             inQ,
+                                                             outDesc,
+                                                             out, outDu, outDv );
+                                        break;
+
+        default:
+            assert(0);
+    }
+
+    if (type==FarPatchTables::GREGORY or type==FarPatchTables::GREGORY_BOUNDARY) {
+        if (outDuDu) memset(outDuDu+outDesc.offset, 0, length*sizeof(real));
+        if (outDvDv) memset(outDvDv+outDesc.offset, 0, length*sizeof(real));
+        if (outDuDv) memset(outDuDv+outDesc.offset, 0, length*sizeof(real));
+    }
+}
+
 // Vertex interpolation of a sample at the limit
 int
 OsdCpuEvalLimitController::EvalLimitSample( OpenSubdiv::OsdEvalCoords const & coord,
@@ -71,72 +179,129 @@ OsdCpuEvalLimitController::EvalLimitSample( OpenSubdiv::OsdEvalCoords const & co
 
     computeSubPatchCoords(context, handle->patchIdx, u, v);
 
-    FarPatchTables::PatchArray const & parray = context->GetPatchArrayVector()[ handle->patchArrayIdx ];
+    VertexData const & vertexData = _currentBindState.vertexData;
 
-    unsigned int const * cvs = &context->GetControlVertices()[ parray.GetVertIndex() + handle->vertexOffset ];
+    if (vertexData.in) {
+        evalLimitSampleScalar( context, handle, u, v,
+                               vertexData.inDesc, vertexData.in, outDesc, 0,
+                               outQ, outDQU, outDQV, outDQUDQU, outDQVDQV, outDQUDQV );
+    }
+
+    return 1;
+}
+
+// Vertex interpolation of a set of samples at the limit
+int
+OsdCpuEvalLimitController::EvalLimitSamples( OpenSubdiv::OsdEvalCoords const * coords,
+                                             int const * order,
+                                             int n,
+                                             OsdCpuEvalLimitContext * context,
+                                             OsdVertexBufferDescriptor const & outDesc,
+                                             real * outQ,
+                                             real * outDQU,
+                                             real * outDQV,
+                                             real * outDQUDQU,
+                                             real * outDQVDQV,
+                                             real * outDQUDQV) const {
 
     VertexData const & vertexData = _currentBindState.vertexData;
 
-    if (vertexData.in) {
-    
-        real * out   = outQ ? outQ + outDesc.offset : 0,
-                * outDu = outDQU ? outDQU + outDesc.offset : 0,
-                * outDv = outDQV ? outDQV + outDesc.offset : 0,
-                * outDuDu = outDQUDQU ? outDQUDQU + outDesc.offset : 0,
-                * outDvDv = outDQVDQV ? outDQVDQV + outDesc.offset : 0,
-                * outDuDv = outDQUDQV ? outDQUDQV + outDesc.offset : 0;
-
-        switch( parray.GetDescriptor().GetType() ) {
-
-            case FarPatchTables::REGULAR  : evalBSpline( v, u, cvs,
-                                                         vertexData.inDesc,
-                                                         vertexData.in,
-                                                         outDesc,
-                                                         out, outDu, outDv, outDuDu, outDvDv, outDuDv );
-                                            break;
-
-            case FarPatchTables::BOUNDARY : evalBoundary( v, u, cvs,
-                                                          vertexData.inDesc,
-                                                          vertexData.in,
-                                                          outDesc,
-                                                          out, outDu, outDv );
-                                            break;
-
-            case FarPatchTables::CORNER   : evalCorner( v, u, cvs,
-                                                        vertexData.inDesc,
-                                                        vertexData.in,
-                                                        outDesc,
-                                                        out, outDu, outDv );
-                                            break;
-
-
-            case FarPatchTables::GREGORY  : evalGregory( v, u, cvs,
-                                                         &context->GetVertexValenceTable()[0],
-                                                         &context->GetQuadOffsetTable()[ parray.GetQuadOffsetIndex() + handle->vertexOffset ],
-                                                         context->GetMaxValence(),
-                                                         vertexData.inDesc,
-                                                         vertexData.in,
-                                                         outDesc,
-                                                         out, outDu, outDv );
-                                            break;
-
-            case FarPatchTables::GREGORY_BOUNDARY :
-                                            evalGregoryBoundary( v, u, cvs,
-                                                                 &context->GetVertexValenceTable()[0],
-                                                                 &context->GetQuadOffsetTable()[ parray.GetQuadOffsetIndex() + handle->vertexOffset ],
-                                                                 context->GetMaxValence(),
-                                                                 vertexData.inDesc,
-                                                                 vertexData.in,
-                                                                 outDesc,
-                                                                 out, outDu, outDv );
-                                            break;
-
-            default:
-                assert(0);
+    int length = vertexData.inDesc.length;
+
+    // control points of the current batch patch (16 points, see
+    // evalBSplineSamples)
+    real * patchCVs = (real*)alloca(16*length*sizeof(real));
+
+    real batchU[OSD_EVAL_LIMIT_BATCH_SIZE],
+         batchV[OSD_EVAL_LIMIT_BATCH_SIZE];
+    int batchIndex[OSD_EVAL_LIMIT_BATCH_SIZE],
+        batchSize = 0;
+
+    FarPatchMap::Handle const * batchHandle = 0;
+
+    int found = 0;
+
+    for (int s=0; s<=n; ++s) {
+
+        FarPatchMap::Handle const * handle = 0;
+
+        int index = 0;
+
+        real u=0.0f, v=0.0f;
+
+        if (s<n) {
+            index = order ? order[s] : s;
+
+            u = coords[index].u;
+            v = coords[index].v;
+
+            // the map may not be able to return a handle if there is a hole or
+            // the face index is incorrect
+            handle = context->GetPatchMap().FindPatch( coords[index].face, u, v );
+
+            if (handle) {
+                computeSubPatchCoords(context, handle->patchIdx, u, v);
+                ++found;
+            }
+        }
+
+        // flush the pending batch once the patch changes or the batch is full
+        if (batchSize>0 and
+            (handle!=batchHandle or batchSize==OSD_EVAL_LIMIT_BATCH_SIZE)) {
+
+            if (batchSize>=OSD_EVAL_LIMIT_MIN_BATCH) {
+
+                FarPatchTables::PatchArray const & parray = context->GetPatchArrayVector()[ batchHandle->patchArrayIdx ];
+
+                unsigned int const * cvs = &context->GetControlVertices()[ parray.GetVertIndex() + batchHandle->vertexOffset ];
+
+                switch (parray.GetDescriptor().GetType()) {
+                    case FarPatchTables::REGULAR  : gatherRegularCVs( cvs, vertexData.inDesc, vertexData.in, patchCVs ); break;
+                    case FarPatchTables::BOUNDARY : gatherBoundaryCVs( cvs, vertexData.inDesc, vertexData.in, patchCVs ); break;
+                    default                       : gatherCornerCVs( cvs, vertexData.inDesc, vertexData.in, patchCVs ); break;
+                }
+
+                evalBSplineSamples( batchSize, batchV, batchU,
+                                    patchCVs, length,
+                                    batchIndex, outDesc,
+                                    outQ, outDQU, outDQV, outDQUDQU, outDQVDQV, outDQUDQV );
+            } else {
+                for (int b=0; b<batchSize; ++b) {
+                    evalLimitSampleScalar( context, batchHandle, batchU[b], batchV[b],
+                                           vertexData.inDesc, vertexData.in, outDesc, batchIndex[b],
+                                           outQ, outDQU, outDQV, outDQUDQU, outDQVDQV, outDQUDQV );
+                }
+            }
+            batchSize = 0;
+        }
+
+        if (not handle or not vertexData.in)
+            continue;
+
+#ifdef OPENSUBDIV_REAL_DOUBLE
+        FarPatchTables::PatchArray const & parray = context->GetPatchArrayVector()[ handle->patchArrayIdx ];
+
+        FarPatchTables::Type type = parray.GetDescriptor().GetType();
+
+        if (type==FarPatchTables::REGULAR or
+            type==FarPatchTables::BOUNDARY or
+            type==FarPatchTables::CORNER) {
+
+            batchHandle = handle;
+            batchU[batchSize] = u;
+            batchV[batchSize] = v;
+            batchIndex[batchSize] = index;
+            ++batchSize;
+            continue;
         }
+#endif
+
+        evalLimitSampleScalar( context, handle, u, v,
+                               vertexData.inDesc, vertexData.in, outDesc, index,
+                               outQ, outDQU, outDQV, outDQUDQU, outDQVDQV, outDQUDQV );
     }
 
-    return 1;
+    return found;
 }
 
 // Vertex interpolation of samples at the limit
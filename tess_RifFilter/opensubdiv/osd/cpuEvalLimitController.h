@@ -179,6 +179,43 @@ public:
                          real * outDQVDQV,
                          real * outDQUDQV) const;
 
+    /// \brief Vertex interpolation of a set of samples at the limit
+    ///
+    /// Evaluates "vertex" interpolation of n samples on the surface limit.
+    /// With double precision, runs of at least 4 consecutive samples (in
+    /// visiting order) that fall on the same regular, boundary or corner
+    /// patch are evaluated together by evalBSplineSamples, so callers
+    /// should sort the samples by face. The other samples, and all of them
+    /// with long double precision, are evaluated one at a time as in
+    /// EvalLimitSample. Second derivatives are zero on Gregory patches.
+    ///
+    /// @param coords   locations on the limit surface to be evaluated
+    ///
+    /// @param order    visiting order of the samples (optional). Sample
+    ///                 coords[i] is always written at index i of the outputs.
+    ///
+    /// @param n        number of samples
+    ///
+    /// @param context  the EvalLimitContext that the controller will evaluate
+    ///
+    /// @param outDesc  data descriptor (offset, length, stride)
+    ///
+    /// @param outQ     output vertex data (optional)
+    ///
+    /// @return the number of samples found
+    ///
+    int EvalLimitSamples(OpenSubdiv::OsdEvalCoords const * coords,
+                         int const * order,
+                         int n,
+                         OsdCpuEvalLimitContext * context,
+                         OsdVertexBufferDescriptor const & outDesc,
+                         real * outQ,
+                         real * outDQU,
+                         real * outDQV,
+                         real * outDQUDQU,
+                         real * outDQVDQV,
+                         real * outDQUDQV) const;
+
     /// \brief Vertex interpolation of samples at the limit
     ///
     /// Evaluates "vertex" interpolation of a sample on the surface limit.
@@ -1161,5 +1161,233 @@ evalGregoryBoundary(real u, real v,
 }
 
 
+
+void
+gatherRegularCVs(unsigned int const * vertexIndices,
+                 OsdVertexBufferDescriptor const & inDesc,
+                 real const * inQ,
+                 real * cvs) {
+
+    int length = inDesc.length;
+
+    real const * inOffset = inQ + inDesc.offset;
+
+    for (int m=0; m<16; ++m) {
+        memcpy(cvs + m*length, inOffset + vertexIndices[m]*inDesc.stride, length*sizeof(real));
+    }
+}
+
+void
+gatherBoundaryCVs(unsigned int const * vertexIndices,
+                  OsdVertexBufferDescriptor const & inDesc,
+                  real const * inQ,
+                  real * cvs) {
+
+    int length = inDesc.length;
+
+    real const * inOffset = inQ + inDesc.offset;
+
+    // row j==0 is mirrored (see evalBoundary)
+    for (int i=0; i<4; ++i) {
+
+        real const * v  = inOffset + vertexIndices[i]*inDesc.stride,
+                   * vn = inOffset + vertexIndices[i+4]*inDesc.stride;
+
+        for (int k=0; k<length; ++k) {
+            cvs[i*length+k] = 2.0f*v[k] - vn[k];
+        }
+    }
+
+    for (int j=1; j<4; ++j) {
+        for (int i=0; i<4; ++i) {
+            memcpy(cvs + (i+j*4)*length, inOffset + vertexIndices[i+(j-1)*4]*inDesc.stride, length*sizeof(real));
+        }
+    }
+}
+
+void
+gatherCornerCVs(unsigned int const * vertexIndices,
+                OsdVertexBufferDescriptor const & inDesc,
+                real const * inQ,
+                real * cvs) {
+
+    int length = inDesc.length;
+
+    real const * inOffset = inQ + inDesc.offset;
+
+    real *M = (real*)alloca(length*7*sizeof(real));
+
+    real const *v0 = inOffset + vertexIndices[0]*inDesc.stride,
+                *v1 = inOffset + vertexIndices[1]*inDesc.stride,
+                *v2 = inOffset + vertexIndices[2]*inDesc.stride,
+                *v3 = inOffset + vertexIndices[3]*inDesc.stride,
+                *v4 = inOffset + vertexIndices[4]*inDesc.stride,
+                *v5 = inOffset + vertexIndices[5]*inDesc.stride,
+                *v7 = inOffset + vertexIndices[7]*inDesc.stride,
+                *v8 = inOffset + vertexIndices[8]*inDesc.stride;
+
+    // mirrored points, see evalCorner
+    for (int k=0; k<length; ++k) {
+        M[0*length+k] = 2.0f*v0[k] - v3[k];
+        M[1*length+k] = 2.0f*v1[k] - v4[k];
+        M[2*length+k] = 2.0f*v2[k] - v5[k];
+
+        M[4*length+k] = 2.0f*v2[k] - v1[k];
+        M[5*length+k] = 2.0f*v5[k] - v4[k];
+        M[6*length+k] = 2.0f*v8[k] - v7[k];
+
+        M[3*length+k] = 2.0f*M[2*length+k] - M[1*length+k];
+    }
+
+    for (int i=0; i<4; ++i) {
+        for (int j=0; j<4; ++j) {
+
+            real const * in = NULL;
+
+            if (j==0) {
+                in = &M[i*length];
+            } else if (i==3) {
+                in = &M[(j+3)*length];
+            } else {
+                in = inOffset + vertexIndices[i+(j-1)*3]*inDesc.stride;
+            }
+
+            memcpy(cvs + (i+j*4)*length, in, length*sizeof(real));
+        }
+    }
+}
+
+// Runtime dispatch between an AVX2 and a baseline (SSE2 on x86-64) build of
+// the accumulation loop.  Requires GCC function multi-versioning (ifunc).
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && \
+    defined(__x86_64__) && defined(__linux__)
+#define OSD_TARGET_CLONES __attribute__((target_clones("avx2","default")))
+#else
+#define OSD_TARGET_CLONES
+#endif
+
+// samples are accumulated in groups of 4 lanes (one AVX register of doubles)
+#define OSD_EVAL_LIMIT_LANES 4
+
+// acc[k][s] = sum_m cvs[m][k] * W[m][s], for s < groups*OSD_EVAL_LIMIT_LANES
+OSD_TARGET_CLONES
+static void
+accumulateBSplineSamples(int groups, real const * cvs, int length,
+                         real const (*W)[OSD_EVAL_LIMIT_BATCH_SIZE],
+                         real (*acc)[OSD_EVAL_LIMIT_BATCH_SIZE]) {
+
+    for (int k=0; k<length; ++k) {
+        for (int g=0; g<groups; ++g) {
+
+            real a[OSD_EVAL_LIMIT_LANES] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+            for (int m=0; m<16; ++m) {
+
+                real c = cvs[m*length+k];
+                real const * w = W[m] + g*OSD_EVAL_LIMIT_LANES;
+
+                for (int s=0; s<OSD_EVAL_LIMIT_LANES; ++s)
+                    a[s] += c * w[s];
+            }
+
+            for (int s=0; s<OSD_EVAL_LIMIT_LANES; ++s)
+                acc[k][g*OSD_EVAL_LIMIT_LANES+s] = a[s];
+        }
+    }
+}
+
+void
+evalBSplineSamples(int n, real const * u, real const * v,
+                   real const * cvs, int length,
+                   int const * outIndex,
+                   OsdVertexBufferDescriptor const & outDesc,
+                   real * outQ,
+                   real * outDQU,
+                   real * outDQV,
+                   real * outDQUDQU,
+                   real * outDQVDQV,
+                   real * outDQUDQV) {
+
+    assert( n>0 and n<=OSD_EVAL_LIMIT_BATCH_SIZE );
+    assert( length <= (outDesc.stride-outDesc.offset) );
+
+    const int N = OSD_EVAL_LIMIT_BATCH_SIZE;
+
+    bool evalDeriv = (outDQU or outDQV);
+    bool evalSecondDeriv = (outDQUDQU or outDQVDQV or outDQUDQV);
+
+    int groups = (n + OSD_EVAL_LIMIT_LANES - 1) / OSD_EVAL_LIMIT_LANES,
+        lanes = groups * OSD_EVAL_LIMIT_LANES;
+
+    // per-sample weights of the 16 control points, one table per output.
+    // Padding lanes (n <= s < lanes) get zero weights.
+    real WQ[16][N], WU[16][N], WV[16][N], WUU[16][N], WVV[16][N], WUV[16][N];
+
+    for (int s=0; s<lanes; ++s) {
+
+        real Bu[4], Du[4], DDu[4], Bv[4], Dv[4], DDv[4];
+
+        if (s<n) {
+            evalCubicBSpline(u[s], Bu, Du, DDu);
+            evalCubicBSpline(v[s], Bv, Dv, DDv);
+        } else {
+            for (int i=0; i<4; ++i)
+                Bu[i] = Du[i] = DDu[i] = Bv[i] = Dv[i] = DDv[i] = 0.0f;
+        }
+
+        // same weights as evalBSpline, point i+j*4
+        for (int j=0; j<4; ++j) {
+            for (int i=0; i<4; ++i) {
+                WQ[i+j*4][s] = Bu[j] * Bv[i];
+                if (evalDeriv) {
+                    WU[i+j*4][s] = Du[j] * Bv[i];
+                    WV[i+j*4][s] = Bu[j] * Dv[i];
+                }
+                if (evalSecondDeriv) {
+                    WUU[i+j*4][s] =  Bu[i] * DDv[j];
+                    WVV[i+j*4][s] = DDu[i] *  Bv[j];
+                    WUV[i+j*4][s] = 0.0f;
+                }
+            }
+        }
+
+        if (evalSecondDeriv) {
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) {
+                    real weight = Du[j]*Dv[i];
+                    WUV[i*4+j][s]       += weight;
+                    WUV[i*4+j+1][s]     -= weight;
+                    WUV[(i+1)*4+j][s]   -= weight;
+                    WUV[(i+1)*4+j+1][s] += weight;
+                }
+            }
+        }
+    }
+
+    real (*acc)[N] = (real(*)[N])alloca(length*N*sizeof(real));
+
+    struct { real (*W)[N]; real * out; } outputs[6] = {
+        { WQ,  outQ      },
+        { WU,  outDQU    },
+        { WV,  outDQV    },
+        { WUU, outDQUDQU },
+        { WVV, outDQVDQV },
+        { WUV, outDQUDQV } };
+
+    for (int o=0; o<6; ++o) {
+
+        if (not outputs[o].out)
+            continue;
+
+        accumulateBSplineSamples(groups, cvs, length, outputs[o].W, acc);
+
+        for (int s=0; s<n; ++s) {
+            real * out = outputs[o].out + outIndex[s]*outDesc.stride + outDesc.offset;
+            for (int k=0; k<length; ++k)
+                out[k] = acc[k][s];
+        }
+    }
+}
+
 }  // end namespace OPENSUBDIV_VERSION
 }  // end namespace OpenSubdiv
@@ -99,6 +99,50 @@ evalGregoryBoundary(real u, real v,
                     real * outDQU,
                     real * outDQV );
 
+// Maximum number of samples of one patch evaluated together by
+// evalBSplineSamples.
+#define OSD_EVAL_LIMIT_BATCH_SIZE 8
+
+// Gather the 16 control points of a regular, boundary or corner patch into
+// cvs (16*inDesc.length values, point i+j*4 at cvs+(i+j*4)*inDesc.length).
+// Boundary and corner patches get their mirrored points, as in evalBoundary
+// and evalCorner.
+void
+gatherRegularCVs(unsigned int const * vertexIndices,
+                 OsdVertexBufferDescriptor const & inDesc,
+                 real const * inQ,
+                 real * cvs);
+
+void
+gatherBoundaryCVs(unsigned int const * vertexIndices,
+                  OsdVertexBufferDescriptor const & inDesc,
+                  real const * inQ,
+                  real * cvs);
+
+void
+gatherCornerCVs(unsigned int const * vertexIndices,
+                OsdVertexBufferDescriptor const & inDesc,
+                real const * inQ,
+                real * cvs);
+
+// Evaluate up to OSD_EVAL_LIMIT_BATCH_SIZE samples (u[s],v[s]) of the same
+// bicubic B-spline patch, including second derivatives.  Sample s is written
+// at out + outIndex[s]*outDesc.stride + outDesc.offset; any output may be
+// NULL.  Computes the same quantities as evalBSpline, with the samples in the
+// innermost loop so that the accumulation vectorizes (AVX2 or SSE2, selected
+// at runtime where the compiler supports function multi-versioning).
+void
+evalBSplineSamples(int n, real const * u, real const * v,
+                   real const * cvs, int length,
+                   int const * outIndex,
+                   OsdVertexBufferDescriptor const & outDesc,
+                   real * outQ,
+                   real * outDQU,
+                   real * outDQV,
+                   real * outDQUDQU,
+                   real * outDQVDQV,
+                   real * outDQUDQV);
+
 }  // end namespace OPENSUBDIV_VERSION
 using namespace OPENSUBDIV_VERSION;
 
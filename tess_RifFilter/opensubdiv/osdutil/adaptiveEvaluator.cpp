@@ -34,9 +34,14 @@
 #include "../osd/ompComputeController.h"
 #endif
 
+#ifdef OPENSUBDIV_HAS_TBB
+#include "../osd/tbbComputeController.h"
+#endif
+
 
 #include "../osd/cpuComputeController.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -178,13 +183,19 @@ OsdUtilAdaptiveEvaluator::Refine(
     const FarMesh<OsdVertex> *fmesh = _refiner->GetFarMesh();
 
 
-    if (numThreads > 1) {
-#ifdef OPENSUBDIV_HAS_OPENMP
+    if (numThreads > 1 or numThreads == -1) {
+#if defined(OPENSUBDIV_HAS_OPENMP)
         OsdOmpComputeController ompComputeController(numThreads);
         ompComputeController.Refine(_computeContext,
                                     fmesh->GetKernelBatches(),
                                     _vertexBuffer, _vvBuffer);
         return true;
+#elif defined(OPENSUBDIV_HAS_TBB)
+        OsdTbbComputeController tbbComputeController(numThreads);
+        tbbComputeController.Refine(_computeContext,
+                                    fmesh->GetKernelBatches(),
+                                    _vertexBuffer, _vvBuffer);
+        return true;
 #endif
     }
 
@@ -215,6 +226,50 @@ OsdUtilAdaptiveEvaluator::EvaluateLimit(
     cpuEvalLimitController.EvalLimitSample(coords, _evalLimitContext, desc, P, dPdu, dPdv, dPdudu, dPdvdv, dPdudv);
 }
 
+// orders sample indices by face, then (u,v), for EvaluateLimitBatch
+struct EvalCoordsLess {
+    const OsdEvalCoords *coords;
+
+    EvalCoordsLess(const OsdEvalCoords *c) : coords(c) { }
+
+    bool operator()(int a, int b) const {
+        if (coords[a].face != coords[b].face)
+            return coords[a].face < coords[b].face;
+        if (coords[a].u != coords[b].u)
+            return coords[a].u < coords[b].u;
+        return coords[a].v < coords[b].v;
+    }
+};
+
+void
+OsdUtilAdaptiveEvaluator::EvaluateLimitBatch(
+    const OsdEvalCoords *coords, int n,
+    real *P, real *dPdu, real *dPdv, real *dPdudu, real *dPdvdv, real *dPdudv)
+{
+    if (n <= 0)
+        return;
+
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), EvalCoordsLess(coords));
+
+    OsdCpuEvalLimitController cpuEvalLimitController;
+
+    OsdVertexBufferDescriptor desc(0, 3, 3);
+
+    // Bind once for the whole batch
+    OsdVertexBufferDescriptor in_desc(0, 3, 3), out_desc(0, 0, 0);
+
+    cpuEvalLimitController.BindVertexBuffers<OsdCpuVertexBuffer,OsdCpuVertexBuffer>(in_desc, _vertexBuffer, out_desc, NULL);
+
+    // samples sharing a patch are evaluated together, in sorted order
+    cpuEvalLimitController.EvalLimitSamples(coords, &order[0], n, _evalLimitContext, desc,
+                                            P, dPdu, dPdv, dPdudu, dPdvdv, dPdudv);
+
+    cpuEvalLimitController.Unbind();
+}
+
 
 void ccgSubSurf__mapGridToFace(int S, real grid_u, real grid_v,
                                       real *face_u, real *face_v)
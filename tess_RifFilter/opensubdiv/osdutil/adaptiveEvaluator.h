@@ -84,8 +84,9 @@ class OsdUtilAdaptiveEvaluator {
         );
 
     // Refine the coarse mesh, needed before calling GetPositions, GetQuads etc
-    // If numThreads is 1, use single cpu.  If numThreads > 1 use Omp and set
-    // number of omp threads.
+    // If numThreads is 1, use single cpu.  If numThreads > 1 use Omp (or Tbb
+    // when OpenMP is not available) with that many threads; -1 uses all
+    // available processors.  Falls back to single cpu if neither is built in.
     //
     bool Refine(int numThreads,
                 std::string *errorMessage = NULL);
@@ -94,6 +95,15 @@ class OsdUtilAdaptiveEvaluator {
     void EvaluateLimit(const OpenSubdiv::OsdEvalCoords &coords,
                        real P[3], real dPdu[3], real dPdv[3], real dPdudu[3], real dPdvdv[3], real dPdudv[3]);
 
+    // Evaluate n samples with a single bind of the vertex buffer.  Each
+    // output array holds three reals per sample, in the order of coords,
+    // and may be NULL if not needed.  Samples are visited sorted by face
+    // so that consecutive patch lookups stay local.  Second derivatives
+    // are zero for patch types that do not compute them.
+    void EvaluateLimitBatch(const OpenSubdiv::OsdEvalCoords *coords, int n,
+                            real *P, real *dPdu, real *dPdv,
+                            real *dPdudu, real *dPdvdv, real *dPdudv);
+
     bool GetRefinedTopology(
             OsdUtilSubdivTopology *t,
             //positions will have three floats * t->numVertices
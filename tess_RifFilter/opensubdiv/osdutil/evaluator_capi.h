@@ -33,7 +33,12 @@ extern "C" {
 /* Types declaration. */
 struct OpenSubdiv_EvaluatorDescr;
 struct OpenSubdiv_TopologyDescr;
+/* Must match opensubdiv/version.h. */
+#ifdef OPENSUBDIV_REAL_DOUBLE
+typedef double real;
+#else
 typedef long double real;
+#endif
 
 /* Methods to create and delete evaluators. */
 struct OpenSubdiv_EvaluatorDescr *openSubdiv_createEvaluatorDescr(int numVertices);
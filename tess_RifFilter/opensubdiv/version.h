@@ -27,6 +27,13 @@
 
 #define OPENSUBDIV_VERSION v2_5_1
 
+// Scalar type of the evaluator and of the tessellator built on it.  Long
+// double is the default; defining OPENSUBDIV_REAL_DOUBLE (TESS_PRECISION=double
+// in CMake) selects double, which the compiler can keep in SSE/AVX registers.
+#ifdef OPENSUBDIV_REAL_DOUBLE
+typedef double real;
+#else
 typedef long double real;
+#endif
 
 #endif /* OPENSUBDIV_VERSION_H */
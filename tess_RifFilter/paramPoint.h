@@ -63,7 +63,15 @@ public:
     bool IsExactlyEvaluable() const;
     bool RadialCurvature(const vec3 & cameraCenter, real & k_r) const;
     real IsophoteDistance(const CameraModel & camera, real isovalue, int maxDistance) const;
+    // same, starting from an already-evaluated position and normal (e.g., from EvaluateBatch)
+    real IsophoteDistance(const CameraModel & camera, real isovalue, int maxDistance, const vec3 & pos0, const vec3 & normal0) const;
+    // same for many points: the rays are advanced in lock-step so that each step is one batched evaluation
+    static void IsophoteDistanceBatch(const std::vector<ParamPoint<T> > & pts, const CameraModel & camera, real isovalue, int maxDistance,
+                                      const std::vector<vec3> & pos0, const std::vector<vec3> & normal0, std::vector<real> & distances);
     void EvaluateByInterpolation(vec3 & limitPosition, vec3 & limitNormal, real* k1=NULL, real* k2=NULL, vec3 * d1=NULL, vec3 * d2=NULL) const;
+    // evaluate many points with a single Subdiv::EvaluateBatch call for the exactly-evaluable ones
+    static void EvaluateBatch(const std::vector<ParamPoint<T> > & pts, std::vector<vec3> & limitPositions, std::vector<vec3> & limitNormals,
+                              std::vector<real> * k1=NULL, std::vector<real> * k2=NULL);
     //  bool IsValid() const; // debugging
 
     // -- interpolation --
@@ -79,12 +87,20 @@ public:
     // are P and Q on the same side of the line containing points (E0, E1)?
     static bool SameSide(const ParamPoint<T> & P, const ParamPoint<T> & Q, const ParamPoint<T> & E0, const ParamPoint<T> & E1);
 
-    static Chart<T> * FindChart(const std::vector<ParamPoint<T> > & pts, std::vector<vec2> & abs);
-    static Chart<T> * FindChart(const ParamPoint<T>  & p0, const ParamPoint<T>  & p1, real & a0, real & b0, real & a1, real & b1);
+    // charts come from the surface's ChartCache and must not be deleted
+    static const Chart<T> * FindChart(const std::vector<ParamPoint<T> > & pts, std::vector<vec2> & abs);
+    static const Chart<T> * FindChart(const ParamPoint<T>  & p0, const ParamPoint<T>  & p1, real & a0, real & b0, real & a1, real & b1);
     static bool HasCommonChart(const ParamPoint<T> & p1, const ParamPoint<T> & p2);
     static bool ConvexInChart(const ParamPoint<T> & p0, const ParamPoint<T> & p1,const ParamPoint<T> & p2, const ParamPoint<T> & p3);
 
-    ParamRay<T> VectorToParamRay(const vec3 & worldVec) const;
+    // tanU/tanV may be passed in when they were already evaluated at this (face) point
+    ParamRay<T> VectorToParamRay(const vec3 & worldVec, const vec3 * tanU=NULL, const vec3 * tanV=NULL) const;
+
+private:
+    // -- evaluation helpers shared by Evaluate() and EvaluateBatch() --
+    void _GetEvalCoords(HbrFace<T> * & face, real & u, real & v) const;
+    void _EvaluateFromDerivatives(const vec3 & tanU, const vec3 & tanV, mat2 * I, mat2 * II,
+                                  vec3 & limitNormal, real * k1, real * k2, vec3 * d1, vec3 * d2) const;
 };
 
 template<class T>
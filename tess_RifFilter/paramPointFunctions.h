@@ -2,6 +2,7 @@
 #define __PARAMPOINTFUNCTIONS_H__
 
 #include <float.h>
+#include <iterator>
 
 #include "paramPoint.h"
 #include "meshFunctions.h"
@@ -122,76 +123,68 @@ void ParamPoint<T>::Print() const
 
 
 template<class T>
-Chart<T> * ParamPoint<T>::FindChart(const std::vector<ParamPoint<T> > & pts, std::vector<vec2> & abs)
+const Chart<T> * ParamPoint<T>::FindChart(const std::vector<ParamPoint<T> > & pts, std::vector<vec2> & abs)
 {
-    // collect all adjacent vertices
-    std::set<HbrVertex<T>*> verts1;
-
-    // probably would be sufficient just to find the neighborhood for a single vertex.
+    // A chart contains a face point only if its origin is a corner of the face, and a vertex (or
+    // edge) point only if its origin shares a face with the vertex (or with the edge's endpoints).
+    // So only the origins around one point need to be tried, preferably a face point, which
+    // leaves at most four candidates.
 
+    const ParamPoint<T> * key = &pts[0];
     for(typename std::vector<ParamPoint<T> >::const_iterator pit = pts.begin(); pit != pts.end(); ++pit)
     {
-        ParamPoint<T>  pt = *pit;
-
-        assert(!pt.IsNull());
-
-        if (pt.SourceVertex() != NULL)
-            verts1.insert(pt.SourceVertex() );
-        else
-            if (pt.SourceEdge() != NULL)
-            {
-                verts1.insert(pt.SourceEdge()->GetOrgVertex());
-                verts1.insert(pt.SourceEdge()->GetDestVertex());
-            }
-            else
-            {
-                for(int i=0;i<4;i++)
-                    verts1.insert(pt.SourceFace()->GetVertex(i));
-            }
-    }
-
-    std::set<HbrFace<T> *> faces;  // all faces to draw candidate vertices from
-
-    for(typename std::set<HbrVertex<T>*>::iterator vit = verts1.begin(); vit != verts1.end(); ++vit)
-    {
-        // insert the one-ring
-        std::list<HbrHalfedge<T> *> edges;
-        (*vit)->GetSurroundingEdges(std::back_inserter(edges));
-        for(typename std::list<HbrHalfedge<T> *>::iterator it = edges.begin(); it != edges.end(); ++it)
+        assert(!pit->IsNull());
+        if (pit->SourceFace() != NULL)
         {
-            if ( (*it)->GetLeftFace() != NULL)
-                faces.insert( (*it)->GetLeftFace());
-            if ( (*it)->GetRightFace() != NULL)
-                faces.insert( (*it)->GetRightFace());
+            key = &(*pit);
+            break;
         }
     }
 
+    std::vector<HbrVertex<T>*> candidates;
+    HbrMesh<T> * mesh;
 
-    // collect all vertices from all neighboring faces
-    std::set<HbrVertex<T>*> verts2;
-    for(typename std::set<HbrFace<T> *>::iterator it=faces.begin(); it!=faces.end();++it)
+    if (key->SourceFace() != NULL)
     {
-        assert( (*it)->GetNumVertices() == 4);
+        mesh = key->SourceFace()->GetMesh();
         for(int i=0;i<4;i++)
+            candidates.push_back(key->SourceFace()->GetVertex(i));
+    }
+    else
+    {
+        HbrVertex<T> * support[2] = { key->SourceVertex(), NULL };
+        if (key->SourceEdge() != NULL)
         {
-            HbrVertex<T> * v = (*it)->GetVertex(i);
-            if (v->GetValence() == 4 && !v->OnBoundary())
-                verts2.insert(v);
+            support[0] = key->SourceEdge()->GetOrgVertex();
+            support[1] = key->SourceEdge()->GetDestVertex();
         }
-    }
+        mesh = support[0]->GetMesh();
 
-    // try all vertices as possible origins
+        for(int s=0;s<2 && support[s] != NULL;s++)
+        {
+            std::vector<HbrHalfedge<T>*> edges;
+            support[s]->GetSurroundingEdges(std::back_inserter(edges));
 
-    //  HbrVertex<T> * origin = NULL;
+            for(typename std::vector<HbrHalfedge<T>*>::iterator it = edges.begin(); it != edges.end(); ++it)
+            {
+                HbrFace<T> * sides[2] = { (*it)->GetLeftFace(), (*it)->GetRightFace() };
+                for(int j=0;j<2;j++)
+                    if (sides[j] != NULL)
+                        for(int i=0;i<4;i++)
+                            if (std::find(candidates.begin(), candidates.end(), sides[j]->GetVertex(i)) == candidates.end())
+                                candidates.push_back(sides[j]->GetVertex(i));
+            }
+        }
+    }
 
-    Chart<T> * chart = NULL;
+    ChartCache<T> & cache = ChartCache<T>::Get(mesh);
 
-    for(typename std::set<HbrVertex<T>*>::iterator it=verts2.begin();it != verts2.end();++it)
+    for(typename std::vector<HbrVertex<T>*>::iterator it=candidates.begin();it != candidates.end();++it)
     {
         if ( (*it)->GetValence() != 4 || (*it)->OnBoundary())
             continue;
 
-        chart = new Chart<T>(*it);
+        const Chart<T> * chart = cache.Get(*it);
         abs.clear();
 
         for(typename std::vector<ParamPoint<T> >::const_iterator pit = pts.begin();pit != pts.end();++pit)
@@ -204,8 +197,6 @@ Chart<T> * ParamPoint<T>::FindChart(const std::vector<ParamPoint<T> > & pts, std
         }
         if (abs.size() == pts.size())
             return chart;
-
-        delete chart;
     }
 
     abs.clear();
@@ -214,7 +205,7 @@ Chart<T> * ParamPoint<T>::FindChart(const std::vector<ParamPoint<T> > & pts, std
 
 
 template<class T>
-Chart<T> * ParamPoint<T>::FindChart(const ParamPoint<T>  & p0, const ParamPoint<T>  & p1, real & a0, real & b0, real & a1, real & b1)
+const Chart<T> * ParamPoint<T>::FindChart(const ParamPoint<T>  & p0, const ParamPoint<T>  & p1, real & a0, real & b0, real & a1, real & b1)
 {
     assert(!p0.IsNull() && !p1.IsNull());
 
@@ -225,7 +216,7 @@ Chart<T> * ParamPoint<T>::FindChart(const ParamPoint<T>  & p0, const ParamPoint<
 
     std::vector<vec2> abs;
 
-    Chart<T> * chart = FindChart(pts, abs);
+    const Chart<T> * chart = FindChart(pts, abs);
 
     if (chart == NULL)
         return NULL;
@@ -246,14 +237,7 @@ bool ParamPoint<T>::HasCommonChart(const ParamPoint<T>  & p1, const ParamPoint<T
 {
     real a0,b0,a1,b1;
 
-    // this could be made a lot more efficient
-    Chart<T> * chart = FindChart(p1,p2,a0,b0,a1,b1);
-
-    if (chart == NULL)
-        return false;
-
-    delete chart;
-    return true;
+    return FindChart(p1,p2,a0,b0,a1,b1) != NULL;
 }
 
 
@@ -269,7 +253,7 @@ bool ParamPoint<T>::ConvexInChart(const ParamPoint<T> & p0, const ParamPoint<T>
 
     std::vector<vec2> abs;
 
-    Chart<T> * chart = FindChart(ps,abs);
+    const Chart<T> * chart = FindChart(ps,abs);
 
     if (chart == NULL){ // can't tell
         //printf("\nNULL CHART\n");
@@ -393,7 +377,7 @@ ParamPoint<T>::Interpolate(const ParamPoint<T>  & p0, const ParamPoint<T>  & p1,
     real a0,b0,a1,b1;
 
     //  HbrVertex<T> * origin = FindABOrigin(p0,p1,a0,b0,a1,b1);
-    Chart<T> * chart = FindChart(p0,p1,a0,b0,a1,b1);
+    const Chart<T> * chart = FindChart(p0,p1,a0,b0,a1,b1);
 
     if( chart == NULL)
         return ParamPoint<T>();
@@ -408,8 +392,6 @@ ParamPoint<T>::Interpolate(const ParamPoint<T>  & p0, const ParamPoint<T>  & p1,
 
     result._normalOffset = newOffset;
 
-    delete chart;
-
     return result;
 }
 
@@ -508,7 +490,7 @@ ParamPoint<T>::MakeExtraordinarySeparator(const ParamPoint<T> & extPoint, const
 
         //  result.print();
 
-        //      assert( fabsl(u0 - result._u) >= t_threshold-1e-10 || fabsl(v0 - result._v) >= t_threshold-1e-10);
+        //      assert( std::fabs(u0 - result._u) >= t_threshold-1e-10 || std::fabs(v0 - result._v) >= t_threshold-1e-10);
 
         assert(result.IsEvaluable());
 
@@ -521,7 +503,7 @@ ParamPoint<T>::MakeExtraordinarySeparator(const ParamPoint<T> & extPoint, const
 
     real a0,b0,a1,b1;
 
-    Chart<T> * chart = FindChart(extPoint,p1,a0,b0,a1,b1);
+    const Chart<T> * chart = FindChart(extPoint,p1,a0,b0,a1,b1);
     //  HbrVertex<T> * origin = FindABOrigin(extPoint,p1,a0,b0,a1,b1);
 
     assert( chart != NULL);
@@ -542,7 +524,7 @@ ParamPoint<T>::MakeExtraordinarySeparator(const ParamPoint<T> & extPoint, const
     }
 
     assert(a >= -1 && a <=1 && b>= -1 && b<=1);
-    assert(fabsl(a0 - a) >= t_threshold-1e-10 || fabsl(b0 - b) >= t_threshold - 1e-10);
+    assert(std::fabs(a0 - a) >= t_threshold-1e-10 || std::fabs(b0 - b) >= t_threshold - 1e-10);
 
     result = chart->ABtoParam(a,b);
     result._normalOffset = newOffset;
@@ -589,7 +571,7 @@ bool ParamPoint<T>::IsExactlyEvaluable() const
         if (vert->GetValence() == 4 && !vert->OnBoundary())
             return true;
 
-        if (fabsl(uvert - _u) >= t_threshold || fabsl(vvert - _v) >= t_threshold)
+        if (std::fabs(uvert - _u) >= t_threshold || std::fabs(vvert - _v) >= t_threshold)
             return true;
 
         return false;
@@ -611,6 +593,105 @@ bool ParamPoint<T>::IsExactlyEvaluable() const
 
 // ================= EVALUATION =====================
 
+template<class T>
+void ParamPoint<T>::_GetEvalCoords(HbrFace<T> * & face, real & u, real & v) const
+{
+    if (_sourceFace != NULL)
+    {
+        face = _sourceFace;
+        u = _u;
+        v = _v;
+    }
+    else
+    {
+        // vertex and edge points are evaluated on a canonical face (the vertex's incident edge face,
+        // the edge face with the lower ID), whichever halfedge describes them, so that the
+        // descriptions of the same location share the Subdiv::Evaluate cache entry
+        HbrHalfedge<T> * edge = _sourceEdge != NULL ? _sourceEdge : _sourceVertex->GetIncidentEdge();
+        face = edge->GetLeftFace() == NULL ? edge->GetRightFace() : edge->GetLeftFace();
+        if (_sourceEdge != NULL && edge->GetRightFace() != NULL && edge->GetRightFace()->GetID() < face->GetID())
+            face = edge->GetRightFace();
+        GetFaceUV<T>(face,*this,u,v);
+    }
+
+    assert(face != NULL && u != -1 && v != -1);
+    assert(u>=0 && u<=1 && v>=0 && v<=1);  // generic error-checking
+}
+
+template<class T>
+void ParamPoint<T>::_EvaluateFromDerivatives(const vec3 & tanU, const vec3 & tanV, mat2 * I, mat2 * II,
+                                             vec3 & limitNormal, real * k1, real * k2, vec3 * d1, vec3 * d2) const
+{
+    vec2 pdir1 = vec2(1,0);
+    vec2 pdir2 = vec2(0,1);
+
+    if(k1 && k2){
+        mat2 S;
+
+        real detI = determinant(*I);
+        if(std::fabs(detI) < 1e-20){
+            //printf("DET I NULL [%f,%f,%f,%f]\n",double((*I)[0][0]),double((*I)[0][1]),double((*I)[1][0]),double((*I)[1][1]));
+            detI = 1e-20;
+        }
+
+        S[0][0] = ((*II)[0][1]*(*I)[0][1] - (*II)[0][0]*(*I)[1][1]) / detI;
+        S[0][1] = ((*II)[1][1]*(*I)[0][1] - (*II)[0][1]*(*I)[1][1]) / detI;
+        S[1][0] = ((*II)[0][0]*(*I)[0][1] - (*II)[0][1]*(*I)[0][0]) / detI;
+        S[1][1] = ((*II)[0][1]*(*I)[0][1] - (*II)[1][1]*(*I)[0][0]) / detI;
+
+        real traceS = S[0][0] + S[1][1];
+        real detS = determinant(S);
+        real diff = traceS*traceS - 4.0 * detS;
+        if(diff>=0){
+            real sqrtDiff = std::sqrt(diff);
+            (*k1) = 0.5 * (traceS + sqrtDiff);
+            (*k2) = 0.5 * (traceS - sqrtDiff);
+            if(std::fabs(*k1)<std::fabs(*k2)){
+                real swap = (*k1);
+                (*k1) = (*k2);
+                (*k2) = swap;
+            }
+            if(std::fabs(S[1][0])>1e-20){
+                pdir1 = vec2((*k1) - S[1][1], S[1][0]);
+                pdir2 = vec2((*k2) - S[1][1], S[1][0]);
+            }else if (std::fabs(S[0][1])>1e-20){
+                pdir1 = vec2(S[0][1], (*k1) - S[0][0]);
+                pdir2 = vec2(S[0][1], (*k2) - S[0][0]);
+            }
+            pdir1.normalize();
+            pdir2.normalize();
+        }else{
+            (*k1) = 0.0;
+            (*k2) = 0.0;
+            if(d1 && d2){
+                (*d1) = tanU;
+                (*d2) = tanV;
+            }
+        }
+    }
+
+    limitNormal = tanU ^ tanV;
+
+    if (limitNormal * limitNormal < 1e-12) // a bug in Nsd, it appears
+    {
+        //printf("tanV [%f, %f, %f]\n",(double)tanV[0],(double)tanV[1],(double)tanV[2]);
+        //printf("tanU [%f, %f, %f]\n",(double)tanU[0],(double)tanU[1],(double)tanU[2]);
+
+        if (_sourceVertex != NULL)
+        {
+            limitNormal = FaceAveragedVertexNormal(_sourceVertex);
+            printf("averaged vtx normal = %f %f %f\n", double(limitNormal[0]), double(limitNormal[1]), double(limitNormal[2]));
+        }
+    }
+    limitNormal.normalize();
+
+    if(d1 && d2){
+        (*d1) = pdir1[0] * tanU + pdir1[1] * tanV;
+        (*d1).normalize();
+        (*d2) = (*d1) ^ limitNormal; //tanU * pdir2[0] + tanV * pdir2[1];
+    }
+}
+
 template<class T>
 void ParamPoint<T>::Evaluate(vec3 & limitPosition, vec3 & limitNormal, real * k1, real * k2, vec3 * d1, vec3 * d2) const
 {
@@ -632,111 +713,21 @@ void ParamPoint<T>::Evaluate(vec3 & limitPosition, vec3 & limitNormal, real * k1
         assert(0);
     }
 
-    vec2 pdir1 = vec2(1,0);
-    vec2 pdir2 = vec2(0,1);
-
     if (IsExactlyEvaluable())
     {
-        if (_sourceFace != NULL)
-        {
-            face = _sourceFace;
-            u = _u;
-            v = _v;
-        }
-        else
-        {
-            HbrHalfedge<T> * edge = _sourceEdge != NULL ? _sourceEdge : _sourceVertex->GetIncidentEdge();
-            face = edge->GetLeftFace() == NULL ? edge->GetRightFace() : edge->GetLeftFace();
-            GetFaceUV<T>(face,*this,u,v);
-        }
-
-        assert(face != NULL && u != -1 && v != -1);
-        assert(u>=0 && u<=1 && v>=0 && v<=1);  // generic error-checking
+        _GetEvalCoords(face,u,v);
 
         //      printf("Evaluating face %p at (%f,%f)\n",face, double(u),double(v));
         //      printf("\tface verts [%p, %p, %p, %p]\n",
         //	     face->GetVertex(0),	 face->GetVertex(1),	 face->GetVertex(2),	 face->GetVertex(3));
 
         if(k1 && k2){
-            mat2 I, II, S;
-
-            Subdiv::getInstance().Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,&I,&II);
-
-            real detI = determinant(I);
-            if(fabsl(detI) < 1e-20){
-                //printf("DET I NULL [%f,%f,%f,%f]\n",double(I[0][0]),double(I[0][1]),double(I[1][0]),double(I[1][1]));
-                detI = 1e-20;
-            }
-
-            S[0][0] = (II[0][1]*I[0][1] - II[0][0]*I[1][1]) / detI;
-            S[0][1] = (II[1][1]*I[0][1] - II[0][1]*I[1][1]) / detI;
-            S[1][0] = (II[0][0]*I[0][1] - II[0][1]*I[0][0]) / detI;
-            S[1][1] = (II[0][1]*I[0][1] - II[1][1]*I[0][0]) / detI;
-
-//            printf("detI: %.16f / %.16f / %.16f / %.16f\n",double(detI),double(II[1][1]*I[0][1]), double(II[0][1]*I[1][1]), double((II[1][1]*I[0][1] - II[0][1]*I[1][1]) / detI));
-//            printf(" I: %.16f %.16f %.16f %.16f\n",double(I[0][0]),double(I[0][1]),double(I[1][0]),double(I[1][1]));
-//            printf("II: %.16f %.16f %.16f %.16f\n",double(II[0][0]),double(II[0][1]),double(II[1][0]),double(II[1][1]));
-//            printf(" S: %.16f %.16f %.16f %.16f\n",double(S[0][0]),double(S[0][1]),double(S[1][0]),double(S[1][1]));
-
-            real traceS = S[0][0] + S[1][1];
-            real detS = determinant(S);
-            real diff = traceS*traceS - 4.0 * detS;
-            if(diff>=0){
-                real sqrtDiff = sqrtl(diff);
-                (*k1) = 0.5 * (traceS + sqrtDiff);
-                (*k2) = 0.5 * (traceS - sqrtDiff);
-                if(fabsl(*k1)<fabsl(*k2)){
-                    real swap = (*k1);
-                    (*k1) = (*k2);
-                    (*k2) = swap;
-                }
-                if(fabsl(S[1][0])>1e-20){
-                    pdir1 = vec2((*k1) - S[1][1], S[1][0]);
-                    pdir2 = vec2((*k2) - S[1][1], S[1][0]);
-                }else if (fabsl(S[0][1])>1e-20){
-                    pdir1 = vec2(S[0][1], (*k1) - S[0][0]);
-                    pdir2 = vec2(S[0][1], (*k2) - S[0][0]);
-                }
-                pdir1.normalize();
-                pdir2.normalize();
-                //printf("trace: %.16f detS: %.16f diff: %.16f k1*k2: %.16f / %.16f\n",double(traceS),double(detS),double(diff),double((*k1)*(*k2)),double((II[0][0]*II[1][1] - II[0][1]*II[0][1])/detI));
-            }else{
-                //#if LINK_FREESTYLE
-                //    char str[200];
-                //    sprintf(str, "DIFF NULL");
-                //    addRIFDebugPoint(-1, double(limitPosition[0]), double(limitPosition[1]), double(limitPosition[2]), str, NULL);
-                //#endif
-                //                printf("DIFF NULL\n");
-                (*k1) = 0.0;
-                (*k2) = 0.0;
-                if(d1 && d2){
-                    (*d1) = tanU;
-                    (*d2) = tanV;
-                }
-            }
+            mat2 I, II;
+            Subdiv::Get(face).Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,&I,&II);
+            _EvaluateFromDerivatives(tanU, tanV, &I, &II, limitNormal, k1, k2, d1, d2);
         }else{
-            Subdiv::getInstance().Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,NULL,NULL);
-        }
-
-        limitNormal = tanU ^ tanV;
-
-        if (limitNormal * limitNormal < 1e-12) // a bug in Nsd, it appears
-        {
-            //printf("tanV [%f, %f, %f]\n",(double)tanV[0],(double)tanV[1],(double)tanV[2]);
-            //printf("tanU [%f, %f, %f]\n",(double)tanU[0],(double)tanU[1],(double)tanU[2]);
-
-            if (_sourceVertex != NULL)
-            {
-                limitNormal = FaceAveragedVertexNormal(_sourceVertex);
-                printf("averaged vtx normal = %f %f %f\n", double(limitNormal[0]), double(limitNormal[1]), double(limitNormal[2]));
-            }
-        }
-        limitNormal.normalize();
-
-        if(d1 && d2){
-            (*d1) = pdir1[0] * tanU + pdir1[1] * tanV;
-            (*d1).normalize();
-            (*d2) = (*d1) ^ limitNormal; //tanU * pdir2[0] + tanV * pdir2[1];
+            Subdiv::Get(face).Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,NULL,NULL);
+            _EvaluateFromDerivatives(tanU, tanV, NULL, NULL, limitNormal, NULL, NULL, d1, d2);
         }
     }
     else
@@ -756,6 +747,81 @@ void ParamPoint<T>::Evaluate(vec3 & limitPosition, vec3 & limitNormal, real * k1
     return;
 }
 
+template<class T>
+void ParamPoint<T>::EvaluateBatch(const std::vector<ParamPoint<T> > & pts, std::vector<vec3> & limitPositions, std::vector<vec3> & limitNormals,
+                                  std::vector<real> * k1, std::vector<real> * k2)
+{
+    int n = pts.size();
+    bool curvature = (k1 != NULL && k2 != NULL);
+
+    limitPositions.resize(n);
+    limitNormals.resize(n);
+    if (curvature)
+    {
+        k1->resize(n);
+        k2->resize(n);
+    }
+
+    // gather the exactly-evaluable points; the others are interpolated from exact corners one at a time
+    std::vector<int> exact;
+    std::vector<OsdEvalCoords> coords;
+    Subdiv * subdiv = NULL;
+    exact.reserve(n);
+    coords.reserve(n);
+
+    for(int i=0;i<n;i++)
+    {
+        if (pts[i].IsExactlyEvaluable())
+        {
+            HbrFace<T> * face;
+            real u,v;
+            pts[i]._GetEvalCoords(face,u,v);
+
+            // _sourceFace is NULL for points on edges and vertices, so the
+            // evaluator is found from the face the point is evaluated on;
+            // all the points lie on the same surface
+            if (subdiv == NULL)
+                subdiv = &Subdiv::Get(face);
+            assert(&Subdiv::Get(face) == subdiv);
+
+            exact.push_back(i);
+            coords.push_back(OsdEvalCoords(face->GetID(),u,v));
+        }
+        else if (curvature)
+            pts[i].Evaluate(limitPositions[i], limitNormals[i], &(*k1)[i], &(*k2)[i]);
+        else
+            pts[i].Evaluate(limitPositions[i], limitNormals[i]);
+    }
+
+    int m = exact.size();
+    if (m == 0)
+        return;
+
+    std::vector<vec3> pos(m), tanU(m), tanV(m);
+    std::vector<mat2> I(curvature ? m : 0), II(curvature ? m : 0);
+
+    subdiv->EvaluateBatch(&coords[0], m, &pos[0], &tanU[0], &tanV[0],
+                          curvature ? &I[0] : NULL, curvature ? &II[0] : NULL);
+
+    for(int j=0;j<m;j++)
+    {
+        int i = exact[j];
+        const ParamPoint<T> & p = pts[i];
+
+        if (curvature)
+            p._EvaluateFromDerivatives(tanU[j], tanV[j], &I[j], &II[j], limitNormals[i], &(*k1)[i], &(*k2)[i], NULL, NULL);
+        else
+            p._EvaluateFromDerivatives(tanU[j], tanV[j], NULL, NULL, limitNormals[i], NULL, NULL, NULL, NULL);
+
+        limitPositions[i] = pos[j];
+
+        assert(limitNormals[i] * limitNormals[i] > 0);
+
+        if (p._normalOffset != 0)
+            limitPositions[i] += p._normalOffset * limitNormals[i];
+    }
+}
+
 
 template<class T>
 void ParamPoint<T>::EvaluateByInterpolation(vec3 & limitPosition, vec3 & limitNormal, real* k1, real* k2, vec3 * d1, vec3 * d2) const
@@ -905,7 +971,7 @@ void ProjectVector(const vec3 & v0, const vec3 & v1, const vec3 w,
 
 template<class T>
 ParamRay<T>
-ParamPoint<T>::VectorToParamRay(const vec3 & worldVec) const
+ParamPoint<T>::VectorToParamRay(const vec3 & worldVec, const vec3 * cachedTanU, const vec3 * cachedTanV) const
 {
     vec3 limitPosition, tanU, tanV;
 
@@ -923,7 +989,13 @@ ParamPoint<T>::VectorToParamRay(const vec3 & worldVec) const
         u = _u;
         v = _v;
 
-        Subdiv::getInstance().Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,NULL,NULL);
+        if (cachedTanU != NULL && cachedTanV != NULL)
+        {
+            tanU = *cachedTanU;
+            tanV = *cachedTanV;
+        }
+        else
+            Subdiv::Get(face).Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,NULL,NULL);
         //_evaluator->Eval(face,u,v,REF_LEVEL,&limitPosition,&tanU,&tanV,NULL,NULL,NULL,0,NULL,0,NULL,0);
 
         ProjectVector<T>(tanU, tanV, worldVec, du, dv);
@@ -953,7 +1025,7 @@ ParamPoint<T>::VectorToParamRay(const vec3 & worldVec) const
             face = *it;
             GetFaceUV(face,*this,u,v);
 
-            Subdiv::getInstance().Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,NULL,NULL);
+            Subdiv::Get(face).Evaluate(OsdEvalCoords(face->GetID(),u,v),&limitPosition,&tanU,&tanV,NULL,NULL);
             //_evaluator->Eval(face,u,v,REF_LEVEL,&limitPosition,&tanU,&tanV,NULL,NULL,NULL,0,NULL,0,NULL,0);
 
             ProjectVector<T>(tanU, tanV, worldVec, du, dv);
@@ -1082,7 +1154,7 @@ ParamPoint<T>::SameSide(const ParamPoint<T>  & P, const ParamPoint<T>  & Q, cons
 
     std::vector<vec2> abs;
 
-    Chart<T> * chart = FindChart(pts,abs);
+    const Chart<T> * chart = FindChart(pts,abs);
     //  HbrVertex<T> * origin = FindABOrigin(pts,abs);
 
     if (chart == NULL)
@@ -1120,6 +1192,19 @@ ParamPoint<T>::SameSide(const ParamPoint<T>  & P, const ParamPoint<T>  & Q, cons
 template<class T>
 real
 ParamPoint<T>::IsophoteDistance(const CameraModel & camera, real isovalue, int maxDistance) const
+{
+    if (!IsEvaluable())
+        return -1;
+
+    vec3 pos0, normal0;
+    Evaluate(pos0, normal0);
+
+    return IsophoteDistance(camera, isovalue, maxDistance, pos0, normal0);
+}
+
+template<class T>
+real
+ParamPoint<T>::IsophoteDistance(const CameraModel & camera, real isovalue, int maxDistance, const vec3 & pos0In, const vec3 & normal0) const
 {
     vec3 cameraCenter = camera.CameraCenter();
 
@@ -1128,8 +1213,7 @@ ParamPoint<T>::IsophoteDistance(const CameraModel & camera, real isovalue, int m
 
     ParamPoint<T> pt0 = *this;
 
-    vec3 pos0, normal0;
-    pt0.Evaluate(pos0, normal0);
+    vec3 pos0 = pos0In;
     vec3 viewVec0 = (cameraCenter - pos0);
     viewVec0.normalize();
     real rho0 = viewVec0 * normal0;
@@ -1139,9 +1223,13 @@ ParamPoint<T>::IsophoteDistance(const CameraModel & camera, real isovalue, int m
     if(rho0 > isovalue)
         return 0;
 
+    // tangents of pt0, when known, so that the ray does not re-evaluate the same point
+    vec3 tanU0, tanV0;
+    bool haveTangents = false;
+
     for(int i=0;i<100;i++)
     {
-        ParamRay<T> ray = pt0.VectorToParamRay(viewVec0);
+        ParamRay<T> ray = haveTangents ? pt0.VectorToParamRay(viewVec0, &tanU0, &tanV0) : pt0.VectorToParamRay(viewVec0);
 
         if (ray.IsNull())
             return -1;
@@ -1151,7 +1239,20 @@ ParamPoint<T>::IsophoteDistance(const CameraModel & camera, real isovalue, int m
             return -1;
 
         vec3 pos1, normal1;
-        pt1.Evaluate(pos1, normal1);
+        if (pt1._sourceFace != NULL && pt1.IsExactlyEvaluable())
+        {
+            // position, normal and tangents from a single evaluation
+            Subdiv::Get(pt1._sourceFace).Evaluate(OsdEvalCoords(pt1._sourceFace->GetID(),pt1._u,pt1._v),&pos1,&tanU0,&tanV0,NULL,NULL);
+            pt1._EvaluateFromDerivatives(tanU0, tanV0, NULL, NULL, normal1, NULL, NULL, NULL, NULL);
+            if (pt1._normalOffset != 0)
+                pos1 += pt1._normalOffset * normal1;
+            haveTangents = true;
+        }
+        else
+        {
+            pt1.Evaluate(pos1, normal1);
+            haveTangents = false;
+        }
         vec3 viewVec1 = cameraCenter - pos1;
         viewVec1.normalize();
         real rho1 = viewVec1 * normal1;
@@ -1185,6 +1286,200 @@ ParamPoint<T>::IsophoteDistance(const CameraModel & camera, real isovalue, int m
     return maxDistance;
 }
 
+template<class T>
+void
+ParamPoint<T>::IsophoteDistanceBatch(const std::vector<ParamPoint<T> > & pts, const CameraModel & camera, real isovalue, int maxDistance,
+                                     const std::vector<vec3> & pos0, const std::vector<vec3> & normal0, std::vector<real> & distances)
+// Same result as IsophoteDistance() on each point.  Each iteration advances every unfinished ray by one
+// source face; the points on face interiors are evaluated together, keeping their tangents for the next ray.
+{
+    vec3 cameraCenter = camera.CameraCenter();
+    int n = pts.size();
+
+    distances.assign(n, maxDistance);
+
+    // state of each march
+    std::vector<ParamPoint<T> > cur(pts);
+    std::vector<vec3> viewVec(n), tanU(n), tanV(n);
+    std::vector<real> rho(n);
+    std::vector<char> haveTangents(n, 0);
+
+    std::vector<int> active;
+    active.reserve(n);
+
+    for(int i=0;i<n;i++)
+    {
+        if (!pts[i].IsEvaluable())
+        {
+            distances[i] = -1;
+            continue;
+        }
+
+        viewVec[i] = cameraCenter - pos0[i];
+        viewVec[i].normalize();
+        rho[i] = viewVec[i] * normal0[i];
+
+        if (rho[i] > isovalue)
+            distances[i] = 0;
+        else
+            active.push_back(i);
+    }
+
+    // crossings found during the march, evaluated together at the end
+    std::vector<ParamPoint<T> > isoPts;
+    std::vector<int> isoIndex;
+
+    std::vector<ParamPoint<T> > next, others;
+    std::vector<int> nextIndex, exact, otherIndex, stillActive;
+    std::vector<OsdEvalCoords> coords;
+    std::vector<vec3> pos, normal, batchPos, batchTanU, batchTanV, otherPos, otherNormal;
+
+    for(int iter=0;iter<100 && !active.empty();iter++)
+    {
+        // advance all the rays
+        next.clear();
+        nextIndex.clear();
+
+        for(size_t k=0;k<active.size();k++)
+        {
+            int i = active[k];
+            ParamRay<T> ray = haveTangents[i] ? cur[i].VectorToParamRay(viewVec[i], &tanU[i], &tanV[i]) : cur[i].VectorToParamRay(viewVec[i]);
+
+            if (ray.IsNull())
+            {
+                distances[i] = -1;
+                continue;
+            }
+
+            ParamPoint<T> pt1 = ray.Advance();
+            if (pt1.IsNull() || !pt1.IsEvaluable())
+            {
+                distances[i] = -1;
+                continue;
+            }
+
+            next.push_back(pt1);
+            nextIndex.push_back(i);
+        }
+
+        int m = next.size();
+        if (m == 0)
+            break;
+
+        // evaluate the new points: face interiors in one Subdiv batch (with tangents), the rest through EvaluateBatch
+        pos.resize(m);
+        normal.resize(m);
+        exact.clear();
+        coords.clear();
+        others.clear();
+        otherIndex.clear();
+        HbrFace<T> * evalFace = NULL;
+
+        for(int j=0;j<m;j++)
+        {
+            const ParamPoint<T> & p = next[j];
+            if (p._sourceFace != NULL && p.IsExactlyEvaluable())
+            {
+                evalFace = p._sourceFace;
+                exact.push_back(j);
+                coords.push_back(OsdEvalCoords(p._sourceFace->GetID(),p._u,p._v));
+            }
+            else
+            {
+                others.push_back(p);
+                otherIndex.push_back(j);
+            }
+        }
+
+        if (!exact.empty())
+        {
+            int me = exact.size();
+            batchPos.resize(me);
+            batchTanU.resize(me);
+            batchTanV.resize(me);
+
+            Subdiv::Get(evalFace).EvaluateBatch(&coords[0], me, &batchPos[0], &batchTanU[0], &batchTanV[0], NULL, NULL);
+
+            for(int e=0;e<me;e++)
+            {
+                int j = exact[e];
+                int i = nextIndex[j];
+                const ParamPoint<T> & p = next[j];
+
+                p._EvaluateFromDerivatives(batchTanU[e], batchTanV[e], NULL, NULL, normal[j], NULL, NULL, NULL, NULL);
+                pos[j] = batchPos[e];
+                if (p._normalOffset != 0)
+                    pos[j] += p._normalOffset * normal[j];
+
+                tanU[i] = batchTanU[e];
+                tanV[i] = batchTanV[e];
+                haveTangents[i] = 1;
+            }
+        }
+
+        if (!others.empty())
+        {
+            EvaluateBatch(others, otherPos, otherNormal);
+            for(size_t o=0;o<others.size();o++)
+            {
+                int j = otherIndex[o];
+                pos[j] = otherPos[o];
+                normal[j] = otherNormal[o];
+                haveTangents[nextIndex[j]] = 0;
+            }
+        }
+
+        // test each ray for termination
+        stillActive.clear();
+
+        for(int j=0;j<m;j++)
+        {
+            int i = nextIndex[j];
+
+            vec3 viewVec1 = cameraCenter - pos[j];
+            viewVec1.normalize();
+            real rho1 = viewVec1 * normal[j];
+
+            if (rho1 < -0.1)
+            {
+                distances[i] = camera.ImageSpaceDistance(pos0[i], pos[j]); // could interpolate
+                continue;
+            }
+
+            if (rho1 > isovalue)
+            {
+                // linear interpolation of rho along the step, as in IsophoteDistance()
+                real t = (isovalue - rho[i]) / (rho1 - rho[i]);
+                isoPts.push_back(ParamPoint::Interpolate(cur[i], next[j], t));
+                isoIndex.push_back(i);
+                continue;
+            }
+
+            if (camera.ImageSpaceDistance(pos0[i], pos[j]) > maxDistance)
+            {
+                distances[i] = maxDistance;
+                continue;
+            }
+
+            cur[i] = next[j];
+            rho[i] = rho1;
+            viewVec[i] = viewVec1;
+            stillActive.push_back(i);
+        }
+
+        active.swap(stillActive);
+    }
+
+    if (isoPts.empty())
+        return;
+
+    std::vector<vec3> isoPos, isoNormal;
+    EvaluateBatch(isoPts, isoPos, isoNormal);
+
+    for(size_t k=0;k<isoPts.size();k++)
+        distances[isoIndex[k]] = camera.ImageSpaceDistance(pos0[isoIndex[k]], isoPos[k]);
+}
+
 template<class T>
 bool ParamPoint<T>::RadialCurvature(const vec3 & cameraCenter,real & k_r) const
 // finite differences using the "(D_w n) dot w / (w dot w)"
@@ -1575,7 +1870,7 @@ ParamRay<T>::IntersectSegment(const ParamPoint<T> & p1, const ParamPoint<T> & p2
     pts.push_back(p1);
     pts.push_back(p2);
     std::vector<vec2> abs;
-    Chart<T> * chart = ParamPoint<T>::FindChart(pts,abs);
+    const Chart<T> * chart = ParamPoint<T>::FindChart(pts,abs);
 
     if(chart == NULL){
         printf("Chart not found\n");
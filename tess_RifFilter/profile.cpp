@@ -0,0 +1,166 @@
+#include "profile.h"
+
+#include <time.h>
+#include <string.h>
+
+__thread Profile * currentProfile = NULL;
+
+static const double STATUS_INTERVAL = 0.5;
+
+const char * ProfileStageName(ProfileStage stage)
+{
+    static const char * names[NUM_PROFILE_STAGES] = {
+        "SurfaceToMesh", "TemporalCache", "RefineContour", "Optimize",
+        "PreProcess", "DetectCusp", "InsertContour", "InsertCusp", "InsertRadial", "FlipRadial",
+        "ExtendRadial", "FlipEdge", "WigglingParam", "SplitEdge", "RadialFinish",
+        "CullBackFaces", "ConsistencyStats", "RadialCurvatures" };
+    return names[stage];
+}
+
+const char * ProfileCounterName(ProfileCounter counter)
+{
+    static const char * names[NUM_PROFILE_COUNTERS] = {
+        "evalLookups", "evalCacheHits", "evalBatched", "contourRoots", "rootIterations",
+        "queueInserts", "queuePops", "zeroCrossings", "cusps", "radialEdges", "flips", "splits",
+        "wiggles", "extensions", "inputFaces", "outputFaces" };
+    return names[counter];
+}
+
+void Profile::Clear()
+{
+    for(int i=0;i<NUM_PROFILE_STAGES;i++)
+        seconds[i] = 0;
+    for(int i=0;i<NUM_PROFILE_COUNTERS;i++)
+        counters[i] = 0;
+}
+
+void Profile::Add(const Profile & p)
+{
+    for(int i=0;i<NUM_PROFILE_STAGES;i++)
+        seconds[i] += p.seconds[i];
+    for(int i=0;i<NUM_PROFILE_COUNTERS;i++)
+        counters[i] += p.counters[i];
+}
+
+double Profile::TotalSeconds() const
+{
+    double total = 0;
+    for(int i=0;i<NUM_PROFILE_STAGES;i++)
+        total += seconds[i];
+    return total;
+}
+
+void Profile::Print(const char * name) const
+{
+    printf("Profile of %s: %.3fs\n", name, TotalSeconds());
+    for(int i=0;i<NUM_PROFILE_STAGES;i++)
+        if (seconds[i] > 0)
+            printf("  %-18s %8.3fs\n", ProfileStageName(ProfileStage(i)), seconds[i]);
+
+    long evaluations = counters[PC_EVAL_LOOKUPS] - counters[PC_EVAL_CACHE_HITS] + counters[PC_EVAL_BATCHED];
+    printf("  limit evaluations: %ld (cache hits: %ld), contour roots: %ld (%.2f iterations per root), queue operations: %ld\n",
+           evaluations, counters[PC_EVAL_CACHE_HITS], counters[PC_CONTOUR_ROOTS],
+           counters[PC_CONTOUR_ROOTS] > 0 ? double(counters[PC_ROOT_ITERATIONS])/counters[PC_CONTOUR_ROOTS] : 0.0,
+           counters[PC_QUEUE_INSERTS] + counters[PC_QUEUE_POPS]);
+}
+
+static void WriteJSONString(FILE * fp, const char * str)
+{
+    fputc('"', fp);
+    for(const char * c = str; *c != 0; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(fp, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20)
+            fprintf(fp, "\\u%04x", (unsigned char)*c);
+        else
+            fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+void Profile::WriteJSON(FILE * fp, const char * indent) const
+{
+    fprintf(fp, "{\n%s  \"totalSeconds\": %.6f,\n%s  \"stages\": {", indent, TotalSeconds(), indent);
+    for(int i=0;i<NUM_PROFILE_STAGES;i++)
+        fprintf(fp, "%s\n%s    \"%s\": %.6f", i > 0 ? "," : "", indent, ProfileStageName(ProfileStage(i)), seconds[i]);
+    fprintf(fp, "\n%s  },\n%s  \"counters\": {", indent, indent);
+    for(int i=0;i<NUM_PROFILE_COUNTERS;i++)
+        fprintf(fp, "%s\n%s    \"%s\": %ld", i > 0 ? "," : "", indent, ProfileCounterName(ProfileCounter(i)), counters[i]);
+    fprintf(fp, "\n%s  }\n%s}", indent, indent);
+}
+
+ProfileTimer::ProfileTimer(ProfileStage stage)
+{
+    _stage = stage;
+    _start = ProfileSeconds();
+}
+
+void ProfileTimer::Stop()
+{
+    if (_start < 0)
+        return;
+    if (currentProfile != NULL)
+        currentProfile->seconds[_stage] += ProfileSeconds() - _start;
+    _start = -1;
+}
+
+double ProfileTimer::ProfileSeconds()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+bool StatusLineDue()
+{
+    // the clock is only read every few calls
+    static __thread unsigned calls = 0;
+    static __thread double lastStatus = 0;
+
+    if ((calls++ & 63) != 0)
+        return false;
+
+    double now = ProfileTimer::ProfileSeconds();
+    if (now - lastStatus < STATUS_INTERVAL)
+        return false;
+
+    lastStatus = now;
+    return true;
+}
+
+std::string ProfileFilename(const char * outputFilename)
+{
+    std::string name(outputFilename);
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && name.find('/', dot) == std::string::npos)
+        name.erase(dot);
+    return name + "_profile.json";
+}
+
+bool WriteProfileJSON(const char * filename, const std::vector<std::string> & names,
+                      const std::vector<Profile> & profiles, const Profile & frame)
+{
+    FILE * fp = fopen(filename, "wt");
+    if (fp == NULL)
+    {
+        printf("WARNING: cannot write profile %s\n", filename);
+        return false;
+    }
+
+    fprintf(fp, "{\n  \"objects\": [");
+    for(size_t i=0;i<profiles.size();i++)
+    {
+        fprintf(fp, "%s\n    {\n      \"name\": ", i > 0 ? "," : "");
+        WriteJSONString(fp, names[i].c_str());
+        fprintf(fp, ",\n      \"profile\": ");
+        profiles[i].WriteJSON(fp, "      ");
+        fprintf(fp, "\n    }");
+    }
+    fprintf(fp, "\n  ],\n  \"frame\": ");
+    frame.WriteJSON(fp, "  ");
+    fprintf(fp, "\n}\n");
+
+    fclose(fp);
+    return true;
+}
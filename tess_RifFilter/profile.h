@@ -0,0 +1,113 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// ---------------- PIPELINE PROFILING ----------------------------------------------------------
+//
+// Time spent in each stage of the tessellation pipeline and a few operation counters, kept per
+// object and summed over the frame. The object being tessellated by a thread is found through a
+// thread-local pointer, so the instrumented code needs no extra arguments. Helper threads (split
+// planning, consistency stats, radial curvatures) count into a profile of their own, which the
+// thread that started them adds to its profile after joining them.
+
+typedef enum {
+    PS_SURFACE_TO_MESH,
+    PS_TEMPORAL_CACHE,
+    PS_REFINE_CONTOUR,
+    PS_OPTIMIZE,
+    // RefineContourRadial, in the order of RefineRadialStep
+    PS_RADIAL_PREPROCESS,
+    PS_RADIAL_DETECT_CUSP,
+    PS_RADIAL_INSERT_CONTOUR,
+    PS_RADIAL_INSERT_CUSP,
+    PS_RADIAL_INSERT_RADIAL,
+    PS_RADIAL_FLIP_RADIAL,
+    PS_RADIAL_EXTEND_RADIAL,
+    PS_RADIAL_FLIP_EDGE,
+    PS_RADIAL_WIGGLING_PARAM,
+    PS_RADIAL_SPLIT_EDGE,
+    PS_RADIAL_FINISH,
+    PS_CULL_BACK_FACES,
+    PS_CONSISTENCY_STATS,
+    PS_RADIAL_CURVATURES,
+    NUM_PROFILE_STAGES
+} ProfileStage;
+
+typedef enum {
+    PC_EVAL_LOOKUPS,        // Subdiv::Evaluate calls
+    PC_EVAL_CACHE_HITS,     // ... answered by the evaluation cache
+    PC_EVAL_BATCHED,        // samples evaluated by Subdiv::EvaluateBatch
+    PC_CONTOUR_ROOTS,       // FindContour calls
+    PC_ROOT_ITERATIONS,     // root-finding steps of FindContour
+    PC_QUEUE_INSERTS,       // FacePriorityQueue insertions
+    PC_QUEUE_POPS,          // FacePriorityQueue pops
+    PC_ZERO_CROSSINGS,      // zero-crossing splits
+    PC_CUSPS,
+    PC_RADIAL_EDGES,
+    PC_FLIPS,
+    PC_SPLITS,
+    PC_WIGGLES,
+    PC_EXTENSIONS,          // extended radial edges
+    PC_INPUT_FACES,
+    PC_OUTPUT_FACES,
+    NUM_PROFILE_COUNTERS
+} ProfileCounter;
+
+const char * ProfileStageName(ProfileStage stage);
+const char * ProfileCounterName(ProfileCounter counter);
+
+struct Profile
+{
+    double seconds[NUM_PROFILE_STAGES];
+    long counters[NUM_PROFILE_COUNTERS];
+
+    Profile() { Clear(); }
+    void Clear();
+    void Add(const Profile & p);  // sum, for the per-frame totals
+
+    double TotalSeconds() const;
+    void Print(const char * name) const;  // one line per stage that took any time
+    void WriteJSON(FILE * fp, const char * indent) const;  // a JSON object, without trailing newline
+};
+
+// profile of the object tessellated by this thread, or NULL
+extern __thread Profile * currentProfile;
+
+inline void ProfileCount(ProfileCounter counter, long n = 1)
+{
+    if (currentProfile != NULL)
+        currentProfile->counters[counter] += n;
+}
+
+// Adds the time until destruction (or the next stage) to a stage of the current profile.
+// Next() lets a sequence of stages with early returns, like RefineContourRadial, share one timer.
+class ProfileTimer
+{
+public:
+    ProfileTimer(ProfileStage stage);
+    ~ProfileTimer() { Stop(); }
+    void Next(ProfileStage stage) { Stop(); _stage = stage; _start = ProfileSeconds(); }
+    void Stop();
+
+    static double ProfileSeconds();  // monotonic clock
+
+private:
+    ProfileStage _stage;
+    double _start;   // < 0 once stopped
+};
+
+// true at most every STATUS_INTERVAL seconds (per thread); progress lines printed at every
+// iteration of the refinement loops cost more than the iteration on big meshes
+bool StatusLineDue();
+
+// profile file of an output mesh file: name.ply -> name_profile.json
+std::string ProfileFilename(const char * outputFilename);
+
+// {"objects": [{"name": ..., "profile": {...}}, ...], "frame": {...}}, objects in RIB order
+bool WriteProfileJSON(const char * filename, const std::vector<std::string> & names,
+                      const std::vector<Profile> & profiles, const Profile & frame);
+
+#endif
@@ -6,15 +6,19 @@
 #include <sstream>
 #include <math.h>
 #include <cfloat>
+#include <cstring>
+#include <cctype>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "refineContour.h"
 
-void SavePLYFile(HbrMesh<VertexDataCatmark> * outputMesh, const char *prefix, int index, bool meshSilhouettes)
+void SavePLYFile(TriMesh<VertexDataCatmark> * outputMesh, const char *prefix, int index, bool meshSilhouettes, bool binary)
 {
     // Remove disconnected vertices
-    std::list<MeshVertex*> vertices;
+    std::vector<MeshVertex*> vertices;
     outputMesh->GetVertices(std::back_inserter(vertices));
-    for(std::list<MeshVertex*>::iterator vit = vertices.begin(); vit != vertices.end(); ++vit){
+    for(std::vector<MeshVertex*>::iterator vit = vertices.begin(); vit != vertices.end(); ++vit){
         if(!(*vit)->IsConnected()) {
             outputMesh->DeleteVertex(*vit);
         }
@@ -34,7 +38,88 @@ void SavePLYFile(HbrMesh<VertexDataCatmark> * outputMesh, const char *prefix, in
 
     // ---- output the PLY header ----
 
-    FILE * fp = fopen(outputFilename, "wt");
+    FILE * fp = OpenPLYFile(outputFilename, binary, meshSilhouettes, numVertices, numFaces, false);
+
+    // ---- output all the vertices and save their IDs ----
+
+    int nextVertID = 0;
+    std::map<TriVertex<VertexDataCatmark>*,int> vmapcc;
+
+    std::vector<TriVertex<VertexDataCatmark>*> verts;
+    outputMesh->GetVertices(std::back_inserter(verts));
+    for(std::vector<TriVertex<VertexDataCatmark>*>::iterator vit = verts.begin(); vit!= verts.end(); ++vit)
+    {
+        vmapcc[*vit] = nextVertID;
+        nextVertID ++;
+
+        vec3 normal = OutputVertexNormal(*vit, meshSilhouettes);
+        const vec3 & pos = (*vit)->GetData().pos;
+        double values[6] = { double(pos[0]), double(pos[1]), double(pos[2]),
+                             double(normal[0]), double(normal[1]), double(normal[2]) };
+        WritePLYVertex(fp, binary, values, 6);
+    }
+
+    assert(nextVertID == numVertices);
+
+    // --- output all the faces ----------
+
+    std::vector<TriFace<VertexDataCatmark>*> faces;
+    outputMesh->GetFaces(std::back_inserter(faces));
+    for(std::vector<TriFace<VertexDataCatmark>*>::iterator fit = faces.begin(); fit != faces.end(); ++fit)
+    {
+        assert((*fit)->GetNumVertices() == 3);
+        WritePLYFace(fp, binary, vmapcc[(*fit)->GetVertex(0)], vmapcc[(*fit)->GetVertex(1)], vmapcc[(*fit)->GetVertex(2)], OutputFaceFlag(*fit));
+    }
+
+    // close output file
+    fclose(fp);
+}
+
+vec3 OutputVertexNormal(TriVertex<VertexDataCatmark>* v, bool meshSilhouettes)
+{
+    if (meshSilhouettes)
+        return -1.*v->GetData().normal;
+    return FaceAveragedVertexNormal(v);
+}
+
+int OutputFaceFlag(TriFace<VertexDataCatmark>* face)
+{
+    FacingType vf = VertexBasedFacing(face);
+    int vfint = (vf == FRONT ? 1 : (vf == BACK ? 2 : 3));
+
+    if((face->GetVertex(0)->GetData().facing == CONTOUR ||
+        face->GetVertex(1)->GetData().facing == CONTOUR ||
+        face->GetVertex(2)->GetData().facing == CONTOUR) &&
+            IsRadialFace(face))
+        vfint+=4;
+
+    return vfint;
+}
+
+static bool HostIsLittleEndian()
+{
+    const int one = 1;
+    return *(const char*)&one == 1;
+}
+
+// write n values of size bytes each in little-endian order
+static void WriteLittleEndian(FILE * fp, const void * data, size_t size, size_t n)
+{
+    if (HostIsLittleEndian())
+    {
+        fwrite(data, size, n, fp);
+        return;
+    }
+
+    const char * bytes = (const char*)data;
+    for(size_t i=0; i<n; i++)
+        for(size_t b=0; b<size; b++)
+            fputc(bytes[i*size + size-1-b], fp);
+}
+
+FILE * OpenPLYFile(const char * filename, bool binary, bool meshSilhouettes, int numVertices, int numFaces, bool vertexColors)
+{
+    FILE * fp = fopen(filename, binary ? "wb" : "wt");
 
     if (fp == NULL)
     {
@@ -42,74 +127,68 @@ void SavePLYFile(HbrMesh<VertexDataCatmark> * outputMesh, const char *prefix, in
         exit(1);
     }
 
+    // the ASCII values are printed with %.16f, so the "float" properties actually carry double precision;
+    // binary files declare double to keep it
+    const char * type = binary ? "double" : "float";
+
     fprintf(fp,"ply\n");
-    fprintf(fp,"format ascii 1.0\n");
+    fprintf(fp,"format %s 1.0\n", binary ? "binary_little_endian" : "ascii");
     fprintf(fp,"comment %s\n", meshSilhouettes ? "mesh silhouettes" : "smooth silhouettes");
     fprintf(fp,"element vertex %d\n", numVertices);
-    fprintf(fp,"property float x\n");   // maybe should save as doubles?  what would this require?
-    fprintf(fp,"property float y\n");   // maybe should save as doubles?
-    fprintf(fp,"property float z\n");   // maybe should save as doubles?
-    fprintf(fp,"property float nx\n");
-    fprintf(fp,"property float ny\n");
-    fprintf(fp,"property float nz\n");
+    fprintf(fp,"property %s x\n", type);
+    fprintf(fp,"property %s y\n", type);
+    fprintf(fp,"property %s z\n", type);
+    fprintf(fp,"property %s nx\n", type);
+    fprintf(fp,"property %s ny\n", type);
+    fprintf(fp,"property %s nz\n", type);
+    if (vertexColors)
+    {
+        fprintf(fp,"property %s red\n", type);
+        fprintf(fp,"property %s green\n", type);
+        fprintf(fp,"property %s blue\n", type);
+        fprintf(fp,"property %s ndotv\n", type);
+    }
 
     fprintf(fp,"element face %d\n", numFaces);
     fprintf(fp,"property list uchar int vertex_index\n");
     fprintf(fp,"property uchar int\n");  // vbf
     fprintf(fp,"end_header\n");
 
-    // ---- output all the vertices and save their IDs ----
-
-    int nextVertID = 0;
-    std::map<HbrVertex<VertexDataCatmark>*,int> vmapcc;
+    return fp;
+}
 
-    std::list<HbrVertex<VertexDataCatmark>*> verts;
-    outputMesh->GetVertices(std::back_inserter(verts));
-    for(std::list<HbrVertex<VertexDataCatmark>*>::iterator vit = verts.begin(); vit!= verts.end(); ++vit)
+void WritePLYVertex(FILE * fp, bool binary, const double * values, int numValues)
+{
+    if (binary)
     {
-        vmapcc[*vit] = nextVertID;
-        nextVertID ++;
-        fprintf(fp, "%.16f %.16f %.16f", double((*vit)->GetData().pos[0]), double((*vit)->GetData().pos[1]), double((*vit)->GetData().pos[2]));
-
-        if (!meshSilhouettes)
-        {
-            vec3 normal = FaceAveragedVertexNormal(*vit);
-            fprintf(fp, " %.16f %.16f %.16f\n", double(normal[0]),double(normal[1]),double(normal[2]));
-        }
-        else
-        {
-            vec3 normal = -1.*(*vit)->GetData().normal;
-            fprintf(fp, " %.16f %.16f %.16f\n", double(normal[0]),double(normal[1]),double(normal[2]));
-        }
+        WriteLittleEndian(fp, values, sizeof(double), numValues);
+        return;
     }
 
-    assert(nextVertID == numVertices);
-
-    // --- output all the faces ----------
+    for(int i=0; i<numValues; i++)
+        fprintf(fp, i == 0 ? "%.16f" : " %.16f", values[i]);
+    fprintf(fp, "\n");
+}
 
-    std::list<HbrFace<VertexDataCatmark>*> faces;
-    outputMesh->GetFaces(std::back_inserter(faces));
-    for(std::list<HbrFace<VertexDataCatmark>*>::iterator fit = faces.begin(); fit != faces.end(); ++fit)
+void WritePLYFace(FILE * fp, bool binary, int v0, int v1, int v2, int vbf)
+{
+    if (!binary)
     {
-        FacingType vf = VertexBasedFacing(*fit);
-        int vfint = (vf == FRONT ? 1 : (vf == BACK ? 2 : 3));
-
-        if(((*fit)->GetVertex(0)->GetData().facing == CONTOUR ||
-            (*fit)->GetVertex(1)->GetData().facing == CONTOUR ||
-            (*fit)->GetVertex(2)->GetData().facing == CONTOUR) &&
-                IsRadialFace(*fit))
-            vfint+=4;
-
-        assert((*fit)->GetNumVertices() == 3);
-        fprintf(fp,"3 %d %d %d %d\n", vmapcc[(*fit)->GetVertex(0)], vmapcc[(*fit)->GetVertex(1)], vmapcc[(*fit)->GetVertex(2)], vfint);
+        fprintf(fp,"3 %d %d %d %d\n", v0, v1, v2, vbf);
+        return;
     }
 
-    // close output file
-    fclose(fp);
+    assert(sizeof(int) == 4);
+    unsigned char count = 3, vbfByte = (unsigned char)vbf;
+    int indices[3] = { v0, v1, v2 };
+    fwrite(&count, 1, 1, fp);
+    WriteLittleEndian(fp, indices, sizeof(int), 3);
+    fwrite(&vbfByte, 1, 1, fp);
 }
 
 
-int numVerts = 0;
+// vertex creation counter (VertexDataCatmark::age), per thread since objects are tessellated concurrently
+__thread int numVerts = 0;
 
 bool IsRadialFace(MeshVertex* v0, MeshVertex* v1, MeshVertex* v2)
 {
@@ -164,6 +243,13 @@ void SetupVertex(VertexDataCatmark & vd, const ParamPointCC & p, const vec3 & ca
 
     p.Evaluate(limitPosition, limitNormal, &k1, &k2, &pdir1, &pdir2);
 
+    SetupVertex(vd, p, cameraCenter, limitPosition, limitNormal, k1, k2);
+}
+
+// same as above, with the limit quantities already evaluated (e.g., by ParamPointCC::EvaluateBatch)
+void SetupVertex(VertexDataCatmark & vd, const ParamPointCC & p, const vec3 & cameraCenter,
+                 const vec3 & limitPosition, const vec3 & limitNormal, real k1, real k2)
+{
     real ndotv;
 
     vec3 viewVec = limitPosition - cameraCenter;
@@ -242,36 +328,70 @@ void SetupVertex(VertexDataCatmark & vd, const ParamPointCC & p, const vec3 & ca
 //    vd.radialCurvature = k_r;
 }
 
-real FindZeroCrossingBySampling(const ParamPointCC & p0, const ParamPointCC & p1, FacingType facing, vec3 cameraCenter)
-// given an edge where the vertices/face are all consistent (e.g., all front- or back-facing),
-// sample the edge to see if there are any points on the edge with opposite facing.
-// if none found, return a Null ParamPoint
+void FindZeroCrossingsBySampling(int numEdges, const ParamPointCC * p0, const ParamPointCC * p1, const FacingType * facing,
+                                 const vec3 & cameraCenter, real * result)
+// given edges where the vertices/face are all consistent (e.g., all front- or back-facing),
+// sample each edge to see if there are any points on it with opposite facing.
+// result[i] is the parameter of the sample with the strongest opposite facing on edge i, or -1 if none found.
+// all the samples are evaluated in a single batch.
 {
-    real maxNdotVmag = 0;
-    real result = -1;
+    std::vector<ParamPointCC> pts;
+    std::vector<int> edge;
+    std::vector<real> ts;
+    pts.reserve(numEdges*NUM_INCONSISTENT_SAMPLES);
 
-    for(int j=0;j<NUM_INCONSISTENT_SAMPLES;j++)
+    for(int i=0;i<numEdges;i++)
     {
-        real t = (j+1.0)/(NUM_INCONSISTENT_SAMPLES + 1);
-        ParamPointCC pt = ParamPointCC::Interpolate(p0, p1, t);
+        result[i] = -1;
 
-        if (!pt.IsEvaluable()){
-            printf("NOT EVALUABLE\n");
-            continue;
+        for(int j=0;j<NUM_INCONSISTENT_SAMPLES;j++)
+        {
+            real t = (j+1.0)/(NUM_INCONSISTENT_SAMPLES + 1);
+            ParamPointCC pt = ParamPointCC::Interpolate(p0[i], p1[i], t);
+
+            if (!pt.IsEvaluable()){
+                printf("NOT EVALUABLE\n");
+                continue;
+            }
+
+            pt.SetNormalOffset(0);
+
+            pts.push_back(pt);
+            edge.push_back(i);
+            ts.push_back(t);
         }
+    }
+
+    if (pts.empty())
+        return;
+
+    std::vector<vec3> limitPos, limitNormal;
+    ParamPointCC::EvaluateBatch(pts, limitPos, limitNormal);
 
-        pt.SetNormalOffset(0);
+    std::vector<real> maxNdotVmag(numEdges, 0);
+
+    for(size_t k=0;k<pts.size();k++)
+    {
+        int i = edge[k];
 
         real ndotv;
-        FacingType ft = Facing(pt, cameraCenter, CONTOUR_THRESHOLD, &ndotv);
+        FacingType ft = Facing(limitPos[k] - cameraCenter, limitNormal[k], CONTOUR_THRESHOLD, &ndotv);
 
-        if (ft != CONTOUR && ft != facing && fabsl(ndotv) > maxNdotVmag)
+        if (ft != CONTOUR && ft != facing[i] && std::fabs(ndotv) > maxNdotVmag[i])
         {
-            maxNdotVmag = fabsl(ndotv);
-            result = t;
+            maxNdotVmag[i] = std::fabs(ndotv);
+            result[i] = ts[k];
         }
     }
+}
 
+real FindZeroCrossingBySampling(const ParamPointCC & p0, const ParamPointCC & p1, FacingType facing, vec3 cameraCenter)
+// given an edge where the vertices/face are all consistent (e.g., all front- or back-facing),
+// sample the edge to see if there are any points on the edge with opposite facing.
+// if none found, return -1
+{
+    real result;
+    FindZeroCrossingsBySampling(1, &p0, &p1, &facing, cameraCenter, &result);
     return result;
 }
 
@@ -296,16 +416,12 @@ MeshVertex * ConvertVertex(Mesh * outputMesh, CatmarkVertex * sourceVertex,
     return newVertex;
 }
 
-// generate a face in the output mesh from a face in the input mesh, using the specified vertices of the source face
-void ConvertFaceToTriangle(Mesh * outputMesh, CatmarkFace * face, int v0, int v1, int v2,
-                           std::map<CatmarkVertex*,MeshVertex *> & vertexMap,
-                           const  CameraModel & cameraModel)
+// generate a face in the output mesh from three source vertices, unless it is outside the view frustum
+void ConvertVerticesToTriangle(Mesh * outputMesh, CatmarkVertex * v0, CatmarkVertex * v1, CatmarkVertex * v2,
+                               std::map<CatmarkVertex*,MeshVertex *> & vertexMap,
+                               const  CameraModel & cameraModel)
 {
-    CatmarkVertex * vertex[3];
-
-    vertex[0] = face->GetVertex(v0);
-    vertex[1] = face->GetVertex(v1);
-    vertex[2] = face->GetVertex(v2);
+    CatmarkVertex * vertex[3] = { v0, v1, v2 };
 
     if (!cameraModel.TriangleInside(vertex[0]->GetData().GetPos(),
                                     vertex[1]->GetData().GetPos(),
@@ -320,6 +436,15 @@ void ConvertFaceToTriangle(Mesh * outputMesh, CatmarkFace * face, int v0, int v1
     NewFace(outputMesh, vertexMap[vertex[0]],vertexMap[vertex[1]],vertexMap[vertex[2]]);
 }
 
+// generate a face in the output mesh from a face in the input mesh, using the specified vertices of the source face
+void ConvertFaceToTriangle(Mesh * outputMesh, CatmarkFace * face, int v0, int v1, int v2,
+                           std::map<CatmarkVertex*,MeshVertex *> & vertexMap,
+                           const  CameraModel & cameraModel)
+{
+    ConvertVerticesToTriangle(outputMesh, face->GetVertex(v0), face->GetVertex(v1), face->GetVertex(v2),
+                              vertexMap, cameraModel);
+}
+
 // insert a point at the center of a source quad and generate four triangles in the output mesh
 void ConvertFaceToTriangles(Mesh * outputMesh, CatmarkFace * face,
                             std::map<CatmarkVertex*, MeshVertex*> & vertexMap,
@@ -377,6 +502,47 @@ void ConvertQuadFace(Mesh * outputMesh, CatmarkFace * face,
             vertexMap[face->GetVertex(2)], vertexMap[face->GetVertex(3)]);
 }
 
+// convert a quad of the finest sampling level to one, two or four output faces
+void ConvertFace(Mesh * outputMesh, CatmarkFace * face, bool triangles,
+                 std::map<CatmarkVertex*, MeshVertex*> & vertexMap,
+                 const CameraModel & cameraModel)
+{
+    bool extraord[4];
+    int numExtraord = 0;
+
+    // ------ create two triangles from this quad -------
+
+    assert(face->GetNumVertices() == 4);
+
+    // want to make sure that there's a diagonal emanating from each extraordinary vertex
+    for(int j=0;j<4;j++)
+    {
+        extraord[j] = (face->GetVertex(j)->GetValence() != 4 || face->GetVertex(j)->OnBoundary());
+        if (extraord[j])
+            numExtraord ++;
+    }
+
+    if (triangles)
+    {
+        // check if there are adjacent extraordinary points and we need to split into four triangles
+        if ((extraord[1] || extraord[3]) && (extraord[0] || extraord[2]))
+            ConvertFaceToTriangles(outputMesh, face, vertexMap, cameraModel);
+        else
+            if (extraord[1] || extraord[3])
+            {
+                ConvertFaceToTriangle(outputMesh, face, 0,1,3, vertexMap, cameraModel);
+                ConvertFaceToTriangle(outputMesh, face, 1,2,3, vertexMap, cameraModel);
+            }
+            else
+            {
+                ConvertFaceToTriangle(outputMesh, face, 0,1,2, vertexMap, cameraModel);
+                ConvertFaceToTriangle(outputMesh, face, 0,2,3, vertexMap, cameraModel);
+            }
+    }
+    else
+        ConvertQuadFace(outputMesh, face, vertexMap, cameraModel);
+}
+
 int IsNearBoundary(CatmarkFace * face, int distance)
 {
     // is this face within "distance" of the boundary?
@@ -421,9 +587,300 @@ void RefineFaceUniform(HbrFace<T>* face, int level)
     }
 }
 
+// ------------------------------- ADAPTIVE SAMPLING -----------------------------------------
+//
+// The coarse faces whose limit surface cannot reach the view frustum are not refined at all (except
+// for one ring of margin, so that the evaluator sees complete neighbourhoods). The children of the
+// visible coarse faces ("roots", always quads) are each sampled at their own level: coarse enough
+// that a triangle covers about targetArea pixels, and at the finest level near predicted contours
+// and mesh boundaries. Along a side shared with a finer root, the cells of the coarser root are
+// fanned from their center to the finer root's vertices, so the output mesh stays conforming.
+
+// can the limit surface of this coarse face intersect the view frustum?  (convex hull property:
+// the limit surface lies within the hull of the control points of the faces around the face)
+bool CoarseFaceInFrustum(CatmarkFace * face, const CameraModel & cameraModel)
+{
+    std::set<CatmarkVertex*> hull;
+
+    for(int i=0;i<face->GetNumVertices();i++)
+    {
+        std::set<CatmarkFace*> oneRing;
+        GetOneRing(face->GetVertex(i), oneRing);
+
+        for(std::set<CatmarkFace*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
+            for(int j=0;j<(*it)->GetNumVertices();j++)
+                hull.insert((*it)->GetVertex(j));
+    }
+
+    std::vector<vec3> pts;
+    for(std::set<CatmarkVertex*>::iterator it = hull.begin(); it != hull.end(); ++it)
+        pts.push_back((*it)->GetData().GetPos());
+
+    return cameraModel.HullInside(pts);
+}
+
+CatmarkHalfedge * FindSourceEdge(CatmarkVertex * v0, CatmarkVertex * v1)
+{
+    CatmarkHalfedge * edge = v0->GetEdge(v1);
+    return edge != NULL ? edge : v1->GetEdge(v0);
+}
+
+// the quad with consecutive corners v0, v1 and v2
+CatmarkFace * FindSourceQuad(CatmarkVertex * v0, CatmarkVertex * v1, CatmarkVertex * v2)
+{
+    CatmarkHalfedge * edges[2] = { v0->GetEdge(v1), v1->GetEdge(v0) };
+
+    for(int i=0;i<2;i++)
+    {
+        if (edges[i] == NULL || edges[i]->GetFace() == NULL)
+            continue;
+
+        CatmarkFace * face = edges[i]->GetFace();
+        for(int j=0;j<face->GetNumVertices();j++)
+            if (face->GetVertex(j) == v2)
+                return face;
+    }
+
+    return NULL;
+}
+
+// vertices of a refined source quad, "levels" levels below it, as an (N+1)x(N+1) grid with N = 2^levels:
+// grid[a + b*(N+1)], with a going from vertex 0 to vertex 1 and b from vertex 0 to vertex 3
+void GetQuadGrid(CatmarkFace * face, int levels, std::vector<CatmarkVertex*> & grid)
+{
+    assert(face->GetNumVertices() == 4);
+
+    int n = 1;
+    grid.resize(4);
+    grid[0] = face->GetVertex(0);
+    grid[1] = face->GetVertex(1);
+    grid[3] = face->GetVertex(2);
+    grid[2] = face->GetVertex(3);
+
+    for(int l=0;l<levels;l++)
+    {
+        int G = n+1, G2 = 2*n+1;
+        std::vector<CatmarkVertex*> fine(G2*G2, (CatmarkVertex*)NULL);
+
+        for(int b=0;b<=n;b++)
+            for(int a=0;a<=n;a++)
+            {
+                fine[2*a + 2*b*G2] = grid[a + b*G]->Subdivide();
+                if (a < n)
+                    fine[2*a+1 + 2*b*G2] = FindSourceEdge(grid[a + b*G], grid[a+1 + b*G])->Subdivide();
+                if (b < n)
+                    fine[2*a + (2*b+1)*G2] = FindSourceEdge(grid[a + b*G], grid[a + (b+1)*G])->Subdivide();
+                if (a < n && b < n)
+                    fine[2*a+1 + (2*b+1)*G2] = FindSourceQuad(grid[a + b*G], grid[a+1 + b*G], grid[a+1 + (b+1)*G])->Subdivide();
+            }
+
+        grid.swap(fine);
+        n *= 2;
+    }
+}
+
+// triangulate a sampling cell like ConvertFace does for a quad of the finest level, with a
+// diagonal emanating from each extraordinary vertex
+void ConvertCellToTriangles(Mesh * outputMesh, CatmarkVertex * const corner[4], CatmarkVertex * center,
+                            std::map<CatmarkVertex*, MeshVertex*> & vertexMap,
+                            const CameraModel & cameraModel)
+{
+    bool extraord[4];
+    for(int j=0;j<4;j++)
+        extraord[j] = (corner[j]->GetValence() != 4 || corner[j]->OnBoundary());
+
+    if ((extraord[1] || extraord[3]) && (extraord[0] || extraord[2]))
+        for(int e=0;e<4;e++)
+            ConvertVerticesToTriangle(outputMesh, corner[e], corner[(e+1)%4], center, vertexMap, cameraModel);
+    else
+        if (extraord[1] || extraord[3])
+        {
+            ConvertVerticesToTriangle(outputMesh, corner[0], corner[1], corner[3], vertexMap, cameraModel);
+            ConvertVerticesToTriangle(outputMesh, corner[1], corner[2], corner[3], vertexMap, cameraModel);
+        }
+        else
+        {
+            ConvertVerticesToTriangle(outputMesh, corner[0], corner[1], corner[2], vertexMap, cameraModel);
+            ConvertVerticesToTriangle(outputMesh, corner[0], corner[2], corner[3], vertexMap, cameraModel);
+        }
+}
+
+void SampleFacesAdaptive(Mesh * outputMesh, CatmarkMesh * sourceMesh, const std::vector<bool> & inFrustum,
+                         int subdivisionLevel, real targetArea, const CameraModel & cameraModel,
+                         std::map<CatmarkVertex*, MeshVertex*> & vertexMap)
+{
+    const int N = 1 << (subdivisionLevel-1);   // finest cells per root side
+    const int G = N+1;
+    const int nearBoundaryDistance = pow(2, subdivisionLevel);
+
+    std::vector<CatmarkFace*> roots;
+    for(size_t i=0;i<inFrustum.size();i++)
+    {
+        CatmarkFace * face = sourceMesh->GetFace(i);
+        if (!inFrustum[i] || !face->HasLimit())
+            continue;
+        for(int k=0;k<face->GetNumVertices();k++)
+            if (face->GetChild(k) != NULL)
+                roots.push_back(face->GetChild(k));
+    }
+
+    std::vector<std::vector<CatmarkVertex*> > grids(roots.size());
+    std::vector<std::vector<CatmarkFace*> > cells(roots.size());   // finest quads, NULL if near the boundary
+    std::vector<int> level(roots.size(), subdivisionLevel);
+    std::map<CatmarkFace*,int> rootIndex;
+
+    // the limit surface is probed at the corners and center of each root to predict contours
+    const int NUM_PROBES = 5;
+    const int probeIndex[NUM_PROBES] = { 0, N, N + N*G, N*G, N/2 + (N/2)*G };
+    std::vector<ParamPointCC> probes;
+
+    for(size_t r=0;r<roots.size();r++)
+    {
+        rootIndex[roots[r]] = r;
+        GetQuadGrid(roots[r], subdivisionLevel-1, grids[r]);
+
+        bool nearBoundary = false;
+        cells[r].resize(N*N);
+        for(int b=0;b<N;b++)
+            for(int a=0;a<N;a++)
+            {
+                CatmarkFace * cell = FindSourceQuad(grids[r][a + b*G], grids[r][a+1 + b*G], grids[r][a+1 + (b+1)*G]);
+                if (cell == NULL || IsNearBoundary(cell, nearBoundaryDistance))
+                {
+                    cell = NULL;
+                    nearBoundary = true;
+                }
+                cells[r][a + b*N] = cell;
+            }
+
+        for(int j=0;j<NUM_PROBES;j++)
+            probes.push_back(ParamPointCC(grids[r][probeIndex[j]]));
+
+        if (nearBoundary)
+            continue;
+
+        vec3 corner[4];
+        bool projectable = true;
+        for(int j=0;j<4;j++)
+        {
+            corner[j] = grids[r][probeIndex[j]]->GetData().GetPos();
+            projectable = projectable && cameraModel.InFrontOfNearPlane(corner[j]);
+        }
+
+        if (!projectable)
+            continue;
+
+        real area = cameraModel.ImageSpaceArea(corner[0], corner[1], corner[2]) +
+                cameraModel.ImageSpaceArea(corner[0], corner[2], corner[3]);
+
+        // each cell at level l is split into two triangles
+        int l = 1;
+        while (l < subdivisionLevel && area / (2 * pow(4, l-1)) > targetArea)
+            l++;
+        level[r] = l;
+    }
+
+    std::vector<vec3> probePos, probeNormal;
+    ParamPointCC::EvaluateBatch(probes, probePos, probeNormal);
+
+    int numCoarse = 0;
+    for(size_t r=0;r<roots.size();r++)
+    {
+        bool front = false, back = false;
+        for(int j=0;j<NUM_PROBES;j++)
+        {
+            real ndotv = (probePos[r*NUM_PROBES+j] - cameraModel.CameraCenter()) * probeNormal[r*NUM_PROBES+j];
+            front = front || ndotv <= 0;
+            back = back || ndotv >= 0;
+        }
+        if (front && back)
+            level[r] = subdivisionLevel;
+        if (level[r] < subdivisionLevel)
+            numCoarse ++;
+    }
+
+    printf("Adaptive sampling: %d / %d root faces below level %d\n", numCoarse, (int)roots.size(), subdivisionLevel);
+
+    for(size_t r=0;r<roots.size();r++)
+    {
+        if (StatusLineDue())
+        {
+            printf("Processing root face %d / %d \r", (int)r, (int)roots.size());
+            fflush(stdout);
+        }
+
+        const std::vector<CatmarkVertex*> & grid = grids[r];
+        int l = level[r];
+
+        if (l == subdivisionLevel)
+        {
+            for(int i=0;i<N*N;i++)
+                if (cells[r][i] != NULL)
+                    ConvertFace(outputMesh, cells[r][i], true, vertexMap, cameraModel);
+            continue;
+        }
+
+        // level of the samples along each side: the finer of this root and its neighbour
+        int sideLevel[4];
+        CatmarkHalfedge * edge = roots[r]->GetFirstEdge();
+        for(int k=0;k<4;k++)
+        {
+            sideLevel[k] = l;
+            CatmarkHalfedge * opposite = edge->GetOpposite();
+            if (opposite != NULL && rootIndex.find(opposite->GetFace()) != rootIndex.end())
+                sideLevel[k] = std::max(l, level[rootIndex[opposite->GetFace()]]);
+            edge = edge->GetNext();
+        }
+
+        int n = 1 << (l-1);
+        int step = N / n;
+
+        for(int b=0;b<n;b++)
+            for(int a=0;a<n;a++)
+            {
+                int x0 = a*step, y0 = b*step, x1 = x0+step, y1 = y0+step;
+
+                // number of segments on each side of the cell, in the order of the root's sides
+                int segments[4] = { 1, 1, 1, 1 };
+                if (b == 0)   segments[0] = 1 << (sideLevel[0] - l);
+                if (a == n-1) segments[1] = 1 << (sideLevel[1] - l);
+                if (b == n-1) segments[2] = 1 << (sideLevel[2] - l);
+                if (a == 0)   segments[3] = 1 << (sideLevel[3] - l);
+
+                CatmarkVertex * center = grid[x0 + step/2 + (y0 + step/2)*G];
+
+                if (segments[0] == 1 && segments[1] == 1 && segments[2] == 1 && segments[3] == 1)
+                {
+                    CatmarkVertex * corner[4] = { grid[x0 + y0*G], grid[x1 + y0*G], grid[x1 + y1*G], grid[x0 + y1*G] };
+                    ConvertCellToTriangles(outputMesh, corner, center, vertexMap, cameraModel);
+                    continue;
+                }
+
+                // stitch: fan from the center to every sample on the cell boundary
+                const int sideStart[4][2] = { {x0,y0}, {x1,y0}, {x1,y1}, {x0,y1} };
+                const int sideDir[4][2] = { {1,0}, {0,1}, {-1,0}, {0,-1} };
+                std::vector<CatmarkVertex*> boundary;
+
+                for(int k=0;k<4;k++)
+                    for(int j=0;j<segments[k];j++)
+                    {
+                        int d = j * step / segments[k];
+                        boundary.push_back(grid[sideStart[k][0] + d*sideDir[k][0] + (sideStart[k][1] + d*sideDir[k][1])*G]);
+                    }
+
+                for(size_t j=0;j<boundary.size();j++)
+                    ConvertVerticesToTriangle(outputMesh, boundary[j], boundary[(j+1)%boundary.size()], center,
+                                              vertexMap, cameraModel);
+            }
+    }
+
+    printf("\n");
+}
+
 // sample an initial triangle mesh from a surface, clipping to the view frustum
 Mesh * SurfaceToMesh(CatmarkMesh * sourceMesh, int subdivisionLevel,
-                     const CameraModel & cameraModel, bool triangles)
+                     const CameraModel & cameraModel, bool triangles,
+                     int refineThreads, std::vector<int> * visibleFaces, real adaptiveArea)
 {
     // subdivide the mesh up to _subdivisionLevel
     // subdividing at least once is necessary since later steps assume all faces are quads.
@@ -431,10 +888,44 @@ Mesh * SurfaceToMesh(CatmarkMesh * sourceMesh, int subdivisionLevel,
 
     printf("nb faces: %d\n",numFaces);
 
+    // adaptive sampling needs at least two levels to choose from, and only produces triangles
+    bool adaptive = adaptiveArea > 0 && triangles && subdivisionLevel >= 2;
+
+    // coarse faces that can be seen, and those that are refined (the visible ones plus a margin)
+    std::vector<bool> inFrustum(numFaces, true);
+    std::vector<bool> refine(numFaces, true);
+
+    if (adaptive)
+    {
+        int numInFrustum = 0;
+        for(int i=0;i<numFaces;i++)
+        {
+            inFrustum[i] = CoarseFaceInFrustum(sourceMesh->GetFace(i), cameraModel);
+            if (inFrustum[i])
+                numInFrustum ++;
+        }
+
+        for(int i=0;i<numFaces;i++)
+        {
+            CatmarkFace * face = sourceMesh->GetFace(i);
+            refine[i] = inFrustum[i];
+            for(int j=0;j<face->GetNumVertices() && !refine[i];j++)
+            {
+                std::set<CatmarkFace*> oneRing;
+                GetOneRing(face->GetVertex(j), oneRing);
+                for(std::set<CatmarkFace*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
+                    if (inFrustum[(*it)->GetID()])
+                        refine[i] = true;
+            }
+        }
+
+        printf("Adaptive sampling: %d / %d coarse faces in the view frustum\n", numInFrustum, numFaces);
+    }
+
     for(int i=0;i<numFaces;i++)
     {
         CatmarkFace* face = sourceMesh->GetFace(i);
-        if (face->HasLimit())
+        if (face->HasLimit() && refine[i])
             RefineFaceUniform(face,subdivisionLevel);
     }
 
@@ -470,139 +961,414 @@ Mesh * SurfaceToMesh(CatmarkMesh * sourceMesh, int subdivisionLevel,
     }
     topology.numVertices = (int)pointPositions.size()/3;
 
-    for(int i=0; i<sourceMesh->GetNumFaces(); ++i){
-        CatmarkFace* f = sourceMesh->GetFace(i);
-        if(f->GetDepth()!=subdivisionLevel)
-            continue;
-        Subdiv::getInstance().faceIndexMap[i] = topology.nverts.size();
-        topology.nverts.push_back(f->GetNumVertices());
-        for (int j=0; j<f->GetNumVertices(); ++j){
-            topology.indices.push_back(indexMap[f->GetVertex(j)->GetID()]);
+    // evaluator for this surface, owned by the source mesh
+    Subdiv & subdiv = Subdiv::Attach(sourceMesh);
+    subdiv.faceIndexMap.assign(sourceMesh->GetNumFaces(), -1);
+
+    for(int i=0; i<sourceMesh->GetNumFaces(); ++i){
+        CatmarkFace* f = sourceMesh->GetFace(i);
+        if(f->GetDepth()!=subdivisionLevel)
+            continue;
+        subdiv.faceIndexMap[i] = topology.nverts.size();
+        topology.nverts.push_back(f->GetNumVertices());
+        for (int j=0; j<f->GetNumVertices(); ++j){
+            topology.indices.push_back(indexMap[f->GetVertex(j)->GetID()]);
+        }
+    }
+
+    topology.refinementLevel = 5;
+
+    std::string *errorMessage;
+    if(!topology.IsValid(errorMessage)){
+        std::cout << "Initialize failed with " << *errorMessage << std::endl;
+        return NULL;
+    }
+
+    subdiv.initialize(topology,pointPositions,refineThreads);
+
+    // charts are built on demand by ParamPoint::FindChart
+    subdiv.chartCache = new ChartCache<Vertex>(sourceMesh->GetNumVertices());
+
+    Mesh * outputMesh = new Mesh;
+
+    if (outputMesh == NULL)
+    {
+        printf("Mesh allocation failed");
+        return NULL;
+    }
+
+    // ------------- transfer all of the faces ----------------------------
+
+    std::map<CatmarkVertex*,MeshVertex *> vertexMap;              // Mapping from input to output vertices
+
+    int initialNumFaces = sourceMesh->GetNumFaces();
+    printf("nb faces after refine: %d\n",initialNumFaces);
+
+    if (adaptive)
+    {
+        // the refined coarse faces determine the numbering of the refined source mesh
+        for(int i=0;i<numFaces && visibleFaces != NULL;i++)
+            if (refine[i] && sourceMesh->GetFace(i)->HasLimit())
+                visibleFaces->push_back(i);
+
+        SampleFacesAdaptive(outputMesh, sourceMesh, inFrustum, subdivisionLevel, adaptiveArea, cameraModel, vertexMap);
+    }
+    else
+    {
+        // copy all faces, creating new vertices as necessary
+        for(int i=0;i<initialNumFaces; i++)
+        {
+            CatmarkFace * face = sourceMesh->GetFace(i);
+
+            // skip faces that are near the boundary
+            if(face->GetDepth() != subdivisionLevel || IsNearBoundary(face, pow(2, subdivisionLevel))){
+                continue;
+            }
+
+            if (StatusLineDue())
+            {
+                printf("Processing face %d / %d \r", i, initialNumFaces);
+                fflush(stdout);
+            }
+
+            int numFacesBefore = outputMesh->GetNumFaces();
+
+            ConvertFace(outputMesh, face, triangles, vertexMap, cameraModel);
+
+            if (visibleFaces != NULL && outputMesh->GetNumFaces() > numFacesBefore)
+                visibleFaces->push_back(i);
+        }
+
+        printf("\n");
+    }
+
+    printf("nb output faces: %d\n",outputMesh->GetNumFaces());
+
+    // was the entire thing culled?
+    if (outputMesh->GetNumFaces() == 0)
+    {
+        delete outputMesh;
+        return NULL;
+    }
+
+    // generate charts.  this has to be done after the geometry is complete
+
+    return outputMesh;
+}
+
+//////////////////////////////// TEMPORAL CACHE: REUSE OF THE PREVIOUS FRAME ////////////////////////
+
+// The refined mesh of an object is saved after RefineContour, with every vertex stored as its
+// location on the source mesh. The next frame reloads it instead of the uniformly sampled mesh if the
+// source topology, the set of visible source faces and the sampled triangles are unchanged. The vertices
+// are re-evaluated on the new limit surface, so RefineContour only queues the faces that became
+// inconsistent.
+
+const char * TEMPORAL_CACHE_MAGIC = "contours-temporal-cache";
+const int TEMPORAL_CACHE_VERSION = 2;
+
+// a cached mesh that grew past this many times the size of the fresh sampling is dropped
+const int TEMPORAL_CACHE_MAX_GROWTH = 4;
+
+std::string TemporalCacheFilename(const char * directory, const std::string & objectName, int nameIndex,
+                                  int numControlFaces)
+{
+    std::string name;
+    for(size_t i=0;i<objectName.size();i++)
+        name += isalnum((unsigned char)objectName[i]) ? objectName[i] : '_';
+
+    // objects sharing a name each get their own file, so that concurrent jobs never write the same one
+    std::ostringstream filename;
+    filename << directory << "/" << name << "-" << numControlFaces;
+    if (nameIndex > 0)
+        filename << "-" << nameIndex;
+    filename << ".tcache";
+    return filename.str();
+}
+
+// FNV-1a over the source location of every vertex of every face.  The visible source faces do not
+// tell which of their triangles survived the frustum culling, so this is compared as well.
+static void HashValue(unsigned long long & hash, unsigned long long value)
+{
+    for(int i=0;i<8;i++)
+    {
+        hash ^= (value >> (8*i)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+}
+
+static unsigned long long HashReal(real value)
+{
+    double d = (double)value;
+    unsigned long long bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+unsigned long long SampledTrianglesKey(Mesh * mesh)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    std::vector<MeshFace*> faces;
+    mesh->GetFaces(std::back_inserter(faces));
+
+    for(size_t i=0;i<faces.size();i++)
+        for(int j=0;j<faces[i]->GetNumVertices();j++)
+        {
+            const ParamPointCC & loc = faces[i]->GetVertex(j)->GetData().sourceLoc;
+
+            if (loc.SourceVertex() != NULL)
+            {
+                HashValue(hash, 'V');
+                HashValue(hash, loc.SourceVertex()->GetID());
+            }
+            else if (loc.SourceEdge() != NULL)
+            {
+                HashValue(hash, 'E');
+                HashValue(hash, loc.SourceEdge()->GetOrgVertex()->GetID());
+                HashValue(hash, loc.SourceEdge()->GetDestVertex()->GetID());
+                HashValue(hash, HashReal(loc.EdgeT()));
+            }
+            else
+            {
+                HashValue(hash, 'F');
+                HashValue(hash, loc.SourceFace()->GetID());
+                HashValue(hash, HashReal(loc.FaceU()));
+                HashValue(hash, HashReal(loc.FaceV()));
+            }
         }
-    }
 
-    topology.refinementLevel = 5;
+    return hash;
+}
 
-    std::string *errorMessage;
-    if(!topology.IsValid(errorMessage)){
-        std::cout << "Initialize failed with " << *errorMessage << std::endl;
-        return NULL;
+bool SaveTemporalCache(const char * filename, Mesh * mesh, CatmarkMesh * sourceMesh, int subdivisionLevel,
+                       const std::vector<int> & visibleFaces, unsigned long long sampledTriangles)
+{
+    FILE * fp = fopen(filename, "wt");
+    if (fp == NULL)
+    {
+        printf("WARNING: CANNOT WRITE TEMPORAL CACHE %s\n", filename);
+        return false;
     }
 
-    Subdiv::getInstance().initialize(topology,pointPositions);
+    std::vector<MeshVertex*> verts;
+    std::vector<MeshFace*> faces;
+    mesh->GetVertices(std::back_inserter(verts));
+    mesh->GetFaces(std::back_inserter(faces));
+
+    std::map<MeshVertex*,int> index;
+    for(size_t i=0;i<verts.size();i++)
+        index[verts[i]] = (int)i;
 
-    Mesh * outputMesh = new Mesh;
+    fprintf(fp, "%s %d\n", TEMPORAL_CACHE_MAGIC, TEMPORAL_CACHE_VERSION);
+    fprintf(fp, "source %d %d %d\n", sourceMesh->GetNumFaces(), sourceMesh->GetNumVertices(), subdivisionLevel);
 
-    if (outputMesh == NULL)
+    fprintf(fp, "visible %d\n", (int)visibleFaces.size());
+    for(size_t i=0;i<visibleFaces.size();i++)
+        fprintf(fp, "%d\n", visibleFaces[i]);
+    fprintf(fp, "sampled %llx\n", sampledTriangles);
+
+    // vertex: kind (V, E or F), source element IDs, parameters and normal offset (as hex floats, so
+    // that the locations round-trip exactly), extSrc index
+    fprintf(fp, "vertices %d\n", (int)verts.size());
+    for(size_t i=0;i<verts.size();i++)
     {
-        printf("Mesh allocation failed");
-        return NULL;
+        const VertexDataCatmark & data = verts[i]->GetData();
+        const ParamPointCC & loc = data.sourceLoc;
+        int extSrc = data.extSrc != NULL ? index[data.extSrc] : -1;
+        long double offset = loc.NormalOffset();
+
+        if (loc.SourceVertex() != NULL)
+            fprintf(fp, "V %d %La %d\n", loc.SourceVertex()->GetID(), offset, extSrc);
+        else if (loc.SourceEdge() != NULL)
+            fprintf(fp, "E %d %d %La %La %d\n", loc.SourceEdge()->GetOrgVertex()->GetID(), loc.SourceEdge()->GetDestVertex()->GetID(),
+                    (long double)loc.EdgeT(), offset, extSrc);
+        else
+            fprintf(fp, "F %d %La %La %La %d\n", loc.SourceFace()->GetID(), (long double)loc.FaceU(), (long double)loc.FaceV(),
+                    offset, extSrc);
     }
 
-    // ------------- transfer all of the faces ----------------------------
+    fprintf(fp, "faces %d\n", (int)faces.size());
+    for(size_t i=0;i<faces.size();i++)
+        fprintf(fp, "%d %d %d\n", index[faces[i]->GetVertex(0)], index[faces[i]->GetVertex(1)], index[faces[i]->GetVertex(2)]);
 
-    std::map<CatmarkVertex*,MeshVertex *> vertexMap;              // Mapping from input to output vertices
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
 
-    int initialNumFaces = sourceMesh->GetNumFaces();
-    printf("nb faces after refine: %d\n",initialNumFaces);
+Mesh * LoadTemporalCache(const char * filename, CatmarkMesh * sourceMesh, int subdivisionLevel,
+                         const std::vector<int> & visibleFaces, unsigned long long sampledTriangles,
+                         int numFreshFaces, const vec3 & cameraCenter)
+// returns NULL if there is no usable cache for this frame
+{
+    FILE * fp = fopen(filename, "rt");
+    if (fp == NULL)
+        return NULL;
+
+    char magic[64];
+    int version, numSourceFaces, numSourceVertices, level, numVisible;
 
-    // copy all faces, creating new vertices as necessary
-    for(int i=0;i<initialNumFaces; i++)
+    if (fscanf(fp, "%63s %d", magic, &version) != 2 || strcmp(magic, TEMPORAL_CACHE_MAGIC) != 0 ||
+            version != TEMPORAL_CACHE_VERSION ||
+            fscanf(fp, " source %d %d %d", &numSourceFaces, &numSourceVertices, &level) != 3 ||
+            numSourceFaces != sourceMesh->GetNumFaces() || numSourceVertices != sourceMesh->GetNumVertices() ||
+            level != subdivisionLevel ||
+            fscanf(fp, " visible %d", &numVisible) != 1 || numVisible != (int)visibleFaces.size())
     {
-        CatmarkFace * face = sourceMesh->GetFace(i);
+        printf("Temporal cache: topology or visibility changed, resampling\n");
+        fclose(fp);
+        return NULL;
+    }
 
-        // skip faces that are near the boundary
-        if(face->GetDepth() != subdivisionLevel || IsNearBoundary(face, pow(2, subdivisionLevel))){
-            continue;
+    for(int i=0;i<numVisible;i++)
+    {
+        int id;
+        if (fscanf(fp, "%d", &id) != 1 || id != visibleFaces[i])
+        {
+            printf("Temporal cache: visibility changed, resampling\n");
+            fclose(fp);
+            return NULL;
         }
+    }
 
-        printf("Processing face %d / %d \r", i, initialNumFaces);
+    unsigned long long cachedTriangles;
+    if (fscanf(fp, " sampled %llx", &cachedTriangles) != 1 || cachedTriangles != sampledTriangles)
+    {
+        printf("Temporal cache: sampled triangles changed, resampling\n");
+        fclose(fp);
+        return NULL;
+    }
 
-        bool extraord[4];
-        int numExtraord = 0;
+    int numVertices, numFaces;
+    if (fscanf(fp, " vertices %d", &numVertices) != 1)
+    {
+        fclose(fp);
+        return NULL;
+    }
 
-        // ------ create two triangles from this quad -------
+    std::vector<ParamPointCC> locs(numVertices);
+    std::vector<int> extSrc(numVertices, -1);
+    bool ok = true;
 
-        assert(face->GetNumVertices() == 4);
+    for(int i=0;i<numVertices && ok;i++)
+    {
+        char kind;
+        int id0, id1;
+        long double a, b, offset;
 
-        // want to make sure that there's a diagonal emanating from each extraordinary vertex
-        for(int j=0;j<4;j++)
+        if (fscanf(fp, " %c", &kind) != 1)
+            ok = false;
+        else if (kind == 'V')
         {
-            extraord[j] = (face->GetVertex(j)->GetValence() != 4 || face->GetVertex(j)->OnBoundary());
-            if (extraord[j])
-                numExtraord ++;
+            ok = fscanf(fp, "%d %La %d", &id0, &offset, &extSrc[i]) == 3 && id0 >= 0 && id0 < numSourceVertices;
+            if (ok)
+                locs[i] = ParamPointCC(sourceMesh->GetVertex(id0), offset);
         }
-
-        if (triangles)
+        else if (kind == 'E')
         {
-            // check if there are adjacent extraordinary points and we need to split into four triangles
-            if ((extraord[1] || extraord[3]) && (extraord[0] || extraord[2]))
-                ConvertFaceToTriangles(outputMesh, face, vertexMap, cameraModel);
-            else
-                if (extraord[1] || extraord[3])
-                {
-                    ConvertFaceToTriangle(outputMesh, face, 0,1,3, vertexMap, cameraModel);
-                    ConvertFaceToTriangle(outputMesh, face, 1,2,3, vertexMap, cameraModel);
-                }
-                else
-                {
-                    ConvertFaceToTriangle(outputMesh, face, 0,1,2, vertexMap, cameraModel);
-                    ConvertFaceToTriangle(outputMesh, face, 0,2,3, vertexMap, cameraModel);
-                }
+            ok = fscanf(fp, "%d %d %La %La %d", &id0, &id1, &a, &offset, &extSrc[i]) == 5 &&
+                    id0 >= 0 && id0 < numSourceVertices && id1 >= 0 && id1 < numSourceVertices;
+            CatmarkHalfedge * edge = ok ? sourceMesh->GetVertex(id0)->GetEdge(sourceMesh->GetVertex(id1)) : NULL;
+            ok = ok && edge != NULL;
+            if (ok)
+                locs[i] = ParamPointCC(edge, a, offset);
+        }
+        else if (kind == 'F')
+        {
+            ok = fscanf(fp, "%d %La %La %La %d", &id0, &a, &b, &offset, &extSrc[i]) == 5 && id0 >= 0 && id0 < numSourceFaces;
+            if (ok)
+                locs[i] = ParamPointCC(sourceMesh->GetFace(id0), a, b, offset);
         }
         else
-            ConvertQuadFace(outputMesh, face, vertexMap, cameraModel);
+            ok = false;
+
+        ok = ok && extSrc[i] >= -1 && extSrc[i] < numVertices && locs[i].IsEvaluable();
     }
 
-    printf("\n");
+    std::vector<int> indices;
+    if (ok && fscanf(fp, " faces %d", &numFaces) == 1 && numFaces <= TEMPORAL_CACHE_MAX_GROWTH * numFreshFaces)
+    {
+        indices.resize(3*numFaces);
+        for(int i=0;i<3*numFaces && ok;i++)
+            ok = fscanf(fp, "%d", &indices[i]) == 1 && indices[i] >= 0 && indices[i] < numVertices;
+    }
+    else
+    {
+        if (ok)
+            printf("Temporal cache: refined mesh grew too large, resampling\n");
+        ok = false;
+    }
 
-    printf("nb output faces: %d\n",outputMesh->GetNumFaces());
+    fclose(fp);
 
-    // was the entire thing culled?
-    if (outputMesh->GetNumFaces() == 0)
-    {
-        delete outputMesh;
+    if (!ok)
         return NULL;
+
+    // rebuild the mesh, re-evaluating every vertex on this frame's limit surface
+    std::vector<vec3> limitPos, limitNormal;
+    std::vector<real> k1, k2;
+    ParamPointCC::EvaluateBatch(locs, limitPos, limitNormal, &k1, &k2);
+
+    Mesh * mesh = new Mesh;
+    std::vector<MeshVertex*> verts(numVertices);
+
+    for(int i=0;i<numVertices;i++)
+    {
+        verts[i] = mesh->NewVertex();
+        SetupVertex(verts[i]->GetData(), locs[i], cameraCenter, limitPos[i], limitNormal[i], k1[i], k2[i]);
+        verts[i]->GetData().age = numVerts ++;
     }
 
-    // generate charts.  this has to be done after the geometry is complete
+    for(int i=0;i<numVertices;i++)
+        if (extSrc[i] != -1)
+            verts[i]->GetData().extSrc = verts[extSrc[i]];
 
-    return outputMesh;
+    for(int i=0;i<numFaces;i++)
+        NewFace(mesh, verts[indices[3*i]], verts[indices[3*i+1]], verts[indices[3*i+2]]);
+
+    printf("Temporal cache: reusing %d faces of the previous frame\n", numFaces);
+
+    return mesh;
 }
 
+
 /////////////////////////////////////  MAIN REFINEMENT ROUTINES ////////////////////////////
 
 
 bool FindContour(const ParamPointCC & p0, const ParamPointCC & p1, vec3 cameraCenter, ParamPointCC & resultPoint)
 // use root-finding to find a contour point between p0 and p1, assuming that p0 and p1 share some face
 //
-// this is potentially very inefficient because each call to interpolate params redoes the interpolation logic
+// Illinois variant of regula falsi: the next point is interpolated where the line through the
+// bracket's ndotv values crosses zero, and the value of an endpoint that is kept twice in a row is
+// halved so that the bracket shrinks from both sides. Each step keeps a sign change in the bracket.
 {
-    //  printf("\n_________________________________________\n");
-
     ParamPointCC lower = p0;
     ParamPointCC upper = p1;
 
-    real t_lower = 0;
-    real t_upper = 1;
-    std::map<real,real> values;
-
     real ndotvL, ndotvU;
 
     FacingType lowerFacing = Facing(lower, cameraCenter, CONTOUR_THRESHOLD, &ndotvL);
-    values[t_lower] = ndotvL;
-
     FacingType upperFacing = Facing(upper, cameraCenter, CONTOUR_THRESHOLD, &ndotvU);
-    values[t_upper] = ndotvU;
 
     bool lowerIsEndpoint = true, upperIsEndpoint = true;
 
     assert(lowerFacing != CONTOUR && upperFacing != CONTOUR && lowerFacing != upperFacing);
 
+    real fL = ndotvL, fU = ndotvU;  // values used for the interpolation (scaled by the Illinois step)
+    int side = 0;                   // -1: lower was replaced last, 1: upper was replaced last
+
+    ProfileCount(PC_CONTOUR_ROOTS);
+
     for(int i=0;i<MAX_ROOT_ITERATIONS;i++)
     {
-        // bisection method
-        ParamPointCC nextPoint = ParamPointCC::Interpolate(lower,upper,0.5);
+        ProfileCount(PC_ROOT_ITERATIONS);
+
+        real t = fL / (fL - fU);
+        if (!(t > 0 && t < 1))
+            t = 0.5;
+
+        ParamPointCC nextPoint = ParamPointCC::Interpolate(lower,upper,t);
 
         if (nextPoint.IsNull() || !nextPoint.IsEvaluable())   // rare round-off error seems to happen once in awhile. seems to relate to root-finding between an extSrc and another point.
         {
@@ -623,39 +1389,25 @@ bool FindContour(const ParamPointCC & p0, const ParamPointCC & p1, vec3 cameraCe
         if (newFacing == lowerFacing)
         {
             lower = nextPoint;
-            ndotvL = ndotv;
+            ndotvL = fL = ndotv;
             lowerIsEndpoint = false;
-            t_lower = (t_lower + t_upper)/2;
-            values[t_lower] = ndotv;
+            if (side == -1)
+                fU /= 2;
+            side = -1;
         }
         else
         {
             upper = nextPoint;
-            ndotvU = ndotv;
+            ndotvU = fU = ndotv;
             upperIsEndpoint = false;
-            t_upper = (t_lower + t_upper)/2;
-            values[t_upper] = ndotv;
+            if (side == 1)
+                fL /= 2;
+            side = 1;
         }
     }
 
     printf("WARNING: EXCEEDED MAX ITERATIONS. ndotv bounds: (%lf, %lf)\n", double(ndotvL), double(ndotvU));
 
-    static int n = 0;
-
-    if (n < 10)
-    {
-        char filename[20];
-        sprintf(filename, "rootfinding-%d.txt", n++);
-        FILE * fp = fopen(filename, "wt");
-
-        for(std::map<real,real>::iterator it = values.begin(); it!=values.end(); ++it)
-            fprintf(fp, "%1.64f %1.16f\n", double((*it).first), double((*it).second));
-        fclose(fp);
-    }
-
-
-    //  assert(0);
-
     assert(!(upperIsEndpoint && lowerIsEndpoint));
 
     // if one of the bounds is an endpoint, return the other point
@@ -665,7 +1417,7 @@ bool FindContour(const ParamPointCC & p0, const ParamPointCC & p1, vec3 cameraCe
         if (lowerIsEndpoint)
             resultPoint = upper;
         else
-            resultPoint = (fabsl(ndotvU) < fabsl(ndotvL) ? upper : lower);
+            resultPoint = (std::fabs(ndotvU) < std::fabs(ndotvL) ? upper : lower);
 
     return false;
 }
@@ -793,10 +1545,10 @@ bool EnsureShiftable(MeshVertex * shiftVertex, const ParamPointCC & targetLoc,
     }
 
     // final check for vanishing edges
-    std::set<MeshFace*> faces;
+    std::vector<MeshFace*> faces;
     GetOneRing<VertexDataCatmark>(shiftVertex, faces);
 
-    for(std::set<MeshFace*>::iterator fit = faces.begin(); fit != faces.end();++fit)
+    for(std::vector<MeshFace*>::iterator fit = faces.begin(); fit != faces.end();++fit)
     {
         vec3 pos[3];
 
@@ -859,10 +1611,10 @@ bool EnsureShiftable(MeshVertex * shiftVertex, const ParamPointCC & targetLoc,
 bool ShiftingCausesFold(MeshVertex * vsource, const ParamPointCC & newLoc)
 // check if moving vsource to newLoc would cause an orientation flip or degeneracy in any adjacent face
 {
-    std::set<MeshFace*> faces;
+    std::vector<MeshFace*> faces;
     GetOneRing<VertexDataCatmark>(vsource, faces);
 
-    for(std::set<MeshFace*>::iterator it = faces.begin(); it != faces.end(); ++it)
+    for(std::vector<MeshFace*>::iterator it = faces.begin(); it != faces.end(); ++it)
     {
         MeshFace * face = *it;
 
@@ -879,19 +1631,19 @@ bool ShiftingCausesFold(MeshVertex * vsource, const ParamPointCC & newLoc)
 }
 
 template<class T>
-bool CanShift(HbrVertex<T> * vertex) // can probably make this generic
+bool CanShift(TriVertex<T> * vertex) // can probably make this generic
 {
-    std::set<HbrFace<T>*> oneRingFaces;
+    std::vector<TriFace<T>*> oneRingFaces;
     GetOneRing<T>(vertex, oneRingFaces);
-    std::set<HbrVertex<T>*> oneRingVerts;
+    std::set<TriVertex<T>*> oneRingVerts;
 
     int numZCs = 0; // number of zero-crossings in the one-ring
-    for(typename std::set<HbrFace<T>*>::iterator it = oneRingFaces.begin(); it!= oneRingFaces.end(); ++it)
+    for(typename std::vector<TriFace<T>*>::iterator it = oneRingFaces.begin(); it!= oneRingFaces.end(); ++it)
     {
-        HbrFace<T> * face = *it;
+        TriFace<T> * face = *it;
         int i = GetVertexIndex<T>(face, vertex);
-        HbrVertex<T> * v1 = face->GetVertex((i+1)%3);
-        HbrVertex<T> * v2 = face->GetVertex((i+2)%3);
+        TriVertex<T> * v1 = face->GetVertex((i+1)%3);
+        TriVertex<T> * v2 = face->GetVertex((i+2)%3);
         FacingType f1 = v1->GetData().facing;
         FacingType f2 = v2->GetData().facing;
         if (f1 == CONTOUR && f2 == CONTOUR)
@@ -978,18 +1730,25 @@ MeshVertex * ShiftVertex(MeshVertex * vA, MeshVertex * vB, const ParamPointCC &
 
     // note: not touching extSrc...
 
-    if (wiggleQueue != NULL && enqueueNewFaces)
+    if (wiggleQueue != NULL)
     {
-        // add the one-ring to the list of modified faces
-        std::set<MeshFace*> faces;
+        // the one-ring faces changed area: update the priorities of the queued ones,
+        // and add the one-ring to the list of modified faces
+        std::vector<MeshFace*> faces;
         GetOneRing<VertexDataCatmark>(shiftVertex, faces);
 
-        for(std::set<MeshFace*>::iterator it = faces.begin(); it != faces.end(); ++it)
+        for(std::vector<MeshFace*>::iterator it = faces.begin(); it != faces.end(); ++it)
         {
             MeshFace * face = *it;
 
             assert(GetArea<VertexDataCatmark>(face) > 0);
-            
+
+            wiggleQueue->Update(face);
+            splitQueue->Update(face);
+
+            if (!enqueueNewFaces)
+                continue;
+
             if (!IsConsistent<VertexDataCatmark>(face, cameraCenter))
                 wiggleQueue->Insert(face);
             splitQueue->Insert(face);
@@ -1039,7 +1798,7 @@ real GetMinAngle(const MeshVertex * v1, const MeshVertex * v2, const MeshVertex
         vec3 e1 = (p[(i+1)%3] - p[i]).normalize();
         vec3 e2 = (p[(i+2)%3] - p[i]).normalize();
 
-        real angle = acosl(e1 * e2);
+        real angle = std::acos(e1 * e2);
 
 #ifdef isnan
         if (isnan(angle) || isinf(angle))
@@ -1065,7 +1824,7 @@ real TriangleQuality(const MeshVertex * v1, const MeshVertex * v2, const MeshVer
     real area = GetArea<VertexDataCatmark>(v1,v2,v3);
     real sumLength = EdgeLengthSquare(v1,v2)+EdgeLengthSquare(v2,v3)+EdgeLengthSquare(v3,v1);
     if(sumLength > 0.0)
-        return (4.0*sqrtl(3.0)*area) / sumLength;
+        return (4.0*std::sqrt(real(3.0))*area) / sumLength;
     return 0;
 }
 
@@ -1133,6 +1892,151 @@ struct Score   // score that a given candidate has.
 };
 
 
+bool IsSplittable(const MeshVertex * v0, const MeshVertex * extSrc0, const MeshVertex * v1, const MeshVertex * extSrc1)
+// same as IsSplittable(v0,v1), given the vertices' extSrc explicitly.  v0 or v1 may be NULL for a vertex
+// that is not in the mesh yet.
+{
+    if (ALLOW_EXTRAORDINARY_INTERPOLATION && !REQUIRE_SEPARATORS)
+        return true;
+
+    if ((extSrc0 != NULL && extSrc0 == v1) || (extSrc1 != NULL && extSrc1 == v0))
+        return false;
+
+    if (extSrc0 != NULL && extSrc0 == extSrc1)
+        return false;
+
+    return true;
+}
+
+
+// Read-only copy of the triangles around a vertex that is being placed: a new split point, or a
+// vertex being wiggled.  Candidate locations are scored against the copy instead of writing them
+// into the mesh, so a whole set of candidates can be evaluated in one batch and only the winning
+// move is applied to the HbrMesh.
+struct RingSnapshot
+{
+    struct Triangle
+    {
+        vec3 pos[3];
+        FacingType facing[3];
+        const MeshVertex * vertex[3];
+        const MeshVertex * extSrc[3];
+        int center;       // the corner being placed
+    };
+
+    const MeshVertex * centerVertex;   // NULL for a split point that is not in the mesh yet
+    std::vector<Triangle> triangles;
+
+    RingSnapshot(const MeshVertex * center) : centerVertex(center) { }
+
+    // v[] holds the triangle's vertices; the corner being placed is either centerVertex or NULL
+    void AddTriangle(MeshVertex * const v[3])
+    {
+        Triangle tri;
+        tri.center = -1;
+        for(int i=0;i<3;i++)
+        {
+            if (v[i] == NULL || v[i] == centerVertex)
+            {
+                tri.center = i;
+                tri.vertex[i] = centerVertex;
+                tri.extSrc[i] = NULL;
+                tri.facing[i] = CONTOUR;
+                continue;
+            }
+            tri.pos[i] = v[i]->GetData().pos;
+            tri.facing[i] = v[i]->GetData().facing;
+            tri.vertex[i] = v[i];
+            tri.extSrc[i] = v[i]->GetData().extSrc;
+        }
+        assert(tri.center != -1);
+        triangles.push_back(tri);
+    }
+
+    // Score the center at pos with the given facing and extSrc: count the consistent triangles and
+    // find the smallest triangle quality (or 1, if withQuality is false).  Returns false if the
+    // location produces a degenerate triangle.  Mirrors IsConsistent, SmallTriangle and TriangleQuality.
+    bool Score(const vec3 & pos, FacingType facing, const MeshVertex * extSrc, const vec3 & cameraCenter,
+               bool withQuality, int & numConsistent, real & minQuality) const
+    {
+        numConsistent = 0;
+        minQuality = -1;
+
+        for(size_t t=0;t<triangles.size();t++)
+        {
+            const Triangle & tri = triangles[t];
+
+            vec3 p[3] = { tri.pos[0], tri.pos[1], tri.pos[2] };
+            FacingType ft[3] = { tri.facing[0], tri.facing[1], tri.facing[2] };
+            const MeshVertex * ext[3] = { tri.extSrc[0], tri.extSrc[1], tri.extSrc[2] };
+            p[tri.center] = pos;
+            ft[tri.center] = facing;
+            ext[tri.center] = extSrc;
+
+            if (GetArea(p[0],p[1],p[2]) < MIN_INCONSISTENT_TRIANGLE_AREA)
+                return false;
+
+            real quality = 1;
+            if (withQuality)
+            {
+                real area = GetArea(p[0],p[1],p[2]);
+                real sumLength = (p[0]-p[1])*(p[0]-p[1]) + (p[1]-p[2])*(p[1]-p[2]) + (p[2]-p[0])*(p[2]-p[0]);
+                quality = sumLength > 0.0 ? (4.0*std::sqrt(real(3.0))*area) / sumLength : 0;
+                if (quality < 0)
+                    return false;
+            }
+
+            if (IsConsistent(p, ft, tri.vertex, ext, cameraCenter))
+                numConsistent ++;
+
+            if (minQuality == -1 || quality < minQuality)
+                minQuality = quality;
+        }
+
+        return true;
+    }
+
+    static bool IsConsistent(const vec3 p[3], const FacingType ft[3], const MeshVertex * const v[3],
+                             const MeshVertex * const ext[3], const vec3 & cameraCenter)
+    {
+        vec3 normal = GetNormal(p[0],p[1],p[2]);
+        normal /= sqrt(normal * normal);
+
+        FacingType facing = Facing(p[0]-cameraCenter,normal,0);
+
+        bool valid[3] = { true, true, true };
+        bool hasSplittable = false;
+
+        for(int i=0;i<3;i++)
+        {
+            int j = (i+1)%3;
+            if (!IsSplittable(v[i], ext[i], v[j], ext[j]))
+            {
+                valid[i] = false;
+                valid[j] = false;
+            }
+            else
+            {
+                hasSplittable = true;
+
+                if (ft[i] != CONTOUR && ft[j] != CONTOUR && ft[i] != ft[j])
+                    return false;
+            }
+        }
+
+        if (hasSplittable)
+            for(int i=0;i<3;i++)
+                if (ft[i] != CONTOUR && ft[i] != facing && valid[i])
+                    return false;
+
+        if (hasSplittable && ft[0] == CONTOUR && ft[1] == CONTOUR && ft[2] == CONTOUR)
+            return false;
+
+        return true;
+    }
+};
+
+
 // for NON-zero-crossing edges, find the point on the edge with the best score.
 SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
                                   const vec3 & cameraCenter,const bool allowShifts)
@@ -1145,16 +2049,15 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
         edge = v2->GetEdge(v1);
     assert(edge != NULL); // might crash at boundaries in which case we must check v2->GetEdge(v1);
 
-    // create a dummy vertex for the test point
-    MeshVertex * vnew = v1->GetMesh()->NewVertex();
-    VertexDataCatmark & data = vnew->GetData();
-    data.extraordinary = false;
-    data.extSrc = NULL;
-    data.age = -1;
-
+    // the four triangles the split would create; the new vertex is the NULL corner
     MeshVertex * newFaces[4][3];
 
-    MakeSplitFaceIndices(edge,vnew,newFaces);
+    MakeSplitFaceIndices<VertexDataCatmark>(edge,NULL,newFaces);
+
+    RingSnapshot ring(NULL);
+    for(int f=0;f<4;f++)
+        if (newFaces[f][2] != NULL)
+            ring.AddTriangle(newFaces[f]);
 
 
     MeshVertex * v0 = NULL;
@@ -1183,10 +2086,9 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
             if(result.IsNull() || !result.IsEvaluable())
                 return SplitCandidate();
 
-            SetupVertex(data, result, cameraCenter);
-            data.extSrc = extSrc;
-            if (extSrc == NULL)
-                data.facing = CONTOUR;
+            vec3 resultPos, resultNormal;
+            result.Evaluate(resultPos, resultNormal);
+            FacingType resultFacing = (extSrc == NULL ? CONTOUR : Facing(resultPos - cameraCenter, resultNormal));
 
 
             // see if we can just shift an adjacent vertex to this contour point
@@ -1203,39 +2105,11 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
                 return candidate;
             }
 
-            int numConsistent = 0;
-
-            real minQuality = -1;
-
-            for(int f=0;f<4;f++)
-            {
-                if (SmallTriangle<VertexDataCatmark>(newFaces[f][0],newFaces[f][1],newFaces[f][2]))
-                {
-                    v1->GetMesh()->DeleteVertex(vnew);
-                    SplitCandidate candidate;
-                    candidate.numConsistent = -1;
-                    return candidate;
-                }
-
-                real quality = TriangleQuality(newFaces[f]);
-
-                if (quality < 0)
-                {
-                    v1->GetMesh()->DeleteVertex(vnew);
-                    SplitCandidate candidate;
-                    candidate.numConsistent = -1;
-                    return candidate;
-                }
-
-                real ndotv;
-                if (IsConsistent<VertexDataCatmark>(newFaces[f],cameraCenter, &ndotv))
-                    numConsistent ++;
-
-                if (minQuality == -1 || quality < minQuality)
-                    minQuality = quality;
-            }
+            int numConsistent;
+            real minQuality;
 
-            v1->GetMesh()->DeleteVertex(vnew);
+            if (!ring.Score(resultPos, resultFacing, extSrc, cameraCenter, true, numConsistent, minQuality))
+                return SplitCandidate();
 
 
             SplitCandidate candidate;
@@ -1244,7 +2118,7 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
             candidate.splitLoc = result;
             candidate.extSrc = extSrc;
             candidate.minQuality = minQuality;
-            candidate.isContour = (data.facing == CONTOUR);
+            candidate.isContour = (resultFacing == CONTOUR);
             candidate.canShift = false;
 
             return candidate;
@@ -1259,7 +2133,6 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
     if (!ParamPointCC::HasCommonChart(v1->GetData().sourceLoc,v2->GetData().sourceLoc))
     {
         printf("WARNING: NO COMMON ORIGIN IN FIND BEST SPLIT\n");
-        v1->GetMesh()->DeleteVertex(vnew);
         return SplitCandidate();
     }
 
@@ -1328,47 +2201,21 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
     int bestNumConsistent = -1;
     real bestMinQuality = 0;
 
-    for(std::vector<ParamPointCC>::iterator it = splitCandidates.begin(); it != splitCandidates.end(); ++it)
-    {
-        ParamPointCC pt = (*it);
-
-        SetupVertex(data, pt, cameraCenter);
-
-        // count number of inconsistent faces there'd be using this as the split point.
-
-        real minQuality = -1;
-
-        int numConsistent = 0;
-        for(int f = 0;f<4;f++)
-            if (newFaces[f][0] != NULL)
-            {
-                real ndotv;
-
-                if (SmallTriangle<VertexDataCatmark>(newFaces[f][0],newFaces[f][1],newFaces[f][2]))
-                {
-                    numConsistent = -100;
-                    continue;
-                }
-
-                real quality = TriangleQuality(newFaces[f]);
-
-                if (quality < 0)
-                {
-                    numConsistent = -100;
-                    continue;
-                }
-
-                if (IsConsistent<VertexDataCatmark>(newFaces[f],cameraCenter,&ndotv))
-                {
-                    numConsistent ++;
-                }
+    // evaluate all candidates at once, then score each against the snapshot of the new triangles.
+    // candidates that produce degenerate triangles are never chosen.
+    std::vector<vec3> candPos, candNormal;
+    ParamPointCC::EvaluateBatch(splitCandidates, candPos, candNormal);
 
-                assert(ndotv <= 1 && ndotv >= -1);
+    for(size_t c = 0; c < splitCandidates.size(); c++)
+    {
+        const ParamPointCC & pt = splitCandidates[c];
 
+        FacingType ft = Facing(candPos[c] - cameraCenter, candNormal[c]);
 
-                if (minQuality == -1 || quality < minQuality)
-                    minQuality = quality;
-            }
+        int numConsistent;
+        real minQuality;
+        if (!ring.Score(candPos[c], ft, NULL, cameraCenter, true, numConsistent, minQuality))
+            continue;
 
         if (numConsistent > bestNumConsistent)
         {
@@ -1386,9 +2233,6 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
 
     }
 
-    // delete the dummy vertex
-    v1->GetMesh()->DeleteVertex(vnew);
-
     if (bestNumConsistent < 0)
         return SplitCandidate();
 
@@ -1404,10 +2248,25 @@ SplitCandidate FindBestSplitPoint(MeshVertex * v1, MeshVertex * v2,
     return candidate;
 }
 
-bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & cameraCenter, Mesh * mesh,
-                            std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges,
-                            PriorityQueueCatmark & wiggleQueue, PriorityQueueCatmark & splitQueue)
+// The edit chosen by the split search for an inconsistent face.  Planning only reads the mesh and
+// badEdges, so faces whose two-rings do not overlap can be planned concurrently; the plans are then
+// applied one at a time.
+struct SplitPlan
 {
+    MeshFace * face;
+    SplitCandidate candidates[3];
+    int shiftEdge;   // edge whose transverse contour point can be reached by shifting a vertex, or -1
+    int splitEdge;   // edge to split, or -1
+    std::vector<std::pair<MeshVertex*,MeshVertex*> > badEdges;  // newly found unsplittable edges
+
+    SplitPlan() { face = NULL; shiftEdge = splitEdge = -1; }
+};
+
+void PlanSplitFace(MeshFace * face, bool allowShifts, const vec3 & cameraCenter,
+                   const std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges, SplitPlan & plan)
+{
+    plan.face = face;
+
     bool bad[3];
     for(int i=0;i<3;i++){
         bad[i] = IsBadEdge(face, badEdges, i);
@@ -1430,7 +2289,7 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
     // find the operation that leads to most consistency. break ties based on edge length.
     // if we find a useful contour shift, do that instead
 
-    SplitCandidate candidates[3];
+    SplitCandidate * candidates = plan.candidates;
 
     for(int i=0;i<3;i++){
         if (!bad[i])
@@ -1442,7 +2301,7 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
 
             if (candidates[i].numConsistent < 0)
             {
-                badEdges.insert(std::pair<MeshVertex*,MeshVertex*>(v1,v2));
+                plan.badEdges.push_back(std::pair<MeshVertex*,MeshVertex*>(v1,v2));
                 continue;
             }
 
@@ -1451,23 +2310,8 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
 
             if (candidates[i].canShift)
             {
-                int eOpp;
-                MeshFace * oppFace = GetOppFace(face,i,eOpp);
-                MeshVertex * v0 = GetOtherVertex(face, v1,v2);
-                MeshVertex * v3 = oppFace->GetVertex(eOpp);
-                assert(v3 != v1 && v3 != v0 && v3 != v2);
-
-                MeshVertex * shifted = ShiftVertex(v0,v3,candidates[i].splitLoc,cameraCenter,mesh,&wiggleQueue,&splitQueue,false,false);
-                assert(shifted != NULL);
-                shifted->GetData().facing = CONTOUR;
-
-                // shifting might not have fixed the face or re-inserted the current one
-                wiggleQueue.Insert(face);
-
-#ifdef VERBOSE
-                printf("Transverse shift\n");
-#endif
-                return false;  // didn't do a split, did a shift
+                plan.shiftEdge = i;
+                return;
             }
         }
     }
@@ -1488,14 +2332,14 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
                     bool validMove = true;
                     for(int j=1; j<3; j++){
                         MeshVertex * v0 = face->GetVertex((i+j)%3);
-                        std::set<MeshFace*> oneRing;
+                        std::vector<MeshFace*> oneRing;
                         GetOneRing(v0,oneRing);
-                        std::set<MeshVertex*> oneRingVertices;
+                        std::vector<MeshVertex*> oneRingVertices;
                         GetOneRingVertices(v0,oneRingVertices);
-                        for(std::set<MeshFace*>::iterator fit=oneRing.begin(); fit!=oneRing.end() && validMove; fit++){
+                        for(std::vector<MeshFace*>::iterator fit=oneRing.begin(); fit!=oneRing.end() && validMove; fit++){
                             MeshFace* f = (*fit);
                             int idx = GetVertexIndex(f,v0);
-                            for(std::set<MeshVertex*>::iterator it=oneRingVertices.begin(); it!=oneRingVertices.end() && validMove; it++){
+                            for(std::vector<MeshVertex*>::iterator it=oneRingVertices.begin(); it!=oneRingVertices.end() && validMove; it++){
                                 MeshVertex* v = (*it);
                                 if(v==f->GetVertex(0) || v==f->GetVertex(1) || v==f->GetVertex(2))
                                     continue;
@@ -1517,16 +2361,55 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
             }
     }
 
+    plan.splitEdge = e;
+}
+
+bool ApplySplitPlan(const SplitPlan & plan, const vec3 & cameraCenter, Mesh * mesh,
+                    std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges,
+                    PriorityQueueCatmark & wiggleQueue, PriorityQueueCatmark & splitQueue)
+// returns true if the face was split
+{
+    MeshFace * face = plan.face;
+
+    badEdges.insert(plan.badEdges.begin(), plan.badEdges.end());
+
+    if (plan.shiftEdge != -1)
+    {
+        int i = plan.shiftEdge;
+        MeshVertex * v1 = face->GetVertex((i+1)%3);
+        MeshVertex * v2 = face->GetVertex((i+2)%3);
+
+        int eOpp;
+        MeshFace * oppFace = GetOppFace(face,i,eOpp);
+        MeshVertex * v0 = GetOtherVertex(face, v1,v2);
+        MeshVertex * v3 = oppFace->GetVertex(eOpp);
+        assert(v3 != v1 && v3 != v0 && v3 != v2);
+
+        MeshVertex * shifted = ShiftVertex(v0,v3,plan.candidates[i].splitLoc,cameraCenter,mesh,&wiggleQueue,&splitQueue,false,false);
+        assert(shifted != NULL);
+        shifted->GetData().facing = CONTOUR;
+
+        // shifting might not have fixed the face or re-inserted the current one
+        wiggleQueue.Insert(face);
+
+#ifdef VERBOSE
+        printf("Transverse shift\n");
+#endif
+        return false;  // didn't do a split, did a shift
+    }
+
+    int e = plan.splitEdge;
+
     if (e == -1)
         return false;
 
     // insert the new vertex
     MeshVertex * newVertex = mesh->NewVertex();
-    SetupVertex(newVertex->GetData(),candidates[e].splitLoc,cameraCenter);
-    newVertex->GetData().extSrc = candidates[e].extSrc;
+    SetupVertex(newVertex->GetData(),plan.candidates[e].splitLoc,cameraCenter);
+    newVertex->GetData().extSrc = plan.candidates[e].extSrc;
 
     InsertVertex<VertexDataCatmark>(face, e, newVertex, mesh, wiggleQueue, splitQueue, false, false);
-    if (candidates[e].isContour) // just in case
+    if (plan.candidates[e].isContour) // just in case
         newVertex->GetData().facing = CONTOUR;
 
 #ifdef VERBOSE
@@ -1536,6 +2419,15 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
     return true;
 }
 
+bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & cameraCenter, Mesh * mesh,
+                            std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges,
+                            PriorityQueueCatmark & wiggleQueue, PriorityQueueCatmark & splitQueue)
+{
+    SplitPlan plan;
+    PlanSplitFace(face, allowShifts, cameraCenter, badEdges, plan);
+    return ApplySplitPlan(plan, cameraCenter, mesh, badEdges, wiggleQueue, splitQueue);
+}
+
 
 bool FindRadialSplitPointFace(MeshFace * face, const vec3 & cameraCenter, Mesh * mesh,
                               std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges,
@@ -1619,23 +2511,31 @@ ShiftCandidate FindBestWiggleVertex(MeshVertex * vertex, const vec3 cameraCenter
 
     // gather the one ring and all adjacent vertices
 
-    std::set<MeshFace*> oneRing;
+    std::vector<MeshFace*> oneRing;
     GetOneRing<VertexDataCatmark>(vertex,oneRing);
 
-    std::set<MeshVertex*> oneRingVertices;
+    std::vector<MeshVertex*> oneRingVertices;
     GetOneRingVertices<VertexDataCatmark>(vertex, oneRingVertices);
 
     // count the current consistency
     int currentConsistency=0;
 
-    for(std::set<MeshFace*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
+    for(std::vector<MeshFace*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
         if (IsConsistent<VertexDataCatmark>( *fit, cameraCenter))
             currentConsistency ++;
 
 
-    // save the old vertex information
+    // save the old vertex information.  candidates are scored against a copy of the one-ring,
+    // so the vertex itself is not modified by the search.
     VertexDataCatmark oldData = vertex->GetData();
 
+    RingSnapshot ring(vertex);
+    for(std::vector<MeshFace*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
+    {
+        MeshVertex * v[3] = { (*fit)->GetVertex(0), (*fit)->GetVertex(1), (*fit)->GetVertex(2) };
+        ring.AddTriangle(v);
+    }
+
 
     int bestConsistency = -1;
     real bestMinQuality = -1;
@@ -1655,70 +2555,62 @@ ShiftCandidate FindBestWiggleVertex(MeshVertex * vertex, const vec3 cameraCenter
 
         if (laplacianMag > 1e-5 && laplacianMag == laplacianMag)  // checking for NaN, don't have isnan()
         {
+            // all samples share the same surface point; evaluate it once and offset along its normal
+            ParamPointCC basePt = oldData.sourceLoc;
+            basePt.SetNormalOffset(0);
+            vec3 basePos, baseNormal;
+            basePt.Evaluate(basePos, baseNormal);
+
             for(int k=-h;k<=h;k++)
             {
                 real t = (h == 0 ? 0 : real(k)/h);
+                real offset = t * laplacianMag;
 
-                vertex->GetData().sourceLoc.SetNormalOffset(t * laplacianMag);
-
-                vec3 normal;
-                // doing much more work than necessary here.
-                vertex->GetData().sourceLoc.Evaluate(vertex->GetData().pos, normal);
+                ParamPointCC testPt = oldData.sourceLoc;
+                testPt.SetNormalOffset(offset);
 
+                vec3 testPos = basePos;
+                if (offset != 0)
+                    testPos += offset * baseNormal;
 
                 // count the one-ring consistency using this sample point
-                int consistency = 0;
-
-                real minQuality = -1;
-                bool badTri = false;
-
-                for(std::set<MeshFace*>::iterator fit2 = oneRing.begin(); fit2 != oneRing.end(); ++fit2)
-                {
-                    if (IsConsistent<VertexDataCatmark>( *fit2, cameraCenter))
-                        consistency ++;
-
-                    real quality = 1; //TriangleQuality(*fit2);
-                    if (quality <= 0 || SmallTriangle<VertexDataCatmark>(*fit2))
-                    {
-                        badTri = true;
-                        break;
-                    }
+                int consistency;
+                real minQuality;
 
-                    if (minQuality == -1 || quality < minQuality)
-                        minQuality = quality;
-                }
+                if (!ring.Score(testPos, oldData.facing, oldData.extSrc, cameraCenter, false, consistency, minQuality))
+                    continue;
 
-                real moveDist = length(vertex->GetData().pos - oldData.pos);
+                real moveDist = length(testPos - oldData.pos);
 
-                if (!badTri)
+                if (consistency > bestConsistency)
                 {
-                    if (consistency > bestConsistency)
+                    bestConsistency = consistency;
+                    bestMinQuality = minQuality;
+                    bestPt = testPt;
+                    bestMoveDist = moveDist;
+                }
+                else
+                    if ( consistency == bestMoveDist && moveDist < bestMoveDist)
+                        //		if (consistency == bestConsistency && minQuality > bestMinQuality)
                     {
-                        bestConsistency = consistency;
                         bestMinQuality = minQuality;
-                        bestPt = vertex->GetData().sourceLoc;
+                        bestPt = testPt;
                         bestMoveDist = moveDist;
                     }
-                    else
-                        if ( consistency == bestMoveDist && moveDist < bestMoveDist)
-                            //		if (consistency == bestConsistency && minQuality > bestMinQuality)
-                        {
-                            bestMinQuality = minQuality;
-                            bestPt = vertex->GetData().sourceLoc;
-                            bestMoveDist = moveDist;
-                        }
-                }
-                // restore the vertex data
-                vertex->GetData() = oldData;
-
             }
         }
     }
 
     // try wiggle + normal offset
-    if (!vertex->GetData().extraordinary && vertex->GetData().extSrc == NULL)
+    if (!oldData.extraordinary && oldData.extSrc == NULL)
     {
-        for(std::set<MeshFace*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
+        // gather the samples of every ray first, so that the whole grid is evaluated in one batch.
+        // row r holds the samples [rowStart[r], rowStart[r+1]), ordered away from the vertex.
+        std::vector<ParamPointCC> gridPts;
+        std::vector<real> gridOffsets;
+        std::vector<size_t> rowStart(1, 0);
+
+        for(std::vector<MeshFace*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
             for(int i=0;i<NUM_WIGGLE_SAMPLES_SQRT;i++)
             {
                 MeshFace * face = *fit;
@@ -1733,109 +2625,92 @@ ShiftCandidate FindBestWiggleVertex(MeshVertex * vertex, const vec3 cameraCenter
                                                                 face->GetVertex( (v+2)%3)->GetData().sourceLoc,
                                                                 i/(NUM_WIGGLE_SAMPLES_SQRT-1.0));
 
+                // seems weird that this would fail...
+                if (!ParamPointCC::HasCommonChart(oldData.sourceLoc, oppPt))
+                    continue;
+
+                // the samples are evaluated without normal offsets, which are added back afterwards
                 for(int j=0;j<NUM_WIGGLE_SAMPLES_SQRT;j++)
                 {
-                    // seems weird that this would fail...
-                    if (!ParamPointCC::HasCommonChart(oldData.sourceLoc, oppPt))
-                        break;
-
                     ParamPointCC testPt = ParamPointCC::Interpolate(oldData.sourceLoc, oppPt, (j+1.0)/(NUM_WIGGLE_SAMPLES_SQRT+1.0));
-
-                    // check if this is a valid point to shift to, and, if so, shift
-                    // note: there is a tremendous amount of rendundant computation hidden here
                     if (!testPt.IsEvaluable())
                         break;   // more extreme shifts are unlikely to work out
+                    gridOffsets.push_back(testPt.NormalOffset());
+                    testPt.SetNormalOffset(0);
+                    gridPts.push_back(testPt);
+                }
+                rowStart.push_back(gridPts.size());
+            }
 
-                    if (!ShiftVertex(vertex,NULL,testPt,cameraCenter,mesh,NULL,NULL,true))
-                        break;   // more extreme shifts are unlikely to work out
-
-                    real laplacianMag;
-
-                    // shift the vertex but without "ensuring shiftability"
-                    SetupVertex(vertex->GetData(), testPt, cameraCenter);
-
-                    // make sure we haven't changed sign
-                    if (vertex->GetData().facing != oldData.facing)
-                    {
-                        vertex->GetData() = oldData;
-                        break;
-                    }
-
-                    // compute the laplacian vector
-                    vec3 laplacian = Laplacian<VertexDataCatmark>( vertex, oneRingVertices );
+        std::vector<vec3> gridPos, gridNormal;
+        ParamPointCC::EvaluateBatch(gridPts, gridPos, gridNormal);
 
-                    //		printf("laplacian = %f %f %f\n", double(laplacian[0]), double(laplacian[1]), double(laplacian[2]));
+        for(size_t r=0;r+1<rowStart.size();r++)
+            for(size_t j=rowStart[r];j<rowStart[r+1];j++)
+            {
+                ParamPointCC testPt = gridPts[j];
+                testPt.SetNormalOffset(gridOffsets[j]);
 
-                    laplacianMag = length(laplacian);
+                // check if this is a valid point to shift to
+                // note: there is a tremendous amount of rendundant computation hidden here
+                if (!ShiftVertex(vertex,NULL,testPt,cameraCenter,mesh,NULL,NULL,true))
+                    break;   // more extreme shifts are unlikely to work out
 
-                    if (laplacianMag < 1e-5 || laplacianMag != laplacianMag)  // checking for NaN, don't have isnan()
-                        laplacianMag = 1e-5;
+                vec3 testPos = gridPos[j];
+                if (gridOffsets[j] != 0)
+                    testPos += gridOffsets[j] * gridNormal[j];
 
-                    // make sure we have an odd number, so that zero offset is one of them
-                    assert((NUM_NORMAL_WIGGLE_SAMPLES % 2) == 1);
+                // make sure we haven't changed sign
+                if (Facing(testPos - cameraCenter, gridNormal[j]) != oldData.facing)
+                    break;
 
-                    int h = (NUM_NORMAL_WIGGLE_SAMPLES - 1)/2;
+                // compute the laplacian vector at the shifted location
+                vec3 laplacian = Laplacian<VertexDataCatmark>( vertex, testPos, oneRingVertices );
 
-                    for(int k=-h;k<=h;k++)
-                    {
-                        real t = (h == 0 ? 0 : real(k)/h);
+                real laplacianMag = length(laplacian);
 
-                        //		  testPt.normalOffset = oldData.sourceLoc.normalOffset + t * laplacianMag;
+                if (laplacianMag < 1e-5 || laplacianMag != laplacianMag)  // checking for NaN, don't have isnan()
+                    laplacianMag = 1e-5;
 
-                        testPt.SetNormalOffset(t * laplacianMag/2);
+                // make sure we have an odd number, so that zero offset is one of them
+                assert((NUM_NORMAL_WIGGLE_SAMPLES % 2) == 1);
 
-                        vec3 normal;
-                        // doing much more work than necessary here.
-                        testPt.Evaluate(vertex->GetData().pos, normal);
+                int h = (NUM_NORMAL_WIGGLE_SAMPLES - 1)/2;
 
-                        // count the one-ring consistency using this sample point
-                        int consistency = 0;
+                for(int k=-h;k<=h;k++)
+                {
+                    real t = (h == 0 ? 0 : real(k)/h);
 
-                        real minQuality = -1;
-                        bool badTri = false;
+                    testPt.SetNormalOffset(t * laplacianMag/2);
 
-                        for(std::set<MeshFace*>::iterator fit2 = oneRing.begin(); fit2 != oneRing.end(); ++fit2)
-                        {
-                            if (IsConsistent<VertexDataCatmark>( *fit2, cameraCenter))
-                                consistency ++;
-
-                            real quality = 1; //TriangleQuality(*fit2);
-                            if (quality <= 0 || SmallTriangle<VertexDataCatmark>(*fit2))
-                            {
-                                badTri = true;
-                                break;
-                            }
+                    // reuse the grid evaluation, offset along the normal
+                    vec3 samplePos = gridPos[j];
+                    if (testPt.NormalOffset() != 0)
+                        samplePos += testPt.NormalOffset() * gridNormal[j];
 
-                            if (minQuality == -1 || quality < minQuality)
-                                minQuality = quality;
-                        }
+                    // count the one-ring consistency using this sample point
+                    int consistency;
+                    real minQuality;
 
-                        real moveDist = length(vertex->GetData().pos - oldData.pos);
+                    if (!ring.Score(samplePos, oldData.facing, oldData.extSrc, cameraCenter, false, consistency, minQuality))
+                        break;
 
-                        if (badTri)
-                        {
-                            vertex->GetData() = oldData;
-                            break;
-                        }
+                    real moveDist = length(samplePos - oldData.pos);
 
-                        if (consistency > bestConsistency)
+                    if (consistency > bestConsistency)
+                    {
+                        bestConsistency = consistency;
+                        bestMinQuality = minQuality;
+                        bestPt = testPt;
+                        bestMoveDist = moveDist;
+                    }
+                    else
+                        if ( consistency == bestMoveDist && moveDist < bestMoveDist)
                         {
-                            bestConsistency = consistency;
                             bestMinQuality = minQuality;
                             bestPt = testPt;
                             bestMoveDist = moveDist;
                         }
-                        else
-                            if ( consistency == bestMoveDist && moveDist < bestMoveDist)
-                            {
-                                bestMinQuality = minQuality;
-                                bestPt = testPt;
-                                bestMoveDist = moveDist;
-                            }
-
-                        // restore the vertex data
-                        vertex->GetData() = oldData;
-                    }
                 }
             }
     }
@@ -2185,7 +3060,7 @@ int WiggleFaceVerticesInABSpace(MeshFace* face, const vec3 & cameraCenter)
     for(int i=0; i<3; i++)
         pts.push_back(currentFace->GetVertex(i)->GetData().sourceLoc);
     std::vector<vec2> abs;
-    ChartCC* chart = ParamPointCC::FindChart(pts,abs);
+    const ChartCC* chart = ParamPointCC::FindChart(pts,abs);
 
     if(!chart){
         for(int i=0; i<3; i++){
@@ -2221,7 +3096,7 @@ int WiggleFaceVerticesInABSpace(MeshFace* face, const vec3 & cameraCenter)
             real r1 = real(s1)/real(NUM_SAMPLES);
             for(int s2=1; s2<NUM_SAMPLES; s2++){
                 real r2 = real(s2)/real(NUM_SAMPLES);
-                real sr2 = sqrtl(1.0-r2);
+                real sr2 = std::sqrt(1.0-r2);
                 real beta = r1 * sr2;
                 real gamma = 1.0 - sr2;
                 vec2 newAB = (1.0-beta-gamma) * abs[0] + beta * abs[1] + gamma * abs[2];
@@ -2282,7 +3157,7 @@ int WiggleFaceVerticesInABSpace(MeshFace* face, const vec3 & cameraCenter)
 
 void WiggleInParamSpace(Mesh * mesh, const vec3 & cameraCenter)
 {
-    std::list<MeshFace*> meshFaces;
+    std::vector<MeshFace*> meshFaces;
     mesh->GetFaces(std::back_inserter(meshFaces));
 
     int reduction;
@@ -2291,7 +3166,7 @@ void WiggleInParamSpace(Mesh * mesh, const vec3 & cameraCenter)
     int idx = 0;
     do{
         int numInconsistent = 0;
-        for(std::list<MeshFace*>::iterator it = meshFaces.begin(); it != meshFaces.end(); ++it)
+        for(std::vector<MeshFace*>::iterator it = meshFaces.begin(); it != meshFaces.end(); ++it)
             if (!IsConsistent(*it, cameraCenter))
                 numInconsistent ++;
         printf("\n# inconsistent faces: %d\n", numInconsistent);
@@ -2301,7 +3176,7 @@ void WiggleInParamSpace(Mesh * mesh, const vec3 & cameraCenter)
 
         reduction = 0;
         printf(" %d",pass++); fflush(stdout);
-        for(std::list<MeshFace*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit){
+        for(std::vector<MeshFace*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit){
             MeshFace* currentFace = (*fit);
             int res = WiggleFaceVerticesInABSpace(currentFace,cameraCenter);
             reduction += res;
@@ -2316,7 +3191,7 @@ void WiggleInParamSpace(Mesh * mesh, const vec3 & cameraCenter)
     printf("\n");
 
     int numInconsistent = 0;
-    for(std::list<MeshFace*>::iterator it = meshFaces.begin(); it != meshFaces.end(); ++it)
+    for(std::vector<MeshFace*>::iterator it = meshFaces.begin(); it != meshFaces.end(); ++it)
         if (!IsConsistent(*it, cameraCenter))
             numInconsistent ++;
     printf("Final # inconsistent faces: %d\n", numInconsistent);
@@ -2634,8 +3509,248 @@ bool SplitZeroCrossingFace(MeshFace * face, Mesh * mesh,const vec3 & cameraCente
 }
 
 
+// faces planned together in one round of the parallel split stage.  fixed, so that the result does
+// not depend on the number of threads.
+const int SPLIT_ROUND_SIZE = 256;
+
+void GetTwoRingVertices(MeshFace * face, std::set<MeshVertex*> & vertices)
+// all vertices within two edges of a vertex of the face
+{
+    // the rings are gathered in a vector and merged, so that the face vertices inserted first are kept
+    std::vector<MeshVertex*> ring;
+    std::set<MeshVertex*> oneRing;
+    for(int i=0;i<3;i++)
+    {
+        oneRing.insert(face->GetVertex(i));
+        GetOneRingVertices<VertexDataCatmark>(face->GetVertex(i), ring);
+        oneRing.insert(ring.begin(), ring.end());
+    }
+
+    vertices.insert(oneRing.begin(), oneRing.end());
+    for(std::set<MeshVertex*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
+    {
+        GetOneRingVertices<VertexDataCatmark>(*it, ring);
+        vertices.insert(ring.begin(), ring.end());
+    }
+}
+
+// Worker threads of the parallel split stage. They are started at the first round and kept for the
+// whole RefineContour call; each round hands them the faces to plan, and the calling thread plans
+// along with them.
+class SplitPlanPool
+{
+public:
+    SplitPlanPool(int numThreads);  // numThreads < 1: all processors (the calling thread included)
+    ~SplitPlanPool();
+
+    // make the plans of all the faces of a round; returns when they are all made
+    void PlanRound(std::vector<SplitPlan> & plans, bool allowShifts, const vec3 & cameraCenter,
+                   const std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges);
+
+private:
+    static void * Worker(void * arg);
+    void PlanFaces();  // plan the faces of the current round until none is left
+
+    int _numThreads;
+    std::vector<pthread_t> _workers;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _roundCond;  // a round started, or the pool is closing
+    pthread_cond_t _doneCond;   // all the workers finished the round
+    int _round;                 // number of rounds started
+    int _busy;                  // workers still planning the current round
+    bool _closed;
+    Profile * _profile;         // of the calling thread, the workers add their counters to it on closing
+
+    // current round; the faces are taken one at a time, every plan only depends on its face
+    std::vector<SplitPlan> * _plans;
+    size_t _next;  // atomic
+    bool _allowShifts;
+    vec3 _cameraCenter;
+    const std::set<std::pair<MeshVertex*,MeshVertex*> > * _badEdges;
+};
+
+SplitPlanPool::SplitPlanPool(int numThreads)
+{
+    _numThreads = numThreads < 1 ? (int)sysconf(_SC_NPROCESSORS_ONLN) : numThreads;
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_roundCond, NULL);
+    pthread_cond_init(&_doneCond, NULL);
+    _round = 0;
+    _busy = 0;
+    _closed = false;
+    _profile = currentProfile;
+    _plans = NULL;
+    _next = 0;
+    _allowShifts = false;
+    _badEdges = NULL;
+}
+
+SplitPlanPool::~SplitPlanPool()
+{
+    pthread_mutex_lock(&_mutex);
+    _closed = true;
+    pthread_cond_broadcast(&_roundCond);
+    pthread_mutex_unlock(&_mutex);
+
+    for(size_t i=0;i<_workers.size();i++)
+        pthread_join(_workers[i], NULL);
+
+    pthread_cond_destroy(&_doneCond);
+    pthread_cond_destroy(&_roundCond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void SplitPlanPool::PlanFaces()
+{
+    size_t n = _plans->size();
+    for(size_t i = __atomic_fetch_add(&_next, 1, __ATOMIC_RELAXED); i < n; i = __atomic_fetch_add(&_next, 1, __ATOMIC_RELAXED))
+    {
+        SplitPlan & plan = (*_plans)[i];
+        PlanSplitFace(plan.face, _allowShifts, _cameraCenter, *_badEdges, plan);
+    }
+}
+
+void * SplitPlanPool::Worker(void * arg)
+{
+    SplitPlanPool * pool = static_cast<SplitPlanPool*>(arg);
+
+    Profile profile;
+    currentProfile = &profile;
+
+    pthread_mutex_lock(&pool->_mutex);
+
+    int round = 0;
+    while (true)
+    {
+        while (pool->_round == round && !pool->_closed)
+            pthread_cond_wait(&pool->_roundCond, &pool->_mutex);
+
+        if (pool->_closed)
+            break;
+
+        round = pool->_round;
+
+        pthread_mutex_unlock(&pool->_mutex);
+        pool->PlanFaces();
+        pthread_mutex_lock(&pool->_mutex);
+
+        if (--pool->_busy == 0)
+            pthread_cond_signal(&pool->_doneCond);
+    }
+
+    // the calling thread is waiting in the destructor, the mutex orders the workers
+    if (pool->_profile != NULL)
+        pool->_profile->Add(profile);
+
+    pthread_mutex_unlock(&pool->_mutex);
+
+    return NULL;
+}
+
+void SplitPlanPool::PlanRound(std::vector<SplitPlan> & plans, bool allowShifts, const vec3 & cameraCenter,
+                              const std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges)
+{
+    pthread_mutex_lock(&_mutex);
+
+    if (_workers.empty() && _numThreads > 1)
+    {
+        _workers.reserve(_numThreads-1);
+        for(int i=1;i<_numThreads;i++)
+        {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, Worker, this) != 0)
+            {
+                printf("WARNING: cannot create refinement thread, planning on %d threads\n", i);
+                break;
+            }
+            _workers.push_back(thread);
+        }
+        _numThreads = (int)_workers.size() + 1;
+    }
+
+    _plans = &plans;
+    _next = 0;
+    _allowShifts = allowShifts;
+    _cameraCenter = cameraCenter;
+    _badEdges = &badEdges;
+
+    // not worth waking the workers for a few faces
+    bool wake = !_workers.empty() && (int)plans.size() >= 4*_numThreads;
+    if (wake)
+    {
+        _busy = (int)_workers.size();
+        _round ++;
+        pthread_cond_broadcast(&_roundCond);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+
+    PlanFaces();
+
+    if (wake)
+    {
+        pthread_mutex_lock(&_mutex);
+        while (_busy > 0)
+            pthread_cond_wait(&_doneCond, &_mutex);
+        pthread_mutex_unlock(&_mutex);
+    }
+}
+
+int SplitRound(Mesh * mesh, const vec3 & cameraCenter, bool allowShifts, int maxFaces, SplitPlanPool & pool,
+               std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges,
+               PriorityQueueCatmark & wiggleQueue, PriorityQueueCatmark & splitQueue)
+// One round of the parallel split stage.  Faces are taken from the split queue in priority order
+// into an independent set: a face is added only if its two-ring shares no vertex with the two-rings of
+// the faces already in the set.  A split or shift only reads and edits the two-ring of its face, so
+// the faces of the set are planned concurrently by the pool and the plans are applied in queue
+// order.  Faces that conflict wait for a later round.  Returns the number of splits.
+{
+    std::vector<SplitPlan> plans;
+    std::vector<MeshFace*> deferred;
+    std::set<MeshVertex*> claimed;
+
+    while (splitQueue.Size() != 0 && (int)plans.size() < maxFaces && (int)deferred.size() < maxFaces)
+    {
+        MeshFace * face = splitQueue.PopFront();
+
+        if (IsConsistent<VertexDataCatmark>(face,cameraCenter))  // might have changed since it was added to the queue
+            continue;
+
+        std::set<MeshVertex*> region;
+        GetTwoRingVertices(face, region);
+
+        bool independent = true;
+        for(std::set<MeshVertex*>::iterator it = region.begin(); it != region.end() && independent; ++it)
+            if (claimed.find(*it) != claimed.end())
+                independent = false;
+
+        if (!independent)
+        {
+            deferred.push_back(face);
+            continue;
+        }
+
+        claimed.insert(region.begin(), region.end());
+        plans.push_back(SplitPlan());
+        plans.back().face = face;
+    }
+
+    // back in the queue before any edit, so that faces deleted by the edits are removed from it
+    for(std::vector<MeshFace*>::iterator it = deferred.begin(); it != deferred.end(); ++it)
+        splitQueue.Insert(*it);
+
+    pool.PlanRound(plans, allowShifts, cameraCenter, badEdges);
+
+    int numSplits = 0;
+    for(std::vector<SplitPlan>::iterator it = plans.begin(); it != plans.end(); ++it)
+        if (ApplySplitPlan(*it, cameraCenter, mesh, badEdges, wiggleQueue, splitQueue))
+            numSplits ++;
+
+    return numSplits;
+}
+
 void RefineContour(Mesh * mesh, const vec3 & cameraCenter, const RefinementType refinement, const bool allowShifts,
-                   const int maxInconsistentSplits)
+                   const int maxInconsistentSplits, const int parallelThreads)
 {
     PriorityQueueCatmark wiggleQueue;  // faces to be tested for shifting, wiggling, flipping improvements
     PriorityQueueCatmark splitQueue;   // faces to be split
@@ -2645,10 +3760,10 @@ void RefineContour(Mesh * mesh, const vec3 & cameraCenter, const RefinementType
     bool localAllowShifts = allowShifts; // && (refinement == RF_CONTOUR_INCONSISTENT || refinement == RF_FULL);
 
     // find all inconsistent faces and put them in the queue
-    std::list<MeshFace*> faces;
+    std::vector<MeshFace*> faces;
     mesh->GetFaces(std::back_inserter(faces));
 
-    for(std::list<MeshFace*>::iterator it = faces.begin(); it != faces.end(); ++it)
+    for(std::vector<MeshFace*>::iterator it = faces.begin(); it != faces.end(); ++it)
         if (!IsConsistent<VertexDataCatmark>(*it,cameraCenter))
             wiggleQueue.Insert(*it);
 
@@ -2670,15 +3785,20 @@ void RefineContour(Mesh * mesh, const vec3 & cameraCenter, const RefinementType
     assert(splitQueue.Size() == 0);
     std::set<std::pair<MeshVertex*,MeshVertex*> > cuspEdges;
 
+    // threads of the parallel split stage, started at the first round
+    SplitPlanPool splitPool(parallelThreads);
+
     while (wiggleQueue.Size() != 0 || splitQueue.Size() != 0)
     {
         if (wiggleQueue.Size() + splitQueue.Size() < minInc && (numSplits < maxInconsistentSplits || maxInconsistentSplits < 0))
             minInc = wiggleQueue.Size()+splitQueue.Size();
 
-        fflush(stdout);
-
-        printf("queue size: %d+%d / %d. ZC: %d. flips: %d. splits: %d. wiggles: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),numZCs, numFlips, numSplits, numWiggles);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. ZC: %d. flips: %d. splits: %d. wiggles: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),numZCs, numFlips, numSplits, numWiggles);
+            fflush(stdout);
+        }
 
         if (wiggleQueue.Size() != 0)
         {
@@ -2740,6 +3860,17 @@ void RefineContour(Mesh * mesh, const vec3 & cameraCenter, const RefinementType
 
         // -------- for an inconsistent face, try to find a way to fix it by splits ---------
 
+        if (parallelThreads != 0)
+        {
+            int maxFaces = SPLIT_ROUND_SIZE;
+            if (maxInconsistentSplits >= 0 && maxInconsistentSplits - numSplits < maxFaces)
+                maxFaces = maxInconsistentSplits - numSplits;
+
+            numSplits += SplitRound(mesh, cameraCenter, localAllowShifts, maxFaces, splitPool, badEdges,
+                                    wiggleQueue, splitQueue);
+            continue;
+        }
+
         MeshFace * face = splitQueue.PopFront();
 
         if (IsConsistent<VertexDataCatmark>(face,cameraCenter))  // might have changed since it was added to the queue
@@ -2758,6 +3889,11 @@ void RefineContour(Mesh * mesh, const vec3 & cameraCenter, const RefinementType
 
     printf("queue size: %d+%d / %d. ZCsplits = %d. flips = %d. splits = %d. wiggles = %d                    \n", (int)wiggleQueue.Size(),splitQueue.Size(),(int)mesh->GetNumFaces(),numZCs, numFlips, numSplits, numWiggles);
 
+    ProfileCount(PC_ZERO_CROSSINGS, numZCs);
+    ProfileCount(PC_FLIPS, numFlips);
+    ProfileCount(PC_SPLITS, numSplits);
+    ProfileCount(PC_WIGGLES, numWiggles);
+
     printf("minInc = %d\n", minInc);
     if (minInc == 0)
         printf("NO INCONSISTENT TRIANGLES!\n");
@@ -2864,61 +4000,178 @@ int VertexDataCatmark::DebugString(char * str) const
     return type;
 }
 
-void ComputeRadialCurvatures(Mesh * mesh, const CameraModel & camera, real isovalue, int maxIsophoteDistance)
+// a contiguous range of vertices for ComputeRadialCurvatures
+struct RadialCurvatureTask
 {
-    printf("Computing radial curvatures and isophote distance.\n");
+    const std::vector<MeshVertex*> * verts;
+    size_t begin, end;
+    const CameraModel * camera;
+    real isovalue;
+    int maxIsophoteDistance;
+    Profile profile;  // counters of the helper thread, added to the caller's profile after the join
+};
 
-    std::list<MeshVertex*> verts;
-    mesh->GetVertices(std::back_inserter(verts));
+// vertices per lock-step isophote march
+const size_t ISOPHOTE_BATCH_SIZE = 256;
 
-    for(std::list<MeshVertex*>::iterator it = verts.begin(); it != verts.end(); ++it)
+static void ComputeRadialCurvatures(RadialCurvatureTask & task)
+{
+    const CameraModel & camera = *task.camera;
+    vec3 cameraCenter = camera.CameraCenter();
+
+    std::vector<ParamPointCC> sourceLocs;
+    std::vector<MeshVertex*> batchVerts;
+    std::vector<vec3> startPos, startNormal;
+    std::vector<real> distances;
+
+    for(size_t b = task.begin; b < task.end; b += ISOPHOTE_BATCH_SIZE)
     {
-        // radial curvature
+        size_t e = std::min(task.end, b + ISOPHOTE_BATCH_SIZE);
+
+        sourceLocs.clear();
+        batchVerts.clear();
 
-        real k_r;
-        VertexDataCatmark & data = (*it)->GetData();
-        bool result = data.sourceLoc.RadialCurvature(camera.CameraCenter(), k_r);
-        if (!result)
-            k_r = -123456;
-        (*it)->GetData().radialCurvature = k_r;
+        for(size_t i = b; i < e; ++i)
+        {
+            VertexDataCatmark & data = (*task.verts)[i]->GetData();
+
+            // radial curvature
+            real k_r;
+            bool result = data.sourceLoc.RadialCurvature(cameraCenter, k_r);
+            if (!result)
+                k_r = -123456;
+            data.radialCurvature = k_r;
+
+            if (!data.sourceLoc.IsEvaluable())
+            {
+                data.isophoteDistance = -1;
+                continue;
+            }
+            sourceLocs.push_back(data.sourceLoc);
+            batchVerts.push_back((*task.verts)[i]);
+        }
+
+        if (sourceLocs.empty())
+            continue;
+
+        // isophote distance: evaluate the starting points, then march all the rays together
+        ParamPointCC::EvaluateBatch(sourceLocs, startPos, startNormal);
+        ParamPointCC::IsophoteDistanceBatch(sourceLocs, camera, task.isovalue, task.maxIsophoteDistance,
+                                            startPos, startNormal, distances);
 
-        // isophote distance
-        data.isophoteDistance = data.sourceLoc.IsophoteDistance(camera, isovalue, maxIsophoteDistance);
+        for(size_t k = 0; k < batchVerts.size(); ++k)
+            batchVerts[k]->GetData().isophoteDistance = distances[k];
     }
 }
 
-void ComputeConsistencyStats(HbrMesh<VertexDataCatmark> * outputMesh, const vec3 & cameraCenter, int & numInconsistent, int & numStrongInconsistent,
-                             int &numNonRadial, int &numInconsistentContour, int &numInconsistentRadial)
+static void * RadialCurvatureThread(void * arg)
+{
+    RadialCurvatureTask & task = *static_cast<RadialCurvatureTask*>(arg);
+    currentProfile = &task.profile;
+    ComputeRadialCurvatures(task);
+    return NULL;
+}
+
+void ComputeRadialCurvatures(Mesh * mesh, const CameraModel & camera, real isovalue, int maxIsophoteDistance, int numThreads)
 {
+    printf("Computing radial curvatures and isophote distance.\n");
 
-    printf("Checking consistency\n");
+    ProfileTimer timer(PS_RADIAL_CURVATURES);
 
-    std::list<HbrFace<VertexDataCatmark>*> faces;
-    outputMesh->GetFaces(std::back_inserter(faces));
+    double startTime = ProfileTimer::ProfileSeconds();
+
+    std::vector<MeshVertex*> verts;
+    verts.reserve(mesh->GetNumVertices());
+    mesh->GetVertices(std::back_inserter(verts));
+
+    if (numThreads < 1)
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    // not worth a thread for less than a batch
+    if (numThreads > (int)(verts.size()/ISOPHOTE_BATCH_SIZE) + 1)
+        numThreads = (int)(verts.size()/ISOPHOTE_BATCH_SIZE) + 1;
 
-    int i = 0;
+    // each vertex only writes its own data, so the ranges are independent
+    std::vector<RadialCurvatureTask> tasks(numThreads);
+    for(int i=0;i<numThreads;i++)
+    {
+        tasks[i].verts = &verts;
+        tasks[i].begin = verts.size()*i/numThreads;
+        tasks[i].end = verts.size()*(i+1)/numThreads;
+        tasks[i].camera = &camera;
+        tasks[i].isovalue = isovalue;
+        tasks[i].maxIsophoteDistance = maxIsophoteDistance;
+    }
 
-    for(std::list<HbrFace<VertexDataCatmark>*>::iterator it = faces.begin(); it != faces.end(); ++it)
+    std::vector<pthread_t> threads(numThreads);
+    std::vector<bool> started(numThreads, false);
+    for(int i=1;i<numThreads;i++)
     {
-        if(i%40==0)
-            printf("Face: %d / %ld.   Count: %d, %d      \r", i, faces.size(), numInconsistent, numStrongInconsistent);
-        i++;
+        started[i] = (pthread_create(&threads[i], NULL, RadialCurvatureThread, &tasks[i]) == 0);
+        if (!started[i])
+        {
+            printf("WARNING: cannot create radial curvature thread, computing in the calling thread\n");
+            ComputeRadialCurvatures(tasks[i]);
+        }
+    }
+
+    ComputeRadialCurvatures(tasks[0]);
+
+    for(int i=1;i<numThreads;i++)
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+            if (currentProfile != NULL)
+                currentProfile->Add(tasks[i].profile);
+        }
+
+    double elapsed = ProfileTimer::ProfileSeconds() - startTime;
+    printf("Radial curvatures: %d vertices in %.2fs (%.1f us per vertex, %d threads)\n",
+           (int)verts.size(), elapsed, verts.empty() ? 0.0 : 1e6*elapsed/verts.size(), numThreads);
+}
+
+// consistency counts of a range of faces
+struct ConsistencyCounts
+{
+    int inconsistent;
+    int strongInconsistent;
+    int nonRadial;
+    int inconsistentContour;
+    int inconsistentRadial;
+};
 
-        HbrFace<VertexDataCatmark> * face = *it;
+struct ConsistencyStatsTask
+{
+    const std::vector<MeshFace*> * faces;
+    size_t begin, end;
+    vec3 cameraCenter;
+    bool sampleEdges;
+    ConsistencyCounts counts;
+    Profile profile;  // counters of the helper thread, added to the caller's profile after the join
+};
+
+static void ComputeConsistencyStats(ConsistencyStatsTask & task)
+{
+    const vec3 & cameraCenter = task.cameraCenter;
+    ConsistencyCounts & counts = task.counts;
+    memset(&counts, 0, sizeof(counts));
+
+    for(size_t i = task.begin; i < task.end; ++i)
+    {
+        TriFace<VertexDataCatmark> * face = (*task.faces)[i];
 
         if(!IsStandardRadialFace(face))
         {
-            numNonRadial++;
+            counts.nonRadial++;
         }
 
         if (!IsConsistent(face, cameraCenter))
         {
-            numInconsistent ++;
+            counts.inconsistent ++;
             for(int e=0;e<3;e++) {
                 if(face->GetVertex(e)->GetData().facing == CONTOUR){
-                    numInconsistentContour++;
+                    counts.inconsistentContour++;
                     if(IsStandardRadialFace(face)){
-                        numInconsistentRadial++;
+                        counts.inconsistentRadial++;
 #if LINK_FREESTYLE
                         char str[200];
                         sprintf(str, "INCONSISTENT RADIAL");
@@ -2932,10 +4185,16 @@ void ComputeConsistencyStats(HbrMesh<VertexDataCatmark> * outputMesh, const vec3
             }
         }
 
-        if (true ||NUM_INCONSISTENT_SAMPLES == 0)
+        if (!task.sampleEdges || NUM_INCONSISTENT_SAMPLES == 0)
             continue;
 
-        bool strongInconsistent = false;
+        // gather the edges to sample; all their samples are evaluated together
+        ParamPointCC p0[3], p1[3];
+        FacingType ft[3];
+#ifdef LINK_FREESTYLE
+        int edgeIndex[3];  // for the debugging points
+#endif
+        int numEdges = 0;
 
         for(int e=0;e<3;e++)
         {
@@ -2950,9 +4209,6 @@ void ComputeConsistencyStats(HbrMesh<VertexDataCatmark> * outputMesh, const vec3
             if (oppFace != NULL && oppFace < face)
                 continue;
 
-
-            ParamPointCC p0 = face->GetVertex(e)->GetData().sourceLoc;
-            ParamPointCC p1 = face->GetVertex((e+1)%3)->GetData().sourceLoc;
             FacingType ft0 = face->GetVertex(e)->GetData().facing;
             FacingType ft1 = face->GetVertex((e+1)%3)->GetData().facing;
 
@@ -2961,43 +4217,124 @@ void ComputeConsistencyStats(HbrMesh<VertexDataCatmark> * outputMesh, const vec3
 
             assert(ft0 == CONTOUR || ft1 == CONTOUR || ft0 == ft1);
 
-            FacingType ft = (ft0 != CONTOUR ? ft0: ft1);
+            p0[numEdges] = face->GetVertex(e)->GetData().sourceLoc;
+            p1[numEdges] = face->GetVertex((e+1)%3)->GetData().sourceLoc;
+            ft[numEdges] = (ft0 != CONTOUR ? ft0: ft1);
+#ifdef LINK_FREESTYLE
+            edgeIndex[numEdges] = e;
+#endif
+            numEdges++;
+        }
 
-            // check for zero-crossings by sampling
+        // check for zero-crossings by sampling
+        real t[3];
+        FindZeroCrossingsBySampling(numEdges, p0, p1, ft, cameraCenter, t);
 
-            real t = FindZeroCrossingBySampling( p0, p1, ft, cameraCenter);
+        bool strongInconsistent = false;
 
+        for(int k=0;k<numEdges;k++)
+        {
+            if (t[k] == -1)
+                continue;
 
-            if (t != -1)
-            {
-                strongInconsistent = true;
+            strongInconsistent = true;
 
 #ifdef LINK_FREESTYLE
-                ParamPointCC zeroCrossingPoint = ParamPointCC::Interpolate(p0, p1, t);
-                zeroCrossingPoint.SetNormalOffset(0);
+            int e = edgeIndex[k];
+            FacingType ft0 = face->GetVertex(e)->GetData().facing;
+            FacingType ft1 = face->GetVertex((e+1)%3)->GetData().facing;
 
-                vec3 pos = (1-t)*face->GetVertex(e)->GetData().pos + t*face->GetVertex((e+1)%3)->GetData().pos;
-                //                vec3 pos2, normal;
-                //                zeroCrossingPoint.Evaluate(pos2,normal);
+            ParamPointCC zeroCrossingPoint = ParamPointCC::Interpolate(p0[k], p1[k], t[k]);
+            zeroCrossingPoint.SetNormalOffset(0);
 
-                char * str = new char[200];
-                zeroCrossingPoint.PrintString(str);
+            vec3 pos = (1-t[k])*face->GetVertex(e)->GetData().pos + t[k]*face->GetVertex((e+1)%3)->GetData().pos;
 
-                real ndotv;
-                FacingType myFacing = Facing(zeroCrossingPoint, cameraCenter, CONTOUR_THRESHOLD, &ndotv);
+            char * str = new char[200];
+            zeroCrossingPoint.PrintString(str);
 
-                char * str2 = new char[300];
-                sprintf(str2, "STRONG INCONSISTENCY.\nft0 = %s, ft1 = %s, myFacing = %s, ndotv = %f, t= %f, %s",
-                        FacingToString(ft0), FacingToString(ft1), FacingToString(myFacing), double(ndotv), double(t), str);
+            real ndotv;
+            FacingType myFacing = Facing(zeroCrossingPoint, cameraCenter, CONTOUR_THRESHOLD, &ndotv);
 
-                addRIFDebugPoint(-1, pos[0], pos[1], pos[2], str2, 0);
+            char * str2 = new char[300];
+            sprintf(str2, "STRONG INCONSISTENCY.\nft0 = %s, ft1 = %s, myFacing = %s, ndotv = %f, t= %f, %s",
+                    FacingToString(ft0), FacingToString(ft1), FacingToString(myFacing), double(ndotv), double(t[k]), str);
+
+            addRIFDebugPoint(-1, pos[0], pos[1], pos[2], str2, 0);
 #endif
-            }
         }
 
         if (strongInconsistent)
-            numStrongInconsistent ++;
+            counts.strongInconsistent ++;
+    }
+}
+
+static void * ConsistencyStatsThread(void * arg)
+{
+    ConsistencyStatsTask & task = *static_cast<ConsistencyStatsTask*>(arg);
+    currentProfile = &task.profile;
+    ComputeConsistencyStats(task);
+    return NULL;
+}
+
+void ComputeConsistencyStats(TriMesh<VertexDataCatmark> * outputMesh, const vec3 & cameraCenter, int & numInconsistent, int & numStrongInconsistent,
+                             int &numNonRadial, int &numInconsistentContour, int &numInconsistentRadial,
+                             int numThreads, bool sampleEdges)
+{
+
+    printf("Checking consistency%s\n", sampleEdges ? " (sampling edges)" : "");
+
+    std::vector<TriFace<VertexDataCatmark>*> faces;
+    faces.reserve(outputMesh->GetNumFaces());
+    outputMesh->GetFaces(std::back_inserter(faces));
+
+    if (numThreads < 1)
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    // not worth a thread for a few faces
+    if (numThreads > (int)faces.size()/256 + 1)
+        numThreads = (int)faces.size()/256 + 1;
+
+    // contiguous ranges of faces, counted separately and summed at the end
+    std::vector<ConsistencyStatsTask> tasks(numThreads);
+    for(int i=0;i<numThreads;i++)
+    {
+        tasks[i].faces = &faces;
+        tasks[i].begin = faces.size()*i/numThreads;
+        tasks[i].end = faces.size()*(i+1)/numThreads;
+        tasks[i].cameraCenter = cameraCenter;
+        tasks[i].sampleEdges = sampleEdges;
+    }
+
+    std::vector<pthread_t> threads(numThreads);
+    std::vector<bool> started(numThreads, false);
+    for(int i=1;i<numThreads;i++)
+    {
+        started[i] = (pthread_create(&threads[i], NULL, ConsistencyStatsThread, &tasks[i]) == 0);
+        if (!started[i])
+        {
+            printf("WARNING: cannot create consistency thread, checking in the calling thread\n");
+            ComputeConsistencyStats(tasks[i]);
+        }
     }
+
+    ComputeConsistencyStats(tasks[0]);
+
+    for(int i=0;i<numThreads;i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+            if (currentProfile != NULL)
+                currentProfile->Add(tasks[i].profile);
+        }
+
+        numInconsistent += tasks[i].counts.inconsistent;
+        numStrongInconsistent += tasks[i].counts.strongInconsistent;
+        numNonRadial += tasks[i].counts.nonRadial;
+        numInconsistentContour += tasks[i].counts.inconsistentContour;
+        numInconsistentRadial += tasks[i].counts.inconsistentRadial;
+    }
+
+    printf("Faces: %d.   Inconsistent: %d, strong: %d\n", (int)faces.size(), numInconsistent, numStrongInconsistent);
 }
 
 bool IsSplittable(MeshVertex * v0, MeshVertex * v1)
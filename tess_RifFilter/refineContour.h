@@ -2,8 +2,10 @@
 #define __REFINE_CONTOUR_H__
 
 #include <string.h>
+#include <string>
 
 #include "subdiv.h"
+#include "profile.h"
 #include "paramPoint.h"
 #include "chart.h"
 
@@ -76,77 +78,110 @@ typedef ParamPoint<Vertex> ParamPointCC;  // sourceLoc for a Catmull-Clark surfa
 typedef ParamRay<Vertex> ParamRayCC;
 typedef Chart<Vertex> ChartCC;
 
+// the refined meshes are compact triangle meshes, see triangleMesh.h
+#include "triangleMesh.h"
+
 struct VertexDataCatmark
+// fields are grouped by size (reals, pointers, ints, flags) to avoid padding; the refined meshes
+// reach millions of vertices
 {
   vec3 pos;                // limit position
   vec3 normal;             // limit normal
-  FacingType facing;       // facing direction, as a function of limit normal
   ParamPointCC sourceLoc;  // parametric location on the source mesh
   real ndotv;
 
   // information on how this vertex was created
-  bool extraordinary;     // source point is an extraordinary point
-  HbrVertex<VertexDataCatmark> * extSrc; // if this is an extraordinary region endpoint, the source extr. point
-  bool isShifted;         // variable is redundant, could just check if origLoc is null...
   ParamPointCC origLoc;   // if this vertex got "shifted," where did it begin?
-  bool shiftSplit;        // created during shifting to make sure parameterizations exist.
+  TriVertex<VertexDataCatmark> * extSrc; // if this is an extraordinary region endpoint, the source extr. point
 
   real radialCurvature;   // only computed at the end
   real isophoteDistance;
   real k1;
   real k2;
 
-  bool cusp; //smooth cusp
-  HbrVertex<VertexDataCatmark> * radialOrg[2];
+  TriVertex<VertexDataCatmark> * radialOrg[2];
 
-  bool rootFindingFailed;
-  bool degenerate;
+  FacingType facing;       // facing direction, as a function of limit normal
   int id;
   int age;
+
+  bool extraordinary;     // source point is an extraordinary point
+  bool isShifted;         // variable is redundant, could just check if origLoc is null...
+  bool shiftSplit;        // created during shifting to make sure parameterizations exist.
+  bool cusp; //smooth cusp
+  bool rootFindingFailed;
+  bool degenerate;
+
   VertexDataCatmark() { Clear(); }
   VertexDataCatmark(int i) { Clear(); id = i; }
   void Clear() { id = -1; age = -1; rootFindingFailed = degenerate = extraordinary = isShifted = cusp = false; extSrc = NULL; shiftSplit = false; isophoteDistance = 6; radialOrg[0] = radialOrg[1] = NULL;}
   int DebugString(char *) const;
   vec3 GetPos() { return pos; }
   bool Radial() const { return radialOrg[0]!=NULL; }
-  void AddRadialOrg(HbrVertex<VertexDataCatmark> *v) { if(Radial()){ assert(!radialOrg[1]); radialOrg[1] = v; }else{ radialOrg[0] = v;  }}
-  bool HasRadialOrg(HbrVertex<VertexDataCatmark> *v) { return radialOrg[0] == v || radialOrg[1] == v; }
+  void AddRadialOrg(TriVertex<VertexDataCatmark> *v) { if(Radial()){ assert(!radialOrg[1]); radialOrg[1] = v; }else{ radialOrg[0] = v;  }}
+  bool HasRadialOrg(TriVertex<VertexDataCatmark> *v) { return radialOrg[0] == v || radialOrg[1] == v; }
   int NumRadialOrg() const { if (radialOrg[0] == NULL) return 0; else if (radialOrg[1] == NULL) return 1; else return 2; }
 };
 
-typedef HbrMesh<VertexDataCatmark> Mesh;
-typedef HbrVertex<VertexDataCatmark> MeshVertex;
-typedef HbrFace<VertexDataCatmark> MeshFace;
-typedef HbrHalfedge<VertexDataCatmark> MeshEdge;
+typedef TriMesh<VertexDataCatmark> Mesh;
+typedef TriVertex<VertexDataCatmark> MeshVertex;
+typedef TriFace<VertexDataCatmark> MeshFace;
+typedef TriHalfedge<VertexDataCatmark> MeshEdge;
 
 template<class T>
 class FacePriorityQueue
         // a queue that supports insertion of arbitrary elements and redundant insertions
-        // implementation right now is very quick and dirty
+        // indexed binary max-heap; the heap position of each face is looked up by face ID,
+        // so a face can be in several queues at once
 {
 private:
-    std::set<HbrFace<T>*> _readySet;  // all of the faces in the queue
-    std::multimap<real,HbrFace<T>*> _queue;  // ordered list of faces
+    struct Entry
+    {
+        real priority;
+        TriFace<T> * face;
+        int id;        // face ID, kept here so that entries are never dereferenced while sifting
+    };
 
+    std::vector<Entry> _heap;     // binary max-heap on priority
+    std::vector<int> _position;   // face ID -> index in _heap, -1 if not queued
 
-    real _Priority(const HbrFace<T>*) const;  // function that determines the priority of a face
+    real _Priority(const TriFace<T>*) const;  // function that determines the priority of a face
 
+    int _Position(const TriFace<T>* f) const { int id = f->GetID(); return id < (int)_position.size() ? _position[id] : -1; }
+    void _Place(int i, const Entry & e) { _heap[i] = e; _position[e.id] = i; }
+    void _SiftUp(int i);
+    void _SiftDown(int i);
+    void _Erase(int i);
 
 public:
-    HbrFace<T> * PopFront(); // return the highest-priority element
-    void Insert(HbrFace<T>*); // add a face to the queue (even if it's already there)
-    void Remove(HbrFace<T>*); // remove a face from the queue
-    int Size() const { return _readySet.size(); }
-    bool HasFace(HbrFace<T>* f) const { return _readySet.find(f) != _readySet.end(); }
-    void Clear() { _readySet.clear();  _queue.clear(); }
+    TriFace<T> * PopFront(); // return the highest-priority element
+    void Insert(TriFace<T>*); // add a face to the queue (even if it's already there)
+    void Update(TriFace<T>*); // recompute the priority of a queued face (increase or decrease key)
+    void Remove(TriFace<T>*); // remove a face from the queue
+    int Size() const { return _heap.size(); }
+    bool HasFace(TriFace<T>* f) const { int i = _Position(f); return i >= 0 && _heap[i].face == f; }
+    void Clear() { _heap.clear();  _position.clear(); }
 };
 
 typedef FacePriorityQueue<VertexDataCatmark> PriorityQueueCatmark;
 
-void SavePLYFile(HbrMesh<VertexDataCatmark> * outputMesh, const char* prefix, int index, bool meshSilhouettes=true);
+void SavePLYFile(TriMesh<VertexDataCatmark> * outputMesh, const char* prefix, int index, bool meshSilhouettes=true, bool binary=true);
+
+// PLY writing shared by the tessellator outputs. Binary files are binary_little_endian with double
+// vertex properties; ASCII files (for debugging) keep the historical float header and %.16f values.
+// Vertices are x y z nx ny nz [red green blue ndotv]; faces are a uchar/int index list and a uchar vbf flag.
+FILE * OpenPLYFile(const char * filename, bool binary, bool meshSilhouettes, int numVertices, int numFaces, bool vertexColors);
+void WritePLYVertex(FILE * fp, bool binary, const double * values, int numValues);
+void WritePLYFace(FILE * fp, bool binary, int v0, int v1, int v2, int vbf);
+
+// per-vertex normal written to the output: the vertex normal with mesh silhouettes, face-averaged otherwise
+vec3 OutputVertexNormal(TriVertex<VertexDataCatmark>* v, bool meshSilhouettes);
 
-bool IsRadialFace(HbrFace<VertexDataCatmark>* face);
-bool IsStandardRadialFace(HbrFace<VertexDataCatmark>* face);
+// vertex-based facing flag written to the output: 1 front, 2 back, 3 contour, +4 for radial faces on the contour
+int OutputFaceFlag(TriFace<VertexDataCatmark>* face);
+
+bool IsRadialFace(TriFace<VertexDataCatmark>* face);
+bool IsStandardRadialFace(TriFace<VertexDataCatmark>* face);
 bool IsStandardRadialFace(MeshVertex* v0, MeshVertex* v1, MeshVertex* v2);
 
 real TriangleQuality(const MeshVertex * v1, const MeshVertex * v2, const MeshVertex * v3);
@@ -157,28 +192,50 @@ bool FindBestSplitPointFace(MeshFace * face, bool allowShifts, const vec3 & came
                             std::set<std::pair<MeshVertex*,MeshVertex*> > & badEdges,
                             PriorityQueueCatmark & wiggleQueue, PriorityQueueCatmark & splitQueue);
 
-// sample an initial triangle mesh from a surface, clipping to the view frustum
-HbrMesh<VertexDataCatmark> * SurfaceToMesh(CatmarkMesh * surface, int subdivisionLevel,
-                                           const CameraModel & cameraModel, bool triangles);
-
-// perform contour filtering on a sampled mesh, in order to have a consistent smooth mesh contour
-void RefineContour(HbrMesh<VertexDataCatmark> * mesh, const vec3 & cameraCenter,
+// sample an initial triangle mesh from a surface, clipping to the view frustum.
+// visibleFaces receives the source faces the sampling depends on: the finest faces that produced
+// triangles, or the refined coarse faces when sampling adaptively.
+// adaptiveArea > 0: skip the coarse faces outside the frustum, and sample each visible face only as
+// finely as needed for triangles of about adaptiveArea pixels (finest level near predicted contours)
+TriMesh<VertexDataCatmark> * SurfaceToMesh(CatmarkMesh * surface, int subdivisionLevel,
+                                           const CameraModel & cameraModel, bool triangles,
+                                           int refineThreads = 1, std::vector<int> * visibleFaces = NULL,
+                                           real adaptiveArea = 0);
+
+// temporal cache: save the refined mesh of one frame as source-mesh locations, and reload it in the
+// next frame if the source topology, the visible source faces (as listed by SurfaceToMesh) and the
+// sampled triangles (SampledTrianglesKey of the fresh mesh) match.  nameIndex counts the earlier
+// objects of the frame with the same name.
+// LoadTemporalCache returns NULL when the cache is missing, stale, or grew past a multiple of numFreshFaces.
+std::string TemporalCacheFilename(const char * directory, const std::string & objectName, int nameIndex,
+                                  int numControlFaces);
+unsigned long long SampledTrianglesKey(TriMesh<VertexDataCatmark> * mesh);
+bool SaveTemporalCache(const char * filename, TriMesh<VertexDataCatmark> * mesh, CatmarkMesh * sourceMesh,
+                       int subdivisionLevel, const std::vector<int> & visibleFaces, unsigned long long sampledTriangles);
+TriMesh<VertexDataCatmark> * LoadTemporalCache(const char * filename, CatmarkMesh * sourceMesh, int subdivisionLevel,
+                                               const std::vector<int> & visibleFaces, unsigned long long sampledTriangles,
+                                               int numFreshFaces, const vec3 & cameraCenter);
+
+// perform contour filtering on a sampled mesh, in order to have a consistent smooth mesh contour.
+// parallelThreads != 0 runs the split stage in rounds of independent faces on that many threads
+// (-1 = all processors); the result is the same for any thread count, but differs from the serial stage.
+void RefineContour(TriMesh<VertexDataCatmark> * mesh, const vec3 & cameraCenter,
 		   const RefinementType refinement, const bool allowShifts,
-		   const int maxInconsistentSplits);
+		   const int maxInconsistentSplits, const int parallelThreads = 0);
 
 typedef enum { PREPROCESS, DETECT_CUSP, INSERT_CONTOUR, INSERT_CUSP, INSERT_RADIAL, FLIP_RADIAL, EXTEND_RADIAL, FLIP_EDGE, WIGGLING_PARAM, SPLIT_EDGE, EVERYTHING} RefineRadialStep;
 
-void RefineContourRadial(HbrMesh<VertexDataCatmark> * mesh, const vec3 & cameraCenter, const bool allowShifts, const RefineRadialStep lastStep);
+void RefineContourRadial(TriMesh<VertexDataCatmark> * mesh, const vec3 & cameraCenter, const bool allowShifts, const RefineRadialStep lastStep);
 
 bool EnsureShiftable(MeshVertex * shiftVertex, const ParamPointCC & targetLoc,
                      const vec3 & cameraCenter, Mesh * mesh,
                      PriorityQueueCatmark * wiggleQueue, PriorityQueueCatmark * splitQueue, bool testMode);
 
-void CullBackFaces(HbrMesh<VertexDataCatmark> * mesh);
+void CullBackFaces(TriMesh<VertexDataCatmark> * mesh);
 
-void WiggleInParamSpace(HbrMesh<VertexDataCatmark> * mesh, const vec3 & cameraCenter);
+void WiggleInParamSpace(TriMesh<VertexDataCatmark> * mesh, const vec3 & cameraCenter);
 
-HbrMesh<VertexDataCatmark> * DuplicateMesh(HbrMesh<VertexDataCatmark> * sourceMesh);
+TriMesh<VertexDataCatmark> * DuplicateMesh(TriMesh<VertexDataCatmark> * sourceMesh);
 
 bool FindContour(MeshVertex * vA, MeshVertex * vB, vec3 cameraCenter, ParamPointCC & resultPoint, MeshVertex  * &  extSrc);
 
@@ -201,25 +258,31 @@ void SplitZeroCrossingEdge(MeshFace * face, int oppVertex, Mesh * mesh,
 bool FlipFace(MeshFace * face, Mesh * mesh, const vec3 & cameraCenter,
               PriorityQueueCatmark & wiggleQueue, PriorityQueueCatmark & splitQueue);
 
-void ComputeRadialCurvatures(HbrMesh<VertexDataCatmark> * mesh, const CameraModel & camera, real isovalue, int maxIsophoteDistance);
+// radial curvature and isophote distance of every vertex, for the Freestyle styles (numThreads < 1: all processors)
+void ComputeRadialCurvatures(TriMesh<VertexDataCatmark> * mesh, const CameraModel & camera, real isovalue, int maxIsophoteDistance,
+                             int numThreads = -1);
 
 // The face orientation according to the vertices of the face; CONTOUR if the face is not vertex-consistent
 // e.g., for a face that's CCF, CFF, FFF, return F; for CCB, CBB, BBB, return B; otherwise return C.
 // (The actual orientation of the face is irrelevant.)
 template<class T>
-FacingType VertexBasedFacing(const HbrFace<T> * face);
+FacingType VertexBasedFacing(const TriFace<T> * face);
 
 template<class T>
-void CullBackFaces(HbrMesh<T> * mesh);
+void CullBackFaces(TriMesh<T> * mesh);
 
 template<class T>
-HbrFace<T> * NewFaceDebug(HbrMesh<T> * mesh, int numVertices, int * IDs, bool tryReverse = false);
+TriFace<T> * NewFaceDebug(TriMesh<T> * mesh, int numVertices, int * IDs, bool tryReverse = false);
 
 template<class T>
-void OptimizeConsistency(HbrMesh<T> * outputMesh, const vec3 & cameraCenter, real lambda, real epsilon);
+void OptimizeConsistency(TriMesh<T> * outputMesh, const vec3 & cameraCenter, real lambda, real epsilon);
 
-void ComputeConsistencyStats(HbrMesh<VertexDataCatmark> * outputMesh, const vec3 & cameraCenter, int & numInconsistent, int & numStrongInconsistent,
-                             int &numNonRadial, int &numInconsistentContour, int &numInconsistentRadial);
+// accumulate the consistency counts of a mesh, over numThreads threads (< 1: all processors).
+// the strong inconsistency count samples the limit surface along the edges and is only computed when
+// sampleEdges is set; otherwise only the cheap per-face statistics are gathered.
+void ComputeConsistencyStats(TriMesh<VertexDataCatmark> * outputMesh, const vec3 & cameraCenter, int & numInconsistent, int & numStrongInconsistent,
+                             int &numNonRadial, int &numInconsistentContour, int &numInconsistentRadial,
+                             int numThreads = 1, bool sampleEdges = false);
 
 #ifdef LINK_FREESTYLE
 void addRIFDebugPoint(int type, double x, double y, double z, char * debugString, double radialCurvature);
@@ -237,7 +300,7 @@ const int NUM_TRANSVERSE_SPLIT_SAMPLES = 0;
 const int NUM_WIGGLE_SAMPLES_SQRT = 11;
 const int NUM_NORMAL_WIGGLE_SAMPLES = 1; //7;  // 1 means no normal wiggling
 
-const int NUM_INCONSISTENT_SAMPLES = 200;  // set to 0 to not sample. this is implemented in a very inefficient way (many redundant computations)
+const int NUM_INCONSISTENT_SAMPLES = 200;  // samples per edge for strong inconsistencies (ComputeConsistencyStats with sampleEdges). set to 0 to not sample.
 
 // these thresholds are important to prevent infinite loops, otherwise the numerics go pear-shaped on tiny triangles
 const real MIN_INCONSISTENT_TRIANGLE_AREA = 1e-20; //1e-5;
@@ -61,7 +61,7 @@ FacingType Facing(const ParamPointCC & p, vec3 cameraCenter, real threshold = CO
 }
 
 template<class T>
-bool SmallTriangle(const HbrVertex<T> * v0, const HbrVertex<T> * v1, const HbrVertex<T> * v2)
+bool SmallTriangle(const TriVertex<T> * v0, const TriVertex<T> * v1, const TriVertex<T> * v2)
 {
     vec3 normal = GetNormal<T>(v0,v1,v2);
 
@@ -69,13 +69,13 @@ bool SmallTriangle(const HbrVertex<T> * v0, const HbrVertex<T> * v1, const HbrVe
 }
 
 template<class T>
-bool SmallTriangle(HbrVertex<T> * const v[3])
+bool SmallTriangle(TriVertex<T> * const v[3])
 {
     return SmallTriangle<T>(v[0],v[1],v[2]);
 }
 
 template<class T>
-bool SmallTriangle(const HbrFace<T> * face)
+bool SmallTriangle(const TriFace<T> * face)
 {
     return SmallTriangle<T>(face->GetVertex(0), face->GetVertex(1), face->GetVertex(2));
 }
@@ -85,7 +85,7 @@ bool SmallTriangle(const HbrFace<T> * face)
 // e.g., for a face that's CCF, CFF, FFF, return F; for CCB, CBB, BBB, return B; otherwise return C.
 // (The actual orientation of the face is irrelevant.)
 template<class T>
-FacingType VertexBasedFacing(HbrVertex<T> * v[3])
+FacingType VertexBasedFacing(TriVertex<T> * v[3])
 {
     FacingType ft[3] = { v[0]->GetData().facing, v[1]->GetData().facing, v[2]->GetData().facing };
     
@@ -107,18 +107,18 @@ FacingType VertexBasedFacing(HbrVertex<T> * v[3])
 }
 
 template<class T>
-FacingType VertexBasedFacing(const HbrFace<T> * face)
+FacingType VertexBasedFacing(const TriFace<T> * face)
 {
-    HbrVertex<T> * v[3] = {face->GetVertex(0), face->GetVertex(1), face->GetVertex(2) };
+    TriVertex<T> * v[3] = {face->GetVertex(0), face->GetVertex(1), face->GetVertex(2) };
     return VertexBasedFacing(v);
 }
 
-bool IsSplittable(HbrVertex<VertexDataCatmark> * v0, HbrVertex<VertexDataCatmark> * v1);
+bool IsSplittable(TriVertex<VertexDataCatmark> * v0, TriVertex<VertexDataCatmark> * v1);
 
 // Is the face consistent?  Treat cases that cannot be refined any further as consistent.
 // Could separate those two questions, so that shifts and wiggles are tried on inconsistent triangles...
 template<class T>
-bool IsConsistent(HbrVertex<T> * v[3], const vec3 & cameraCenter, real * ndotv = NULL)
+bool IsConsistent(TriVertex<T> * v[3], const vec3 & cameraCenter, real * ndotv = NULL)
 {
     vec3 normal = GetNormal<T>(v[0],v[1],v[2]);
 
@@ -172,7 +172,7 @@ bool IsConsistent(HbrVertex<T> * v[3], const vec3 & cameraCenter, real * ndotv =
 
 
 template <class T>  // concistency checking for the optimizer; TODO: reconcile with the other IsConsistent...
-bool IsConsistentOpt(HbrFace<T> * face, const vec3 & cameraCenter, real * ndotv = NULL) 
+bool IsConsistentOpt(TriFace<T> * face, const vec3 & cameraCenter, real * ndotv = NULL) 
 {
     FacingType vbf = VertexBasedFacing<T>(face);
     if (vbf == CONTOUR) // this function is only called in places that don't modify the VBF
@@ -188,21 +188,21 @@ bool IsConsistentOpt(HbrFace<T> * face, const vec3 & cameraCenter, real * ndotv
 }
 
 template<class T>
-bool IsConsistent(HbrFace<T> * face, const vec3 & cameraCenter, real * ndotv = NULL)
+bool IsConsistent(TriFace<T> * face, const vec3 & cameraCenter, real * ndotv = NULL)
 {
-    HbrVertex<T> * v[3] = { face->GetVertex(0), face->GetVertex(1), face->GetVertex(2) };
+    TriVertex<T> * v[3] = { face->GetVertex(0), face->GetVertex(1), face->GetVertex(2) };
     return IsConsistent<T>(v, cameraCenter, ndotv);
 }
 
 template<class T>
-void CullBackFaces(HbrMesh<T> * mesh)
+void CullBackFaces(TriMesh<T> * mesh)
 {
-    std::list<HbrFace<T>*> faces;
+    std::vector<TriFace<T>*> faces;
     mesh->GetFaces(std::back_inserter(faces));
 
-    for(typename std::list<HbrFace<T>*>::iterator it = faces.begin(); it != faces.end(); it++)
+    for(typename std::vector<TriFace<T>*>::iterator it = faces.begin(); it != faces.end(); it++)
     {
-        HbrFace<T>* face = *it;
+        TriFace<T>* face = *it;
 
         if (face == NULL)
             continue;
@@ -212,12 +212,12 @@ void CullBackFaces(HbrMesh<T> * mesh)
     }
 
     // delete any isolated vertices
-    std::list<HbrVertex<T>*> verts;
+    std::vector<TriVertex<T>*> verts;
     int n = 0, m = 0;
     mesh->GetVertices(std::back_inserter(verts));
-    for(typename std::list<HbrVertex<T>*>::iterator it = verts.begin(); it != verts.end(); ++it)
+    for(typename std::vector<TriVertex<T>*>::iterator it = verts.begin(); it != verts.end(); ++it)
     {
-        HbrVertex<T> * vert = *it;
+        TriVertex<T> * vert = *it;
         if (vert == NULL)
             continue;
 
@@ -237,13 +237,13 @@ void CullBackFaces(HbrMesh<T> * mesh)
 }
 
 template<class T>
-HbrFace<T> * NewFaceDebug(HbrMesh<T> * mesh, int numVertices, int * IDs, bool tryReverse)
+TriFace<T> * NewFaceDebug(TriMesh<T> * mesh, int numVertices, int * IDs, bool tryReverse)
 {
     bool bad = false;
     for(int i=0;i<numVertices;i++)
     {
-        HbrVertex<T> * v0 = mesh->GetVertex(IDs[i]);
-        HbrVertex<T> * v1 = mesh->GetVertex(IDs[(i+1)%3]);
+        TriVertex<T> * v0 = mesh->GetVertex(IDs[i]);
+        TriVertex<T> * v1 = mesh->GetVertex(IDs[(i+1)%3]);
 
         assert(v0 != v1);
 
@@ -265,7 +265,7 @@ HbrFace<T> * NewFaceDebug(HbrMesh<T> * mesh, int numVertices, int * IDs, bool tr
         return NULL;
     }
 
-    HbrFace<T> * face = mesh->NewFace(numVertices, IDs, 0);
+    TriFace<T> * face = mesh->NewFace(numVertices, IDs, 0);
 
     assert(!bad);
 
@@ -273,7 +273,7 @@ HbrFace<T> * NewFaceDebug(HbrMesh<T> * mesh, int numVertices, int * IDs, bool tr
 }
 
 template<class T>
-HbrFace<T> * NewFaceDebug(HbrMesh<T> * mesh, HbrVertex<T> * v0, HbrVertex<T> * v1, HbrVertex<T> * v2)
+TriFace<T> * NewFaceDebug(TriMesh<T> * mesh, TriVertex<T> * v0, TriVertex<T> * v1, TriVertex<T> * v2)
 {
     int IDs[3] = { v0->GetID(), v1->GetID(), v2->GetID() };
     return NewFaceDebug<T>(mesh, 3, IDs);
@@ -281,7 +281,7 @@ HbrFace<T> * NewFaceDebug(HbrMesh<T> * mesh, HbrVertex<T> * v0, HbrVertex<T> * v
 
 // for now, don't do normal projection for Catmarks
 inline vec3
-GetNormal(HbrVertex<VertexDataCatmark> * vertex)
+GetNormal(TriVertex<VertexDataCatmark> * vertex)
 {
     vec3 point, normal;
     vertex->GetData().sourceLoc.Evaluate(point, normal);
@@ -289,9 +289,9 @@ GetNormal(HbrVertex<VertexDataCatmark> * vertex)
 }
 
 template<class T>
-real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVertex<T>*>& meshVertexCluster, std::map<HbrVertex<T>*,vec3> & origPos,
+real ConsistencyEnergy(std::set<TriFace<T>*>& meshFaceCluster, std::set<TriVertex<T>*>& meshVertexCluster, std::map<TriVertex<T>*,vec3> & origPos,
                        const vec3 & cameraCenter, real lambda, real epsilon, int & numInconsistent,
-                       std::map<HbrVertex<T>*,vec3> * gradients)
+                       std::map<TriVertex<T>*,vec3> * gradients)
 {
     real energy = 0;
     numInconsistent = 0;
@@ -304,7 +304,7 @@ real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVerte
 
     // compute the consistency energy term
 
-    for(typename std::set<HbrFace<T>*>::iterator fit = meshFaceCluster.begin(); fit != meshFaceCluster.end(); ++fit)
+    for(typename std::set<TriFace<T>*>::iterator fit = meshFaceCluster.begin(); fit != meshFaceCluster.end(); ++fit)
     {
         FacingType vbf = VertexBasedFacing<T>(*fit);
         if (vbf == CONTOUR)
@@ -312,7 +312,7 @@ real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVerte
         int s = -(vbf == FRONT ? 1 : -1);   // Negative because source code uses v = p - c, derivation uses v=p-c.
 
 
-        HbrVertex<T> * v[3] = { (*fit)->GetVertex(0), (*fit)->GetVertex(1), (*fit)->GetVertex(2) };
+        TriVertex<T> * v[3] = { (*fit)->GetVertex(0), (*fit)->GetVertex(1), (*fit)->GetVertex(2) };
         vec3 p[3] = { v[0]->GetData().pos, v[1]->GetData().pos, v[2]->GetData().pos };
         real R = (cameraCenter - p[0]) * ((p[2] - p[0]) ^ (p[1] - p[0])); // /w;
 
@@ -336,7 +336,7 @@ real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVerte
                     continue;
 
                 vec3 dRdp_i = (p[(i+1)%3] - cameraCenter)^(p[(i+2)%3] - cameraCenter);
-                typename std::map<HbrVertex<T>*,vec3>::iterator it = gradients->find(v[i]);
+                typename std::map<TriVertex<T>*,vec3>::iterator it = gradients->find(v[i]);
                 if (it != gradients->end())
                     (*it).second += -s*dRdp_i;
                 else
@@ -348,7 +348,7 @@ real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVerte
 
     // add the squared-distance to the original positions, and then project the gradient onto normal direction (?)
 
-    for(typename std::set<HbrVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
+    for(typename std::set<TriVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
     {
         if ((*it)->GetData().pos == origPos[*it])
             continue;
@@ -357,7 +357,7 @@ real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVerte
         energy += lambda * (d*d);
         if (gradients != NULL)
         {
-            typename std::map<HbrVertex<T>*,vec3>::iterator git = gradients->find(*it);
+            typename std::map<TriVertex<T>*,vec3>::iterator git = gradients->find(*it);
             if (git != gradients->end())
                 (*git).second += lambda * d;
             else
@@ -374,13 +374,13 @@ real ConsistencyEnergy(std::set<HbrFace<T>*>& meshFaceCluster, std::set<HbrVerte
 
 
 template<class T>
-int OptimizeCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T>*> & meshVertexCluster, std::map<HbrVertex<T>*,vec3> & origPos,
+int OptimizeCluster(std::set<TriFace<T>*> & meshFaceCluster, std::set<TriVertex<T>*> & meshVertexCluster, std::map<TriVertex<T>*,vec3> & origPos,
                     const vec3 & cameraCenter, real lambda, real epsilon)
 {
     real stepSize = 1;
 
-    std::map<HbrVertex<T>*,vec3> iterOrigVals;
-    std::map<HbrVertex<T>*,vec3> gradients;
+    std::map<TriVertex<T>*,vec3> iterOrigVals;
+    std::map<TriVertex<T>*,vec3> gradients;
 
     //    int initialNumInconsistent;
     int numInconsistent;
@@ -391,13 +391,13 @@ int OptimizeCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<
     for(int iteration=0;iteration<100;iteration++)
     {
         // only need to compute this for elements with non-zero gradients
-        for(typename std::set<HbrVertex<T>*>::iterator vit = meshVertexCluster.begin(); vit != meshVertexCluster.end(); vit++)
+        for(typename std::set<TriVertex<T>*>::iterator vit = meshVertexCluster.begin(); vit != meshVertexCluster.end(); vit++)
             iterOrigVals[*vit] = (*vit)->GetData().pos;
 
         // compute current energy and gradient
         energy = ConsistencyEnergy<T>(meshFaceCluster, meshVertexCluster, origPos, cameraCenter, lambda, epsilon, numInconsistent, &gradients);
 
-        for(typename std::map<HbrVertex<T>*,vec3>::iterator git = gradients.begin(); git != gradients.end(); ++git) {
+        for(typename std::map<TriVertex<T>*,vec3>::iterator git = gradients.begin(); git != gradients.end(); ++git) {
             (*git).first->GetData().pos = iterOrigVals[(*git).first] - stepSize * (*git).second;
         }
 
@@ -409,7 +409,7 @@ int OptimizeCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<
         {
             stepSize /= 2;
 
-            for(typename std::map<HbrVertex<T>*,vec3>::iterator git = gradients.begin(); git != gradients.end(); ++git)
+            for(typename std::map<TriVertex<T>*,vec3>::iterator git = gradients.begin(); git != gradients.end(); ++git)
                 (*git).first->GetData().pos = iterOrigVals[(*git).first] - stepSize * (*git).second;
 
             newEnergy = ConsistencyEnergy<T>(meshFaceCluster, meshVertexCluster, origPos, cameraCenter, lambda, epsilon, numInconsistent, NULL);
@@ -430,14 +430,14 @@ int OptimizeCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<
 
 
 template<class T>
-bool IsContourFace(HbrFace<T> * face)
+bool IsContourFace(TriFace<T> * face)
 {
     FacingType vbf = VertexBasedFacing<T>(face);
     if (vbf == CONTOUR)
         return false;
     for(int e=0;e<3;e++)
     {
-        HbrFace<T> * oppFace;
+        TriFace<T> * oppFace;
         oppFace = GetOppFace(face,e);
         if (oppFace != NULL && VertexBasedFacing<T>(oppFace) != vbf)
             return true;
@@ -448,12 +448,12 @@ bool IsContourFace(HbrFace<T> * face)
 
 // search along the normal direction for the offset amount that minimizes the number of inconsistent adjacent triangles, and minimizes distance to source mesh
 template<class T>
-int WiggleVertex(HbrVertex<T> * vertex, const vec3 & cameraCenter, const vec3 & origPos)
+int WiggleVertex(TriVertex<T> * vertex, const vec3 & cameraCenter, const vec3 & origPos)
 {
-    std::set<HbrFace<T>*> oneRing;
+    std::vector<TriFace<T>*> oneRing;
     GetOneRing<T>(vertex, oneRing);
 
-    std::set<HbrVertex<T>*> oneRingVertices;
+    std::vector<TriVertex<T>*> oneRingVertices;
     GetOneRingVertices<T>(vertex, oneRingVertices);
 
     vec3 normal = GetNormal(vertex);
@@ -461,7 +461,7 @@ int WiggleVertex(HbrVertex<T> * vertex, const vec3 & cameraCenter, const vec3 &
     const int contourScore = 1;
 
     int initialNumInconsistent = 0;
-    for(typename std::set<HbrFace<T>*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
+    for(typename std::vector<TriFace<T>*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
         if (!IsConsistentOpt<T>(*it, cameraCenter))
         {
             if (IsContourFace<T>(*it))
@@ -471,7 +471,7 @@ int WiggleVertex(HbrVertex<T> * vertex, const vec3 & cameraCenter, const vec3 &
         }
 
     real aveDistToORVs = 0;
-    for(typename std::set<HbrVertex<T>*>::iterator it = oneRingVertices.begin(); it != oneRingVertices.end(); ++it)
+    for(typename std::vector<TriVertex<T>*>::iterator it = oneRingVertices.begin(); it != oneRingVertices.end(); ++it)
         aveDistToORVs += length((*it)->GetData().pos - vertex->GetData().pos);
     aveDistToORVs /= oneRingVertices.size();
 
@@ -490,7 +490,7 @@ int WiggleVertex(HbrVertex<T> * vertex, const vec3 & cameraCenter, const vec3 &
         int numInconsistent = 0;
         vertex->GetData().pos = curPos + aveDistToORVs / real(numSamples) * real(i) * normal;
 
-        for(typename std::set<HbrFace<T>*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
+        for(typename std::vector<TriFace<T>*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
             if (!IsConsistentOpt<T>(*it, cameraCenter))
             {
                 if (IsContourFace<T>(*it))
@@ -513,22 +513,22 @@ int WiggleVertex(HbrVertex<T> * vertex, const vec3 & cameraCenter, const vec3 &
 }
 
 template<class T>
-int WiggleFace(HbrFace<T> * face, const vec3 & cameraCenter, const vec3 origPos[3])
+int WiggleFace(TriFace<T> * face, const vec3 & cameraCenter, const vec3 origPos[3])
 {
     printf("Wiggle face %p : ",face);
 
-    std::set<HbrFace<T>*> adjacentFaces;
+    std::set<TriFace<T>*> adjacentFaces;
 
     for(int i=0; i<3; i++){
-        std::set<HbrFace<T>*> oneRing;
+        std::vector<TriFace<T>*> oneRing;
         GetOneRing<T>(face->GetVertex(i), oneRing);
-        for(typename std::set<HbrFace<T>*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
+        for(typename std::vector<TriFace<T>*>::iterator it = oneRing.begin(); it != oneRing.end(); ++it)
             adjacentFaces.insert(*it);
     }
     const int contourScore = 1;
 
     int initialNumInconsistent = 0;
-    for(typename std::set<HbrFace<T>*>::iterator it = adjacentFaces.begin(); it != adjacentFaces.end(); ++it)
+    for(typename std::set<TriFace<T>*>::iterator it = adjacentFaces.begin(); it != adjacentFaces.end(); ++it)
         if (!IsConsistentOpt<T>(*it, cameraCenter))
         {
             if (IsContourFace<T>(*it))
@@ -543,10 +543,10 @@ int WiggleFace(HbrFace<T> * face, const vec3 & cameraCenter, const vec3 origPos[
     vec3 bestPos[3];
     real dist[3];
     for(int i=0; i<3; i++){
-        std::set<HbrVertex<T>*> oneRingVertices;
-        HbrVertex<T>* vertex = face->GetVertex(i);
+        std::vector<TriVertex<T>*> oneRingVertices;
+        TriVertex<T>* vertex = face->GetVertex(i);
         GetOneRingVertices<T>(vertex, oneRingVertices);
-        for(typename std::set<HbrVertex<T>*>::iterator it = oneRingVertices.begin(); it != oneRingVertices.end(); ++it)
+        for(typename std::vector<TriVertex<T>*>::iterator it = oneRingVertices.begin(); it != oneRingVertices.end(); ++it)
             aveDistToORVs[i] += length((*it)->GetData().pos - vertex->GetData().pos);
         aveDistToORVs[i] /= oneRingVertices.size();
         dist[i] = length(vertex->GetData().pos - origPos[i]);
@@ -554,7 +554,7 @@ int WiggleFace(HbrFace<T> * face, const vec3 & cameraCenter, const vec3 origPos[
         bestPos[i] = vertex->GetData().pos;
         normal[i] = GetNormal(vertex);
     }
-    real bestDist = fmaxl(fmaxl(dist[0],dist[1]),dist[2]);
+    real bestDist = std::max(std::max(dist[0],dist[1]),dist[2]);
 
     int numSamples = 51;
     int h = (numSamples - 1)/2;
@@ -579,7 +579,7 @@ int WiggleFace(HbrFace<T> * face, const vec3 & cameraCenter, const vec3 origPos[
 
                 int numInconsistent = 0;
 
-                for(typename std::set<HbrFace<T>*>::iterator it = adjacentFaces.begin(); it != adjacentFaces.end(); ++it)
+                for(typename std::set<TriFace<T>*>::iterator it = adjacentFaces.begin(); it != adjacentFaces.end(); ++it)
                     if (!IsConsistentOpt<T>(*it, cameraCenter))
                     {
                         if (IsContourFace<T>(*it))
@@ -589,7 +589,7 @@ int WiggleFace(HbrFace<T> * face, const vec3 & cameraCenter, const vec3 origPos[
                     }
 
                 dist[2] = length(face->GetVertex(2)->GetData().pos - origPos[2]);
-                real maxDist = fmaxl(fmaxl(dist[0],dist[1]),dist[2]);
+                real maxDist = std::max(std::max(dist[0],dist[1]),dist[2]);
                 if (numInconsistent < bestNumInconsistent || (numInconsistent == bestNumInconsistent && maxDist < bestDist))
                 {
                     for(int l=0; l<3; l++)
@@ -612,22 +612,22 @@ template<class T>
 class WiggleCandidate
 {
 public:
-    std::map<HbrVertex<T>*, int> offset;
+    std::map<TriVertex<T>*, int> offset;
     int _h;
     bool done;
 
     WiggleCandidate() { }
-    WiggleCandidate(std::set<HbrVertex<T>*> & meshVertexCluster, int h)
+    WiggleCandidate(std::set<TriVertex<T>*> & meshVertexCluster, int h)
     {
         _h = h;
-        for(typename std::set<HbrVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
+        for(typename std::set<TriVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
             offset[*it] = -_h;
         done = false;
     }
 
     void increment()
     {
-        typename std::map<HbrVertex<T>*, int>::iterator it = offset.begin();
+        typename std::map<TriVertex<T>*, int>::iterator it = offset.begin();
         while (it != offset.end())
         {
             (*it).second ++;
@@ -641,7 +641,7 @@ public:
 };
 
 template<class T>
-void WiggleCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T>*> & meshVertexCluster, std::map<HbrVertex<T>*,vec3> & origPos,
+void WiggleCluster(std::set<TriFace<T>*> & meshFaceCluster, std::set<TriVertex<T>*> & meshVertexCluster, std::map<TriVertex<T>*,vec3> & origPos,
                    const vec3 & cameraCenter, real lambda, real epsilon)
 {
     printf("%d  ", meshVertexCluster.size()); fflush(stdout);
@@ -649,15 +649,15 @@ void WiggleCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T
     int h = (numSamples - 1)/2;
 
     // compute one-ring distances
-    std::map<HbrVertex<T>*, real> aveOneRingDist;
-    for(typename std::set<HbrVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
+    std::map<TriVertex<T>*, real> aveOneRingDist;
+    for(typename std::set<TriVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
     {
-        HbrVertex<T> * v = (*it);
-        std::set<HbrVertex<T>*> oneRingVertices;
+        TriVertex<T> * v = (*it);
+        std::set<TriVertex<T>*> oneRingVertices;
         GetOneRingVertices<T>(v, oneRingVertices);
 
         real aveDistToORVs = 0;
-        for(typename std::set<HbrVertex<T>*>::iterator orvit = oneRingVertices.begin(); orvit != oneRingVertices.end(); ++orvit)
+        for(typename std::set<TriVertex<T>*>::iterator orvit = oneRingVertices.begin(); orvit != oneRingVertices.end(); ++orvit)
             aveDistToORVs += length((*orvit)->GetData().pos - v->GetData().pos);
         aveDistToORVs /= oneRingVertices.size();
 
@@ -672,9 +672,9 @@ void WiggleCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T
     for(WiggleCandidate<T> counter(meshVertexCluster, h); !counter.done; counter.increment())
     {
         // offset all vertices
-        for(typename std::set<HbrVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
+        for(typename std::set<TriVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
         {
-            HbrVertex<T> * v = (*it);
+            TriVertex<T> * v = (*it);
             v->GetData().pos = origPos[v] + .5*counter.offset[v] * GetNormal(v) * aveOneRingDist[v] / real(numSamples);
         }
 
@@ -682,7 +682,7 @@ void WiggleCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T
 
         int inconsistent = 0;
         // count the inconsistency in the neighborhood
-        for (typename std::set<HbrFace<T>*>::iterator it = meshFaceCluster.begin(); it != meshFaceCluster.end() && bestInconsistent > 0; ++it)
+        for (typename std::set<TriFace<T>*>::iterator it = meshFaceCluster.begin(); it != meshFaceCluster.end() && bestInconsistent > 0; ++it)
             if (!IsConsistentOpt(*it, cameraCenter))
                 inconsistent ++;
 
@@ -696,9 +696,9 @@ void WiggleCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T
     }
 
     // apply the best candidate
-    for(typename std::set<HbrVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
+    for(typename std::set<TriVertex<T>*>::iterator it = meshVertexCluster.begin(); it != meshVertexCluster.end(); ++it)
     {
-        HbrVertex<T> * v = (*it);
+        TriVertex<T> * v = (*it);
         v->GetData().pos = origPos[v] + .5* bestCandidate.offset[v] * GetNormal(v) * aveOneRingDist[v] / real(numSamples);
     }
 
@@ -708,22 +708,22 @@ void WiggleCluster(std::set<HbrFace<T>*> & meshFaceCluster, std::set<HbrVertex<T
 
 template <class T>
 void
-ProcessClusters(HbrMesh<T> * mesh, const vec3 & cameraCenter, std::map<HbrVertex<T>*,vec3> & origPos, real lambda, real epsilon)
+ProcessClusters(TriMesh<T> * mesh, const vec3 & cameraCenter, std::map<TriVertex<T>*,vec3> & origPos, real lambda, real epsilon)
 {
     printf("Wiggling clusters\n");
-    std::set<HbrVertex<T>*> visitedVertices;
+    std::set<TriVertex<T>*> visitedVertices;
     int totalNumInconsistent = 0;
 
-    std::list<HbrFace<T>*> meshFaces;
-    std::list<HbrVertex<T>*> meshVertices;
+    std::list<TriFace<T>*> meshFaces;
+    std::list<TriVertex<T>*> meshVertices;
 
     mesh->GetFaces(std::back_inserter(meshFaces));
     mesh->GetVertices(std::back_inserter(meshVertices));
 
     // determine which vertices are variables (active).  Those that are adjacent to an inconsistent face are variable
     int initialNumInconsistent =0;
-    std::set<HbrVertex<T>*> activeVertices;
-    for(typename std::list<HbrFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
+    std::set<TriVertex<T>*> activeVertices;
+    for(typename std::list<TriFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
         if (!IsConsistentOpt(*fit, cameraCenter))
         {
             initialNumInconsistent ++;
@@ -731,7 +731,7 @@ ProcessClusters(HbrMesh<T> * mesh, const vec3 & cameraCenter, std::map<HbrVertex
                 activeVertices.insert((*fit)->GetVertex(i));
         }
 
-    for(typename std::set<HbrVertex<T>*>::iterator vit = activeVertices.begin(); vit != activeVertices.end(); ++vit)
+    for(typename std::set<TriVertex<T>*>::iterator vit = activeVertices.begin(); vit != activeVertices.end(); ++vit)
     {
         if (visitedVertices.find(*vit) != visitedVertices.end())
             continue;
@@ -742,10 +742,10 @@ ProcessClusters(HbrMesh<T> * mesh, const vec3 & cameraCenter, std::map<HbrVertex
         // a face is active if it is adjacent to a active vertex
         // adjacent variable faces are put in the same cluster, as are their variable vertices
 
-        std::set<HbrFace<T>*> meshFaceCluster;
-        std::set<HbrVertex<T>*> meshVertexCluster;
+        std::set<TriFace<T>*> meshFaceCluster;
+        std::set<TriVertex<T>*> meshVertexCluster;
 
-        std::list<HbrVertex<T>*> vertexQueue;
+        std::list<TriVertex<T>*> vertexQueue;
 
         vertexQueue.push_back(*vit);
         meshVertexCluster.insert(*vit);
@@ -753,19 +753,19 @@ ProcessClusters(HbrMesh<T> * mesh, const vec3 & cameraCenter, std::map<HbrVertex
 
         while(vertexQueue.size() > 0)  // flood fill
         {
-            HbrVertex<T> * v = vertexQueue.front();
+            TriVertex<T> * v = vertexQueue.front();
             vertexQueue.pop_front();
 
-            std::set<HbrFace<T>*> oneRing;
+            std::set<TriFace<T>*> oneRing;
             GetOneRing<T>(v, oneRing);
-            for(typename std::set<HbrFace<T>*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
+            for(typename std::set<TriFace<T>*>::iterator fit = oneRing.begin(); fit != oneRing.end(); ++fit)
             {
                 if (meshFaceCluster.find(*fit) != meshFaceCluster.end())
                     continue;
                 meshFaceCluster.insert(*fit);
                 for(int i=0;i<3;i++)
                 {
-                    HbrVertex<T> * v = (*fit)->GetVertex(i);
+                    TriVertex<T> * v = (*fit)->GetVertex(i);
                     if (visitedVertices.find(v) == visitedVertices.end() && activeVertices.find(v) != activeVertices.end())
                     {
                         vertexQueue.push_back(v);
@@ -783,7 +783,7 @@ ProcessClusters(HbrMesh<T> * mesh, const vec3 & cameraCenter, std::map<HbrVertex
 
     totalNumInconsistent = 0;
 
-    for(typename std::list<HbrFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
+    for(typename std::list<TriFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
         if (!IsConsistentOpt(*fit, cameraCenter))
             totalNumInconsistent ++;
     printf("\nTOTAL INCONSISTENT AFTER CLUSTER WIGGLING/OPTIMIZING: %d (was %d)\n", totalNumInconsistent, initialNumInconsistent);
@@ -791,22 +791,22 @@ ProcessClusters(HbrMesh<T> * mesh, const vec3 & cameraCenter, std::map<HbrVertex
 
 
 template<class T>
-void FilterNdotV(HbrMesh<T> * mesh)
+void FilterNdotV(TriMesh<T> * mesh)
 {
-    std::list<HbrVertex<T>*> meshVertices;
+    std::list<TriVertex<T>*> meshVertices;
     mesh->GetVertices(std::back_inserter(meshVertices));
 
-    for(typename std::list<HbrVertex<T>*>::iterator it = meshVertices.begin(); it!=meshVertices.end();it++)
+    for(typename std::list<TriVertex<T>*>::iterator it = meshVertices.begin(); it!=meshVertices.end();it++)
     {
-        HbrVertex<T> * vertex = *it;
-        std::set<HbrVertex<T>*> oneRingVertices;
+        TriVertex<T> * vertex = *it;
+        std::set<TriVertex<T>*> oneRingVertices;
         GetOneRingVertices<T>(vertex, oneRingVertices);
 
         FacingType myFacing = vertex->GetData().facing;
         FacingType oppFacing = myFacing == FRONT ? BACK : FRONT;
 
         int numSame = 0;
-        for(typename std::set<HbrVertex<T>*>::iterator orit = oneRingVertices.begin(); orit != oneRingVertices.end(); ++orit)
+        for(typename std::set<TriVertex<T>*>::iterator orit = oneRingVertices.begin(); orit != oneRingVertices.end(); ++orit)
             if ( (*orit)->GetData().facing == myFacing)
                 numSame ++;
 
@@ -831,30 +831,30 @@ vec3 GetOrigPos(const VertexDataCatmark & vd)
 }
 
 template<class T>
-void OptimizeConsistency(HbrMesh<T> * outputMesh, const vec3 & cameraCenter, real lambda, real epsilon)
+void OptimizeConsistency(TriMesh<T> * outputMesh, const vec3 & cameraCenter, real lambda, real epsilon)
 {
     printf("Optimizing consistency.\n");
 
-    std::list<HbrFace<T>*> meshFaces;
-    std::list<HbrVertex<T>*> meshVertices;
+    std::list<TriFace<T>*> meshFaces;
+    std::list<TriVertex<T>*> meshVertices;
 
     outputMesh->GetFaces(std::back_inserter(meshFaces));
     outputMesh->GetVertices(std::back_inserter(meshVertices));
 
     // save the original positions (would prefer to use limit positions or whatever)
-    std::map<HbrVertex<T>*,vec3> origPos;
+    std::map<TriVertex<T>*,vec3> origPos;
 
-    for(typename std::list<HbrVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); ++it)
+    for(typename std::list<TriVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); ++it)
         origPos[*it] = (*it)->GetData().pos;
 
     // optimize everything jointly
-    std::set<HbrFace<T>*> meshFaceCluster;
-    std::set<HbrVertex<T>*> meshVertexCluster;
+    std::set<TriFace<T>*> meshFaceCluster;
+    std::set<TriVertex<T>*> meshVertexCluster;
 
-    for(typename std::list<HbrFace<T>*>::iterator fit = meshFaces.begin(); fit != meshFaces.end(); ++fit)
+    for(typename std::list<TriFace<T>*>::iterator fit = meshFaces.begin(); fit != meshFaces.end(); ++fit)
         meshFaceCluster.insert(*fit);
 
-    for(typename std::list<HbrVertex<T>*>::iterator vit = meshVertices.begin(); vit != meshVertices.end(); ++vit)
+    for(typename std::list<TriVertex<T>*>::iterator vit = meshVertices.begin(); vit != meshVertices.end(); ++vit)
         meshVertexCluster.insert(*vit);
 
     OptimizeCluster(meshFaceCluster, meshVertexCluster, origPos, cameraCenter, lambda, epsilon);
@@ -863,21 +863,21 @@ void OptimizeConsistency(HbrMesh<T> * outputMesh, const vec3 & cameraCenter, rea
 }
 
 template<class T>
-void WiggleAllFaces(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
+void WiggleAllFaces(TriMesh<T> * outputMesh, const vec3 & cameraCenter)
 {
     // wiggle conjointly all vertices of an inconsistent face.
 
     printf("Wiggling face:\n");
 
-    std::list<HbrFace<T>*> meshFaces;
-    std::list<HbrVertex<T>*> meshVertices;
+    std::list<TriFace<T>*> meshFaces;
+    std::list<TriVertex<T>*> meshVertices;
     outputMesh->GetFaces(std::back_inserter(meshFaces));
     outputMesh->GetVertices(std::back_inserter(meshVertices));
 
     // save the original positions (would prefer to use limit positions or whatever)
-    std::map<HbrVertex<T>*,vec3> origPos;
+    std::map<TriVertex<T>*,vec3> origPos;
 
-    for(typename std::list<HbrVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); ++it)
+    for(typename std::list<TriVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); ++it)
         origPos[*it] = (*it)->GetData().pos;
 
     int reduction;
@@ -887,7 +887,7 @@ void WiggleAllFaces(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
         reduction = 0;
         printf("pass %d\n",pass++);
         fflush(stdout);
-        for(typename std::list<HbrFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
+        for(typename std::list<TriFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
         {
             if (!IsConsistentOpt<T>(*fit , cameraCenter)){
                 vec3 pos[3] = {origPos[(*fit)->GetVertex(0)], origPos[(*fit)->GetVertex(1)], origPos[(*fit)->GetVertex(2)]};
@@ -900,22 +900,22 @@ void WiggleAllFaces(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
 }
 
 template<class T>
-void WiggleAllVertices(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
+void WiggleAllVertices(TriMesh<T> * outputMesh, const vec3 & cameraCenter)
 {
     // wiggle each vertex of an inconsistent face.
 
     
     printf("Wiggling individual vertices: passes");
 
-    std::list<HbrFace<T>*> meshFaces;
-    std::list<HbrVertex<T>*> meshVertices;
+    std::list<TriFace<T>*> meshFaces;
+    std::list<TriVertex<T>*> meshVertices;
     outputMesh->GetFaces(std::back_inserter(meshFaces));
     outputMesh->GetVertices(std::back_inserter(meshVertices));
 
     // save the original positions (would prefer to use limit positions or whatever)
-    std::map<HbrVertex<T>*,vec3> origPos;
+    std::map<TriVertex<T>*,vec3> origPos;
 
-    for(typename std::list<HbrVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); ++it)
+    for(typename std::list<TriVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); ++it)
         origPos[*it] = (*it)->GetData().pos;
 
     int reduction;
@@ -926,7 +926,7 @@ void WiggleAllVertices(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
         reduction = 0;
         printf(" %d",pass++);
         fflush(stdout);
-        for(typename std::list<HbrFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
+        for(typename std::list<TriFace<T>*>::iterator fit= meshFaces.begin(); fit != meshFaces.end(); ++fit)
         {
             if (!IsConsistentOpt<T>(*fit , cameraCenter))
                 for(int i=0;i<3;i++)
@@ -942,12 +942,12 @@ void WiggleAllVertices(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
     // danger: code below assumes origPos hasn't changed
 
     int numInconsistent = 0;
-    for(typename std::list<HbrFace<T>*>::iterator it = meshFaces.begin(); it != meshFaces.end(); ++it)
+    for(typename std::list<TriFace<T>*>::iterator it = meshFaces.begin(); it != meshFaces.end(); ++it)
         if (!IsConsistentOpt(*it, cameraCenter))
             numInconsistent ++;
 
     // update the normal offsets
-    for(typename std::list<HbrVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); it++)
+    for(typename std::list<TriVertex<T>*>::iterator it = meshVertices.begin(); it != meshVertices.end(); it++)
     {
         vec3 motion = (*it)->GetData().pos - origPos[*it];
         vec3 normal = GetNormal(*it);
@@ -962,54 +962,120 @@ void WiggleAllVertices(HbrMesh<T> * outputMesh, const vec3 & cameraCenter)
 ///////////////////////////////////////////// PRIORITY QUEUE /////////////////////////////////
 
 template<class T>
-HbrFace<T> * FacePriorityQueue<T>::PopFront()
+TriFace<T> * FacePriorityQueue<T>::PopFront()
 {
     assert(Size()!=0);
 
-    HbrFace<T> * face;
-    typename std::set<HbrFace<T>*>::iterator rit;
+    TriFace<T> * face = _heap[0].face;
+    _Erase(0);
+    ProfileCount(PC_QUEUE_POPS);
 
-    do
-    {
-        typename std::multimap<real,HbrFace<T>*>::iterator it=_queue.end();
-        --it;
-        face = (*it).second;
-        _queue.erase(it);
+    return face;
+}
 
-        rit = _readySet.find(face);
-    }
-    while (rit == _readySet.end());
+template<class T>
+void FacePriorityQueue<T>::Insert(TriFace<T>* face)
+{
+    if (HasFace(face))
+        return;
 
-    _readySet.erase(rit);
+    int id = face->GetID();
+    if (id >= (int)_position.size())
+        _position.resize(std::max(id+1, 2*(int)_position.size()), -1);
 
-    return face;
+    ProfileCount(PC_QUEUE_INSERTS);
+
+    Entry e;
+    e.priority = _Priority(face);
+    e.face = face;
+    e.id = id;
+
+    _heap.push_back(e);
+    _position[id] = _heap.size()-1;
+    _SiftUp(_heap.size()-1);
 }
 
 template<class T>
-void FacePriorityQueue<T>::Insert(HbrFace<T>* face)
+void FacePriorityQueue<T>::Update(TriFace<T>* face)
 {
-    if (_readySet.find(face) != _readySet.end())
+    if (!HasFace(face))
         return;
 
-    _readySet.insert(face);
+    int i = _Position(face);
+    real old = _heap[i].priority;
+    _heap[i].priority = _Priority(face);
+
+    if (_heap[i].priority > old)
+        _SiftUp(i);
+    else
+        _SiftDown(i);
+}
+
+template<class T>
+void FacePriorityQueue<T>::Remove(TriFace<T> * face)
+{
+    if (!HasFace(face))
+        return;
 
-    _queue.insert(std::pair<real,HbrFace<T>*>(_Priority(face),face));
+    _Erase(_Position(face));
 }
 
 template<class T>
-void FacePriorityQueue<T>::Remove(HbrFace<T> * face)
+void FacePriorityQueue<T>::_Erase(int i)
 {
-    if (_readySet.find(face) == _readySet.end())
+    _position[_heap[i].id] = -1;
+
+    Entry last = _heap.back();
+    _heap.pop_back();
+
+    if (i == (int)_heap.size())
         return;
 
-    _readySet.erase(face);
+    // move the last entry into the hole and restore the heap in whichever direction it violates
+    _Place(i, last);
+    if (i > 0 && _heap[(i-1)/2].priority < last.priority)
+        _SiftUp(i);
+    else
+        _SiftDown(i);
+}
 
-    // could also remove from the queue and then simplify "PopFront()"
-}  
+template<class T>
+void FacePriorityQueue<T>::_SiftUp(int i)
+{
+    Entry e = _heap[i];
+    while (i > 0)
+    {
+        int parent = (i-1)/2;
+        if (!(_heap[parent].priority < e.priority))
+            break;
+        _Place(i, _heap[parent]);
+        i = parent;
+    }
+    _Place(i, e);
+}
 
+template<class T>
+void FacePriorityQueue<T>::_SiftDown(int i)
+{
+    Entry e = _heap[i];
+    int n = _heap.size();
+    while (true)
+    {
+        int child = 2*i+1;
+        if (child >= n)
+            break;
+        if (child+1 < n && _heap[child].priority < _heap[child+1].priority)
+            child++;
+        if (!(e.priority < _heap[child].priority))
+            break;
+        _Place(i, _heap[child]);
+        i = child;
+    }
+    _Place(i, e);
+}
 
 template<class T>
-real FacePriorityQueue<T>::_Priority(const HbrFace<T> * face) const
+real FacePriorityQueue<T>::_Priority(const TriFace<T> * face) const
 {
     return GetArea<T>(face);
 }
@@ -1017,7 +1083,7 @@ real FacePriorityQueue<T>::_Priority(const HbrFace<T> * face) const
 
 
 template<class T>
-void MakeSplitFaceIndices(HbrHalfedge<T> * edge, HbrVertex<T> * vnew, HbrVertex<T> * newFaces[4][3])
+void MakeSplitFaceIndices(TriHalfedge<T> * edge, TriVertex<T> * vnew, TriVertex<T> * newFaces[4][3])
 // given an edge and a vertex to insert in that edge, determine the indexes (with correct orientations)
 // of the vertices to be inserted in the new triangles
 {
@@ -1026,14 +1092,14 @@ void MakeSplitFaceIndices(HbrHalfedge<T> * edge, HbrVertex<T> * vnew, HbrVertex<
         for(int j=0;j<3;j++)
             newFaces[i][j] = NULL;
 
-    HbrVertex<T> * v1 = edge->GetOrgVertex();
-    HbrVertex<T> * v2 = edge->GetDestVertex();
+    TriVertex<T> * v1 = edge->GetOrgVertex();
+    TriVertex<T> * v2 = edge->GetDestVertex();
 
     // gather the adjacent faces/vertices with consistent ordering
     if (edge->GetLeftFace() != NULL)
     {
-        HbrFace<T> * leftFace = edge->GetLeftFace();
-        HbrVertex<T> * v[3] = { leftFace->GetVertex(0),leftFace->GetVertex(1),leftFace->GetVertex(2)};
+        TriFace<T> * leftFace = edge->GetLeftFace();
+        TriVertex<T> * v[3] = { leftFace->GetVertex(0),leftFace->GetVertex(1),leftFace->GetVertex(2)};
         int e;
         for(e=0;e<3;e++)
             if ((v[e] == v1 && v[(e+1)%3] == v2) || (v[e] == v2 && v[(e+1)%3] == v1))
@@ -1045,8 +1111,8 @@ void MakeSplitFaceIndices(HbrHalfedge<T> * edge, HbrVertex<T> * vnew, HbrVertex<
 
     if (edge->GetRightFace() != NULL)
     {
-        HbrFace<T> * rightFace = edge->GetRightFace();
-        HbrVertex<T> * v[3] = { rightFace->GetVertex(0),rightFace->GetVertex(1),rightFace->GetVertex(2)};
+        TriFace<T> * rightFace = edge->GetRightFace();
+        TriVertex<T> * v[3] = { rightFace->GetVertex(0),rightFace->GetVertex(1),rightFace->GetVertex(2)};
         int e;
         for(e=0;e<3;e++)
             if ((v[e] == v1 && v[(e+1)%3] == v2) || (v[e] == v2 && v[(e+1)%3] == v1))
@@ -1061,6 +1127,8 @@ void MakeSplitFaceIndices(HbrHalfedge<T> * edge, HbrVertex<T> * vnew, HbrVertex<
 
 
 void SetupVertex(VertexDataCatmark & vd, const ParamPointCC & p, const vec3 & cameraCenter);
+void SetupVertex(VertexDataCatmark & vd, const ParamPointCC & p, const vec3 & cameraCenter,
+                 const vec3 & limitPosition, const vec3 & limitNormal, real k1, real k2);
 
 inline
 bool CheesyInterpolatePoint(VertexDataCatmark & newData, VertexDataCatmark & vd0, VertexDataCatmark & vd1, real t, const vec3 & cameraCenter)
@@ -1099,7 +1167,7 @@ bool Inverse(real A[3][3])
             n-=A[i][j]*A[i-1][j+1]*A[i-2][j+2];
     }
 
-    if(fabsl(n)>0.0)
+    if(std::fabs(n)>0.0)
         x=1.0/n;
     else{
         return false;
@@ -1205,20 +1273,20 @@ bool Outside(vec3 & pos0, vec3 & pos1, vec3 & pos2, vec3 & testPos,
 }
 
 template<class T>
-bool Outside(HbrVertex<T>* v[3], HbrVertex<T>* testV, real & lambda, real & mu)
+bool Outside(TriVertex<T>* v[3], TriVertex<T>* testV, real & lambda, real & mu)
 {
     return Outside<T>(v[0]->GetData().pos,v[1]->GetData().pos,v[2]->GetData().pos,testV->GetData().pos,lambda,mu);
 }
 
 template<class T>
-bool Outside(HbrFace<T>* f, HbrVertex<T>* testV, real & lambda, real & mu)
+bool Outside(TriFace<T>* f, TriVertex<T>* testV, real & lambda, real & mu)
 {
-    HbrVertex<T>* vertices[3] = { f->GetVertex(0), f->GetVertex(1), f->GetVertex(2) };
+    TriVertex<T>* vertices[3] = { f->GetVertex(0), f->GetVertex(1), f->GetVertex(2) };
     return Outside(vertices,testV,lambda,mu);
 }
 
 template<class T>
-void FlipAndInsert(HbrVertex<T>* v[3], HbrVertex<T>* newV, HbrFace<T>* face, HbrMesh<T>* mesh, std::list< HbrFace<T>* > & f,
+void FlipAndInsert(TriVertex<T>* v[3], TriVertex<T>* newV, TriFace<T>* face, TriMesh<T>* mesh, std::list< TriFace<T>* > & f,
 FacePriorityQueue<T> & wiggleQueue, FacePriorityQueue<T> & splitQueue, bool skip[3])
 {
     real lambda, mu;
@@ -1227,10 +1295,10 @@ FacePriorityQueue<T> & wiggleQueue, FacePriorityQueue<T> & splitQueue, bool skip
             if(v[0]->GetData().facing!=CONTOUR || v[1]->GetData().facing!=CONTOUR){
                 //                printf("\nOUTSIDE 1\n");
                 //Flip v[0]v[1]
-                HbrHalfedge<T>* adjEdge = v[0]->GetEdge(v[1]) ? v[0]->GetEdge(v[1]) : v[1]->GetEdge(v[0]);
-                HbrFace<T>* adjFace = adjEdge->GetLeftFace() != face ? adjEdge->GetLeftFace() : adjEdge->GetRightFace();
+                TriHalfedge<T>* adjEdge = v[0]->GetEdge(v[1]) ? v[0]->GetEdge(v[1]) : v[1]->GetEdge(v[0]);
+                TriFace<T>* adjFace = adjEdge->GetLeftFace() != face ? adjEdge->GetLeftFace() : adjEdge->GetRightFace();
                 if (adjFace){
-                    HbrVertex<T>* oppositeV;
+                    TriVertex<T>* oppositeV;
                     for(int i=0; i<3; i++){
                         assert(adjFace != NULL);
                         oppositeV = adjFace->GetVertex(i);
@@ -1255,10 +1323,10 @@ FacePriorityQueue<T> & wiggleQueue, FacePriorityQueue<T> & splitQueue, bool skip
         }else if(lambda<0 && mu>=0){
             if(v[0]->GetData().facing!=CONTOUR || v[2]->GetData().facing!=CONTOUR){
                 //Flip v[0]v[2]
-                HbrHalfedge<T>* adjEdge = v[0]->GetEdge(v[2]) ? v[0]->GetEdge(v[2]) : v[2]->GetEdge(v[0]);
-                HbrFace<T>* adjFace = adjEdge->GetLeftFace() != face ? adjEdge->GetLeftFace() : adjEdge->GetRightFace();
+                TriHalfedge<T>* adjEdge = v[0]->GetEdge(v[2]) ? v[0]->GetEdge(v[2]) : v[2]->GetEdge(v[0]);
+                TriFace<T>* adjFace = adjEdge->GetLeftFace() != face ? adjEdge->GetLeftFace() : adjEdge->GetRightFace();
                 if(adjFace){
-                    HbrVertex<T>* oppositeV;
+                    TriVertex<T>* oppositeV;
                     for(int i=0; i<3; i++){
                         assert(adjFace != NULL);
                         oppositeV = adjFace->GetVertex(i);
@@ -1283,10 +1351,10 @@ FacePriorityQueue<T> & wiggleQueue, FacePriorityQueue<T> & splitQueue, bool skip
         }else if((lambda+mu) > 1.0){
             if(v[1]->GetData().facing!=CONTOUR || v[2]->GetData().facing!=CONTOUR){
                 //Flip v[1]v[2]
-                HbrHalfedge<T>* adjEdge = v[1]->GetEdge(v[2]) ? v[1]->GetEdge(v[2]) : v[2]->GetEdge(v[1]);
-                HbrFace<T>* adjFace = adjEdge->GetLeftFace() != face ? adjEdge->GetLeftFace() : adjEdge->GetRightFace();
+                TriHalfedge<T>* adjEdge = v[1]->GetEdge(v[2]) ? v[1]->GetEdge(v[2]) : v[2]->GetEdge(v[1]);
+                TriFace<T>* adjFace = adjEdge->GetLeftFace() != face ? adjEdge->GetLeftFace() : adjEdge->GetRightFace();
                 if(adjFace){
-                    HbrVertex<T>* oppositeV;
+                    TriVertex<T>* oppositeV;
                     for(int i=0; i<3; i++){
                         assert(adjFace != NULL);
                         oppositeV = adjFace->GetVertex(i);
@@ -1315,29 +1383,29 @@ FacePriorityQueue<T> & wiggleQueue, FacePriorityQueue<T> & splitQueue, bool skip
 }
 
 template<class T>
-void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, HbrMesh<T> * mesh, 
+void InsertVertex(TriFace<T> * face, int oppVertex, TriVertex<T> * newVertex, TriMesh<T> * mesh, 
                   FacePriorityQueue<T> & wiggleQueue,FacePriorityQueue<T> & splitQueue,
                   bool enqueueNewFaces = true, bool enqueueNewOppFaces = true)
 {
-    HbrVertex<T> * v0 = face->GetVertex(oppVertex);
-    HbrVertex<T> * v1 = face->GetVertex( (oppVertex+1)%3 );
-    HbrVertex<T> * v2 = face->GetVertex( (oppVertex+2)%3 );
+    TriVertex<T> * v0 = face->GetVertex(oppVertex);
+    TriVertex<T> * v1 = face->GetVertex( (oppVertex+1)%3 );
+    TriVertex<T> * v2 = face->GetVertex( (oppVertex+2)%3 );
 
     MYTEST("a\n");
 
     int eOpp;
-    HbrFace<T> * oppFace = GetOppFace<T>(face, oppVertex, eOpp);
+    TriFace<T> * oppFace = GetOppFace<T>(face, oppVertex, eOpp);
 
-    std::list<HbrFace<T>*> newFaces;
+    std::list<TriFace<T>*> newFaces;
     bool skip0[3] = {false,false,false};
     bool skip1[3] = {false,false,false};
 
     real lambda0, mu0;
-    HbrVertex<T>* vertices0[3] = {v0,v1,v2};
+    TriVertex<T>* vertices0[3] = {v0,v1,v2};
     if(Outside(vertices0,newVertex,lambda0,mu0)){
         if(oppFace){
             real lambda1, mu1;
-            HbrVertex<T>* vertices1[3] = {oppFace->GetVertex(eOpp),v1,v2};
+            TriVertex<T>* vertices1[3] = {oppFace->GetVertex(eOpp),v1,v2};
             if(Outside(vertices1,newVertex,lambda1,mu1)){
                 if(lambda0<0 || mu0<0){
                     FlipAndInsert(vertices0,newVertex,face,mesh,newFaces,wiggleQueue,splitQueue,skip0);
@@ -1358,10 +1426,10 @@ void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, Hb
 
     MYTEST("c\n");
 
-    HbrFace<T> * f1 = !skip0[0] ? NewFace<T>(mesh, v0, v1, newVertex) : NULL;
+    TriFace<T> * f1 = !skip0[0] ? NewFace<T>(mesh, v0, v1, newVertex) : NULL;
     MYTEST("c1\n");
 
-    HbrFace<T> * f2 = !skip0[2] ? NewFace<T>(mesh, v0, newVertex, v2) : NULL;
+    TriFace<T> * f2 = !skip0[2] ? NewFace<T>(mesh, v0, newVertex, v2) : NULL;
 
     MYTEST("d\n");
 
@@ -1384,7 +1452,7 @@ void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, Hb
 
     if (oppFace != NULL) // split the opposite face as well
     {
-        HbrVertex<T> * v3 = oppFace->GetVertex(eOpp);
+        TriVertex<T> * v3 = oppFace->GetVertex(eOpp);
 
         wiggleQueue.Remove(oppFace);
         splitQueue.Remove(oppFace);
@@ -1393,8 +1461,8 @@ void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, Hb
 
         mesh->DeleteFace(oppFace);
 
-        HbrFace<T> * f3 = !skip1[0] ? NewFace<T>(mesh, newVertex, v1, v3) : NULL;
-        HbrFace<T> * f4 = !skip1[2] ? NewFace<T>(mesh, v2, newVertex, v3) : NULL;
+        TriFace<T> * f3 = !skip1[0] ? NewFace<T>(mesh, newVertex, v1, v3) : NULL;
+        TriFace<T> * f4 = !skip1[2] ? NewFace<T>(mesh, v2, newVertex, v3) : NULL;
 
         MYTEST("G\n");
 
@@ -1439,32 +1507,32 @@ void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, Hb
 }
 
 template<class T>
-void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, HbrMesh<T> * mesh, std::vector<HbrFace<T>*> & deletedFaces)
+void InsertVertex(TriFace<T> * face, int oppVertex, TriVertex<T> * newVertex, TriMesh<T> * mesh, std::vector<TriFace<T>*> & deletedFaces)
 {
-    HbrVertex<T> * v0 = face->GetVertex(oppVertex);
-    HbrVertex<T> * v1 = face->GetVertex( (oppVertex+1)%3 );
-    HbrVertex<T> * v2 = face->GetVertex( (oppVertex+2)%3 );
+    TriVertex<T> * v0 = face->GetVertex(oppVertex);
+    TriVertex<T> * v1 = face->GetVertex( (oppVertex+1)%3 );
+    TriVertex<T> * v2 = face->GetVertex( (oppVertex+2)%3 );
 
     int eOpp;
-    HbrFace<T> * oppFace = GetOppFace<T>(face, oppVertex, eOpp);
+    TriFace<T> * oppFace = GetOppFace<T>(face, oppVertex, eOpp);
 
     mesh->DeleteFace(face);
     deletedFaces.push_back(face);
 
-    HbrFace<T> * f1 = NewFace<T>(mesh, v0, v1, newVertex);
-    HbrFace<T> * f2 = NewFace<T>(mesh, v0, newVertex, v2);
+    TriFace<T> * f1 = NewFace<T>(mesh, v0, v1, newVertex);
+    TriFace<T> * f2 = NewFace<T>(mesh, v0, newVertex, v2);
 
     assert(GetArea<T>(f1) > 0 && GetArea<T>(f2) > 0);
 
     if (oppFace != NULL) // split the opposite face as well
     {
-        HbrVertex<T> * v3 = oppFace->GetVertex(eOpp);
+        TriVertex<T> * v3 = oppFace->GetVertex(eOpp);
 
         mesh->DeleteFace(oppFace);
         deletedFaces.push_back(oppFace);
 
-        HbrFace<T> * f3 = NewFace<T>(mesh, newVertex, v1, v3);
-        HbrFace<T> * f4 = NewFace<T>(mesh, v2, newVertex, v3);
+        TriFace<T> * f3 = NewFace<T>(mesh, newVertex, v1, v3);
+        TriFace<T> * f4 = NewFace<T>(mesh, v2, newVertex, v3);
 
         assert(GetArea<T>(f3) > 0 && GetArea<T>(f4) > 0);
     }
@@ -1472,7 +1540,7 @@ void InsertVertex(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, Hb
 
 
 template<class T>
-bool HasTwoContourPoints(HbrFace<T> * face)
+bool HasTwoContourPoints(TriFace<T> * face)
 {
     int n = 0;
     for(int i=0;i<3;i++)
@@ -1483,9 +1551,9 @@ bool HasTwoContourPoints(HbrFace<T> * face)
 
 
 template<class T>
-bool TooSmallToSplit(HbrFace<T> * face, int oppVertex, HbrVertex<T> * newVertex, real areaThreshold)
+bool TooSmallToSplit(TriFace<T> * face, int oppVertex, TriVertex<T> * newVertex, real areaThreshold)
 {
-    HbrVertex<T> * newFaces[4][3];
+    TriVertex<T> * newFaces[4][3];
 
     MakeSplitFaceIndices(face->GetEdge((oppVertex+1)%3),newVertex,newFaces);
 
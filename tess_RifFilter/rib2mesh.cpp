@@ -1,6 +1,7 @@
 #include <map>
 #include <set>
 #include <strings.h>  // for strcasecmp on Mac
+#include <unistd.h>   // for sysconf
 #include <algorithm>
 
 #include "rib2mesh.h"
@@ -13,6 +14,10 @@
 real OPT_LAMBDA = 1;//1e-16;
 real OPT_EPSILON = 0.000001;//1e-10;
 
+// isophote distances of -radialCurvatures, with the settings of the isophoteDistance.py style
+const real RADIAL_ISOVALUE = 0.3;
+const int MAX_ISOPHOTE_DISTANCE = 4;
+
 using namespace std;
 
 
@@ -51,6 +56,18 @@ RifPlugin* RifPluginManufacture(int argc, char ** argv)
     std::vector<char*> styleModules;
     bool invertNormals = false;
     bool useConsistency = true;
+    int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int refineThreads = 1;
+    bool binaryPLY = true;
+    bool savePLY = true;
+    bool consistencySampling = false;
+    bool parallelRefine = false;
+    const char * temporalCacheDir = NULL;
+    double adaptiveArea = 0;
+    bool profileJSON = false;
+    bool occluderBVH = false;
+    bool benchmarkOccluders = false;
+    bool radialCurvatures = false;
 
     if (argc > 1)
         outputFilename = argv[0];
@@ -234,6 +251,83 @@ RifPlugin* RifPluginManufacture(int argc, char ** argv)
                                             runFreestyleInteractive = (strcmp(argv[i+1],"False") != 0);
                                             i += 2;
                                         }
+                                        else if (strcmp(argv[i],"-precision") == 0)
+                                        {
+                                            // the scalar type is chosen at build time (TESS_PRECISION); only check that it matches
+                                            if (strcmp(argv[i+1],TESS_PRECISION_NAME) != 0)
+                                                printf("RIB2MESH: WARNING: -precision %s requested, but the filter was built with %s precision\n",
+                                                       argv[i+1], TESS_PRECISION_NAME);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-threads") == 0)
+                                        {
+                                            numThreads = atoi(argv[i+1]);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-refineThreads") == 0)
+                                        {
+                                            refineThreads = atoi(argv[i+1]);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-savePLY") == 0)
+                                        {
+                                            savePLY = (strcmp(argv[i+1],"False") != 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-consistencySampling") == 0)
+                                        {
+                                            // sample the limit surface along the edges to count strong inconsistencies (slow)
+                                            consistencySampling = (strcmp(argv[i+1],"True") == 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-parallelRefine") == 0)
+                                        {
+                                            // split independent faces concurrently on -refineThreads threads
+                                            parallelRefine = (strcmp(argv[i+1],"True") == 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-temporalCache") == 0)
+                                        {
+                                            // directory for reusing each object's refined mesh in the next frame
+                                            temporalCacheDir = argv[i+1];
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-adaptiveArea") == 0)
+                                        {
+                                            // target image-space area of the initial triangles, in pixels (0 = uniform sampling)
+                                            adaptiveArea = atof(argv[i+1]);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-profile") == 0)
+                                        {
+                                            // write the per-object and per-frame timings and counters next to the output file
+                                            profileJSON = (strcmp(argv[i+1],"True") == 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-occluderBVH") == 0)
+                                        {
+                                            // Freestyle casts its visibility rays against a BVH instead of the FastGrid
+                                            occluderBVH = (strcmp(argv[i+1],"True") == 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-benchmarkOccluders") == 0)
+                                        {
+                                            // Freestyle times the FastGrid and the BVH on the visibility rays
+                                            benchmarkOccluders = (strcmp(argv[i+1],"True") == 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-radialCurvatures") == 0)
+                                        {
+                                            // radial curvature (the PLY and Freestyle vertex data) and isophote distance of the output vertices
+                                            radialCurvatures = (strcmp(argv[i+1],"True") == 0);
+                                            i+=2;
+                                        }
+                                        else if (strcmp(argv[i],"-plyFormat") == 0)
+                                        {
+                                            // "binary" (default) or "ascii" for readable files when debugging
+                                            binaryPLY = (strcmp(argv[i+1],"ascii") != 0);
+                                            i+=2;
+                                        }
                                         else if (strcmp(argv[i],"-beginStyleModules") == 0)
                                         {
                                             i++;
@@ -255,7 +349,9 @@ RifPlugin* RifPluginManufacture(int argc, char ** argv)
     rib2mesh * obj = new rib2mesh(targetSurfacePattern,outputFilename,exclusionPattern,subdivisionLevel,meshSmoothing,
                             refinement, maxInconsistentSplits, allowShifts, maxDisplayWidth, maxDisplayHeight, useOrientation, invertNormals,
                             cullBackFaces, meshSilhouettes, useConsistency, runFreestyle,
-                            runFreestyleInteractive, cuspTrimThreshold, graftThreshold, wiggleFactor, outputImage, outputEPSPolyline, outputEPSThick, freestyleLibPath, lastStep);
+                            runFreestyleInteractive, cuspTrimThreshold, graftThreshold, wiggleFactor, outputImage, outputEPSPolyline, outputEPSThick, freestyleLibPath, lastStep,
+                            numThreads, refineThreads, binaryPLY, savePLY, consistencySampling, parallelRefine,
+                            temporalCacheDir, adaptiveArea, profileJSON, occluderBVH, benchmarkOccluders, radialCurvatures);
 
     for(std::vector<char*>::iterator it = styleModules.begin(); it != styleModules.end(); ++it)
         obj->addStyle(*it);
@@ -274,10 +370,30 @@ rib2mesh::rib2mesh(const char * targetSurfacePattern, const char *outputFilename
              bool cullBackFaces,
              bool meshSilhouettes, bool useConsistency, bool runFreestyle, bool runFreestyleInteractive,
              double cuspTrimThreshold, double graftThreshold, double wiggleFactor,
-             const char * outputImage, const char * outputEPSPolyline, const char * outputEPSThick, const char * freestyleLibPath, RefineRadialStep lastStep)
+             const char * outputImage, const char * outputEPSPolyline, const char * outputEPSThick, const char * freestyleLibPath, RefineRadialStep lastStep,
+             int numThreads, int refineThreads, bool binaryPLY, bool savePLY, bool consistencySampling, bool parallelRefine,
+             const char * temporalCacheDir, double adaptiveArea, bool profileJSON,
+             bool occluderBVH, bool benchmarkOccluders, bool radialCurvatures)
 { 
     printf("Using pattern: %s\n", targetSurfacePattern);
     printf("Output geom filename: %s\n", outputFilename);
+    if (savePLY)
+        printf("Output geom format: %s\n", binaryPLY ? "binary" : "ascii");
+    else
+        printf("Output geom not saved\n");
+    printf("Precision: %s\n", TESS_PRECISION_NAME);
+    printf("Tessellation threads: %d\n", numThreads);
+    printf("Refine threads: %d\n", refineThreads);
+    printf("Consistency sampling: %s\n", consistencySampling ? "true" : "false");
+    printf("Parallel refinement: %s\n", parallelRefine ? "true" : "false");
+    if (temporalCacheDir != NULL)
+        printf("Temporal cache: %s\n", temporalCacheDir);
+    if (adaptiveArea > 0)
+        printf("Adaptive sampling: %f pixels per triangle\n", adaptiveArea);
+    if (profileJSON)
+        printf("Profile: %s\n", ProfileFilename(outputFilename).c_str());
+    printf("Freestyle occluders: %s%s\n", occluderBVH ? "BVH" : "FastGrid", benchmarkOccluders ? " (benchmark)" : "");
+    printf("Radial curvatures: %s\n", radialCurvatures ? "true" : "false");
     if (exclusionPattern == NULL)
         printf("No exclusion pattern\n");
     else
@@ -347,6 +463,26 @@ rib2mesh::rib2mesh(const char * targetSurfacePattern, const char *outputFilename
     _totalOutputFaces = 0;
     _totalInconsistentFaces = 0;
     _totalStrongInconsistentFaces = 0;
+    _totalContourInconsistentFaces = 0;
+    _totalRadialInconsistentFaces = 0;
+    _totalNonRadialFaces = 0;
+
+    _numThreads = numThreads < 1 ? 1 : numThreads;
+    _refineThreads = refineThreads;
+    _binaryPLY = binaryPLY;
+    _savePLY = savePLY;
+    _consistencySampling = consistencySampling;
+    _parallelRefine = parallelRefine;
+    _temporalCacheDir = temporalCacheDir;
+    _adaptiveArea = adaptiveArea;
+    _profileJSON = profileJSON;
+    _occluderBVH = occluderBVH;
+    _benchmarkOccluders = benchmarkOccluders;
+    _radialCurvatures = radialCurvatures;
+    _nextJob = 0;
+    _jobsClosed = false;
+    pthread_mutex_init(&_jobMutex, NULL);
+    pthread_cond_init(&_jobCond, NULL);
 
     // ---------------------------- COMPILE THE REGEXPs ----------------------------------
 
@@ -459,7 +595,7 @@ double compute_gcurv_colors(double k1, double k2, double feature_size)
     return fmin(fmax(c, 0.0), 1.0);
 }
 
-double compute_feature_size(HbrMesh<VertexDataCatmark>* mesh, bool radial=false)
+double compute_feature_size(TriMesh<VertexDataCatmark>* mesh, bool radial=false)
 {
     int nv = mesh->GetNumVertices();
     int nsamp = std::min(nv, 500);
@@ -478,10 +614,10 @@ double compute_feature_size(HbrMesh<VertexDataCatmark>* mesh, bool radial=false)
             continue;
         }
         if(radial){
-               samples.push_back(fabsl(mesh->GetVertex(ind)->GetData().radialCurvature));
+               samples.push_back(std::fabs(mesh->GetVertex(ind)->GetData().radialCurvature));
         }else{
-            samples.push_back(fabsl(mesh->GetVertex(ind)->GetData().k1));
-            samples.push_back(fabsl(mesh->GetVertex(ind)->GetData().k2));
+            samples.push_back(std::fabs(mesh->GetVertex(ind)->GetData().k1));
+            samples.push_back(std::fabs(mesh->GetVertex(ind)->GetData().k2));
         }
     }
 
@@ -496,11 +632,13 @@ double compute_feature_size(HbrMesh<VertexDataCatmark>* mesh, bool radial=false)
 
 int rib2mesh::SavePLYFile()
 {
+    // finish tessellating all the objects
+    waitForCatmarkJobs();
 
     // ---- count the number of vertices and faces ----
     int numVertices = 0;
     int numFaces = 0;
-    for(std::vector<HbrMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
     {
         numVertices += (*it)->GetNumVertices();
         numFaces += (*it)->GetNumFaces();
@@ -508,74 +646,40 @@ int rib2mesh::SavePLYFile()
 
     // ---- output the PLY header ----
 
-    FILE * fp = fopen(_outputFilename, "wt");
-
-    if (fp == NULL)
-    {
-        printf("ERROR: CANNOT OPEN OUTPUT PLY FILE\n");
-        exit(1);
-    }
-
-    fprintf(fp,"ply\n");
-    fprintf(fp,"format ascii 1.0\n");
-    fprintf(fp,"comment %s\n", _meshSilhouettes ? "mesh silhouettes" : "smooth silhouettes");
-    fprintf(fp,"element vertex %d\n", numVertices);
-    fprintf(fp,"property float x\n");   // maybe should save as doubles?  what would this require?
-    fprintf(fp,"property float y\n");   // maybe should save as doubles?
-    fprintf(fp,"property float z\n");   // maybe should save as doubles?
-    fprintf(fp,"property float nx\n");
-    fprintf(fp,"property float ny\n");
-    fprintf(fp,"property float nz\n");
-    fprintf(fp,"property float red\n");
-    fprintf(fp,"property float green\n");
-    fprintf(fp,"property float blue\n");
-    fprintf(fp,"property float ndotv\n");
-
-    fprintf(fp,"element face %d\n", numFaces);
-    //  fprintf(fp,"property uchar vbf\n");
-    fprintf(fp,"property list uchar int vertex_index\n");
-    fprintf(fp,"property uchar int\n");  // vbf
-    fprintf(fp,"end_header\n");
+    FILE * fp = OpenPLYFile(_outputFilename, _binaryPLY, _meshSilhouettes, numVertices, numFaces, true);
 
     // ---- output all the vertices and save their IDs ----
 
     int nextVertID = 0;
-    std::map<HbrVertex<VertexDataCatmark>*,int> vmapcc;
+    std::map<TriVertex<VertexDataCatmark>*,int> vmapcc;
 
-    for(std::vector<HbrMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
     {
         double feature_size = compute_feature_size(*it);
         double feature_size_radial = compute_feature_size(*it,true);
 
-        std::list<HbrVertex<VertexDataCatmark>*> verts;
+        std::list<TriVertex<VertexDataCatmark>*> verts;
         (*it)->GetVertices(std::back_inserter(verts));
-        for(std::list<HbrVertex<VertexDataCatmark>*>::iterator vit = verts.begin(); vit!= verts.end(); ++vit)
+        for(std::list<TriVertex<VertexDataCatmark>*>::iterator vit = verts.begin(); vit!= verts.end(); ++vit)
         {
             vmapcc[*vit] = nextVertID;
             nextVertID ++;
-            fprintf(fp, "%.16f %.16f %.16f", double((*vit)->GetData().pos[0]), double((*vit)->GetData().pos[1]), double((*vit)->GetData().pos[2]));
 
-            if (!_meshSilhouettes)
-            {
-                vec3 normal = FaceAveragedVertexNormal(*vit);
-                fprintf(fp, " %.16f %.16f %.16f", double(normal[0]),double(normal[1]),double(normal[2]));
-            }
-            else {
-                vec3 normal = -1.*(*vit)->GetData().normal;
-                fprintf(fp, " %.16f %.16f %.16f", double(normal[0]),double(normal[1]),double(normal[2]));
-            }
+            vec3 normal = OutputVertexNormal(*vit, _meshSilhouettes);
 
             //double C = compute_gcurv_colors((*vit)->GetData().k1,(*vit)->GetData().k2,feature_size);
             double color[3];
             compute_curv_colors((*vit)->GetData().k1,(*vit)->GetData().k2,feature_size,color);
 
-            fprintf(fp, " %f %f %f %.16f\n",
-                    //C,C,C,
-                    color[0], color[1], color[2],
-                    //double((*vit)->GetData().ndotv));
-                    double((*vit)->GetData().radialCurvature)/(0.5*feature_size_radial));
-                    //double(0.5*((*vit)->GetData().k1+(*vit)->GetData().k2))); //double((*vit)->GetData().ndotv),
-
+            const vec3 & pos = (*vit)->GetData().pos;
+            double values[10] = { double(pos[0]), double(pos[1]), double(pos[2]),
+                                  double(normal[0]), double(normal[1]), double(normal[2]),
+                                  //C,C,C,
+                                  color[0], color[1], color[2],
+                                  //double((*vit)->GetData().ndotv));
+                                  double((*vit)->GetData().radialCurvature)/(0.5*feature_size_radial) };
+                                  //double(0.5*((*vit)->GetData().k1+(*vit)->GetData().k2))); //double((*vit)->GetData().ndotv),
+            WritePLYVertex(fp, _binaryPLY, values, 10);
         }
     }
 
@@ -583,23 +687,14 @@ int rib2mesh::SavePLYFile()
 
     // --- output all the faces ----------
 
-    for(std::vector<HbrMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
     {
-        std::list<HbrFace<VertexDataCatmark>*> faces;
+        std::list<TriFace<VertexDataCatmark>*> faces;
         (*it)->GetFaces(std::back_inserter(faces));
-        for(std::list<HbrFace<VertexDataCatmark>*>::iterator fit = faces.begin(); fit != faces.end(); ++fit)
+        for(std::list<TriFace<VertexDataCatmark>*>::iterator fit = faces.begin(); fit != faces.end(); ++fit)
         {
-            FacingType vf = VertexBasedFacing(*fit);
-            int vfint = (vf == FRONT ? 1 : (vf == BACK ? 2 : 3));
-
-            if(((*fit)->GetVertex(0)->GetData().facing == CONTOUR ||
-                (*fit)->GetVertex(1)->GetData().facing == CONTOUR ||
-                (*fit)->GetVertex(2)->GetData().facing == CONTOUR) &&
-                    IsRadialFace(*fit))
-                vfint+=4;
-
             assert((*fit)->GetNumVertices() == 3);
-            fprintf(fp,"3 %d %d %d %d\n", vmapcc[(*fit)->GetVertex(0)], vmapcc[(*fit)->GetVertex(1)], vmapcc[(*fit)->GetVertex(2)], vfint);
+            WritePLYFace(fp, _binaryPLY, vmapcc[(*fit)->GetVertex(0)], vmapcc[(*fit)->GetVertex(1)], vmapcc[(*fit)->GetVertex(2)], OutputFaceFlag(*fit));
         }
     }
 
@@ -614,15 +709,20 @@ rib2mesh::~rib2mesh()
 {
     // ----------------------------- SAVE AND CLOSE THE OUTPUT FILE ---------------------
 
-    // generate a PLY file
+    // finish tessellating all the objects
+    waitForCatmarkJobs();
 
-    int numFaces = SavePLYFile();
+    int numFaces = 0;
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+        numFaces += (*it)->GetNumFaces();
 
-    printf("Deleting meshes\n");
+    // generate a PLY file (Freestyle gets the meshes directly)
+    if (_savePLY)
+        SavePLYFile();
 
-    // delete all the meshes
-    for(std::vector<HbrMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
-        delete *it;
+    _frameProfile.Print("frame");
+    if (_profileJSON)
+        WriteProfileJSON(ProfileFilename(_outputFilename).c_str(), _objectNames, _objectProfiles, _frameProfile);
 
     if (false && NUM_INCONSISTENT_SAMPLES > 0)
         printf("STATS: Input faces: %d, Output faces: %d, Inconsistent faces: %d, Strong Inconsistent Faces: %d\n\n",
@@ -647,6 +747,16 @@ rib2mesh::~rib2mesh()
         exit(1);
 #endif
     }
+
+    // Freestyle reads the meshes, so they are deleted last
+    printf("Deleting meshes\n");
+
+    // delete all the meshes
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+        delete *it;
+
+    pthread_mutex_destroy(&_jobMutex);
+    pthread_cond_destroy(&_jobCond);
 }
 
 
@@ -922,7 +1032,7 @@ vec3 rib2mesh::matrixTransform(const vec3 & pos)
 
     if (!printed)
     {
-        printf("an output point: %Lf %Lf %Lf\n", posout[0], posout[1], posout[2]);
+        printf("an output point: %f %f %f\n", double(posout[0]), double(posout[1]), double(posout[2]));
         printed = true;
     }
 
@@ -1012,11 +1122,11 @@ RtVoid rib2mesh::hierarchicalSubdivisionMeshV(RtToken mask, RtInt nf, RtInt nver
 
 #ifdef LINK_FREESTYLE
 template<class T>
-void CreatePointDebuggingData(HbrMesh<T> * mesh)
+void CreatePointDebuggingData(TriMesh<T> * mesh)
 {
-    std::list<HbrVertex<T>*> vertices;
+    std::list<TriVertex<T>*> vertices;
     mesh->GetVertices(std::back_inserter(vertices));
-    for(typename std::list<HbrVertex<T>*>::iterator it = vertices.begin(); it != vertices.end(); ++it)
+    for(typename std::list<TriVertex<T>*>::iterator it = vertices.begin(); it != vertices.end(); ++it)
     {
         vec3 posx = (*it)->GetData().pos;
         char debugString[2000];
@@ -1059,7 +1169,7 @@ void rib2mesh::handleCatmark(RtInt nf, RtInt nverts[],
 
     // find out how long verts is, then use verts to find out the number of vertices
     params.numVertices = 0;
-    int i, j, k;
+    int i;
 
     int nverts_len=0;
     for(i=0;i<nf;i++)
@@ -1159,28 +1269,50 @@ void rib2mesh::handleCatmark(RtInt nf, RtInt nverts[],
         }
     }
 
+    // ----------------- HAND THE OBJECT TO THE TESSELLATION WORKERS ------------------
+
+    CatmarkJob * job = new CatmarkJob(obj->cameraModel());
+    job->name = obj->_currentName;
+    job->faceSizes.assign(params.faceSizes, params.faceSizes + params.numFaces);
+    job->vertIndices.assign(params.vertIndices, params.vertIndices + nverts_len);
+    job->positions.swap(pointPositions);
+
+    obj->submitCatmark(job);
+}
+
+void rib2mesh::tessellateCatmark(CatmarkJob * job)
+{
+    int i, j, k;
+
+    int numVertices = (int)job->positions.size()/3;
+    int numFaces = (int)job->faceSizes.size();
+
+    // the instrumented code of this thread records into the job's profile
+    currentProfile = &job->profile;
+
     // ----------------- CREATE THE SUBD DATA STRUCTURE AND TESSELATE ------------------
 
-    static HbrCatmarkSubdivision<Vertex> catmark;
+    // one subdivision rule object per surface, so that objects can be refined concurrently
+    HbrCatmarkSubdivision<Vertex> catmark;
     CatmarkMesh * surface = new CatmarkMesh(&catmark);
 
     Vertex vtx;
-    for(int i=0;i<params.numVertices; i++ ) {
+    for(int i=0;i<numVertices; i++ ) {
         CatmarkVertex* v = surface->NewVertex(i, vtx);
-        v->GetData().SetPosition(pointPositions[3*i],pointPositions[3*i+1],pointPositions[3*i+2]);
+        v->GetData().SetPosition(job->positions[3*i],job->positions[3*i+1],job->positions[3*i+2]);
     }
 
     int maxFaceSize = 0;
-    for(i = 0; i < params.numFaces; ++i) {
-        maxFaceSize = std::max(params.faceSizes[i], maxFaceSize);
+    for(i = 0; i < numFaces; ++i) {
+        maxFaceSize = std::max(job->faceSizes[i], maxFaceSize);
     }
 
     int* fv = new int[maxFaceSize];
     k = 0;
-    for (i=0; i<params.numFaces; ++i) {
-        int faceSize = params.faceSizes[i];
+    for (i=0; i<numFaces; ++i) {
+        int faceSize = job->faceSizes[i];
         for(j = 0; j < faceSize; ++j) {
-            fv[j] = params.vertIndices[k++];
+            fv[j] = job->vertIndices[k++];
 
 //            topology.indices.push_back(params.vertIndices[k++]);//fv[j]);
         }
@@ -1217,6 +1349,8 @@ void rib2mesh::handleCatmark(RtInt nf, RtInt nverts[],
         surface->NewFace(faceSize, fv, i);
     }
 
+    delete [] fv;
+
     surface->SetInterpolateBoundaryMethod( CatmarkMesh::k_InterpolateBoundaryEdgeOnly );
 
     surface->Finish();
@@ -1230,7 +1364,7 @@ void rib2mesh::handleCatmark(RtInt nf, RtInt nverts[],
 
 
 
-//    topology.refinementLevel = obj->_subdivisionLevel;
+//    topology.refinementLevel = _subdivisionLevel;
 
 //    std::string *errorMessage;
 //    if(!topology.IsValid(errorMessage)){
@@ -1290,57 +1424,228 @@ void rib2mesh::handleCatmark(RtInt nf, RtInt nverts[],
 
     printf("Converting to mesh\n");
 
-    HbrMesh<VertexDataCatmark> * outputMesh = SurfaceToMesh(surface, obj->_subdivisionLevel, obj->cameraModel(), true);//, obj->_refinement != RF_FLOWTESS );
+    // the temporal cache is only used for RefineContour: the radial and optimization passes rebuild the mesh
+    bool useTemporalCache = _temporalCacheDir != NULL &&
+            (_refinement == RF_CONTOUR_ONLY || _refinement == RF_FULL || _refinement == RF_CONTOUR_INCONSISTENT);
+    std::vector<int> visibleFaces;
+
+    ProfileTimer timer(PS_SURFACE_TO_MESH);
+    TriMesh<VertexDataCatmark> * outputMesh = SurfaceToMesh(surface, _subdivisionLevel, job->camera, true, _refineThreads,
+                                                            useTemporalCache ? &visibleFaces : NULL, _adaptiveArea);//, _refinement != RF_FLOWTESS );
+    timer.Stop();
 
     if (outputMesh == NULL) // entire object culled
     {
         printf(" *** ENTIRE OBJECT CLIPPED; IGNORING *** \n");
+        Subdiv::Release(surface);
         delete surface;
+        currentProfile = NULL;
         return;
     }
 
-    obj->_totalInputFaces += outputMesh->GetNumFaces();
+    job->inputFaces += outputMesh->GetNumFaces();
+
+    std::string temporalCacheFile;
+    unsigned long long sampledTriangles = 0;
+    if (useTemporalCache)
+    {
+        timer.Next(PS_TEMPORAL_CACHE);
+        temporalCacheFile = TemporalCacheFilename(_temporalCacheDir, job->name, job->nameIndex, (int)job->faceSizes.size());
+        sampledTriangles = SampledTrianglesKey(outputMesh);
+
+        TriMesh<VertexDataCatmark> * cachedMesh = LoadTemporalCache(temporalCacheFile.c_str(), surface, _subdivisionLevel,
+                                                                    visibleFaces, sampledTriangles, outputMesh->GetNumFaces(),
+                                                                    job->camera.CameraCenter());
+        if (cachedMesh != NULL)
+        {
+            delete outputMesh;
+            outputMesh = cachedMesh;
+        }
+        timer.Stop();
+    }
 
     // -------- REFINE CONTOUR, RESOLVE INCONSISTENCIES, ETC -------------------------
 
-    if (obj->_refinement == RF_CONTOUR_ONLY || obj->_refinement == RF_FULL || obj->_refinement == RF_CONTOUR_INCONSISTENT)
+    if (_refinement == RF_CONTOUR_ONLY || _refinement == RF_FULL || _refinement == RF_CONTOUR_INCONSISTENT)
     {
         printf("Refining contour\n");
 
-        RefineContour(outputMesh, obj->cameraModel().CameraCenter(), obj->_refinement, obj->_allowShifts, obj->_maxInconsistentSplits);
+        timer.Next(PS_REFINE_CONTOUR);
+        RefineContour(outputMesh, job->camera.CameraCenter(), _refinement, _allowShifts, _maxInconsistentSplits,
+                      _parallelRefine ? _refineThreads : 0);
+
+        timer.Stop();
+
+        if (useTemporalCache)
+        {
+            timer.Next(PS_TEMPORAL_CACHE);
+            SaveTemporalCache(temporalCacheFile.c_str(), outputMesh, surface, _subdivisionLevel, visibleFaces, sampledTriangles);
+            timer.Stop();
+        }
     }
-    else if (obj->_refinement == RF_OPTIMIZE)
+    else if (_refinement == RF_OPTIMIZE)
     {
-        RefineContour(outputMesh, obj->cameraModel().CameraCenter(), RF_CONTOUR_ONLY, obj->_allowShifts, obj->_maxInconsistentSplits);
+        timer.Next(PS_REFINE_CONTOUR);
+        RefineContour(outputMesh, job->camera.CameraCenter(), RF_CONTOUR_ONLY, _allowShifts, _maxInconsistentSplits,
+                      _parallelRefine ? _refineThreads : 0);
 
-        OptimizeConsistency<VertexDataCatmark>(outputMesh, obj->cameraModel().CameraCenter(), OPT_LAMBDA, OPT_EPSILON);
+        timer.Next(PS_OPTIMIZE);
+        OptimizeConsistency<VertexDataCatmark>(outputMesh, job->camera.CameraCenter(), OPT_LAMBDA, OPT_EPSILON);
 
-        WiggleAllVertices<VertexDataCatmark>(outputMesh, obj->cameraModel().CameraCenter());
+        WiggleAllVertices<VertexDataCatmark>(outputMesh, job->camera.CameraCenter());
+        timer.Stop();
     }
-    else if (obj->_refinement == RF_RADIAL)
+    else if (_refinement == RF_RADIAL)
     {
-        RefineContourRadial(outputMesh, obj->cameraModel().CameraCenter(), obj->_allowShifts, obj->_lastStep);
+        RefineContourRadial(outputMesh, job->camera.CameraCenter(), _allowShifts, _lastStep);
     }
 
-    if (obj->_cullBackFaces)
+    if (_cullBackFaces)
     {
         printf("Culling backfaces\n");
+        timer.Next(PS_CULL_BACK_FACES);
         CullBackFaces<VertexDataCatmark>(outputMesh);
+        timer.Stop();
     }
 
-    obj->_totalOutputFaces += outputMesh->GetNumFaces();
-    ComputeConsistencyStats(outputMesh, obj->cameraModel().CameraCenter(), obj->_totalInconsistentFaces, obj->_totalStrongInconsistentFaces,
-                            obj->_totalNonRadialFaces, obj->_totalContourInconsistentFaces, obj->_totalRadialInconsistentFaces);
+    job->outputFaces += outputMesh->GetNumFaces();
+    timer.Next(PS_CONSISTENCY_STATS);
+    ComputeConsistencyStats(outputMesh, job->camera.CameraCenter(), job->inconsistentFaces, job->strongInconsistentFaces,
+                            job->nonRadialFaces, job->contourInconsistentFaces, job->radialInconsistentFaces,
+                            _refineThreads, _consistencySampling);
+    timer.Stop();
+
+    if (_radialCurvatures)
+        ComputeRadialCurvatures(outputMesh, job->camera, RADIAL_ISOVALUE, MAX_ISOPHOTE_DISTANCE, _refineThreads);
 
 #ifdef LINK_FREESTYLE
     CreatePointDebuggingData<VertexDataCatmark>(outputMesh);
 #endif
 
+    Subdiv * subdiv = Subdiv::Get(surface);
+    subdiv->PrintCacheStats();
+    ChartCache<Vertex>::Get(surface).PrintStats();
+
+    Profile & profile = job->profile;
+    profile.counters[PC_EVAL_LOOKUPS] += subdiv->CacheLookups();
+    profile.counters[PC_EVAL_CACHE_HITS] += subdiv->CacheHits();
+    profile.counters[PC_EVAL_BATCHED] += subdiv->BatchEvaluations();
+    profile.counters[PC_INPUT_FACES] += job->inputFaces;
+    profile.counters[PC_OUTPUT_FACES] += job->outputFaces;
+    profile.Print(job->name.c_str());
+    currentProfile = NULL;
+
+    Subdiv::Release(surface);
     delete surface;
 
-    obj->_outputMeshesCatmark.push_back(outputMesh);
+    job->outputMesh = outputMesh;
+
+    printf("DONE: %s\n\n",job->name.c_str());
+}
+
+
+//
+//
+// *********************************** Tessellation worker pool ***********************
+//
+//
+
+void rib2mesh::submitCatmark(CatmarkJob * job)
+{
+    job->nameIndex = _jobNameCounts[job->name]++;
+
+    if (_numThreads <= 1)
+    {
+        _catmarkJobs.push_back(job);
+        _nextJob = _catmarkJobs.size();
+        tessellateCatmark(job);
+        return;
+    }
+
+    pthread_mutex_lock(&_jobMutex);
+
+    if (_workers.empty())
+    {
+        // lazily built, shared tables must exist before the workers race to create them
+        FarPatchTables::Descriptor::GetAllValidDescriptors();
+
+        _workers.resize(_numThreads);
+        for(int i=0;i<_numThreads;i++)
+            if (pthread_create(&_workers[i], NULL, catmarkWorker, this) != 0)
+            {
+                printf("ERROR: CANNOT START TESSELLATION THREAD\n");
+                exit(1);
+            }
+    }
+
+    _catmarkJobs.push_back(job);
+    pthread_cond_signal(&_jobCond);
 
-    printf("DONE: %s\n\n",obj->_currentName);
+    pthread_mutex_unlock(&_jobMutex);
+}
+
+void * rib2mesh::catmarkWorker(void * plugin)
+{
+    rib2mesh * obj = static_cast<rib2mesh *>(plugin);
+
+    pthread_mutex_lock(&obj->_jobMutex);
+
+    while (true)
+    {
+        while (obj->_nextJob >= obj->_catmarkJobs.size() && !obj->_jobsClosed)
+            pthread_cond_wait(&obj->_jobCond, &obj->_jobMutex);
+
+        if (obj->_nextJob >= obj->_catmarkJobs.size())
+            break;
+
+        CatmarkJob * job = obj->_catmarkJobs[obj->_nextJob++];
+
+        pthread_mutex_unlock(&obj->_jobMutex);
+        obj->tessellateCatmark(job);
+        pthread_mutex_lock(&obj->_jobMutex);
+    }
+
+    pthread_mutex_unlock(&obj->_jobMutex);
+
+    return NULL;
+}
+
+void rib2mesh::waitForCatmarkJobs()
+{
+    pthread_mutex_lock(&_jobMutex);
+    _jobsClosed = true;
+    pthread_cond_broadcast(&_jobCond);
+    pthread_mutex_unlock(&_jobMutex);
+
+    for(std::vector<pthread_t>::iterator it = _workers.begin(); it != _workers.end(); ++it)
+        pthread_join(*it, NULL);
+    _workers.clear();
+
+    // collect the results in RIB order
+    for(std::vector<CatmarkJob*>::iterator it = _catmarkJobs.begin(); it != _catmarkJobs.end(); ++it)
+    {
+        CatmarkJob * job = *it;
+
+        if (job->outputMesh != NULL)
+            _outputMeshesCatmark.push_back(job->outputMesh);
+
+        _totalInputFaces += job->inputFaces;
+        _totalOutputFaces += job->outputFaces;
+        _totalInconsistentFaces += job->inconsistentFaces;
+        _totalStrongInconsistentFaces += job->strongInconsistentFaces;
+        _totalNonRadialFaces += job->nonRadialFaces;
+        _totalContourInconsistentFaces += job->contourInconsistentFaces;
+        _totalRadialInconsistentFaces += job->radialInconsistentFaces;
+
+        _objectNames.push_back(job->name);
+        _objectProfiles.push_back(job->profile);
+        _frameProfile.Add(job->profile);
+
+        delete job;
+    }
+    _catmarkJobs.clear();
+    _jobNameCounts.clear();
+    _nextJob = 0;
 }
 
 
@@ -1359,6 +1664,79 @@ void run2(const char * meshFilename, const char * snapshotFilename,
 
 void addStyleFS(const char * styleFilename);
 
+void setOccludersFS(bool useBVH, bool benchmark);
+
+void setMeshFS(unsigned numVertices, double * vertices, double * normals, float * vertexUserData,
+               unsigned numFaces, unsigned * faceVertices, int * faceUserData, bool meshSilhouettes);
+
+// hand the output meshes to Freestyle as the arrays of its indexed face set, with the same
+// contents as the PLY file (positions, normals, ndotv user data, vertex-based facing flags)
+void rib2mesh::sendMeshToFreestyle()
+{
+    unsigned numVertices = 0;
+    unsigned numFaces = 0;
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+    {
+        numVertices += (*it)->GetNumVertices();
+        numFaces += (*it)->GetNumFaces();
+    }
+
+    // owned by Freestyle once handed over
+    double * vertices = new double[3*numVertices];
+    double * normals = new double[3*numVertices];
+    float * vertexUserData = new float[numVertices];
+    unsigned * faceVertices = new unsigned[3*numFaces];
+    int * faceUserData = new int[numFaces];
+
+    unsigned nextVertID = 0;
+    unsigned nextFaceID = 0;
+
+    for(std::vector<TriMesh<VertexDataCatmark>*>::iterator it = _outputMeshesCatmark.begin(); it != _outputMeshesCatmark.end(); ++it)
+    {
+        double feature_size_radial = compute_feature_size(*it,true);
+
+        // output index of the vertices of this mesh, by Hbr vertex ID
+        std::vector<unsigned> vertexIndex;
+
+        std::list<TriVertex<VertexDataCatmark>*> verts;
+        (*it)->GetVertices(std::back_inserter(verts));
+        for(std::list<TriVertex<VertexDataCatmark>*>::iterator vit = verts.begin(); vit!= verts.end(); ++vit)
+        {
+            int id = (*vit)->GetID();
+            if (id >= (int)vertexIndex.size())
+                vertexIndex.resize(id+1);
+            vertexIndex[id] = nextVertID;
+
+            const vec3 & pos = (*vit)->GetData().pos;
+            vec3 normal = OutputVertexNormal(*vit, _meshSilhouettes);
+            for(int j=0;j<3;j++)
+            {
+                vertices[3*nextVertID+j] = double(pos[j]);
+                normals[3*nextVertID+j] = double(normal[j]);
+            }
+            vertexUserData[nextVertID] = double((*vit)->GetData().radialCurvature)/(0.5*feature_size_radial);
+
+            nextVertID ++;
+        }
+
+        std::list<TriFace<VertexDataCatmark>*> faces;
+        (*it)->GetFaces(std::back_inserter(faces));
+        for(std::list<TriFace<VertexDataCatmark>*>::iterator fit = faces.begin(); fit != faces.end(); ++fit)
+        {
+            assert((*fit)->GetNumVertices() == 3);
+            for(int j=0;j<3;j++)
+                faceVertices[3*nextFaceID+j] = vertexIndex[(*fit)->GetVertex(j)->GetID()];
+            faceUserData[nextFaceID] = OutputFaceFlag(*fit);
+
+            nextFaceID ++;
+        }
+    }
+
+    assert(nextVertID == numVertices && nextFaceID == numFaces);
+
+    setMeshFS(numVertices, vertices, normals, vertexUserData, numFaces, faceVertices, faceUserData, _meshSilhouettes);
+}
+
 void rib2mesh::runFreestyle()
 {
     // create a pointer to a 4x4 Matrix
@@ -1390,6 +1768,9 @@ void rib2mesh::runFreestyle()
         displayHeight = _yres;
     }
 
+    sendMeshToFreestyle();
+    setOccludersFS(_occluderBVH, _benchmarkOccluders);
+
     run2(_outputFilename, _outputImage, _outputEPSPolyline, _outputEPSThick, camera, _left, _right, _bottom, _top,
          _pixelaspect, _aspect, _near, _far, _focalLength, _xres, _yres, displayWidth, displayHeight, 0,
          _useConsistency && _refinement != RF_NONE, _runFreestyleInteractive, _cuspTrimThreshold, _graftThreshold, _wiggleFactor,
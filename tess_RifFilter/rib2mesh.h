@@ -1,6 +1,9 @@
 #include <iostream>
+#include <string>
 #include <vector>
+#include <map>
 #include <regex.h>
+#include <pthread.h>
 
 #include <ri.h>
 #ifdef RENDERMAN
@@ -18,12 +21,52 @@ public:
     Attribute(bool orientation) { orientationOutside = orientation; }
 };
 
+// A Catmull-Clark surface captured from the RIB stream, tessellated by a
+// worker thread. Holds a copy of everything the tessellation needs, since the
+// RIF callback arguments are only valid during the callback.
+struct CatmarkJob
+{
+    std::string name;
+    int nameIndex;  // jobs of the frame with the same name before this one
+    std::vector<int> faceSizes;
+    std::vector<int> vertIndices;
+    std::vector<real> positions;  // transformed vertex positions, 3 per vertex
+    CameraModel camera;
+
+    TriMesh<VertexDataCatmark> * outputMesh;  // NULL if the object was clipped
+
+    // per-object statistics, added to the totals after the join
+    int inputFaces;
+    int outputFaces;
+    int inconsistentFaces;
+    int strongInconsistentFaces;
+    int nonRadialFaces;
+    int contourInconsistentFaces;
+    int radialInconsistentFaces;
+
+    Profile profile;  // stage timings and counters
+
+    CatmarkJob(const CameraModel & cam) : nameIndex(0), camera(cam), outputMesh(NULL), inputFaces(0), outputFaces(0),
+        inconsistentFaces(0), strongInconsistentFaces(0), nonRadialFaces(0),
+        contourInconsistentFaces(0), radialInconsistentFaces(0) { }
+};
+
 class rib2mesh : public RifPlugin
 { 
 public:
     RifFilter _filter;
     int _subdivisionLevel;  // how much to subdivide
     const char * _outputFilename; // output mesh file
+    bool _binaryPLY;              // binary_little_endian output (ascii otherwise)
+    bool _savePLY;                // write the output file (Freestyle gets the meshes in memory)
+    bool _consistencySampling;    // count strong inconsistencies by sampling the edges (slow)
+    bool _parallelRefine;         // split independent faces concurrently (same result for any thread count)
+    const char * _temporalCacheDir; // reuse each object's refined mesh from the previous frame (NULL = off)
+    double _adaptiveArea;         // target pixel area of the initial triangles (0 = uniform sampling)
+    bool _profileJSON;            // write the profiles next to the output file
+    bool _occluderBVH;            // Freestyle ray casts against a BVH (FastGrid otherwise)
+    bool _benchmarkOccluders;     // Freestyle times both occluder structures
+    bool _radialCurvatures;       // compute the radial curvatures and isophote distances of the refined meshes
     int _numVerts;
     int _numFaces;
     double _meshSmoothing;
@@ -38,7 +81,18 @@ public:
     bool _useConsistency;
 
     // meshes to save to the output file
-    std::vector<HbrMesh<VertexDataCatmark>*> _outputMeshesCatmark;
+    std::vector<TriMesh<VertexDataCatmark>*> _outputMeshesCatmark;
+
+    // worker pool for tessellating objects in parallel
+    int _numThreads;                        // 1 = tessellate inside the RIF callback
+    int _refineThreads;                     // OpenSubdiv refine, consistency check and parallel split threads per object (-1 = all processors)
+    std::vector<CatmarkJob*> _catmarkJobs;  // in RIB order
+    size_t _nextJob;                        // next job to hand out to a worker
+    bool _jobsClosed;                       // no more jobs will be submitted
+    std::map<std::string,int> _jobNameCounts;  // jobs submitted per object name (for CatmarkJob::nameIndex)
+    std::vector<pthread_t> _workers;
+    pthread_mutex_t _jobMutex;
+    pthread_cond_t _jobCond;
 
     // for running Freestyle from the RIF
     bool _runFreestyle;
@@ -79,6 +133,9 @@ public:
     int _totalRadialInconsistentFaces;
     int _totalStrongInconsistentFaces;
     int _totalNonRadialFaces;
+    std::vector<std::string> _objectNames;  // profiled objects, in RIB order
+    std::vector<Profile> _objectProfiles;
+    Profile _frameProfile;                  // sum over the objects
 
     // only needed when calling Freestyle
     int _xres, _yres;
@@ -95,6 +152,13 @@ public:
                               RtToken stringargs[],
                               RtInt, RtToken[], RtPointer[]);
 
+    // tessellation pipeline for one object (Hbr build, SurfaceToMesh, RefineContour*, stats)
+    void tessellateCatmark(CatmarkJob * job);
+
+    void submitCatmark(CatmarkJob * job);
+    void waitForCatmarkJobs();   // joins the workers and collects the output meshes
+    static void * catmarkWorker(void * plugin);
+
     // RIF hooks
     static RtVoid subdivisionMeshV(RtToken mask, RtInt nf, RtInt nverts[],
                                    RtInt verts[], RtInt nt, RtToken tags[],
@@ -135,6 +199,7 @@ public:
     void extractCameraCenter();
 
 #ifdef LINK_FREESTYLE
+    void sendMeshToFreestyle();
     void runFreestyle();
 #endif
 
@@ -146,7 +211,9 @@ public:
           bool invertNormals, bool cullBackFaces, bool meshSilhouettes, bool useConsistency,
           bool runFreestyle, bool runFreestyleInteractive, double cuspTrimThreshold, double graftThreshhold,  double wiggleFactor,
           const char * outputTIFF, const char * outputEPSpolyline, const char * outputEPSthick,
-          const char * freestyleLibPath, RefineRadialStep lastStep);
+          const char * freestyleLibPath, RefineRadialStep lastStep, int numThreads, int refineThreads, bool binaryPLY, bool savePLY, bool consistencySampling, bool parallelRefine,
+          const char * temporalCacheDir, double adaptiveArea, bool profileJSON,
+          bool occluderBVH, bool benchmarkOccluders, bool radialCurvatures);
     void addStyle(char * filename) { _styleModules.push_back(filename); }
     ~rib2mesh();
     RifFilter& GetFilter() { return _filter; }
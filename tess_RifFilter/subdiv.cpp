@@ -2,7 +2,97 @@
 
 #include <hbr/mesh.h>
 
-void Subdiv::initialize(const OsdUtilSubdivTopology &topology, const std::vector<real> &pointPositions)
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+
+static double seconds()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+// serial numbers of the evaluators, for the Evaluate cache tags; 0 is never used
+static long lastSerial = 0;
+
+Subdiv::Subdiv()
+{
+    _serial = __atomic_add_fetch(&lastSerial, 1L, __ATOMIC_RELAXED);
+    _cacheLookups = 0;
+    _cacheHits = 0;
+    _batchEvaluations = 0;
+    chartCache = NULL;
+}
+
+Subdiv::~Subdiv()
+{
+    delete chartCache;
+}
+
+void Subdiv::PrintCacheStats() const
+{
+    long lookups = CacheLookups(), hits = CacheHits();
+    printf("Evaluation cache : %ld lookups, %ld hits (%.1f%%)\n", lookups, hits,
+           lookups > 0 ? 100.0*hits/lookups : 0.0);
+}
+
+// Evaluate cache of one thread: direct-mapped on (evaluator, face, u, v), a colliding sample replaces
+// the previous one. The refinement loops evaluate the same points many times (probing a candidate,
+// then committing it) on the thread that refines the object, and ParamPoint evaluates vertex and edge
+// points on a canonical face, so the repeats hit the table of the evaluating thread.
+struct CacheEntry
+{
+    long serial;    // evaluator the sample belongs to
+    unsigned face;  // NO_FACE if empty
+    real u, v;
+    real P[3], dPdu[3], dPdv[3], dPdudu[3], dPdvdv[3], dPdudv[3];
+};
+
+static const unsigned NO_FACE = ~0u;
+static const int CACHE_SIZE = 1 << 12;
+
+static pthread_key_t cacheKey;
+static pthread_once_t cacheKeyOnce = PTHREAD_ONCE_INIT;
+
+static void FreeThreadCache(void * cache)
+{
+    delete [] static_cast<CacheEntry*>(cache);
+}
+
+static void CreateCacheKey()
+{
+    pthread_key_create(&cacheKey, FreeThreadCache);
+}
+
+// table of the calling thread, allocated on first use and freed when the thread exits
+static CacheEntry * ThreadCache()
+{
+    pthread_once(&cacheKeyOnce, CreateCacheKey);
+    CacheEntry * cache = static_cast<CacheEntry*>(pthread_getspecific(cacheKey));
+    if (cache == NULL)
+    {
+        cache = new CacheEntry[CACHE_SIZE];
+        for(int i=0;i<CACHE_SIZE;i++)
+            cache[i].face = NO_FACE;
+        pthread_setspecific(cacheKey, cache);
+    }
+    return cache;
+}
+
+static unsigned CacheSlot(long serial, unsigned face, real u, real v, unsigned size)
+{
+    // hash the double bits; equality is still checked on the full-precision coordinates
+    double d[2] = { double(u), double(v) };
+    unsigned h[4];
+    memcpy(h, d, sizeof(d));
+    unsigned hash = (face + unsigned(serial) * 40503u) * 2654435761u;
+    for(int i=0;i<4;i++)
+        hash = (hash ^ h[i]) * 16777619u;
+    return (hash ^ (hash >> 15)) & (size - 1);
+}
+
+void Subdiv::initialize(const OsdUtilSubdivTopology &topology, const std::vector<real> &pointPositions, int refineThreads)
 {
     std::string *errorMessage;
 
@@ -15,12 +105,15 @@ void Subdiv::initialize(const OsdUtilSubdivTopology &topology, const std::vector
     // Push the vertex data
     _adaptiveEvaluator.SetCoarsePositions(&(pointPositions[0]), (int) pointPositions.size(), errorMessage);
 
-    // Refine with one thread
-    if (!_adaptiveEvaluator.Refine(1, errorMessage)) {
+    double refineStart = seconds();
+
+    if (!_adaptiveEvaluator.Refine(refineThreads, errorMessage)) {
         std::cout << "Refine failed with " << *errorMessage << std::endl;
         return;
     }
 
+    printf("Subdiv refining  : %lf\n", seconds() - refineStart);
+
     if(_adaptiveEvaluator.GetHbrMesh()->GetNumDisconnectedVertices()>0)
     {
         printf("The specified subdivmesh contains disconnected surface components.\n");
@@ -39,12 +132,56 @@ void Subdiv::getRefineTopology(OsdUtilSubdivTopology &refinedTopology, std::vect
 
 }
 
+// first and second fundamental forms from the limit derivatives
+static void FundamentalForms(const vec3 & tanU, const vec3 & tanV, const real dPdudu[3], const real dPdvdv[3], const real dPdudv[3],
+                             mat2 * I, mat2 * II)
+{
+    vec3 dudu = vec3(dPdudu[0], dPdudu[1], dPdudu[2]);
+    vec3 dvdv = vec3(dPdvdv[0], dPdvdv[1], dPdvdv[2]);
+    vec3 dudv = vec3(dPdudv[0], dPdudv[1], dPdudv[2]);
+
+    real xform[2][2] = { {tanU*tanU, tanU*tanV}, {tanU*tanV, tanV*tanV} };
+    I->Set(xform);
+    vec3 normal = tanU ^ tanV;
+    normal.normalize();
+    real xform2[2][2] = { {dudu*normal, dudv*normal}, {dudv*normal, dvdv*normal} };
+    II->Set(xform2);
+}
+
 void Subdiv::Evaluate(OsdEvalCoords coord, vec3 *limitPos, vec3 *tanU, vec3 *tanV, mat2* I, mat2* II)
 {
     real P[3], dPdu[3], dPdv[3], dPdudu[3], dPdvdv[3], dPdudv[3];
-    assert(faceIndexMap.find(coord.face) != faceIndexMap.end());
-    coord.face = faceIndexMap[coord.face];
-    _adaptiveEvaluator.EvaluateLimit(coord, P, dPdu, dPdv, dPdudu, dPdvdv, dPdudv);
+    assert(coord.face < faceIndexMap.size() && faceIndexMap[coord.face] >= 0);
+
+    CacheEntry & entry = ThreadCache()[CacheSlot(_serial, coord.face, coord.u, coord.v, CACHE_SIZE)];
+    __atomic_fetch_add(&_cacheLookups, 1L, __ATOMIC_RELAXED);
+    if (entry.serial == _serial && entry.face == coord.face && entry.u == coord.u && entry.v == coord.v)
+    {
+        __atomic_fetch_add(&_cacheHits, 1L, __ATOMIC_RELAXED);
+        memcpy(P, entry.P, sizeof(P));
+        memcpy(dPdu, entry.dPdu, sizeof(dPdu));
+        memcpy(dPdv, entry.dPdv, sizeof(dPdv));
+        memcpy(dPdudu, entry.dPdudu, sizeof(dPdudu));
+        memcpy(dPdvdv, entry.dPdvdv, sizeof(dPdvdv));
+        memcpy(dPdudv, entry.dPdudv, sizeof(dPdudv));
+    }
+    else
+    {
+        OsdEvalCoords mapped = coord;
+        mapped.face = faceIndexMap[coord.face];
+        _adaptiveEvaluator.EvaluateLimit(mapped, P, dPdu, dPdv, dPdudu, dPdvdv, dPdudv);
+
+        entry.serial = _serial;
+        entry.face = coord.face;
+        entry.u = coord.u;
+        entry.v = coord.v;
+        memcpy(entry.P, P, sizeof(P));
+        memcpy(entry.dPdu, dPdu, sizeof(dPdu));
+        memcpy(entry.dPdv, dPdv, sizeof(dPdv));
+        memcpy(entry.dPdudu, dPdudu, sizeof(dPdudu));
+        memcpy(entry.dPdvdv, dPdvdv, sizeof(dPdvdv));
+        memcpy(entry.dPdudv, dPdudv, sizeof(dPdudv));
+    }
 
     limitPos->setX(P[0]);
     limitPos->setY(P[1]);
@@ -64,15 +201,46 @@ void Subdiv::Evaluate(OsdEvalCoords coord, vec3 *limitPos, vec3 *tanU, vec3 *tan
     }
     if(I && II){
         assert(tanU!=0 && tanV!=0);
-        vec3 dudu = vec3(dPdudu[0], dPdudu[1], dPdudu[2]);
-        vec3 dvdv = vec3(dPdvdv[0], dPdvdv[1], dPdvdv[2]);
-        vec3 dudv = vec3(dPdudv[0], dPdudv[1], dPdudv[2]);
-
-        real xform[2][2] = { {(*tanU)*(*tanU), (*tanU)*(*tanV)}, {(*tanU)*(*tanV), (*tanV)*(*tanV)} };
-        I->Set(xform);
-        vec3 normal = (*tanU) ^ (*tanV);
-        normal.normalize();
-        real xform2[2][2] = { {dudu*normal, dudv*normal}, {dudv*normal, dvdv*normal} };
-        II->Set(xform2);
+        FundamentalForms(*tanU, *tanV, dPdudu, dPdvdv, dPdudv, I, II);
+    }
+}
+
+void Subdiv::EvaluateBatch(const OsdEvalCoords *coords, int n, vec3 *limitPos, vec3 *tanU, vec3 *tanV, mat2* I, mat2* II)
+{
+    if (n <= 0)
+        return;
+
+    __atomic_fetch_add(&_batchEvaluations, (long)n, __ATOMIC_RELAXED);
+
+    std::vector<OsdEvalCoords> mapped(coords, coords + n);
+    for(int i=0; i<n; i++){
+        assert(mapped[i].face < faceIndexMap.size() && faceIndexMap[mapped[i].face] >= 0);
+        mapped[i].face = faceIndexMap[mapped[i].face];
+    }
+
+    // second derivatives are only fetched when the fundamental forms are requested
+    bool secondOrder = (I && II);
+    assert(!secondOrder || (tanU!=0 && tanV!=0));
+
+    std::vector<real> P(3*n), dPdu(3*n), dPdv(3*n);
+    std::vector<real> dPdudu(secondOrder ? 3*n : 0), dPdvdv(secondOrder ? 3*n : 0), dPdudv(secondOrder ? 3*n : 0);
+
+    _adaptiveEvaluator.EvaluateLimitBatch(&mapped[0], n, &P[0], &dPdu[0], &dPdv[0],
+                                          secondOrder ? &dPdudu[0] : NULL,
+                                          secondOrder ? &dPdvdv[0] : NULL,
+                                          secondOrder ? &dPdudv[0] : NULL);
+
+    for(int i=0; i<n; i++){
+        const real * p = &P[3*i];
+        limitPos[i] = vec3(p[0], p[1], p[2]);
+
+        assert(limitPos[i] * limitPos[i] > 0);
+
+        if(tanU)
+            tanU[i] = vec3(dPdu[3*i], dPdu[3*i+1], dPdu[3*i+2]);
+        if(tanV)
+            tanV[i] = vec3(dPdv[3*i], dPdv[3*i+1], dPdv[3*i+2]);
+        if(secondOrder)
+            FundamentalForms(tanU[i], tanV[i], &dPdudu[3*i], &dPdvdv[3*i], &dPdudv[3*i], &I[i], &II[i]);
     }
 }
@@ -4,30 +4,106 @@
 #include "VecMat.h"
 #include <osdutil/topology.h>
 #include <osdutil/adaptiveEvaluator.h>
+#include <hbr/mesh.h>
+#include <hbr/face.h>
+
+#include <cassert>
 
 using namespace OpenSubdiv::OPENSUBDIV_VERSION;
 
+// name of the scalar type selected at build time (see TESS_PRECISION in CMakeLists.txt)
+#ifdef OPENSUBDIV_REAL_DOUBLE
+#define TESS_PRECISION_NAME "double"
+#else
+#define TESS_PRECISION_NAME "long"
+#endif
+
+// per-surface chart cache (see ChartCache in chart.h); not templated here so that the
+// evaluator can own and delete it
+class ChartCacheBase
+{
+public:
+    virtual ~ChartCacheBase() {}
+};
+
 //------------------------------------------------------------------------------
 
+// Limit surface evaluator of one source mesh. SurfaceToMesh creates it and
+// attaches it to the mesh (HbrMesh client data); ParamPoint finds it through
+// the source face, so several surfaces can be evaluated at the same time.
 class Subdiv {
 public:
-    static Subdiv& getInstance()
+    Subdiv();
+    ~Subdiv();
+
+    // evaluator attached to a source mesh, or NULL
+    template<class T>
+    static Subdiv * Get(const HbrMesh<T> * mesh) { return static_cast<Subdiv*>(mesh->GetClientData()); }
+
+    template<class T>
+    static Subdiv & Get(const HbrFace<T> * face)
     {
-        static Subdiv instance;
-        return instance;
+        Subdiv * subdiv = Get(face->GetMesh());
+        assert(subdiv != NULL);
+        return *subdiv;
     }
 
-    void initialize(const OsdUtilSubdivTopology &topology, const std::vector<real> &pointPositions);
+    // attach a new evaluator to a source mesh, replacing the previous one
+    template<class T>
+    static Subdiv & Attach(HbrMesh<T> * mesh)
+    {
+        Release(mesh);
+        Subdiv * subdiv = new Subdiv;
+        mesh->SetClientData(subdiv);
+        return *subdiv;
+    }
+
+    // delete the evaluator of a source mesh; call before deleting the mesh
+    template<class T>
+    static void Release(HbrMesh<T> * mesh)
+    {
+        delete Get(mesh);
+        mesh->SetClientData(NULL);
+    }
+
+    // build and refine the evaluator; refineThreads > 1 (or -1 for all processors)
+    // refines on the OpenSubdiv OpenMP/TBB controllers
+    void initialize(const OsdUtilSubdivTopology &topology, const std::vector<real> &pointPositions, int refineThreads = 1);
 
     void getRefineTopology(OsdUtilSubdivTopology &refinedTopologym, std::vector<real> &positions);
 
     void Evaluate(OsdEvalCoords coord, vec3 *limitPos, vec3 *tanU=NULL, vec3 *tanV=NULL, mat2* I=NULL, mat2* II=NULL);
 
-    std::map<int,int> faceIndexMap;
+    // evaluate n samples at once; output arrays have n entries and may be NULL (I and II require tanU and tanV)
+    void EvaluateBatch(const OsdEvalCoords *coords, int n, vec3 *limitPos, vec3 *tanU=NULL, vec3 *tanV=NULL, mat2* I=NULL, mat2* II=NULL);
+
+    // source face ID -> face index in the evaluator topology, -1 for faces that are not evaluated
+    std::vector<int> faceIndexMap;
+
+    // charts of the regular source vertices, built on demand; owned by the evaluator
+    ChartCacheBase * chartCache;
+
+    // hit rate of the Evaluate cache
+    void PrintCacheStats() const;
+    // for the pipeline profile: Evaluate calls, cache hits, and samples evaluated by EvaluateBatch
+    long CacheLookups() const { return __atomic_load_n(&_cacheLookups, __ATOMIC_RELAXED); }
+    long CacheHits() const { return __atomic_load_n(&_cacheHits, __ATOMIC_RELAXED); }
+    long BatchEvaluations() const { return __atomic_load_n(&_batchEvaluations, __ATOMIC_RELAXED); }
+
 private:
-    Subdiv() {}
+    // not copyable (owns the evaluator tables)
+    Subdiv(const Subdiv &);
+    Subdiv & operator=(const Subdiv &);
 
     OsdUtilAdaptiveEvaluator _adaptiveEvaluator;
+
+    // Evaluate cache: every thread has its own direct-mapped table (see subdiv.cpp), so the
+    // parallel stages evaluate without locking. The entries are tagged with the serial number
+    // of the evaluator, so a thread that moves on to another object starts with an empty cache.
+    long _serial;
+    long _cacheLookups;  // atomic
+    long _cacheHits;     // atomic
+    long _batchEvaluations;  // atomic
 };
 
 #endif
@@ -0,0 +1,778 @@
+#ifndef __TRIANGLE_MESH_H__
+#define __TRIANGLE_MESH_H__
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <cstddef>
+#include <cassert>
+#include <alloca.h>
+
+// Compact half-edge triangle mesh, used for the refined meshes that RefineContour and RefineContourRadial
+// edit millions of times (splits, flips, shifts) and never subdivide, instead of Hbr's general
+// pointer-based mesh:
+//  - the topology is kept in arrays indexed by 32-bit integers. The halfedges of the face in slot s are
+//    3s, 3s+1 and 3s+2, so next/previous are arithmetic, and an array holds the opposite halfedges.
+//  - deleted faces and vertices go to free lists, so the arrays stay as large as the live mesh.
+//  - walking a one-ring (GetNextEdge) reads two integers instead of chasing face and edge pointers.
+// TriFace, TriHalfedge and TriVertex are handles into the arrays. They are allocated in chunks and never
+// move, so pointers to them (and references to the vertex data T) stay valid.
+// The interface follows the part of Hbr's that the tessellator uses, with the same semantics: vertex IDs
+// are recycled smallest first, face IDs are never reused, and the incident edge cycles of the vertices
+// (including singular ones) are maintained as by HbrVertex::AddIncidentEdge/RemoveIncidentEdge.
+
+template<class T> class TriMesh;
+template<class T> class TriFace;
+template<class T> class TriVertex;
+
+template<class T>
+class TriHalfedge
+{
+public:
+    // Returns the opposite half edge, NULL on the boundary
+    TriHalfedge * GetOpposite() const;
+
+    // Returns the next and the previous halfedges around the incident face
+    TriHalfedge * GetNext() const { return const_cast<TriHalfedge*>(_index % 3 == 2 ? this - 2 : this + 1); }
+    TriHalfedge * GetPrev() const { return const_cast<TriHalfedge*>(_index % 3 == 0 ? this + 2 : this - 1); }
+
+    TriVertex<T> * GetOrgVertex() const;
+    TriVertex<T> * GetDestVertex() const { return GetNext()->GetOrgVertex(); }
+    TriVertex<T> * GetVertex() const { return GetOrgVertex(); }
+    int GetOrgVertexID() const;
+    int GetDestVertexID() const { return GetNext()->GetOrgVertexID(); }
+
+    TriFace<T> * GetFace() const;
+    TriFace<T> * GetLeftFace() const { return GetFace(); }
+    TriFace<T> * GetRightFace() const;
+    TriMesh<T> * GetMesh() const;
+
+    bool IsBoundary() const;
+
+private:
+    friend class TriFace<T>;
+    friend class TriVertex<T>;
+    friend class TriMesh<T>;
+
+    TriHalfedge() : _index(0) { }
+
+    unsigned int _index;  // 3 * face slot + index of the edge in the face
+};
+
+template<class T>
+class TriFace
+{
+public:
+    int GetID() const;
+    TriMesh<T> * GetMesh() const { return _mesh; }
+    int GetNumVertices() const { return 3; }
+
+    TriVertex<T> * GetVertex(int index) const;
+    int GetVertexID(int index) const;
+
+    // edge index goes from vertex index to vertex index+1
+    TriHalfedge<T> * GetEdge(int index) const
+    { assert(index >= 0 && index < 3); return const_cast<TriHalfedge<T>*>(_edges + index); }
+    TriHalfedge<T> * GetFirstEdge() const { return GetEdge(0); }
+
+private:
+    friend class TriHalfedge<T>;
+    friend class TriMesh<T>;
+
+    TriFace() : _mesh(NULL), _slot(0) { }
+
+    TriMesh<T> * _mesh;
+    unsigned int _slot;
+    TriHalfedge<T> _edges[3];  // contiguous, so that GetNext/GetPrev/GetFace are address arithmetic
+};
+
+template<class T>
+class TriVertex
+{
+public:
+    int GetID() const { return _id; }
+    T & GetData() { return _data; }
+    const T & GetData() const { return _data; }
+    TriMesh<T> * GetMesh() const { return _mesh; }
+
+    TriFace<T> * GetFace() const { return GetIncidentEdge()->GetFace(); }
+
+    // Returns the first halfedge of the incident edge cycles; on the boundary, the outgoing boundary halfedge
+    TriHalfedge<T> * GetIncidentEdge() const;
+
+    // Returns the next (counterclockwise) and previous outgoing halfedges around the vertex,
+    // NULL past the boundary
+    TriHalfedge<T> * GetNextEdge(const TriHalfedge<T> * edge) const;
+    TriHalfedge<T> * GetPreviousEdge(const TriHalfedge<T> * edge) const
+    { return edge->GetOpposite()->GetNext(); }
+
+    // Returns the outgoing halfedge to dest, NULL if there is none
+    TriHalfedge<T> * GetEdge(const TriVertex * dest) const { return GetEdge(dest->GetID()); }
+    TriHalfedge<T> * GetEdge(int dest) const;
+
+    // the ring of edges (on the boundary, the last one is incoming) and of vertices around the vertex
+    template <typename OutputIterator>
+    void GetSurroundingEdges(OutputIterator edges) const;
+    template <typename OutputIterator>
+    void GetSurroundingVertices(OutputIterator vertices) const;
+
+    int GetValence() const;
+    bool OnBoundary() const;
+    bool IsSingular() const;
+    bool IsConnected() const;
+
+private:
+    friend class TriMesh<T>;
+
+    TriVertex() : _mesh(NULL), _id(-1) { }
+
+    TriMesh<T> * _mesh;
+    int _id;
+    T _data;
+};
+
+template<class T>
+class TriMesh
+{
+public:
+    TriMesh();
+    ~TriMesh();
+
+    // Create vertex with the indicated ID and data
+    TriVertex<T> * NewVertex(int id, const T & data);
+
+    // Create vertex; the ID is the smallest deleted one, or the next unused one
+    TriVertex<T> * NewVertex(const T & data) { return NewVertex(_NewVertexID(), data); }
+    TriVertex<T> * NewVertex();
+
+    TriVertex<T> * GetVertex(int id) const
+    { return (unsigned int)id < _vertexAlive.size() && _vertexAlive[id] ? _Vertex(id) : NULL; }
+
+    // Create a triangle from vertex IDs (NULL if one does not exist) or from vertices. The face gets the
+    // next face ID; uindex, parent and childindex are only there for the Hbr interface.
+    TriFace<T> * NewFace(int nvertices, const int * vtx, int uindex);
+    TriFace<T> * NewFace(int nvertices, TriVertex<T> ** vtx,
+                                         TriFace<T> * parent, int childindex);
+
+    void DeleteFace(TriFace<T> * face);
+
+    // Remove a vertex; it must not have incident faces
+    void DeleteVertex(TriVertex<T> * vertex);
+
+    int GetNumVertices() const { return _numVertices; }
+    int GetNumFaces() const { return _numFaces; }
+
+    TriFace<T> * GetFace(int id) const
+    { return (unsigned int)id < _faceSlots.size() && _faceSlots[id] != NONE ? _Face(_faceSlots[id]) : NULL; }
+
+    // all the vertices/faces, in ID order
+    template <typename OutputIterator>
+    void GetVertices(OutputIterator vertices) const;
+    template <typename OutputIterator>
+    void GetFaces(OutputIterator faces) const;
+
+private:
+    friend class TriHalfedge<T>;
+    friend class TriFace<T>;
+    friend class TriVertex<T>;
+
+    enum { NONE = 0xffffffffu };
+    enum { CHUNK_BITS = 10, CHUNK_SIZE = 1 << CHUNK_BITS };  // handles are allocated CHUNK_SIZE at a time
+
+    TriMesh(const TriMesh &);
+    TriMesh & operator=(const TriMesh &);
+
+    static unsigned int _Prev(unsigned int h) { return h % 3 == 0 ? h + 2 : h - 1; }
+    static unsigned int _Next(unsigned int h) { return h % 3 == 2 ? h - 2 : h + 1; }
+
+    // next outgoing halfedge counterclockwise around the origin of h, NONE past the boundary
+    unsigned int _NextEdge(unsigned int h) const { return _opposite[_Prev(h)]; }
+    bool _IsBoundary(unsigned int h) const { return _opposite[h] == NONE; }
+    unsigned int _FaceID(unsigned int h) const { return _faceIDs[h/3]; }
+
+    TriFace<T> * _Face(unsigned int slot) const { return _faceChunks[slot >> CHUNK_BITS] + (slot & (CHUNK_SIZE-1)); }
+    TriHalfedge<T> * _Edge(unsigned int h) const { return _Face(h/3)->_edges + h%3; }
+    TriVertex<T> * _Vertex(unsigned int id) const { return _vertexChunks[id >> CHUNK_BITS] + (id & (CHUNK_SIZE-1)); }
+
+    int _NewVertexID();
+
+    // start of the i-th incident edge cycle of vertex v
+    unsigned int _Cycle(unsigned int v, int i) const
+    { return i == 0 ? _vertexEdges[v] : _singularCycles.find(v)->second[i]; }
+    void _GetCycles(unsigned int v, unsigned int * cycles) const;
+    void _SetCycles(unsigned int v, const unsigned int * cycles, int count);
+    void _AddIncidentEdge(unsigned int v, unsigned int h);
+    void _RemoveIncidentEdge(unsigned int v, unsigned int h);
+
+    // per halfedge
+    std::vector<unsigned int> _origins;        // origin vertex ID
+    std::vector<unsigned int> _opposite;       // opposite halfedge, NONE on the boundary
+
+    // per face slot / face ID
+    std::vector<unsigned int> _faceIDs;        // face ID of the slot, NONE for a free slot
+    std::vector<unsigned int> _faceSlots;      // slot of the face ID, NONE for a deleted face
+    std::vector<unsigned int> _freeFaceSlots;
+
+    // per vertex ID
+    std::vector<unsigned int> _vertexEdges;    // start of the first incident edge cycle, NONE if disconnected
+    std::vector<unsigned short> _vertexCycles; // number of incident edge cycles, > 1 for singular vertices
+    std::vector<unsigned int> _vertexFaces;    // number of incident faces
+    std::vector<char> _vertexAlive;
+    std::vector<unsigned int> _freeVertexIDs;  // min-heap, so that the smallest ID is recycled first
+    std::map<unsigned int, std::vector<unsigned int> > _singularCycles;  // all the cycle starts of singular vertices
+
+    std::vector<TriFace<T>*> _faceChunks;
+    std::vector<TriVertex<T>*> _vertexChunks;
+
+    int _numVertices;
+    int _numFaces;
+};
+
+//------------------------------------------------------------------------------
+
+template<class T>
+inline TriHalfedge<T> * TriHalfedge<T>::GetOpposite() const
+{
+    const TriMesh<T> * mesh = GetMesh();
+    unsigned int opposite = mesh->_opposite[_index];
+    return opposite == TriMesh<T>::NONE ? NULL : mesh->_Edge(opposite);
+}
+
+template<class T>
+inline TriVertex<T> * TriHalfedge<T>::GetOrgVertex() const
+{
+    const TriMesh<T> * mesh = GetMesh();
+    return mesh->_Vertex(mesh->_origins[_index]);
+}
+
+template<class T>
+inline int TriHalfedge<T>::GetOrgVertexID() const
+{
+    return GetMesh()->_origins[_index];
+}
+
+template<class T>
+inline TriFace<T> * TriHalfedge<T>::GetFace() const
+{
+    // the halfedges are stored in their face, as in Hbr
+    const TriHalfedge * first = this - _index % 3;
+    return (TriFace<T>*)((char*)first - offsetof(TriFace<T>, _edges));
+}
+
+template<class T>
+inline TriFace<T> * TriHalfedge<T>::GetRightFace() const
+{
+    TriHalfedge * opposite = GetOpposite();
+    return opposite != NULL ? opposite->GetFace() : NULL;
+}
+
+template<class T>
+inline TriMesh<T> * TriHalfedge<T>::GetMesh() const
+{
+    return GetFace()->_mesh;
+}
+
+template<class T>
+inline bool TriHalfedge<T>::IsBoundary() const
+{
+    return GetMesh()->_IsBoundary(_index);
+}
+
+template<class T>
+inline int TriFace<T>::GetID() const
+{
+    return _mesh->_faceIDs[_slot];
+}
+
+template<class T>
+inline TriVertex<T> * TriFace<T>::GetVertex(int index) const
+{
+    assert(index >= 0 && index < 3);
+    return _mesh->_Vertex(_mesh->_origins[3*_slot + index]);
+}
+
+template<class T>
+inline int TriFace<T>::GetVertexID(int index) const
+{
+    assert(index >= 0 && index < 3);
+    return _mesh->_origins[3*_slot + index];
+}
+
+template<class T>
+inline TriHalfedge<T> * TriVertex<T>::GetIncidentEdge() const
+{
+    unsigned int h = _mesh->_vertexEdges[_id];
+    return h == TriMesh<T>::NONE ? NULL : _mesh->_Edge(h);
+}
+
+template<class T>
+inline TriHalfedge<T> * TriVertex<T>::GetNextEdge(const TriHalfedge<T> * edge) const
+{
+    unsigned int h = _mesh->_NextEdge(edge->_index);
+    return h == TriMesh<T>::NONE ? NULL : _mesh->_Edge(h);
+}
+
+template<class T>
+inline TriHalfedge<T> * TriVertex<T>::GetEdge(int dest) const
+{
+    // go through all the halfedge cycles
+    const TriMesh<T> * mesh = _mesh;
+    for (int i = 0; i < mesh->_vertexCycles[_id]; i++)
+    {
+        unsigned int cycle = mesh->_Cycle(_id, i);
+        unsigned int h = cycle;
+        do {
+            if ((int)mesh->_origins[TriMesh<T>::_Next(h)] == dest)
+                return mesh->_Edge(h);
+            h = mesh->_NextEdge(h);
+        } while (h != TriMesh<T>::NONE && h != cycle);
+    }
+    return NULL;
+}
+
+template<class T> template <typename OutputIterator>
+void TriVertex<T>::GetSurroundingEdges(OutputIterator edges) const
+{
+    unsigned int start = _mesh->_vertexEdges[_id];
+    unsigned int h = start;
+    while (h != TriMesh<T>::NONE)
+    {
+        *edges++ = _mesh->_Edge(h);
+        unsigned int next = _mesh->_NextEdge(h);
+        if (next == start)
+            break;
+        if (next == TriMesh<T>::NONE)
+        {
+            // last edge of a boundary cycle: the incoming one
+            *edges++ = _mesh->_Edge(TriMesh<T>::_Prev(h));
+            break;
+        }
+        h = next;
+    }
+}
+
+template<class T> template <typename OutputIterator>
+void TriVertex<T>::GetSurroundingVertices(OutputIterator vertices) const
+{
+    unsigned int start = _mesh->_vertexEdges[_id];
+    unsigned int h = start;
+    while (h != TriMesh<T>::NONE)
+    {
+        *vertices++ = _mesh->_Vertex(_mesh->_origins[TriMesh<T>::_Next(h)]);
+        unsigned int next = _mesh->_NextEdge(h);
+        if (next == start)
+            break;
+        if (next == TriMesh<T>::NONE)
+        {
+            // the last vertex of a boundary cycle is not the destination of an outgoing halfedge
+            *vertices++ = _mesh->_Vertex(_mesh->_origins[TriMesh<T>::_Prev(h)]);
+            break;
+        }
+        h = next;
+    }
+}
+
+template<class T>
+inline int TriVertex<T>::GetValence() const
+{
+    assert(!IsSingular());
+    int valence = 0;
+    unsigned int start = _mesh->_vertexEdges[_id];
+    unsigned int h = start;
+    if (h != TriMesh<T>::NONE)
+    {
+        do {
+            valence++;
+            h = _mesh->_NextEdge(h);
+        } while (h != TriMesh<T>::NONE && h != start);
+    }
+    // boundary vertices have one more edge than outgoing halfedges
+    if (h == TriMesh<T>::NONE)
+        valence++;
+    return valence;
+}
+
+template<class T>
+inline bool TriVertex<T>::OnBoundary() const
+{
+    // singular vertices are on the boundary, so the first cycle is enough
+    return _mesh->_IsBoundary(_mesh->_vertexEdges[_id]);
+}
+
+template<class T>
+inline bool TriVertex<T>::IsSingular() const
+{
+    return _mesh->_vertexCycles[_id] > 1;
+}
+
+template<class T>
+inline bool TriVertex<T>::IsConnected() const
+{
+    return _mesh->_vertexCycles[_id] > 0;
+}
+
+//------------------------------------------------------------------------------
+
+template<class T>
+inline TriMesh<T>::TriMesh()
+    : _numVertices(0), _numFaces(0)
+{
+}
+
+template<class T>
+inline TriMesh<T>::~TriMesh()
+{
+    for (size_t i = 0; i < _faceChunks.size(); i++)
+        delete [] _faceChunks[i];
+    for (size_t i = 0; i < _vertexChunks.size(); i++)
+        delete [] _vertexChunks[i];
+}
+
+template<class T>
+inline int TriMesh<T>::_NewVertexID()
+{
+    if (_freeVertexIDs.empty())
+        return _vertexAlive.size();
+
+    std::pop_heap(_freeVertexIDs.begin(), _freeVertexIDs.end(), std::greater<unsigned int>());
+    int id = _freeVertexIDs.back();
+    _freeVertexIDs.pop_back();
+    return id;
+}
+
+template<class T>
+inline TriVertex<T> * TriMesh<T>::NewVertex()
+{
+    int id = _NewVertexID();
+    T data(id);
+    data.Clear();
+    return NewVertex(id, data);
+}
+
+template<class T>
+inline TriVertex<T> * TriMesh<T>::NewVertex(int id, const T & data)
+{
+    assert(id >= 0);
+
+    while ((unsigned int)id >= _vertexAlive.size())
+    {
+        unsigned int next = _vertexAlive.size();
+        if ((next & (CHUNK_SIZE-1)) == 0)
+        {
+            TriVertex<T> * chunk = new TriVertex<T>[CHUNK_SIZE];
+            for (int i = 0; i < CHUNK_SIZE; i++)
+            {
+                chunk[i]._mesh = this;
+                chunk[i]._id = next + i;
+            }
+            _vertexChunks.push_back(chunk);
+        }
+        _vertexEdges.push_back(NONE);
+        _vertexCycles.push_back(0);
+        _vertexFaces.push_back(0);
+        _vertexAlive.push_back(0);
+
+        // IDs skipped by an explicit ID are not recycled, as in Hbr
+    }
+
+    if (_vertexAlive[id])
+    {
+        // replaces the vertex
+        assert(_vertexFaces[id] == 0);
+        _numVertices--;
+    }
+    else
+    {
+        std::vector<unsigned int>::iterator it = std::find(_freeVertexIDs.begin(), _freeVertexIDs.end(), (unsigned int)id);
+        if (it != _freeVertexIDs.end())
+        {
+            _freeVertexIDs.erase(it);
+            std::make_heap(_freeVertexIDs.begin(), _freeVertexIDs.end(), std::greater<unsigned int>());
+        }
+    }
+
+    TriVertex<T> * vertex = _Vertex(id);
+    vertex->_data = data;
+    _vertexEdges[id] = NONE;
+    _vertexCycles[id] = 0;
+    _vertexFaces[id] = 0;
+    _vertexAlive[id] = 1;
+    _numVertices++;
+
+    return vertex;
+}
+
+template<class T>
+inline void TriMesh<T>::DeleteVertex(TriVertex<T> * vertex)
+{
+    int id = vertex->GetID();
+    if (GetVertex(id) != vertex)
+        return;
+
+    // vertices are only safe for deletion if they have no incident faces
+    assert(_vertexFaces[id] == 0);
+
+    _vertexAlive[id] = 0;
+    _freeVertexIDs.push_back(id);
+    std::push_heap(_freeVertexIDs.begin(), _freeVertexIDs.end(), std::greater<unsigned int>());
+    _numVertices--;
+}
+
+template<class T>
+inline TriFace<T> * TriMesh<T>::NewFace(int nvertices, const int * vtx, int)
+{
+    assert(nvertices == 3);
+
+    TriVertex<T> * vertices[3];
+    for (int i = 0; i < 3; i++)
+    {
+        vertices[i] = GetVertex(vtx[i]);
+        if (vertices[i] == NULL)
+            return NULL;
+    }
+    return NewFace(3, vertices, NULL, -1);
+}
+
+template<class T>
+inline TriFace<T> * TriMesh<T>::NewFace(int nvertices, TriVertex<T> ** vtx,
+                                                                       TriFace<T> * parent, int)
+{
+    assert(nvertices == 3 && parent == NULL);
+
+    unsigned int slot;
+    if (!_freeFaceSlots.empty())
+    {
+        slot = _freeFaceSlots.back();
+        _freeFaceSlots.pop_back();
+    }
+    else
+    {
+        slot = _faceIDs.size();
+        if ((slot & (CHUNK_SIZE-1)) == 0)
+        {
+            TriFace<T> * chunk = new TriFace<T>[CHUNK_SIZE];
+            for (int i = 0; i < CHUNK_SIZE; i++)
+            {
+                chunk[i]._mesh = this;
+                chunk[i]._slot = slot + i;
+                for (int k = 0; k < 3; k++)
+                    chunk[i]._edges[k]._index = 3*(slot + i) + k;
+            }
+            _faceChunks.push_back(chunk);
+        }
+        _faceIDs.push_back(NONE);
+        _origins.resize(_origins.size() + 3);
+        _opposite.resize(_opposite.size() + 3, NONE);
+    }
+
+    unsigned int id = _faceSlots.size();
+    _faceSlots.push_back(slot);
+    _faceIDs[slot] = id;
+
+    unsigned int first = 3*slot;
+    for (int k = 0; k < 3; k++)
+        _origins[first + k] = vtx[k]->GetID();
+
+    // as in TriFace::Initialize, all the opposites are linked before the edges are added to the
+    // vertices' cycles
+    for (int k = 0; k < 3; k++)
+    {
+        TriHalfedge<T> * opposite = vtx[(k+1)%3]->GetEdge(vtx[k]->GetID());
+        _opposite[first + k] = opposite != NULL ? opposite->_index : NONE;
+        if (opposite != NULL)
+            _opposite[opposite->_index] = first + k;
+    }
+    for (int k = 0; k < 3; k++)
+        _AddIncidentEdge(vtx[k]->GetID(), first + k);
+
+    _numFaces++;
+
+    return _Face(slot);
+}
+
+template<class T>
+inline void TriMesh<T>::DeleteFace(TriFace<T> * face)
+{
+    if (face->_mesh != this || _faceIDs[face->_slot] == NONE)
+        return;
+
+    // as in TriFace::Destroy, the edges leave the vertices' cycles while the opposites are still linked
+    unsigned int first = 3*face->_slot;
+    for (int k = 0; k < 3; k++)
+        _RemoveIncidentEdge(_origins[first + k], first + k);
+    for (int k = 0; k < 3; k++)
+    {
+        unsigned int opposite = _opposite[first + k];
+        if (opposite != NONE)
+        {
+            _opposite[opposite] = NONE;
+            _opposite[first + k] = NONE;
+        }
+    }
+
+    _faceSlots[_faceIDs[face->_slot]] = NONE;
+    _faceIDs[face->_slot] = NONE;
+    _freeFaceSlots.push_back(face->_slot);
+    _numFaces--;
+}
+
+template<class T> template <typename OutputIterator>
+void TriMesh<T>::GetVertices(OutputIterator vertices) const
+{
+    for (unsigned int id = 0; id < _vertexAlive.size(); id++)
+        if (_vertexAlive[id])
+            *vertices++ = _Vertex(id);
+}
+
+template<class T> template <typename OutputIterator>
+void TriMesh<T>::GetFaces(OutputIterator faces) const
+{
+    for (unsigned int id = 0; id < _faceSlots.size(); id++)
+        if (_faceSlots[id] != NONE)
+            *faces++ = _Face(_faceSlots[id]);
+}
+
+template<class T>
+inline void TriMesh<T>::_GetCycles(unsigned int v, unsigned int * cycles) const
+{
+    int count = _vertexCycles[v];
+    if (count == 1)
+        cycles[0] = _vertexEdges[v];
+    else if (count > 1)
+        std::copy(_singularCycles.find(v)->second.begin(), _singularCycles.find(v)->second.end(), cycles);
+}
+
+template<class T>
+inline void TriMesh<T>::_SetCycles(unsigned int v, const unsigned int * cycles, int count)
+{
+    if (_vertexCycles[v] > 1 && count <= 1)
+        _singularCycles.erase(v);
+    else if (count > 1)
+        _singularCycles[v].assign(cycles, cycles + count);
+
+    _vertexCycles[v] = count;
+    _vertexEdges[v] = count > 0 ? cycles[0] : NONE;
+}
+
+// TriVertex::AddIncidentEdge on the arrays: the cycle starts are boundary halfedges when possible,
+// and a closed cycle starts at the halfedge of its lowest face ID
+template<class T>
+inline void TriMesh<T>::_AddIncidentEdge(unsigned int v, unsigned int edge)
+{
+    int count = _vertexCycles[v];
+    unsigned int * cycles = (unsigned int*)alloca((count+1) * sizeof(unsigned int));
+    _GetCycles(v, cycles);
+
+    // drop the cycle starts that stopped being boundaries, unless they now start a closed cycle
+    int newCount = 0;
+    bool edgeFound = false;
+    for (int i = 0; i < count; i++)
+    {
+        if (cycles[i] == edge)
+            edgeFound = true;
+
+        if (_IsBoundary(cycles[i]))
+        {
+            cycles[newCount++] = cycles[i];
+            continue;
+        }
+
+        unsigned int start = cycles[i];
+        unsigned int h = start;
+        bool prevMatch = false;
+        do {
+            h = _NextEdge(h);
+            for (int j = 0; j < i; j++)
+            {
+                if (cycles[j] == h)
+                {
+                    prevMatch = true;
+                    break;
+                }
+            }
+        } while (!prevMatch && h != NONE && h != start);
+
+        if (!prevMatch && h == start)
+            cycles[newCount++] = cycles[i];
+    }
+
+    if (newCount == 0)
+    {
+        // the edge becomes the sole incident edge
+        if (!(edgeFound && count == 1))
+            cycles[0] = edge;
+        count = 1;
+    }
+    else if (_IsBoundary(edge) && !edgeFound)
+    {
+        // a boundary edge begins a new cycle
+        cycles[newCount] = edge;
+        count = newCount + 1;
+    }
+    else
+        count = newCount;
+
+    if (!_IsBoundary(cycles[0]))
+    {
+        // start the closed cycle at its lowest face ID, so that the ring order does not depend on the history
+        unsigned int start = cycles[0];
+        for (unsigned int h = _NextEdge(start); h != NONE && h != start; h = _NextEdge(h))
+            if (_FaceID(h) < _FaceID(cycles[0]))
+                cycles[0] = h;
+    }
+
+    _SetCycles(v, cycles, count);
+    _vertexFaces[v]++;
+}
+
+// TriVertex::RemoveIncidentEdge on the arrays
+template<class T>
+inline void TriMesh<T>::_RemoveIncidentEdge(unsigned int v, unsigned int edge)
+{
+    _vertexFaces[v]--;
+    if (_vertexFaces[v] == 0)
+    {
+        _SetCycles(v, NULL, 0);
+        return;
+    }
+
+    int count = _vertexCycles[v];
+    unsigned int * cycles = (unsigned int*)alloca((count+1) * sizeof(unsigned int));
+    _GetCycles(v, cycles);
+
+    unsigned int next = _NextEdge(edge);
+
+    int i;
+    for (i = 0; i < count; i++)
+        if (cycles[i] == edge)
+            break;
+
+    if (i < count)
+    {
+        // the edge starts a cycle: the next edge starts it instead, or the cycle goes away
+        if (next != NONE)
+            cycles[i] = next;
+        else
+        {
+            assert(count > 1);
+            std::copy(cycles + i + 1, cycles + count, cycles + i);
+            count--;
+        }
+    }
+    else if (count == 1 && !_IsBoundary(cycles[0]))
+    {
+        // removing an edge of a closed cycle opens it after the edge
+        assert(next != NONE);
+        cycles[0] = next;
+    }
+    else if (!_IsBoundary(edge) && next != NONE)
+    {
+        // removing an edge in the middle of a boundary cycle splits it
+        cycles[count++] = next;
+    }
+
+    _SetCycles(v, cycles, count);
+}
+
+#endif
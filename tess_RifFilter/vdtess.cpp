@@ -54,22 +54,22 @@ ParamPointCC RootFindContour(RootFindMode mode,
     real lengths[3];
 
     for(int i=0; i<3; i++){
-        lengths[i] = sqrtl((abs[i][0] - abs[(i+1)%3][0])*(abs[i][0] - abs[(i+1)%3][0]) +
+        lengths[i] = std::sqrt((abs[i][0] - abs[(i+1)%3][0])*(abs[i][0] - abs[(i+1)%3][0]) +
                            (abs[i][1] - abs[(i+1)%3][1])*(abs[i][1] - abs[(i+1)%3][1]));
     }
 
     real halfp = real(0.5) * (lengths[0] + lengths[1] + lengths[2]);
-    real area = sqrtl(halfp*(halfp-lengths[0])*(halfp-lengths[1])*(halfp-lengths[2]));
+    real area = std::sqrt(halfp*(halfp-lengths[0])*(halfp-lengths[1])*(halfp-lengths[2]));
 
     const real threshold_r = mode == RF_CUSP ? 1e-6 : 0.00001;
     const real threshold_ndotv = mode != RF_RADIAL_INT ? CONTOUR_THRESHOLD : threshold_r;
 
-    if(fabsl(ndotv[0]) <= threshold_ndotv &&
-            fabsl(ndotv[1]) <= threshold_ndotv &&
-            fabsl(ndotv[2]) <= threshold_ndotv &&
-            fabsl(r[0]) <= threshold_r &&
-            fabsl(r[1]) <= threshold_r &&
-            fabsl(r[2]) <= threshold_r ){
+    if(std::fabs(ndotv[0]) <= threshold_ndotv &&
+            std::fabs(ndotv[1]) <= threshold_ndotv &&
+            std::fabs(ndotv[2]) <= threshold_ndotv &&
+            std::fabs(r[0]) <= threshold_r &&
+            std::fabs(r[1]) <= threshold_r &&
+            std::fabs(r[2]) <= threshold_r ){
         ParamPointCC res =  ParamPointCC::Interpolate(ParamPointCC::Interpolate(p[0], p[1], 0.5), p[2], 1.0/3);
         return res;
     }
@@ -181,10 +181,14 @@ ParamPointCC PlaneEdgeIntersection(const vec3 &planePoint, const vec3 &planeNorm
     const int NUM_SAMPLES = 40;
     vec3 pos, normal;
 
-    // Find intersection with the radial plan by root-finding
+    // Find intersection with the radial plan by root-finding (Illinois, as in FindContour)
     ParamPointCC intersection;
+    int side = 0;
     for(int s=0; s<NUM_SAMPLES; s++){
-        intersection = ParamPointCC::Interpolate(p1,p2,0.5);
+        real t = d1 / (d1 - d2);
+        if(!(t > 0 && t < 1))
+            t = 0.5;
+        intersection = ParamPointCC::Interpolate(p1,p2,t);
         if(intersection.IsNull() || !intersection.IsEvaluable())
             return ParamPointCC();
         intersection.Evaluate(pos,normal);
@@ -192,9 +196,15 @@ ParamPointCC PlaneEdgeIntersection(const vec3 &planePoint, const vec3 &planeNorm
         if(d<-CONTOUR_THRESHOLD){
             p1 = intersection;
             d1 = d;
+            if(side == -1)
+                d2 /= 2;
+            side = -1;
         }else if(d>CONTOUR_THRESHOLD){
             p2 = intersection;
             d2 = d;
+            if(side == 1)
+                d1 /= 2;
+            side = 1;
         }else{
             return intersection;
         }
@@ -223,18 +233,28 @@ ParamPointCC PlaneEdgeIntersection(const vec3 &planePoint, const vec3 &planeNorm
     const int NUM_SAMPLES = 40;
     vec3 pos, normal;
 
-    // Find intersection with the radial plan by root-finding
+    // Find intersection with the radial plan by root-finding (Illinois, as in FindContour)
     ParamPointCC intersection;
+    int side = 0;
     for(int s=0; s<NUM_SAMPLES; s++){
-        intersection = ParamPointCC::Interpolate(p1,p2,0.5);
+        real t = d1 / (d1 - d2);
+        if(!(t > 0 && t < 1))
+            t = 0.5;
+        intersection = ParamPointCC::Interpolate(p1,p2,t);
         intersection.Evaluate(pos,normal);
         real d = planeNormal * (pos - planePoint);
         if(d<-CONTOUR_THRESHOLD){
             p1 = intersection;
             d1 = d;
+            if(side == -1)
+                d2 /= 2;
+            side = -1;
         }else if(d>CONTOUR_THRESHOLD){
             p2 = intersection;
             d2 = d;
+            if(side == 1)
+                d1 /= 2;
+            side = 1;
         }else{
             break;
         }
@@ -1287,7 +1307,7 @@ bool InsertSmoothCusp(MeshFace * face, Mesh * mesh,const vec3 & cameraCenter, bo
                     if(!cuspParam.IsNull() && cuspParam.IsEvaluable()){
                         real r;
                         bool success = cuspParam.RadialCurvature(cameraCenter,r);
-                        if(Facing(cuspParam,cameraCenter,CONTOUR_THRESHOLD)!=CONTOUR || !success || fabsl(r)>0.01)
+                        if(Facing(cuspParam,cameraCenter,CONTOUR_THRESHOLD)!=CONTOUR || !success || std::fabs(r)>0.01)
                             return false;
 
                         MeshVertex* cPts[2]  = {NULL, NULL};
@@ -1530,7 +1550,7 @@ bool InsertSmoothCuspFirst(MeshFace* face, Mesh* mesh, const vec3 & cameraCenter
     if(!cuspParam.IsNull()){
         real r;
         bool success = cuspParam.RadialCurvature(cameraCenter,r);
-        if(Facing(cuspParam,cameraCenter,CONTOUR_THRESHOLD)!=CONTOUR || !success || fabsl(r)>0.01){
+        if(Facing(cuspParam,cameraCenter,CONTOUR_THRESHOLD)!=CONTOUR || !success || std::fabs(r)>0.01){
             printf("\nSPURIOUS CUSP\n");
 #if LINK_FREESTYLE
             char str[200];
@@ -1566,7 +1586,7 @@ bool InsertSmoothCuspFirst(MeshFace* face, Mesh* mesh, const vec3 & cameraCenter
             pts.push_back(v0->GetData().sourceLoc);
             pts.push_back(v1->GetData().sourceLoc);
             std::vector<vec2> abs;
-            ChartCC * chart = ParamPointCC::FindChart(pts,abs);
+            const ChartCC * chart = ParamPointCC::FindChart(pts,abs);
             if(chart == NULL){
                 printf("CHART NOT FOUND\n");
                 return false;
@@ -1678,6 +1698,23 @@ bool CheckZeroCrossingBySampling(MeshVertex* v0, MeshVertex* v1, int v2Idx,
     return false;
 }
 
+// adds the operation counts of RefineContourRadial to the profile when it returns, after any step
+struct RadialProfileCounts
+{
+    const unsigned int & cusps;
+    const int & zeroCrossings, & radialEdges, & flips, & splits, & extensions;
+
+    ~RadialProfileCounts()
+    {
+        ProfileCount(PC_CUSPS, cusps);
+        ProfileCount(PC_ZERO_CROSSINGS, zeroCrossings);
+        ProfileCount(PC_RADIAL_EDGES, radialEdges);
+        ProfileCount(PC_FLIPS, flips);
+        ProfileCount(PC_SPLITS, splits);
+        ProfileCount(PC_EXTENSIONS, extensions);
+    }
+};
+
 void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
                          const bool allowShifts,
                          const RefineRadialStep lastStep)
@@ -1705,20 +1742,27 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
     int numFlips = 0;
     int numSplits = 0;
     int numExtend = 0;
+    RadialProfileCounts counts = { numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend };
 
     //---------------- MAIN LOOP: iterate over the faces until everything is consistent --------
 
     printf("Refining contour\n");
 
+    // time of each step, up to lastStep
+    ProfileTimer timer(PS_RADIAL_PREPROCESS);
+
 #if 1
     // Check zero-crossing by sampling
     while (wiggleQueue.Size() != 0) {
-        fflush(stdout);
         MeshFace * face = wiggleQueue.PopFront();
 
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
         for(int i=0; i<3; i++){
             MeshVertex* v0 = face->GetVertex(i);
             MeshVertex* v1 = face->GetVertex((i+1)%3);
@@ -1741,6 +1785,7 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == PREPROCESS)
         return;
+    timer.Next(PS_RADIAL_DETECT_CUSP);
 
 #if 1
     // If insert==true: insert cusps before contour points
@@ -1749,12 +1794,15 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
     std::set<std::pair<MeshVertex*,MeshVertex*> > cuspEdges;
 
     while (wiggleQueue.Size() != 0) {
-        fflush(stdout);
         MeshFace * face = wiggleQueue.PopFront();
 
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
         if(InsertSmoothCuspFirst(face,mesh,cameraCenter, allowShifts, wiggleQueue, splitQueue,false,cuspEdges))
             numCUSPs++;
     }
@@ -1771,16 +1819,20 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == DETECT_CUSP)
         return;
+    timer.Next(PS_RADIAL_INSERT_CONTOUR);
 
 #if 1
     // Insert contour points
     while (wiggleQueue.Size() != 0)
     {
-        fflush(stdout);
         MeshFace * face = wiggleQueue.PopFront();
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
 
         if (SplitZeroCrossingFace(face, mesh, cameraCenter, localAllowShifts, wiggleQueue, splitQueue, badEdges, cuspEdges)){
             numZCs++;
@@ -1826,11 +1878,14 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
     // Insert contour points
     while (wiggleQueue.Size() != 0)
     {
-        fflush(stdout);
         MeshFace * face = wiggleQueue.PopFront();
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
 
         if (SplitZeroCrossingFace(face, mesh, cameraCenter, localAllowShifts, wiggleQueue, splitQueue, badEdges, cuspEdges)){
             numZCs++;
@@ -1840,12 +1895,12 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == INSERT_CONTOUR)
         return;
+    timer.Next(PS_RADIAL_INSERT_CUSP);
 
 #if 1
     badEdges.clear();
     // Effectively insert cusps
     for(std::set<std::pair<MeshVertex*,MeshVertex*> >::iterator it=cuspEdges.begin(); it!=cuspEdges.end(); it++){
-        fflush(stdout);
         MeshEdge * edge = (*it).first->GetEdge((*it).second) ? (*it).first->GetEdge((*it).second) : (*it).second->GetEdge((*it).first);
         if(!edge || (*it).first->GetData().facing == (*it).second->GetData().facing){
             continue;
@@ -1860,9 +1915,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
                 break;
             }
         }
-        printf("queue size: %d+%d / %d. CUSPS: %d. ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d. ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
 
         std::pair<MeshVertex*,MeshVertex*> badEdge;
         SplitZeroCrossingEdge(face, oppIdx, mesh, cameraCenter, false, wiggleQueue, splitQueue, badEdge, cuspEdges, true);
@@ -1885,6 +1944,7 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == INSERT_CUSP)
         return;
+    timer.Next(PS_RADIAL_INSERT_RADIAL);
 
     std::set<MeshVertex*> contourPoints;
 
@@ -1914,10 +1974,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
     // Insert radial edges
     while (wiggleQueue.Size() != 0)
     {
-        fflush(stdout);
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
 
         MeshFace * face = wiggleQueue.PopFront();
 
@@ -1930,6 +1993,7 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == INSERT_RADIAL)
         return;
+    timer.Next(PS_RADIAL_FLIP_RADIAL);
 
 #if 1
     faces.resize(0);
@@ -1946,10 +2010,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
             MeshFace * face = wiggleQueue.PopFront();
             for(int i=0; i<3; i++)
                 if(face->GetVertex(i)->GetData().facing==CONTOUR){
-                    fflush(stdout);
-                    printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-                           wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-                           numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+                    if (StatusLineDue())
+                    {
+                        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+                        fflush(stdout);
+                    }
                     bool ir = ImproveRadialConsistency(face->GetVertex(i),mesh,numFlips,wiggleQueue);
                     allRadial = ir && allRadial;
                     break;
@@ -1966,6 +2033,7 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == FLIP_RADIAL)
         return;
+    timer.Next(PS_RADIAL_EXTEND_RADIAL);
 
 #if 1
     // Extend radial edges to decrease the number of inconsistent triangles
@@ -1976,10 +2044,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
         if(IsConsistent<VertexDataCatmark>(face,cameraCenter))
             continue;
 
-        fflush(stdout);
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
 
         if(ExtendRadialEdge(face,mesh,cameraCenter,wiggleQueue,splitQueue)){
             numExtend++;
@@ -1989,6 +2060,7 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == EXTEND_RADIAL)
         return;
+    timer.Next(PS_RADIAL_FLIP_EDGE);
 
 #if 1
     // Try to improve consistency by fliping edges of inconsistent triangles
@@ -2004,10 +2076,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
         if(IsConsistent<VertexDataCatmark>(face,cameraCenter))
             continue;
 
-        fflush(stdout);
-        printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-               wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-               numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+        if (StatusLineDue())
+        {
+            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            fflush(stdout);
+        }
 
         if (FlipFace(face, mesh, cameraCenter, wiggleQueue, splitQueue))
         {
@@ -2019,11 +2094,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == FLIP_EDGE)
         return;
+    timer.Next(PS_RADIAL_WIGGLING_PARAM);
 
     WiggleInParamSpace(mesh,cameraCenter);
 
     if(lastStep == WIGGLING_PARAM)
         return;
+    timer.Next(PS_RADIAL_SPLIT_EDGE);
 
     for(int i=0; i<3; i++){
 
@@ -2045,10 +2122,13 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
             if(IsConsistent<VertexDataCatmark>(face,cameraCenter))
                 continue;
 
-            fflush(stdout);
-            printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
-                   wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
-                   numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+            if (StatusLineDue())
+            {
+                printf("queue size: %d+%d / %d. CUSPS: %d.  ZC: %d. radial: %d.  flips: %d. splits: %d. extend: %d   \r",
+                       wiggleQueue.Size(), splitQueue.Size(), mesh->GetNumFaces(),
+                       numCUSPs, numZCs, numREs, numFlips, numSplits, numExtend);
+                fflush(stdout);
+            }
 
             if (FindBestSplitPointFace(face, localAllowShifts, cameraCenter, mesh, badEdges, wiggleQueue, splitQueue))
             {
@@ -2065,6 +2145,7 @@ void RefineContourRadial(Mesh * mesh, const vec3 & cameraCenter,
 
     if(lastStep == SPLIT_EDGE)
         return;
+    timer.Next(PS_RADIAL_FINISH);
 
     WiggleAllVertices(mesh, cameraCenter);
 